@@ -0,0 +1,56 @@
+/**
+ * @file Backoff.h
+ * @brief Defines the Backoff helper used by threads that wait on lock-free queues.
+ *
+ * A thread that polls a lock-free structure should react within nanoseconds when work is
+ * arriving continuously, but must not burn a whole core while the system is idle. Backoff
+ * escalates from a CPU pause instruction, to yielding the time slice, to a short sleep.
+ */
+
+#pragma once
+
+#include <chrono> // For std::chrono::microseconds
+#include <thread> // For std::this_thread
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#include <immintrin.h> // For _mm_pause
+#endif
+
+/** @brief Tells the CPU that we are in a spin-wait loop (saves power and helps the sibling hyper-thread). */
+inline void cpuRelax() {
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+/**
+ * @class Backoff
+ * @brief An escalating wait strategy: spin, then yield, then sleep.
+ */
+class Backoff {
+public:
+    static constexpr unsigned kSpinLimit = 64;   // Pause this many times first...
+    static constexpr unsigned kYieldLimit = 128; // ...then yield until this many attempts...
+    static constexpr auto kSleep = std::chrono::microseconds(50); // ...then sleep between attempts.
+
+    /** @brief Waits a little, a bit longer each time it is called since the last reset(). */
+    void pause() {
+        if (this->attempts_ < kSpinLimit) {
+            cpuRelax();
+        } else if (this->attempts_ < kYieldLimit) {
+            std::this_thread::yield();
+        } else {
+            std::this_thread::sleep_for(kSleep);
+            return; // Stay at the sleeping stage until reset.
+        }
+        ++this->attempts_;
+    }
+
+    /** @brief Call after useful work was found, so the next wait starts with spinning again. */
+    void reset() { this->attempts_ = 0; }
+
+private:
+    unsigned attempts_ = 0;
+};
@@ -0,0 +1,486 @@
+/**
+ * @file Benchmark.cpp
+ * @brief Throughput and latency benchmark of the matching core, without the HTTP server in the way.
+ *
+ * A workload (synthetic, or loaded from a recorded order file) is generated up front from a
+ * seed, so every run of the same options feeds exactly the same orders, cancels and modifies.
+ * It is then driven directly into OrderBook::processOrder ("book" mode) and through the
+ * MatchingEngine's shards ("engine" mode), recording every operation's latency in a histogram.
+ *
+ * With --rate, operations arrive as a Poisson process and each latency is measured from the
+ * operation's scheduled arrival, so time spent queued behind a slow operation is counted
+ * instead of silently omitted. Without it, operations are issued back to back and the
+ * latency is pure service time.
+ *
+ * Each run also prints a digest of the trades it produced. Matching is deterministic, so the
+ * digest must not change unless a change was meant to alter matching results; the two modes
+ * must agree with each other, and the benchmark fails if they do not.
+ */
+
+#include <algorithm>   // For std::min
+#include <chrono>
+#include <cstdint>
+#include <cstdio>      // For std::printf
+#include <fstream>     // For the recorded order files
+#include <iostream>
+#include <memory>      // For std::unique_ptr
+#include <optional>
+#include <random>
+#include <sstream>     // For parsing the recorded order files
+#include <stdexcept>   // For std::invalid_argument, std::runtime_error
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "Histogram.h"
+#include "MatchingEngine.h"
+#include "OrderBook.h"
+
+// --- Workload ---
+
+/**
+ * @struct Operation
+ * @brief One step of a workload. Cancels and modifies refer to the order created by an earlier step.
+ */
+struct Operation {
+    enum class Kind : std::uint8_t { New, Cancel, Modify };
+
+    Kind kind = Kind::New;
+    std::uint32_t symbol = 0;       // Index into Workload::symbols.
+    OrderType type = OrderType::Limit;
+    Side side = Side::Buy;
+    Price price = 0;                // In ticks; the new price of a Modify.
+    Quantity quantity = 0;          // In lots; the new quantity of a Modify.
+    std::uint32_t target = 0;       // Cancel/Modify: the index of the New operation whose order is targeted.
+};
+
+struct Workload {
+    std::vector<std::string> symbols;
+    std::vector<Operation> operations;
+};
+
+/**
+ * @struct BenchmarkOptions
+ * @brief The configuration of a benchmark run, taken from the command line.
+ */
+struct BenchmarkOptions {
+    std::string mode = "both";     // --mode book|engine|both
+    std::size_t orders = 1000000;  // --orders N: the number of operations to generate.
+    std::size_t symbols = 1;       // --symbols K: orders are spread evenly over K symbols.
+    std::size_t shards = 1;        // --shards N: the engine's matching threads (engine mode).
+    double rate = 0;               // --rate R: Poisson arrivals at R operations per second (0: back to back).
+    double cancel_ratio = 0.25;    // --cancel-ratio: the share of operations that cancel a resting order.
+    double modify_ratio = 0.05;    // --modify-ratio: the share of operations that modify one.
+    // --mix limit=W,market=W,ioc=W,fok=W: the relative weights of the new order types.
+    double mix[4] = {5, 70, 20, 5}; // Indexed by OrderType: market, limit, ioc, fok.
+    int depth = 50;                // --depth L: passive orders rest within L ticks of the mid price.
+    Quantity sweep = 10;           // --sweep Q: market, IOC and FOK orders take 1 to Q lots (limit orders 1 to 10).
+    std::string profile = "exponential"; // --profile uniform|exponential: how they are spread over those ticks.
+    std::uint64_t seed = 1;        // --seed S
+    std::string record;            // --record FILE: save the generated workload.
+    std::string replay;            // --replay FILE: run a recorded workload instead of generating one.
+};
+
+/** @brief Generates a synthetic workload: limit orders around a slowly drifting mid, plus aggressive orders, cancels and modifies. */
+Workload GenerateWorkload(const BenchmarkOptions& options) {
+    constexpr Price kInitialMid = 1000000;
+
+    Workload workload;
+    for (std::size_t i = 0; i < options.symbols; ++i) {
+        workload.symbols.push_back("SYM" + std::to_string(i));
+    }
+    std::vector<Price> mids(options.symbols, kInitialMid);
+    std::vector<std::uint32_t> limits; // The New operations that placed limit orders, most recent last.
+
+    std::mt19937_64 rng(options.seed);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::discrete_distribution<int> type_of(std::begin(options.mix), std::end(options.mix));
+    std::exponential_distribution<double> distance(4.0 / options.depth);
+    auto pick_recent_limit = [&] {
+        const std::size_t window = std::min<std::size_t>(limits.size(), 4096);
+        return limits[limits.size() - 1 - rng() % window];
+    };
+
+    workload.operations.reserve(options.orders);
+    for (std::size_t i = 0; i < options.orders; ++i) {
+        Operation op;
+        const double u = unit(rng);
+        if (u < options.cancel_ratio && !limits.empty()) {
+            op.kind = Operation::Kind::Cancel;
+            op.target = pick_recent_limit();
+            op.symbol = workload.operations[op.target].symbol;
+        } else if (u < options.cancel_ratio + options.modify_ratio && !limits.empty()) {
+            op.kind = Operation::Kind::Modify;
+            op.target = pick_recent_limit();
+            const Operation& target = workload.operations[op.target];
+            op.symbol = target.symbol;
+            // Half of the modifies keep the price (an in-place amend), the others step one tick back.
+            op.price = target.price + ((rng() & 1) ? 0 : (target.side == Side::Buy ? -1 : 1));
+            op.quantity = 1 + static_cast<Quantity>(rng() % 10);
+        } else {
+            op.kind = Operation::Kind::New;
+            op.symbol = static_cast<std::uint32_t>(rng() % options.symbols);
+            op.type = static_cast<OrderType>(type_of(rng));
+            op.side = (rng() & 1) ? Side::Buy : Side::Sell;
+            op.quantity = 1 + static_cast<Quantity>(rng() % (op.type == OrderType::Limit ? 10 : options.sweep));
+            Price& mid = mids[op.symbol];
+            if (rng() % 100 == 0) {
+                mid += (rng() & 1) ? 1 : -1;
+            }
+            const Price towards_book = (op.side == Side::Buy) ? 1 : -1;
+            if (op.type == OrderType::Limit) {
+                Price ticks = (options.profile == "uniform") ? static_cast<Price>(rng() % options.depth)
+                                                            : std::min<Price>(static_cast<Price>(distance(rng)), options.depth - 1);
+                // A few limit orders cross the spread and trade before resting.
+                if (rng() % 20 == 0) {
+                    ticks = -1 - static_cast<Price>(rng() % 3);
+                }
+                op.price = mid - towards_book * (1 + ticks);
+            } else if (op.type != OrderType::Market) {
+                op.price = mid + towards_book * static_cast<Price>(rng() % 5);
+            }
+            if (op.type == OrderType::Limit) {
+                limits.push_back(static_cast<std::uint32_t>(i));
+            }
+        }
+        workload.operations.push_back(op);
+    }
+    return workload;
+}
+
+const char* const kTypeNames[] = {"market", "limit", "ioc", "fok"};
+
+/**
+ * @brief Saves a workload as a recorded order file. One operation per line:
+ *     N <symbol> <buy|sell> <market|limit|ioc|fok> <price ticks> <quantity lots>
+ *     C <line of the N to cancel>
+ *     M <line of the N to modify> <price ticks> <quantity lots>
+ * where lines are numbered from 0, not counting blank lines and # comments.
+ */
+void SaveWorkload(const Workload& workload, const std::string& path) {
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Could not create '" + path + "'.");
+    }
+    out << "# Recorded order workload; see Benchmark.cpp for the format.\n";
+    for (const Operation& op : workload.operations) {
+        switch (op.kind) {
+            case Operation::Kind::New:
+                out << "N " << workload.symbols[op.symbol] << ' ' << (op.side == Side::Buy ? "buy" : "sell") << ' '
+                    << kTypeNames[static_cast<int>(op.type)] << ' ' << op.price << ' ' << op.quantity << '\n';
+                break;
+            case Operation::Kind::Cancel:
+                out << "C " << op.target << '\n';
+                break;
+            case Operation::Kind::Modify:
+                out << "M " << op.target << ' ' << op.price << ' ' << op.quantity << '\n';
+                break;
+        }
+    }
+}
+
+/** @brief Loads a recorded order file (see SaveWorkload). */
+Workload LoadWorkload(const std::string& path) {
+    std::ifstream in(path);
+    if (!in) {
+        throw std::runtime_error("Could not open '" + path + "'.");
+    }
+    Workload workload;
+    std::unordered_map<std::string, std::uint32_t> symbol_index;
+    std::string line;
+    for (std::size_t line_number = 1; std::getline(in, line); ++line_number) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        std::istringstream fields(line);
+        std::string kind;
+        fields >> kind;
+        Operation op;
+        bool ok = false;
+        if (kind == "N") {
+            std::string symbol, side, type;
+            ok = static_cast<bool>(fields >> symbol >> side >> type >> op.price >> op.quantity) &&
+                 (side == "buy" || side == "sell");
+            op.side = (side == "buy") ? Side::Buy : Side::Sell;
+            int type_index = 0;
+            while (type_index < 4 && type != kTypeNames[type_index]) {
+                ++type_index;
+            }
+            ok = ok && type_index < 4;
+            op.type = static_cast<OrderType>(type_index);
+            auto [it, inserted] = symbol_index.try_emplace(symbol, static_cast<std::uint32_t>(workload.symbols.size()));
+            if (inserted) {
+                workload.symbols.push_back(symbol);
+            }
+            op.symbol = it->second;
+        } else if (kind == "C" || kind == "M") {
+            op.kind = (kind == "C") ? Operation::Kind::Cancel : Operation::Kind::Modify;
+            ok = static_cast<bool>(fields >> op.target) && (op.kind == Operation::Kind::Cancel ||
+                                                            static_cast<bool>(fields >> op.price >> op.quantity));
+            ok = ok && op.target < workload.operations.size() &&
+                 workload.operations[op.target].kind == Operation::Kind::New;
+            if (ok) {
+                op.symbol = workload.operations[op.target].symbol;
+            }
+        }
+        if (!ok) {
+            throw std::runtime_error("'" + path + "' line " + std::to_string(line_number) + ": invalid operation.");
+        }
+        workload.operations.push_back(op);
+    }
+    return workload;
+}
+
+// --- Measurement ---
+
+/**
+ * @struct RunResult
+ * @brief What one benchmark run measured.
+ */
+struct RunResult {
+    Histogram latency; // Nanoseconds per operation.
+    double seconds = 0;
+    std::uint64_t trades = 0;
+    std::uint64_t digest = 14695981039346656037ull; // FNV-1a over every trade's symbol, price, quantity and side.
+
+    void addTrades(const std::vector<Trade>& executed) {
+        for (const Trade& trade : executed) {
+            for (std::uint64_t field : {std::uint64_t{trade.symbolId}, static_cast<std::uint64_t>(trade.price),
+                                        static_cast<std::uint64_t>(trade.quantity),
+                                        std::uint64_t{trade.aggressorSide == Side::Buy}}) {
+                this->digest = (this->digest ^ field) * 1099511628211ull;
+            }
+        }
+        this->trades += executed.size();
+    }
+};
+
+/**
+ * @brief Runs every operation of a workload through `apply(index, op)` and measures it.
+ * @param rate The Poisson arrival rate in operations per second, or 0 to issue them back to back.
+ */
+template <typename Apply>
+void RunTimed(const Workload& workload, double rate, std::uint64_t seed, RunResult& result, Apply&& apply) {
+    using Clock = std::chrono::steady_clock;
+    std::mt19937_64 rng(seed);
+    std::exponential_distribution<double> gap_ns(rate > 0 ? rate / 1e9 : 1.0);
+    double arrival_ns = 0;
+
+    const Clock::time_point start = Clock::now();
+    for (std::size_t i = 0; i < workload.operations.size(); ++i) {
+        Clock::time_point issued;
+        if (rate > 0) {
+            arrival_ns += gap_ns(rng);
+            issued = start + std::chrono::nanoseconds(static_cast<std::int64_t>(arrival_ns));
+            while (Clock::now() < issued) {
+                // Spin: sleeping would add far more jitter than the latencies being measured.
+            }
+        } else {
+            issued = Clock::now();
+        }
+        apply(i, workload.operations[i]);
+        result.latency.record(static_cast<std::uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - issued).count()));
+    }
+    result.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+/** @brief Drives the workload straight into OrderBook objects on the calling thread. */
+RunResult RunBook(const Workload& workload, const BenchmarkOptions& options) {
+    OrderIndex index;
+    OrderOwners owners;
+    std::vector<std::unique_ptr<OrderBook>> books;
+    for (std::size_t i = 0; i < workload.symbols.size(); ++i) {
+        books.push_back(std::make_unique<OrderBook>(static_cast<SymbolId>(i), index, owners));
+    }
+    std::vector<OrderId> ids(workload.operations.size(), 0);
+    std::vector<Trade> trades;
+    OrderId next_id = 1;
+
+    RunResult result;
+    RunTimed(workload, options.rate, options.seed, result, [&](std::size_t i, const Operation& op) {
+        trades.clear();
+        OrderBook& book = *books[op.symbol];
+        switch (op.kind) {
+            case Operation::Kind::New: {
+                Order order(next_id++, op.type, op.side, op.quantity, op.symbol, op.price);
+                ids[i] = order.getOrderID();
+                book.processOrder(order, trades);
+                break;
+            }
+            case Operation::Kind::Cancel:
+                book.cancelOrder(ids[op.target]);
+                break;
+            case Operation::Kind::Modify:
+                book.modifyOrder(ids[op.target], op.price, op.quantity, trades);
+                break;
+        }
+        result.addTrades(trades);
+    });
+    return result;
+}
+
+/** @brief Drives the workload through a MatchingEngine, one operation in flight at a time. */
+RunResult RunEngine(const Workload& workload, const BenchmarkOptions& options) {
+    MatchingEngine engine(options.shards);
+    std::vector<SymbolId> symbols;
+    for (const std::string& name : workload.symbols) {
+        symbols.push_back(engine.configureSymbol(name));
+    }
+    engine.freezeSymbols();
+    std::vector<OrderId> ids(workload.operations.size(), 0);
+    std::vector<Trade> trades;
+    CommandReply reply;
+    reply.trades = &trades;
+
+    RunResult result;
+    RunTimed(workload, options.rate, options.seed, result, [&](std::size_t i, const Operation& op) {
+        Command command;
+        switch (op.kind) {
+            case Operation::Kind::New:
+                command.type = CommandType::NewOrder;
+                command.orderType = op.type;
+                command.side = op.side;
+                command.symbol = symbols[op.symbol];
+                command.price = op.price;
+                command.quantity = op.quantity;
+                break;
+            case Operation::Kind::Cancel:
+                command.type = CommandType::Cancel;
+                command.orderId = ids[op.target];
+                break;
+            case Operation::Kind::Modify:
+                command.type = CommandType::Modify;
+                command.orderId = ids[op.target];
+                command.newPriceTicks = op.price;
+                command.newQuantityLots = op.quantity;
+                break;
+        }
+        command.reply = &reply;
+        engine.submit(std::move(command));
+        reply.wait();
+        if (op.kind == Operation::Kind::New) {
+            ids[i] = reply.orderId;
+        }
+        result.addTrades(trades);
+        reply.reset();
+    });
+    return result;
+}
+
+void PrintResult(const char* mode, const RunResult& result) {
+    const Histogram& h = result.latency;
+    std::printf("%-6s %10llu ops in %7.3f s = %11.0f ops/s | latency ns: p50 %llu  p99 %llu  p99.9 %llu  max %llu"
+                "  mean %.0f | trades %llu  digest %016llx\n",
+                mode, static_cast<unsigned long long>(h.count()), result.seconds,
+                static_cast<double>(h.count()) / result.seconds,
+                static_cast<unsigned long long>(h.percentile(50)), static_cast<unsigned long long>(h.percentile(99)),
+                static_cast<unsigned long long>(h.percentile(99.9)), static_cast<unsigned long long>(h.max()),
+                h.mean(), static_cast<unsigned long long>(result.trades), static_cast<unsigned long long>(result.digest));
+}
+
+// --- Command-Line Options ---
+
+/**
+ * @brief Parses the command-line arguments into BenchmarkOptions.
+ * @throws std::invalid_argument on an unknown flag or a missing/invalid value.
+ */
+BenchmarkOptions ParseOptions(int argc, char* argv[]) {
+    BenchmarkOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for option '" + flag + "'.");
+        }
+        std::string value = argv[++i];
+        if (flag == "--mode") {
+            options.mode = value;
+        } else if (flag == "--orders") {
+            options.orders = std::stoul(value);
+        } else if (flag == "--symbols") {
+            options.symbols = std::stoul(value);
+        } else if (flag == "--shards") {
+            options.shards = std::stoul(value);
+        } else if (flag == "--rate") {
+            options.rate = std::stod(value);
+        } else if (flag == "--cancel-ratio") {
+            options.cancel_ratio = std::stod(value);
+        } else if (flag == "--modify-ratio") {
+            options.modify_ratio = std::stod(value);
+        } else if (flag == "--mix") {
+            std::istringstream entries(value);
+            std::string entry;
+            for (double& weight : options.mix) {
+                weight = 0;
+            }
+            while (std::getline(entries, entry, ',')) {
+                const std::size_t eq = entry.find('=');
+                int type_index = 0;
+                while (type_index < 4 && entry.compare(0, eq, kTypeNames[type_index]) != 0) {
+                    ++type_index;
+                }
+                if (eq == std::string::npos || type_index == 4) {
+                    throw std::invalid_argument("Invalid --mix entry '" + entry + "'.");
+                }
+                options.mix[type_index] = std::stod(entry.substr(eq + 1));
+            }
+        } else if (flag == "--depth") {
+            options.depth = std::stoi(value);
+        } else if (flag == "--sweep") {
+            options.sweep = std::stoll(value);
+        } else if (flag == "--profile") {
+            options.profile = value;
+        } else if (flag == "--seed") {
+            options.seed = std::stoull(value);
+        } else if (flag == "--record") {
+            options.record = value;
+        } else if (flag == "--replay") {
+            options.replay = value;
+        } else {
+            throw std::invalid_argument("Unknown option '" + flag + "'.");
+        }
+    }
+    if (options.mode != "book" && options.mode != "engine" && options.mode != "both") {
+        throw std::invalid_argument("--mode must be book, engine or both.");
+    }
+    if (options.profile != "uniform" && options.profile != "exponential") {
+        throw std::invalid_argument("--profile must be uniform or exponential.");
+    }
+    if (options.symbols == 0 || options.depth <= 0 || options.sweep <= 0 || options.cancel_ratio < 0 || options.modify_ratio < 0 ||
+        options.cancel_ratio + options.modify_ratio >= 1 || options.rate < 0) {
+        throw std::invalid_argument("--symbols, --depth and --sweep must be positive, the ratios must add up to less than 1.");
+    }
+    return options;
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        const BenchmarkOptions options = ParseOptions(argc, argv);
+        const Workload workload = options.replay.empty() ? GenerateWorkload(options) : LoadWorkload(options.replay);
+        if (!options.record.empty()) {
+            SaveWorkload(workload, options.record);
+        }
+
+        std::optional<RunResult> book, engine;
+        if (options.mode != "engine") {
+            book = RunBook(workload, options);
+            PrintResult("book", *book);
+        }
+        if (options.mode != "book") {
+            engine = RunEngine(workload, options);
+            PrintResult("engine", *engine);
+        }
+        if (book && engine && (book->trades != engine->trades || book->digest != engine->digest)) {
+            std::cerr << "Error: the engine's trades differ from the book's." << std::endl;
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: engine_bench [--mode book|engine|both] [--orders N] [--symbols K] [--shards N] [--rate OPS_PER_SEC]\n"
+                     "                    [--cancel-ratio R] [--modify-ratio R] [--mix limit=W,market=W,ioc=W,fok=W]\n"
+                     "                    [--depth TICKS] [--profile uniform|exponential] [--seed S]\n"
+                     "                    [--record FILE] [--replay FILE]" << std::endl;
+        return 1;
+    }
+    return 0;
+}
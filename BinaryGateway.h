@@ -0,0 +1,400 @@
+/**
+ * @file BinaryGateway.h
+ * @brief Defines the BinaryGateway, a TCP order-entry server speaking the protocol in BinaryProtocol.h.
+ *
+ * The JSON endpoint pays for an HTTP request, a JSON parse and two pretty-printed dumps per
+ * order. Algorithmic clients instead keep one TCP session open and stream fixed-layout
+ * binary frames over it. Each session has its own thread, which decodes every complete
+ * frame it has received, hands the whole batch to the owning shards at once (so orders for
+ * different shards are matched in parallel), then waits for the replies and answers the
+ * batch with one write of acks and fills.
+ *
+ * Every session gets its own SessionId, which tags the orders it submits. A MassCancel can then
+ * cancel the session's orders, and with cancel-on-disconnect the gateway does so as soon as the
+ * session's connection drops, so a market maker that loses its link does not leave stale quotes.
+ */
+
+#pragma once
+
+#include <algorithm> // For std::max
+#include <atomic>
+#include <cstddef>   // For std::size_t
+#include <cstdint>
+#include <cstring>   // For std::memmove
+#include <memory>    // For std::unique_ptr
+#include <mutex>
+#include <optional>  // For the symbol of a mass cancel
+#include <stdexcept> // For std::runtime_error
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>   // For htons, htonl
+#include <netinet/in.h>  // For sockaddr_in
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <sys/socket.h>
+#include <unistd.h>      // For close
+#endif
+
+#include "BinaryProtocol.h"
+#include "MatchingEngine.h"
+
+/**
+ * @class BinaryGateway
+ * @brief Accepts binary order-entry sessions and runs each on its own thread.
+ */
+class BinaryGateway {
+public:
+    // The most requests a session has in flight at once. Larger bursts are processed in chunks of this size.
+    static constexpr std::size_t kMaxBatch = 256;
+
+    /**
+     * @brief Creates a gateway; call start() to begin accepting sessions.
+     * @param engine The engine to submit orders to. Must outlive the gateway.
+     * @param port The TCP port to listen on.
+     * @param cancelOnDisconnect Whether to cancel every order of a session when it disconnects.
+     */
+    BinaryGateway(MatchingEngine& engine, std::uint16_t port, bool cancelOnDisconnect = false)
+        : engine_(engine), port_(port), cancel_on_disconnect_(cancelOnDisconnect) {}
+
+    BinaryGateway(const BinaryGateway&) = delete;
+    BinaryGateway& operator=(const BinaryGateway&) = delete;
+
+    ~BinaryGateway() { stop(); }
+
+    /**
+     * @brief Binds the port and starts accepting sessions on a background thread.
+     * @throws std::runtime_error if the port cannot be bound.
+     */
+    void start() {
+        listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener_ == kInvalidSocket) {
+            throw std::runtime_error("Could not create the binary gateway socket.");
+        }
+        int reuse = 1;
+        ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port_);
+        if (::bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener_, SOMAXCONN) != 0) {
+            closeSocket(listener_);
+            listener_ = kInvalidSocket;
+            throw std::runtime_error("Could not listen on port " + std::to_string(port_) + " for the binary gateway.");
+        }
+
+        running_.store(true, std::memory_order_release);
+        acceptor_ = std::thread([this] { acceptLoop(); });
+    }
+
+    /** @brief Stops accepting, disconnects every session and waits for their threads to finish. */
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        shutdownSocket(listener_); // Wakes up the blocked accept().
+        closeSocket(listener_);
+        if (acceptor_.joinable()) {
+            acceptor_.join();
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& session : sessions_) {
+            shutdownSocket(session->socket); // Wakes up the session's blocked recv().
+        }
+        for (auto& session : sessions_) {
+            session->thread.join();
+            closeSocket(session->socket);
+        }
+        sessions_.clear();
+    }
+
+private:
+#if defined(_WIN32)
+    using Socket = SOCKET;
+    static constexpr Socket kInvalidSocket = INVALID_SOCKET;
+    static void closeSocket(Socket socket) { ::closesocket(socket); }
+    static void shutdownSocket(Socket socket) { ::shutdown(socket, SD_BOTH); }
+#else
+    using Socket = int;
+    static constexpr Socket kInvalidSocket = -1;
+    static void closeSocket(Socket socket) { ::close(socket); }
+    static void shutdownSocket(Socket socket) { ::shutdown(socket, SHUT_RDWR); }
+#endif
+
+    /** @brief One connected client. The socket is only closed once the thread has been joined. */
+    struct Session {
+        Socket socket = kInvalidSocket;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    /** @brief A request of the batch being processed, with the reply the shard fills in. */
+    struct Pending {
+        CommandReply reply;
+        std::vector<Trade> trades;
+        CommandType type = CommandType::NewOrder;
+        std::uint64_t clientTag = 0;
+        OrderId orderId = 0;       // The order a Cancel/Modify refers to.
+        bool rejected = false;     // Rejected by the gateway itself; never submitted.
+    };
+
+    MatchingEngine& engine_;
+    const std::uint16_t port_;
+    const bool cancel_on_disconnect_;
+    Socket listener_ = kInvalidSocket;
+    std::thread acceptor_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mtx_; // Guards sessions_.
+    std::vector<std::unique_ptr<Session>> sessions_;
+
+    void acceptLoop() {
+        while (running_.load(std::memory_order_acquire)) {
+            Socket client = ::accept(listener_, nullptr, nullptr);
+            if (client == kInvalidSocket) {
+                continue; // Either stop() closed the listener or the connection went away before we took it.
+            }
+            int nodelay = 1; // Acks must leave immediately, not wait to be coalesced.
+            ::setsockopt(client, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            reapFinishedSessions();
+            auto session = std::make_unique<Session>();
+            session->socket = client;
+            Session* raw = session.get();
+            session->thread = std::thread([this, raw] {
+                runSession(raw->socket);
+                raw->finished.store(true, std::memory_order_release);
+            });
+            sessions_.push_back(std::move(session));
+        }
+    }
+
+    /** @brief Joins and forgets the sessions whose clients have disconnected. Requires mtx_. */
+    void reapFinishedSessions() {
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            if ((*it)->finished.load(std::memory_order_acquire)) {
+                (*it)->thread.join();
+                closeSocket((*it)->socket);
+                it = sessions_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void runSession(Socket socket) {
+        const SessionId session = engine_.openSession();
+        LOG_INFO("Binary gateway session {} connected.", session);
+        std::vector<unsigned char> in(64 * 1024);
+        std::vector<unsigned char> out;
+        std::unique_ptr<Pending[]> pending(new Pending[kMaxBatch]);
+        for (std::size_t i = 0; i < kMaxBatch; ++i) {
+            pending[i].reply.trades = &pending[i].trades;
+        }
+
+        std::size_t filled = 0;
+        bool open = true;
+        while (open) {
+            const int received = ::recv(socket, reinterpret_cast<char*>(in.data() + filled),
+                                        static_cast<int>(in.size() - filled), 0);
+            if (received <= 0) {
+                break;
+            }
+            filled += static_cast<std::size_t>(received);
+            const std::uint64_t read_time = Tsc::now();
+
+            // Decode every complete frame, submitting them in batches of at most kMaxBatch.
+            std::size_t offset = 0;
+            std::size_t batch = 0;
+            while (filled - offset >= binary::kHeaderSize) {
+                const std::size_t length = binary::readU16(in.data() + offset);
+                if (length < binary::kHeaderSize) {
+                    open = false; // The stream can no longer be framed; drop the client.
+                    break;
+                }
+                if (filled - offset < length) {
+                    break;
+                }
+                decode(session, in.data() + offset, length, read_time, pending[batch++]);
+                offset += length;
+                if (batch == kMaxBatch) {
+                    open = respond(socket, pending.get(), batch, out) && open;
+                    batch = 0;
+                }
+            }
+            open = respond(socket, pending.get(), batch, out) && open;
+
+            // Keep the incomplete tail for the next read.
+            std::memmove(in.data(), in.data() + offset, filled - offset);
+            filled -= offset;
+        }
+        LOG_INFO("Binary gateway session {} disconnected.", session);
+        if (cancel_on_disconnect_) {
+            try {
+                const std::size_t cancelled = engine_.cancelSession(session).size();
+                LOG_INFO("Cancelled {} order(s) of disconnected session {}.", cancelled, session);
+            } catch (const std::exception& e) {
+                LOG_ERROR("Could not cancel the orders of disconnected session {}: {}", session, e.what());
+            }
+        }
+    }
+
+    /**
+     * @brief Validates one frame and submits the command it describes (or marks it rejected).
+     * @param received When the read that completed the frame returned (a Tsc timestamp).
+     */
+    void decode(SessionId session, const unsigned char* frame, std::size_t length, std::uint64_t received,
+                Pending& request) {
+        const auto type = static_cast<binary::MessageType>(frame[2]);
+        request.clientTag = (length >= 12) ? binary::readU64(frame + 4) : 0;
+        request.orderId = 0;
+        request.rejected = true;
+
+        Command command;
+        command.reply = &request.reply;
+        command.received = received;
+        command.options.session = session;
+        const bool withOptions = type == binary::MessageType::NewOrderWithOptions && length == binary::kNewOrderWithOptionsSize;
+        if ((type == binary::MessageType::NewOrder && length == binary::kNewOrderSize) || withOptions) {
+            const std::uint32_t symbol = binary::readU32(frame + 12);
+            const std::uint8_t side = frame[16];
+            const std::uint8_t orderType = frame[17];
+            const OrderType lastType = withOptions ? OrderType::StopLimit : OrderType::FOK;
+            command.type = CommandType::NewOrder;
+            command.symbol = symbol;
+            command.side = (side == 0) ? Side::Buy : Side::Sell;
+            command.orderType = static_cast<OrderType>(orderType);
+            command.price = binary::readI64(frame + 20);
+            command.quantity = binary::readI64(frame + 28);
+            request.rejected = symbol >= engine_.symbolCount() || side > 1 ||
+                               orderType > static_cast<std::uint8_t>(lastType);
+            if (withOptions) {
+                const std::uint8_t stp = frame[48];
+                command.options.stopPrice = binary::readI64(frame + 36);
+                command.options.account = binary::readU32(frame + 44);
+                command.options.selfTradePrevention = static_cast<SelfTradePrevention>(stp);
+                request.rejected = request.rejected || stp > static_cast<std::uint8_t>(SelfTradePrevention::CancelOldest);
+            }
+        } else if (type == binary::MessageType::Cancel && length == binary::kCancelSize) {
+            command.type = CommandType::Cancel;
+            command.orderId = request.orderId = binary::readU64(frame + 12);
+            request.rejected = false;
+        } else if (type == binary::MessageType::Modify && length == binary::kModifySize) {
+            const std::uint8_t flags = frame[36];
+            command.type = CommandType::Modify;
+            command.orderId = request.orderId = binary::readU64(frame + 12);
+            if (flags & binary::kModifyPrice) {
+                command.newPriceTicks = binary::readI64(frame + 20);
+            }
+            if (flags & binary::kModifyQuantity) {
+                command.newQuantityLots = binary::readI64(frame + 28);
+            }
+            request.rejected = false;
+        } else if (type == binary::MessageType::MassCancel && length == binary::kMassCancelSize) {
+            const std::uint32_t symbol = binary::readU32(frame + 12);
+            const AccountId account = binary::readU32(frame + 16);
+            request.type = CommandType::MassCancel;
+            if (symbol != binary::kAllSymbols && symbol >= engine_.symbolCount()) {
+                return;
+            }
+            // Cancelling on every symbol involves every shard, so it is not pipelined: it runs (after
+            // the requests submitted before it, which are ahead of it in the shards' queues) right here.
+            const std::optional<SymbolId> only = (symbol == binary::kAllSymbols) ? std::nullopt : std::optional<SymbolId>(symbol);
+            try {
+                request.reply.cancelled = (account != kNoAccount) ? engine_.massCancel(account, only)
+                                                                  : engine_.cancelSession(session, only);
+            } catch (const std::exception& e) {
+                request.reply.error = e.what();
+            }
+            request.reply.complete();
+            request.rejected = false;
+            return;
+        }
+
+        request.type = command.type;
+        if (!request.rejected) {
+            engine_.submit(std::move(command));
+        }
+    }
+
+    /**
+     * @brief Waits for the replies of a batch and sends its acks and fills in one write.
+     * With a journal, the write waits until the whole batch is durable (a single group commit).
+     * @return False if the client can no longer be written to.
+     */
+    bool respond(Socket socket, Pending* pending, std::size_t count, std::vector<unsigned char>& out) {
+        out.clear();
+        std::uint64_t journal_size = 0;
+        for (std::size_t i = 0; i < count; ++i) {
+            Pending& request = pending[i];
+            binary::AckStatus status = binary::AckStatus::Rejected;
+            OrderId orderId = request.orderId;
+            if (!request.rejected) {
+                request.reply.wait();
+                journal_size = std::max(journal_size, request.reply.journalSize);
+                status = ackStatus(request.type, request.reply);
+                if (request.type == CommandType::NewOrder) {
+                    orderId = request.reply.orderId;
+                } else if (request.type == CommandType::MassCancel) {
+                    orderId = request.reply.cancelled.size();
+                }
+            }
+
+            std::size_t at = out.size();
+            out.resize(at + binary::kAckSize + request.trades.size() * binary::kFillSize);
+            binary::encodeAck(out.data() + at, request.clientTag, orderId, status);
+            at += binary::kAckSize;
+            for (const Trade& trade : request.trades) {
+                binary::encodeFill(out.data() + at, trade);
+                at += binary::kFillSize;
+            }
+            request.reply.reset();
+        }
+        engine_.waitDurable(journal_size);
+        return sendAll(socket, out);
+    }
+
+    static binary::AckStatus ackStatus(CommandType type, const CommandReply& reply) {
+        if (!reply.error.empty()) {
+            return binary::AckStatus::Rejected;
+        }
+        switch (type) {
+            case CommandType::Cancel:
+                return reply.found ? binary::AckStatus::Accepted : binary::AckStatus::NotFound;
+            case CommandType::Modify:
+                switch (reply.modifyResult) {
+                    case ModifyResult::Amended:  return binary::AckStatus::Accepted;
+                    case ModifyResult::Replaced: return binary::AckStatus::Replaced;
+                    case ModifyResult::NotFound: return binary::AckStatus::NotFound;
+                }
+                return binary::AckStatus::NotFound;
+            default:
+                return binary::AckStatus::Accepted;
+        }
+    }
+
+    static bool sendAll(Socket socket, const std::vector<unsigned char>& data) {
+#if defined(MSG_NOSIGNAL)
+        constexpr int flags = MSG_NOSIGNAL; // A client that went away must not kill the server with SIGPIPE.
+#else
+        constexpr int flags = 0;
+#endif
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const int n = ::send(socket, reinterpret_cast<const char*>(data.data() + sent),
+                                 static_cast<int>(data.size() - sent), flags);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,161 @@
+/**
+ * @file BinaryProtocol.h
+ * @brief Defines the fixed-layout binary order-entry protocol spoken by the BinaryGateway.
+ *
+ * Every message is a fixed-size frame of little-endian fields, so there is nothing to
+ * parse: a field is read from a known offset. A frame starts with a 4-byte header:
+ *
+ *     offset 0  u16  length of the whole frame in bytes (header included)
+ *     offset 2  u8   message type (MessageType)
+ *     offset 3  u8   reserved, 0
+ *
+ * Prices are in ticks and quantities in lots of the symbol (see GET /symbols for the
+ * symbol IDs and their tick and lot sizes). A client may send any number of frames back
+ * to back without waiting; the gateway answers each request with exactly one Ack, in
+ * request order, followed by one Fill per trade the request caused.
+ */
+
+#pragma once
+
+#include <cstddef> // For std::size_t
+#include <cstdint> // For the fixed-width integer types
+
+#include "LittleEndian.h"
+#include "Order.h"
+#include "Trade.h"
+
+namespace binary {
+
+/**
+ * @enum MessageType
+ * @brief The type byte of a frame. Requests are below 0x80, responses at or above it.
+ */
+enum class MessageType : std::uint8_t {
+    NewOrder = 0x01,
+    Cancel = 0x02,
+    Modify = 0x03,
+    MassCancel = 0x04,
+    NewOrderWithOptions = 0x05,
+    Ack = 0x81,
+    Fill = 0x82
+};
+
+/**
+ * @enum AckStatus
+ * @brief The outcome of a request, as reported by its Ack.
+ */
+enum class AckStatus : std::uint8_t {
+    Accepted = 0, // NewOrder: the order was processed. Cancel: it was removed. Modify: priority kept. MassCancel: done.
+    Replaced = 1, // Modify: the order was re-queued and lost its time priority.
+    NotFound = 2, // Cancel/Modify: the order is not resting on any book.
+    Rejected = 3  // The request was invalid (unknown symbol, bad field, off the tick/lot grid, ...).
+};
+
+// --- Frame sizes ---
+
+constexpr std::size_t kHeaderSize = 4;
+
+/**
+ * NewOrder (36 bytes):
+ *     4  u64 client tag (echoed in the Ack)
+ *    12  u32 symbol ID
+ *    16  u8  side (0 = buy, 1 = sell)
+ *    17  u8  order type (0 = market, 1 = limit, 2 = ioc, 3 = fok)
+ *    18  u16 reserved, 0
+ *    20  i64 price in ticks (ignored for market orders)
+ *    28  i64 quantity in lots
+ */
+constexpr std::size_t kNewOrderSize = 36;
+
+/**
+ * NewOrderWithOptions (56 bytes), a NewOrder that may also be a stop order and carry an account:
+ *     4  ...  the fields of a NewOrder, with order types 4 = stop market and 5 = stop limit allowed
+ *    36  i64 stop price in ticks (only for stop orders)
+ *    44  u32 account, or 0 for none
+ *    48  u8  self-trade prevention (0 = none, 1 = cancel newest, 2 = cancel oldest; needs an account)
+ *    49  u8[7] reserved, 0
+ */
+constexpr std::size_t kNewOrderWithOptionsSize = 56;
+
+/**
+ * Cancel (20 bytes):
+ *     4  u64 client tag
+ *    12  u64 order ID
+ */
+constexpr std::size_t kCancelSize = 20;
+
+/**
+ * Modify (40 bytes):
+ *     4  u64 client tag
+ *    12  u64 order ID
+ *    20  i64 new price in ticks (only if flags bit 0 is set)
+ *    28  i64 new remaining quantity in lots (only if flags bit 1 is set)
+ *    36  u8  flags
+ *    37  u8[3] reserved, 0
+ */
+constexpr std::size_t kModifySize = 40;
+constexpr std::uint8_t kModifyPrice = 0x01;
+constexpr std::uint8_t kModifyQuantity = 0x02;
+
+/**
+ * MassCancel (24 bytes), answered by an Ack whose order ID field is the number of orders cancelled:
+ *     4  u64 client tag
+ *    12  u32 symbol ID, or kAllSymbols to cancel on every symbol
+ *    16  u32 account whose orders to cancel, or 0 for the orders submitted on this session
+ *    20  u32 reserved, 0
+ */
+constexpr std::size_t kMassCancelSize = 24;
+constexpr std::uint32_t kAllSymbols = 0xFFFFFFFF;
+
+/**
+ * Ack (24 bytes):
+ *     4  u64 client tag of the request
+ *    12  u64 order ID (assigned for a NewOrder, echoed for a Cancel/Modify, the count for a MassCancel)
+ *    20  u8  status (AckStatus)
+ *    21  u8[3] reserved, 0
+ */
+constexpr std::size_t kAckSize = 24;
+
+/**
+ * Fill (52 bytes), one per trade caused by the preceding Ack's request:
+ *     4  u64 taker order ID (the order of the request)
+ *    12  u64 maker order ID (the resting order it traded against)
+ *    20  u64 trade ID
+ *    28  i64 price in ticks
+ *    36  i64 quantity in lots
+ *    44  u32 symbol ID
+ *    48  u8  aggressor side (0 = buy, 1 = sell)
+ *    49  u8[3] reserved, 0
+ */
+constexpr std::size_t kFillSize = 52;
+
+/** @brief Writes a frame header; the rest of the frame must be filled in by the caller. */
+inline void writeHeader(unsigned char* p, std::size_t length, MessageType type) {
+    writeU16(p, static_cast<std::uint16_t>(length));
+    p[2] = static_cast<unsigned char>(type);
+    p[3] = 0;
+}
+
+/** @brief Encodes an Ack frame into `p`, which must have room for kAckSize bytes. */
+inline void encodeAck(unsigned char* p, std::uint64_t clientTag, OrderId orderId, AckStatus status) {
+    writeHeader(p, kAckSize, MessageType::Ack);
+    writeU64(p + 4, clientTag);
+    writeU64(p + 12, orderId);
+    p[20] = static_cast<unsigned char>(status);
+    p[21] = p[22] = p[23] = 0;
+}
+
+/** @brief Encodes a Fill frame into `p`, which must have room for kFillSize bytes. */
+inline void encodeFill(unsigned char* p, const Trade& trade) {
+    writeHeader(p, kFillSize, MessageType::Fill);
+    writeU64(p + 4, trade.takerOrderID);
+    writeU64(p + 12, trade.makerOrderID);
+    writeU64(p + 20, trade.tradeID);
+    writeI64(p + 28, trade.price);
+    writeI64(p + 36, trade.quantity);
+    writeU32(p + 44, trade.symbolId);
+    p[48] = (trade.aggressorSide == Side::Buy) ? 0 : 1;
+    p[49] = p[50] = p[51] = 0;
+}
+
+} // namespace binary
@@ -0,0 +1,123 @@
+/**
+ * @file BookView.h
+ * @brief Defines the BookView, a copy of the top of a book that any thread can read, and the SeqLock that guards it.
+ *
+ * The books belong to their shards' threads, so a REST depth query, a dashboard or a risk
+ * check cannot look at one without either racing the matcher or making it take a lock. Instead,
+ * each shard copies the top levels of a book into that symbol's view whenever a change reaches
+ * them (the same test that decides whether market data is published), and readers copy the view
+ * out. The view is protected by a sequence lock: the writer never waits for anyone, and a reader
+ * only retries if it overlapped a write, which is a few hundred bytes of stores long.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>      // For std::size_t
+#include <cstdint>
+#include <cstring>      // For std::memcpy
+#include <type_traits>  // For std::is_trivially_copyable_v
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "Backoff.h"
+
+/** @brief A `[price, quantity]` level of a market data message; quantity 0 means the level is gone. */
+struct LevelQuote {
+    Price price;
+    Quantity quantity;
+};
+
+/**
+ * @class SeqLock
+ * @brief A single-writer, many-reader sequence lock around a trivially copyable value.
+ *
+ * The version is odd while a write is in progress. A reader copies the value between two
+ * reads of the version and keeps the copy only if both were the same even number. The value
+ * is held as relaxed atomic words, so the copying races are well defined.
+ * @tparam T The guarded value.
+ */
+template <typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable_v<T>, "A SeqLock can only guard a trivially copyable value.");
+
+public:
+    /** @brief Replaces the value. Must only ever be called from one thread at a time. */
+    void store(const T& value) {
+        std::uint64_t words[kWords] = {};
+        std::memcpy(words, &value, sizeof(T));
+        const std::uint64_t version = this->version_.load(std::memory_order_relaxed);
+        this->version_.store(version + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (std::size_t i = 0; i < kWords; ++i) {
+            this->words_[i].store(words[i], std::memory_order_relaxed);
+        }
+        this->version_.store(version + 2, std::memory_order_release);
+    }
+
+    /** @brief Copies the value out, unless a write was in progress. @return True if `out` was filled in. */
+    bool tryLoad(T& out) const {
+        const std::uint64_t before = this->version_.load(std::memory_order_acquire);
+        if (before & 1) {
+            return false;
+        }
+        std::uint64_t words[kWords];
+        for (std::size_t i = 0; i < kWords; ++i) {
+            words[i] = this->words_[i].load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (this->version_.load(std::memory_order_relaxed) != before) {
+            return false;
+        }
+        std::memcpy(&out, words, sizeof(T));
+        return true;
+    }
+
+    /** @brief Copies the value out, retrying until it did not overlap a write. Never blocks the writer. */
+    T load() const {
+        T value{};
+        Backoff backoff;
+        while (!tryLoad(value)) {
+            backoff.pause();
+        }
+        return value;
+    }
+
+private:
+    static constexpr std::size_t kWords = (sizeof(T) + 7) / 8;
+
+    alignas(64) std::atomic<std::uint64_t> version_{0};
+    std::array<std::atomic<std::uint64_t>, kWords> words_{};
+};
+
+/**
+ * @struct BookView
+ * @brief The top levels of both sides of a book, as of one market data sequence number.
+ */
+struct BookView {
+    static constexpr int kDepth = 10; // Levels per side; the depth of the market data.
+
+    std::uint64_t seq = 0;            // The book's market data sequence number at the time of the copy.
+    std::uint32_t bidCount = 0;       // The number of levels in `bids`, best first.
+    std::uint32_t askCount = 0;       // The number of levels in `asks`, best first.
+    LevelQuote bids[kDepth] = {};
+    LevelQuote asks[kDepth] = {};
+
+    /** @brief Copies the top levels of a book. Must run on the thread that owns the book. */
+    static BookView of(const OrderBook& book) {
+        BookView view;
+        view.seq = book.getMarketDataSeq();
+        copyLevels(book, Side::Buy, view.bids, view.bidCount);
+        copyLevels(book, Side::Sell, view.asks, view.askCount);
+        return view;
+    }
+
+private:
+    static void copyLevels(const OrderBook& book, Side side, LevelQuote* levels, std::uint32_t& count) {
+        book.forEachLevel(side, [&](const PriceLevel& level) {
+            levels[count++] = {level.price, level.totalQuantity};
+            return count < static_cast<std::uint32_t>(kDepth);
+        });
+    }
+};
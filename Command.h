@@ -0,0 +1,175 @@
+/**
+ * @file Command.h
+ * @brief Defines the Command passed from the API threads to a matching shard, and its reply.
+ *
+ * The API threads never touch an order book. They parse a request, describe it as a
+ * Command, push it into the owning shard's lock-free queue and wait on the CommandReply
+ * until the shard's thread has executed it.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint> // For std::uint64_t
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "Order.h"
+#include "OrderBook.h" // For ModifyResult
+#include "Trade.h"
+#include "Backoff.h"
+#include "Publisher.h"  // For FeedChannel
+
+/**
+ * @enum CommandType
+ * @brief The kinds of requests a shard can execute.
+ */
+enum class CommandType {
+    NewOrder, // Match a new order and rest any remainder.
+    NewOrderBatch, // Match several new orders for one symbol back to back.
+    Cancel,   // Remove a resting order.
+    Modify,   // Change the price and/or quantity of a resting order.
+    MassCancel, // Remove every resting and stop order of an account or session, on one symbol or all of the shard's.
+    PublishSnapshots, // Send a snapshot of every book on the shard to the new subscribers of `feedChannel`.
+    Sync,            // Do nothing; completes once every command queued before it has been executed.
+    TakeSnapshot,    // Copy the shard's books and ID sequences into a ShardSnapshot.
+    RestoreSnapshot  // Rebuild the shard's books and ID sequences from a SnapshotFile.
+};
+
+struct ShardSnapshot;
+class SnapshotFile;
+
+/**
+ * @struct OrderOptions
+ * @brief The less common attributes of a new order; the defaults describe a plain order.
+ */
+struct OrderOptions {
+    Price stopPrice = 0;           // StopMarket / StopLimit: the trade price that triggers the order, in ticks.
+    AccountId account = kNoAccount; // The submitting account, used for self-trade prevention.
+    SelfTradePrevention selfTradePrevention = SelfTradePrevention::None; // Requires an account.
+    SessionId session = kNoSession; // The submitting session, whose disconnect may cancel the order.
+};
+
+/**
+ * @struct BatchOrder
+ * @brief One order of a batch submitted with MatchingEngine::processBatch.
+ */
+struct BatchOrder {
+    SymbolId symbol = 0;
+    OrderType type = OrderType::Limit;
+    Side side = Side::Buy;
+    Quantity quantity = 0; // In lots.
+    Price price = 0;       // In ticks.
+    OrderOptions options;
+    OrderId orderId = 0;   // Filled in by the shard: the ID assigned to the order.
+};
+
+/**
+ * @struct CommandReply
+ * @brief The result of a Command, filled in by the shard and awaited by the submitting thread.
+ */
+struct CommandReply {
+    OrderId orderId = 0;                              // NewOrder: the ID assigned to the order.
+    bool found = false;                               // Cancel: whether the order was resting.
+    ModifyResult modifyResult = ModifyResult::NotFound; // Modify: what happened to the order.
+    std::string error;                                // Set if the command was rejected.
+    // If the engine has a journal: the journal size that makes this command's records durable.
+    // The command must not be acknowledged to a client before the journal has reached it.
+    std::uint64_t journalSize = 0;
+    // If set, NewOrder and Modify copy the trades they caused into this vector.
+    // Owned by the submitting thread, which can reuse it (and its capacity) for the next command.
+    std::vector<Trade>* trades = nullptr;
+    // NewOrder, NewOrderBatch and Modify: the orders cancelled by self-trade prevention.
+    std::vector<OrderId> selfTradeCancels;
+    // MassCancel: the orders removed.
+    std::vector<OrderId> cancelled;
+
+    /** @brief Blocks the calling thread until the shard has executed the command. */
+    void wait() const {
+        Backoff backoff;
+        while (!this->done_.load(std::memory_order_acquire)) {
+            backoff.pause();
+        }
+    }
+
+    /** @brief Called by the shard once every result field has been written. */
+    void complete() { this->done_.store(true, std::memory_order_release); }
+
+    /** @brief Prepares a reply that has been waited for to be used for another command. */
+    void reset() {
+        this->orderId = 0;
+        this->found = false;
+        this->modifyResult = ModifyResult::NotFound;
+        this->error.clear();
+        this->journalSize = 0;
+        this->selfTradeCancels.clear();
+        this->cancelled.clear();
+        if (this->trades != nullptr) {
+            this->trades->clear();
+        }
+        this->done_.store(false, std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<bool> done_{false};
+};
+
+/**
+ * @struct Command
+ * @brief A request for a matching shard. Only the fields relevant to `type` are used.
+ */
+struct Command {
+    CommandType type = CommandType::NewOrder;
+
+    // Set when the command is being replayed from the journal: it is applied but not journaled
+    // again, and a NewOrder keeps the `orderId` it was originally given.
+    bool replay = false;
+
+    // --- NewOrder ---
+    OrderType orderType = OrderType::Limit;
+    Side side = Side::Buy;
+    SymbolId symbol = 0;
+    Price price = 0;       // In ticks.
+    Quantity quantity = 0; // In lots.
+    OrderOptions options;
+
+    // --- NewOrderBatch ---
+    // The orders to process for `symbol`, in order. Owned by the submitting thread.
+    std::vector<BatchOrder*>* batch = nullptr;
+
+    // --- Cancel / Modify ---
+    OrderId orderId = 0;
+    // The new decimal values of a Modify. They are converted to ticks and lots on the shard,
+    // which is the only thread that knows which book (and so which tick size) the order is on.
+    std::optional<double> newPrice;
+    std::optional<double> newQuantity;
+    // Alternatively, the new values already in ticks and lots (used by the binary gateway).
+    // When both forms are given, these win.
+    std::optional<Price> newPriceTicks;
+    std::optional<Quantity> newQuantityLots;
+
+    // --- MassCancel ---
+    // Whose orders to cancel: those of `options.session` if it is set, otherwise those of
+    // `options.account`. Only the orders for `symbol`, unless `allSymbols` is set.
+    bool allSymbols = false;
+
+    // --- PublishSnapshots ---
+    // MarketDataDeltas for full depth snapshots, OrderEvents for market-by-order snapshots.
+    FeedChannel feedChannel = FeedChannel::MarketDataDeltas;
+
+    // --- TakeSnapshot / RestoreSnapshot ---
+    ShardSnapshot* snapshot = nullptr;           // Where TakeSnapshot copies the shard's state.
+    const SnapshotFile* snapshotFile = nullptr;  // What RestoreSnapshot restores the shard from.
+
+    // When the gateway read the request (a Tsc timestamp), carried into the orders and their trades.
+    // Left at 0 by commands that did not come through a gateway; the shard then uses `submitted`.
+    std::uint64_t received = 0;
+
+    // When the command was handed to the shard (a Tsc timestamp), for the queueing delay metric.
+    std::uint64_t submitted = 0;
+
+    // Where the shard reports the outcome. Owned by the submitting thread; may be null for
+    // fire-and-forget commands (PublishSnapshots, replayed commands), which nobody waits for.
+    CommandReply* reply = nullptr;
+};
@@ -0,0 +1,115 @@
+/**
+ * @file EngineTests.cpp
+ * @brief Tests of the MatchingEngine's order entry: what the shards accept and reject, whichever
+ * front end the command came from.
+ *
+ * The REST server, the binary gateway and the routing gateway all hand their commands to the
+ * shards, which validate them. These tests go through process(), processBatch(), modify() and
+ * submit(), the last of which is the path the binary gateway takes.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include "Command.h"
+#include "Instrument.h"
+#include "MatchingEngine.h"
+#include "TestHarness.h"
+#include "TestSupport.h"
+
+using testing::Execute;
+
+TEST(NewOrdersNeedAPositiveQuantity) {
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::Limit, Side::Buy, 0, symbol, 100));
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::Limit, Side::Buy, -5, symbol, 100));
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::Market, Side::Sell, 0, symbol));
+    CHECK(engine.getBookView(symbol).bidCount == 0);
+}
+
+TEST(OrdersWithALimitPriceNeedAPositivePrice) {
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+
+    for (OrderType type : {OrderType::Limit, OrderType::IOC, OrderType::FOK}) {
+        CHECK_THROWS(std::invalid_argument, engine.process(type, Side::Buy, 10, symbol, 0));
+        CHECK_THROWS(std::invalid_argument, engine.process(type, Side::Sell, 10, symbol, -100));
+    }
+    OrderOptions stop;
+    stop.stopPrice = 100;
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::StopLimit, Side::Buy, 10, symbol, 0, stop));
+    // Market and stop market orders take no price.
+    engine.process(OrderType::Market, Side::Buy, 10, symbol);
+    engine.process(OrderType::StopMarket, Side::Buy, 10, symbol, 0, stop);
+
+    stop.stopPrice = 0;
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::StopMarket, Side::Buy, 10, symbol, 0, stop));
+    CHECK(engine.getBookView(symbol).bidCount == 0);
+}
+
+TEST(SubmittedCommandsAreValidatedByTheShard) {
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+
+    CommandReply reply;
+    Command command;
+    command.type = CommandType::NewOrder;
+    command.orderType = OrderType::Limit;
+    command.symbol = symbol;
+    command.quantity = 10;
+    command.price = 0;
+    Execute(engine, std::move(command), reply);
+    CHECK(!reply.error.empty());
+
+    reply.reset();
+    Command zero_quantity;
+    zero_quantity.type = CommandType::NewOrder;
+    zero_quantity.orderType = OrderType::Limit;
+    zero_quantity.symbol = symbol;
+    zero_quantity.quantity = 0;
+    zero_quantity.price = 100;
+    Execute(engine, std::move(zero_quantity), reply);
+    CHECK(!reply.error.empty());
+    CHECK(engine.getBookView(symbol).bidCount == 0);
+}
+
+TEST(ABatchWithAnInvalidOrderIsNotApplied) {
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+
+    std::vector<BatchOrder> batch(2);
+    batch[0].symbol = symbol;
+    batch[0].quantity = 10;
+    batch[0].price = 100;
+    batch[1].symbol = symbol;
+    batch[1].quantity = 10;
+    batch[1].price = 0;
+    CHECK_THROWS(std::invalid_argument, engine.processBatch(batch));
+    CHECK(engine.getBookView(symbol).bidCount == 0);
+}
+
+TEST(ModifyRejectsANonPositivePriceAndKeepsTheOrder) {
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+    const OrderId id = engine.process(OrderType::Limit, Side::Buy, 10, symbol, 100);
+
+    CHECK_THROWS(std::invalid_argument, engine.modify(id, 0.0, std::nullopt));
+    CHECK_THROWS(std::invalid_argument, engine.modify(id, -1.0, std::nullopt));
+    CHECK_THROWS(std::invalid_argument, engine.modify(id, std::nullopt, 0.0));
+
+    // The binary gateway's modify carries ticks and lots.
+    CommandReply reply;
+    Command command;
+    command.type = CommandType::Modify;
+    command.orderId = id;
+    command.newPriceTicks = 0;
+    Execute(engine, std::move(command), reply);
+    CHECK(!reply.error.empty());
+
+    const BookView view = engine.getBookView(symbol);
+    CHECK(view.bidCount == 1);
+    CHECK(view.bids[0].price == 100);
+    CHECK(view.bids[0].quantity == 10);
+}
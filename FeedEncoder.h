@@ -0,0 +1,417 @@
+/**
+ * @file FeedEncoder.h
+ * @brief Defines the FeedEncoder class, which writes the SSE trade and market data messages.
+ *
+ * Building an nlohmann::json object per message costs a map node and a string per key, and
+ * dump() then walks it all again; the depth arrays added a std::to_string per price and
+ * quantity on top. Every message sent to the feeds has a fixed shape, so the encoder writes
+ * it directly into a buffer that is reused from one message to the next: the keys are
+ * string literals, integers are formatted with std::to_chars and decimal levels with
+ * integer arithmetic, and symbol names are escaped once and cached. The finished message is
+ * copied once into the shared payload that the Publisher hands to every subscriber.
+ *
+ * The output is byte for byte what the nlohmann::json version produced, since existing clients
+ * parse it: keys in alphabetical order (nlohmann::json objects are sorted maps), numbers
+ * formatted by nlohmann's own float printer, and levels as std::to_string ("%f") strings.
+ */
+
+#pragma once
+
+#include <charconv>     // For std::to_chars
+#include <cmath>        // For std::isfinite
+#include <cstddef>      // For std::size_t
+#include <cstdint>
+#include <cstdio>       // For std::snprintf
+#include <memory>       // For std::make_shared
+#include <string>
+#include <vector>
+
+#include "BookView.h"    // For LevelQuote
+#include "Instrument.h"
+#include "Metrics.h"     // For Tsc, which the trade timestamps are converted with
+#include "OrderBook.h"
+#include "Publisher.h"   // For the Payload type
+#include "SymbolTable.h"
+#include "Trade.h"
+#include "json.hpp"      // For escaping symbol names and for nlohmann's float formatting
+
+/**
+ * @class FeedEncoder
+ * @brief Serializes feed messages into reusable buffers. Not thread-safe: each shard owns one.
+ */
+class FeedEncoder {
+public:
+    explicit FeedEncoder(const SymbolTable& symbols) : symbols_(symbols) {}
+
+    /**
+     * @brief One "trade" event per trade, all in a single payload.
+     * Carries the monotonic times (in nanoseconds) at which the trade was matched and its taker
+     * order was received, so that a client can tell how long the order took to execute.
+     */
+    Payload encodeTrades(const std::vector<Trade>& trades, const Instrument& instrument) {
+        this->buffer_.clear();
+        for (const Trade& trade : trades) {
+            this->buffer_ += "data: {\"aggressor_side\":";
+            this->buffer_ += (trade.aggressorSide == Side::Buy) ? "\"buy\"" : "\"sell\"";
+            this->buffer_ += ",\"maker_order_id\":";
+            appendUnsigned(trade.makerOrderID);
+            this->buffer_ += ",\"matched_ns\":";
+            appendUnsigned(Tsc::toNanos(trade.matched));
+            this->buffer_ += ",\"price\":";
+            appendNumber(instrument.fromTicks(trade.price));
+            this->buffer_ += ",\"quantity\":";
+            appendNumber(instrument.fromLots(trade.quantity));
+            this->buffer_ += ",\"symbol\":";
+            this->buffer_ += symbolJson(trade.symbolId);
+            this->buffer_ += ",\"taker_order_id\":";
+            appendUnsigned(trade.takerOrderID);
+            this->buffer_ += ",\"taker_received_ns\":";
+            appendUnsigned(Tsc::toNanos(trade.takerReceived));
+            this->buffer_ += ",\"trade_id\":";
+            appendUnsigned(trade.tradeID);
+            this->buffer_ += ",\"type\":\"trade\"}\n\n";
+        }
+        return finish();
+    }
+
+    /**
+     * @brief One "trade_batch" event per taker order, all in a single payload.
+     * An event carries every fill of its taker (consecutive trades with the same taker) and
+     * their summary: the total quantity, the volume-weighted average price and the number of
+     * price levels swept. For an order that sweeps the book, that is one event to parse
+     * instead of one per fill.
+     */
+    Payload encodeTradeBatches(const std::vector<Trade>& trades, const Instrument& instrument) {
+        this->buffer_.clear();
+        for (std::size_t first = 0; first < trades.size();) {
+            const Trade& taker = trades[first];
+            this->buffer_ += "data: {\"aggressor_side\":";
+            this->buffer_ += (taker.aggressorSide == Side::Buy) ? "\"buy\"" : "\"sell\"";
+            this->buffer_ += ",\"fills\":[";
+
+            Quantity total = 0;
+            double notional = 0; // In ticks times lots; exact while it stays below 2^53.
+            std::size_t levels = 0;
+            std::size_t last = first;
+            for (; last < trades.size() && trades[last].takerOrderID == taker.takerOrderID &&
+                   trades[last].symbolId == taker.symbolId; ++last) {
+                const Trade& fill = trades[last];
+                if (last != first) {
+                    this->buffer_ += ',';
+                }
+                this->buffer_ += "{\"maker_order_id\":";
+                appendUnsigned(fill.makerOrderID);
+                this->buffer_ += ",\"price\":";
+                appendNumber(instrument.fromTicks(fill.price));
+                this->buffer_ += ",\"quantity\":";
+                appendNumber(instrument.fromLots(fill.quantity));
+                this->buffer_ += ",\"trade_id\":";
+                appendUnsigned(fill.tradeID);
+                this->buffer_ += '}';
+
+                total += fill.quantity;
+                notional += static_cast<double>(fill.price) * static_cast<double>(fill.quantity);
+                if (last == first || fill.price != trades[last - 1].price) {
+                    ++levels; // Fills come in price order, so each new price is a new level.
+                }
+            }
+
+            this->buffer_ += "],\"levels_swept\":";
+            appendUnsigned(levels);
+            this->buffer_ += ",\"matched_ns\":";
+            appendUnsigned(Tsc::toNanos(taker.matched));
+            this->buffer_ += ",\"symbol\":";
+            this->buffer_ += symbolJson(taker.symbolId);
+            this->buffer_ += ",\"taker_order_id\":";
+            appendUnsigned(taker.takerOrderID);
+            this->buffer_ += ",\"taker_received_ns\":";
+            appendUnsigned(Tsc::toNanos(taker.takerReceived));
+            this->buffer_ += ",\"total_quantity\":";
+            appendNumber(instrument.fromLots(total));
+            this->buffer_ += ",\"type\":\"trade_batch\",\"vwap\":";
+            // Converted like Instrument::fromTicks, so that a single-price sweep reports exactly that price.
+            const double vwap_ticks = notional / static_cast<double>(total);
+            appendNumber(instrument.getTicksPerUnit() != 0 ? vwap_ticks / instrument.getTicksPerUnit()
+                                                           : vwap_ticks * instrument.getTickSize());
+            this->buffer_ += "}\n\n";
+            first = last;
+        }
+        return finish();
+    }
+
+    /** @brief The "l2update" message: the book's BBO and its top `depth` levels per side, at its current sequence number. */
+    Payload encodeSnapshot(const OrderBook& book, int depth) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_.clear();
+        this->buffer_ += "data: {\"asks\":";
+        appendDepth(book, Side::Sell, depth);
+
+        BBO bbo;
+        if (book.getBBO(bbo)) {
+            this->buffer_ += ",\"best_ask\":";
+            appendNumber(instrument.fromTicks(bbo.bestAsk));
+            this->buffer_ += ",\"best_bid\":";
+            appendNumber(instrument.fromTicks(bbo.bestBid));
+        } else {
+            this->buffer_ += ",\"best_ask\":null,\"best_bid\":null";
+        }
+
+        this->buffer_ += ",\"bids\":";
+        appendDepth(book, Side::Buy, depth);
+        this->buffer_ += ",\"seq\":";
+        appendUnsigned(book.getMarketDataSeq());
+        this->buffer_ += ",\"symbol\":";
+        this->buffer_ += symbolJson(book.getSymbolId());
+        this->buffer_ += ",\"type\":\"l2update\"}\n\n";
+        return finish();
+    }
+
+    /** @brief The "l2delta" message: the given level updates of a book, with sequence number `seq`. */
+    Payload encodeDelta(const OrderBook& book, std::uint64_t seq, const std::vector<LevelQuote>& bids,
+                        const std::vector<LevelQuote>& asks) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_.clear();
+        this->buffer_ += "data: {\"asks\":";
+        appendLevels(asks, instrument);
+        this->buffer_ += ",\"bids\":";
+        appendLevels(bids, instrument);
+        this->buffer_ += ",\"seq\":";
+        appendUnsigned(seq);
+        this->buffer_ += ",\"symbol\":";
+        this->buffer_ += symbolJson(book.getSymbolId());
+        this->buffer_ += ",\"type\":\"l2delta\"}\n\n";
+        return finish();
+    }
+
+    /**
+     * @brief The "bbo" message: the best bid and ask of a book with their total quantities, at its
+     * current sequence number. The price and quantity of an empty side are null.
+     */
+    Payload encodeBbo(const OrderBook& book, const LevelQuote& bid, const LevelQuote& ask) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_.clear();
+        this->buffer_ += "data: {\"ask_quantity\":";
+        appendOptionalQuantity(ask, instrument);
+        this->buffer_ += ",\"best_ask\":";
+        appendOptionalPrice(ask, instrument);
+        this->buffer_ += ",\"best_bid\":";
+        appendOptionalPrice(bid, instrument);
+        this->buffer_ += ",\"bid_quantity\":";
+        appendOptionalQuantity(bid, instrument);
+        this->buffer_ += ",\"seq\":";
+        appendUnsigned(book.getMarketDataSeq());
+        this->buffer_ += ",\"symbol\":";
+        this->buffer_ += symbolJson(book.getSymbolId());
+        this->buffer_ += ",\"type\":\"bbo\"}\n\n";
+        return finish();
+    }
+
+    /**
+     * @brief The "l3" message: the changes to individual orders of one change to a book, in order, with sequence `seq`.
+     * Events are compact arrays: `["A",id,side,price,quantity]` add, `["E",id,quantity]` execute,
+     * `["D",id]` delete and `["R",id,quantity]` replace (the new remaining quantity).
+     */
+    Payload encodeOrderEvents(const OrderBook& book, std::uint64_t seq, const std::vector<OrderEvent>& events) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_.clear();
+        this->buffer_ += "data: {\"events\":[";
+        for (std::size_t i = 0; i < events.size(); ++i) {
+            const OrderEvent& event = events[i];
+            if (i != 0) {
+                this->buffer_ += ',';
+            }
+            switch (event.type) {
+                case OrderEventType::Add:
+                    this->buffer_ += "[\"A\",";
+                    appendUnsigned(event.orderId);
+                    this->buffer_ += (event.side == Side::Buy) ? ",\"buy\",\"" : ",\"sell\",\"";
+                    appendFixed(event.price, instrument.getTicksPerUnit(), instrument.fromTicks(event.price));
+                    this->buffer_ += "\",\"";
+                    appendQuantity(event.quantity, instrument);
+                    this->buffer_ += "\"]";
+                    break;
+                case OrderEventType::Execute:
+                case OrderEventType::Replace:
+                    this->buffer_ += (event.type == OrderEventType::Execute) ? "[\"E\"," : "[\"R\",";
+                    appendUnsigned(event.orderId);
+                    this->buffer_ += ",\"";
+                    appendQuantity(event.quantity, instrument);
+                    this->buffer_ += "\"]";
+                    break;
+                case OrderEventType::Delete:
+                    this->buffer_ += "[\"D\",";
+                    appendUnsigned(event.orderId);
+                    this->buffer_ += ']';
+                    break;
+            }
+        }
+        this->buffer_ += "],\"seq\":";
+        appendUnsigned(seq);
+        this->buffer_ += ",\"symbol\":";
+        this->buffer_ += symbolJson(book.getSymbolId());
+        this->buffer_ += ",\"type\":\"l3\"}\n\n";
+        return finish();
+    }
+
+    /**
+     * @brief The "l3snapshot" message: every resting order of a book as `[id,side,price,quantity]`, bids
+     * then asks, each best price first and each level in queue order, at its current market-by-order sequence.
+     */
+    Payload encodeOrderSnapshot(const OrderBook& book) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_.clear();
+        this->buffer_ += "data: {\"orders\":[";
+        bool first = true;
+        auto append_order = [&](const Order& order) {
+            if (!first) {
+                this->buffer_ += ',';
+            }
+            first = false;
+            this->buffer_ += '[';
+            appendUnsigned(order.getOrderID());
+            this->buffer_ += (order.getSide() == Side::Buy) ? ",\"buy\",\"" : ",\"sell\",\"";
+            appendFixed(order.getPrice(), instrument.getTicksPerUnit(), instrument.fromTicks(order.getPrice()));
+            this->buffer_ += "\",\"";
+            appendQuantity(order.getQuantity(), instrument);
+            this->buffer_ += "\"]";
+        };
+        book.forEachOrder(Side::Buy, append_order);
+        book.forEachOrder(Side::Sell, append_order);
+        this->buffer_ += "],\"seq\":";
+        appendUnsigned(book.getOrderEventSeq());
+        this->buffer_ += ",\"symbol\":";
+        this->buffer_ += symbolJson(book.getSymbolId());
+        this->buffer_ += ",\"type\":\"l3snapshot\"}\n\n";
+        return finish();
+    }
+
+    /** @brief A reusable vector for the caller to collect one side's level updates in before encodeDelta(). */
+    std::vector<LevelQuote>& levels(Side side) { return (side == Side::Buy) ? this->bid_levels_ : this->ask_levels_; }
+
+private:
+    const SymbolTable& symbols_;
+    std::string buffer_;                   // The message being built; keeps its capacity between messages.
+    std::vector<std::string> symbol_json_; // By symbol ID: the name as a quoted, escaped JSON string.
+    std::vector<LevelQuote> bid_levels_;
+    std::vector<LevelQuote> ask_levels_;
+
+    Payload finish() const { return std::make_shared<const std::string>(this->buffer_); }
+
+    /** @brief The symbol's name as a JSON string, escaped exactly as nlohmann::json would on first use. */
+    const std::string& symbolJson(SymbolId id) {
+        if (id >= this->symbol_json_.size()) {
+            this->symbol_json_.resize(static_cast<std::size_t>(id) + 1);
+        }
+        std::string& quoted = this->symbol_json_[id];
+        if (quoted.empty()) {
+            // Invalid UTF-8 is replaced rather than thrown on, so a bad name cannot fail the command that traded.
+            quoted = nlohmann::json(this->symbols_.name(id)).dump(-1, ' ', false, nlohmann::json::error_handler_t::replace);
+        }
+        return quoted;
+    }
+
+    void appendDepth(const OrderBook& book, Side side, int depth) {
+        const Instrument& instrument = book.getInstrument();
+        this->buffer_ += '[';
+        int count = 0;
+        book.forEachLevel(side, [&](const PriceLevel& level) {
+            if (count == depth) {
+                return false;
+            }
+            if (count++ != 0) {
+                this->buffer_ += ',';
+            }
+            appendLevel(level.price, level.totalQuantity, instrument);
+            return true;
+        });
+        this->buffer_ += ']';
+    }
+
+    void appendLevels(const std::vector<LevelQuote>& levels, const Instrument& instrument) {
+        this->buffer_ += '[';
+        for (std::size_t i = 0; i < levels.size(); ++i) {
+            if (i != 0) {
+                this->buffer_ += ',';
+            }
+            appendLevel(levels[i].price, levels[i].quantity, instrument);
+        }
+        this->buffer_ += ']';
+    }
+
+    void appendLevel(Price price, Quantity quantity, const Instrument& instrument) {
+        this->buffer_ += "[\"";
+        appendFixed(price, instrument.getTicksPerUnit(), instrument.fromTicks(price));
+        this->buffer_ += "\",\"";
+        appendFixed(quantity, instrument.getLotsPerUnit(), instrument.fromLots(quantity));
+        this->buffer_ += "\"]";
+    }
+
+    void appendQuantity(Quantity quantity, const Instrument& instrument) {
+        appendFixed(quantity, instrument.getLotsPerUnit(), instrument.fromLots(quantity));
+    }
+
+    void appendOptionalPrice(const LevelQuote& level, const Instrument& instrument) {
+        if (level.quantity == 0) {
+            this->buffer_ += "null";
+        } else {
+            appendNumber(instrument.fromTicks(level.price));
+        }
+    }
+
+    void appendOptionalQuantity(const LevelQuote& level, const Instrument& instrument) {
+        if (level.quantity == 0) {
+            this->buffer_ += "null";
+        } else {
+            appendNumber(instrument.fromLots(level.quantity));
+        }
+    }
+
+    void appendUnsigned(std::uint64_t value) {
+        char digits[20];
+        const auto result = std::to_chars(digits, digits + sizeof(digits), value);
+        this->buffer_.append(digits, static_cast<std::size_t>(result.ptr - digits));
+    }
+
+    /** @brief A JSON number, formatted as nlohmann::json::dump() formats a double. */
+    void appendNumber(double value) {
+        if (!std::isfinite(value)) {
+            this->buffer_ += "null";
+            return;
+        }
+        char digits[64];
+        const char* end = nlohmann::detail::to_chars(digits, digits + sizeof(digits), value);
+        this->buffer_.append(digits, static_cast<std::size_t>(end - digits));
+    }
+
+    /**
+     * @brief A decimal with six fractional digits, exactly as std::to_string(value) ("%f") prints it.
+     *
+     * When the increment is 10^-k with k <= 6, the decimal is simply the integer `units` with the
+     * point moved k places, and printing the double to six places gives that same decimal while
+     * the double is accurate to well under 0.5e-6, i.e. below 2^32. Anything else goes through printf.
+     */
+    void appendFixed(std::int64_t units, double perUnit, double value) {
+        static constexpr std::uint64_t kMicros = 1000000;
+        std::uint64_t scale = 1;
+        while (scale < kMicros && static_cast<double>(scale) != perUnit) {
+            scale *= 10;
+        }
+        const std::uint64_t magnitude = units < 0 ? 0 - static_cast<std::uint64_t>(units) : static_cast<std::uint64_t>(units);
+        if (static_cast<double>(scale) != perUnit || magnitude >= (std::uint64_t{1} << 32) * scale) {
+            char digits[400]; // Enough for any double in "%f".
+            const int length = std::snprintf(digits, sizeof(digits), "%f", value);
+            this->buffer_.append(digits, static_cast<std::size_t>(length));
+            return;
+        }
+        if (units < 0) {
+            this->buffer_ += '-';
+        }
+        appendUnsigned(magnitude / scale);
+        std::uint64_t fraction = (magnitude % scale) * (kMicros / scale);
+        char digits[7] = {'.', '0', '0', '0', '0', '0', '0'};
+        for (int i = 6; i > 0; --i, fraction /= 10) {
+            digits[i] = static_cast<char>('0' + fraction % 10);
+        }
+        this->buffer_.append(digits, sizeof(digits));
+    }
+};
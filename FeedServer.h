@@ -0,0 +1,706 @@
+/**
+ * @file FeedServer.h
+ * @brief Defines the FeedServer class, which streams the SSE feeds from a few event-loop threads.
+ *
+ * A feed client stays connected for hours but is idle almost all of that time. Serving it from
+ * the HTTP server's thread pool ties up a worker per client, so enough dashboards starve order
+ * entry of threads. The feed server listens on a port of its own instead and multiplexes every
+ * feed connection over a handful of epoll loops: a loop only touches a connection when its
+ * client sent something, its socket became writable again, or its subscriber was notified by
+ * the Publisher that messages are waiting. Those messages are written straight from their
+ * shared payloads with writev, so however many clients there are, a message is never copied.
+ *
+ * The endpoints and their parameters are the same as those of the HTTP server's feeds:
+ * GET /ws/trades and GET /ws/marketdata. The response is an SSE stream that ends when either
+ * side closes the connection.
+ */
+
+#pragma once
+
+#include <algorithm>   // For std::min
+#include <atomic>
+#include <chrono>
+#include <cstddef>     // For std::size_t
+#include <cstdint>
+#include <deque>
+#include <map>         // For std::multimap
+#include <memory>      // For std::unique_ptr, std::shared_ptr
+#include <mutex>
+#include <stdexcept>   // For std::invalid_argument, std::runtime_error
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <arpa/inet.h>    // For htons, htonl
+#include <cerrno>
+#include <fcntl.h>
+#include <netinet/in.h>   // For sockaddr_in
+#include <netinet/tcp.h>  // For TCP_NODELAY
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>      // For writev
+#include <unistd.h>       // For close, read
+#endif
+
+#include "MatchingEngine.h"
+#include "Logger.h"
+#include "json.hpp"       // For the error responses
+
+/** @brief The query parameters of a feed request: the same type as httplib::Params. */
+using FeedParams = std::multimap<std::string, std::string>;
+
+/**
+ * @struct FeedRequest
+ * @brief What a client asked for when it connected to a feed.
+ */
+struct FeedRequest {
+    FeedChannel channel = FeedChannel::Trades;
+    SubscriptionFilter filter;
+    std::chrono::milliseconds coalesce{0}; // Write the messages of up to this long together (0: at once).
+};
+
+// The most a coalescing client may ask for, and the most one coalesced write carries.
+inline constexpr int kMaxCoalesceMillis = 1000;
+inline constexpr std::size_t kMaxCoalescedBytes = 64 * 1024;
+
+/**
+ * @brief Interprets a request for one of the feeds.
+ *
+ * - `/ws/trades`: `format` ("trade" or "batch").
+ * - `/ws/marketdata`: `channel` ("l2update", "l2delta", "bbo" or "l3") and, for l2update, `depth` (1 to 10).
+ * - Both: `symbols` (comma-separated; all if omitted) and `coalesce_ms` (0 to kMaxCoalesceMillis).
+ *
+ * @param path Either "/ws/trades" or "/ws/marketdata".
+ * @param symbols Looks the listed symbols up with `findSymbol`: the MatchingEngine, or the gateway's router.
+ * @throws std::invalid_argument for an unknown path, an invalid parameter or an unknown symbol.
+ */
+template <typename Symbols>
+FeedRequest ParseFeedRequest(const std::string& path, const FeedParams& params, const Symbols& symbols) {
+    auto param = [&](const char* name, const char* fallback) {
+        auto it = params.find(name);
+        return it != params.end() ? it->second : std::string(fallback);
+    };
+    FeedRequest request;
+    if (path == "/ws/trades") {
+        const std::string format = param("format", "trade");
+        if (format != "trade" && format != "batch") {
+            throw std::invalid_argument("format must be 'trade' or 'batch'.");
+        }
+        request.channel = (format == "batch") ? FeedChannel::TradeBatches : FeedChannel::Trades;
+    } else if (path == "/ws/marketdata") {
+        const std::string channel = param("channel", "l2update");
+        if (channel != "l2update" && channel != "l2delta" && channel != "bbo" && channel != "l3") {
+            throw std::invalid_argument("channel must be 'l2update', 'l2delta', 'bbo' or 'l3'.");
+        }
+        request.channel = channel == "l2delta" ? FeedChannel::MarketDataDeltas
+                          : channel == "bbo"   ? FeedChannel::Bbo
+                          : channel == "l3"    ? FeedChannel::OrderEvents
+                                               : FeedChannel::MarketData;
+    } else {
+        throw std::invalid_argument("There is no feed at '" + path + "'.");
+    }
+
+    // A whole number in [low, high], or -1.
+    auto number = [](const std::string& value, int low, int high) {
+        std::size_t used = 0;
+        int parsed = -1;
+        try {
+            parsed = std::stoi(value, &used);
+        } catch (const std::exception&) {
+            return -1;
+        }
+        return (used == value.size() && parsed >= low && parsed <= high) ? parsed : -1;
+    };
+
+    if (params.count("coalesce_ms") != 0) {
+        const int millis = number(param("coalesce_ms", ""), 0, kMaxCoalesceMillis);
+        if (millis < 0) {
+            throw std::invalid_argument("coalesce_ms must be between 0 and " + std::to_string(kMaxCoalesceMillis) + ".");
+        }
+        request.coalesce = std::chrono::milliseconds(millis);
+    }
+    if (params.count("symbols") != 0) {
+        const std::string list = param("symbols", "");
+        std::size_t begin = 0;
+        while (begin <= list.size()) {
+            std::size_t end = list.find(',', begin);
+            if (end == std::string::npos) {
+                end = list.size();
+            }
+            if (end > begin) {
+                request.filter.symbols.push_back(symbols.findSymbol(list.substr(begin, end - begin)));
+            }
+            begin = end + 1;
+        }
+        if (request.filter.symbols.empty()) {
+            throw std::invalid_argument("symbols must list at least one symbol.");
+        }
+    }
+    if (params.count("depth") != 0) {
+        if (request.channel != FeedChannel::MarketData) {
+            throw std::invalid_argument("depth is only supported on the l2update channel.");
+        }
+        request.filter.depth = number(param("depth", ""), 1, MatchingEngine::kMarketDataDepth);
+        if (request.filter.depth < 0) {
+            throw std::invalid_argument("depth must be between 1 and " + std::to_string(MatchingEngine::kMarketDataDepth) + ".");
+        }
+    }
+    return request;
+}
+
+/**
+ * @class FeedServer
+ * @brief Serves the SSE feeds on their own port from a few epoll threads (Linux only).
+ */
+class FeedServer {
+public:
+#if defined(__linux__)
+    static constexpr bool kSupported = true;
+#else
+    static constexpr bool kSupported = false;
+#endif
+
+    /**
+     * @brief Creates a feed server; call start() to begin accepting clients.
+     * @param engine The engine whose feeds are served. Must outlive the server.
+     * @param port The TCP port to listen on.
+     * @param threads The number of event loops (at least 1).
+     */
+    FeedServer(MatchingEngine& engine, std::uint16_t port, std::size_t threads)
+        : engine_(engine), port_(port), thread_count_(std::max<std::size_t>(threads, 1)) {}
+
+    FeedServer(const FeedServer&) = delete;
+    FeedServer& operator=(const FeedServer&) = delete;
+
+    ~FeedServer() { stop(); }
+
+#if defined(__linux__)
+    /**
+     * @brief Binds the port and starts the event loops.
+     * @throws std::runtime_error if the port cannot be bound or a loop cannot be set up.
+     */
+    void start() {
+        listener_ = ::socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, IPPROTO_TCP);
+        if (listener_ < 0) {
+            throw std::runtime_error("Could not create the feed server socket.");
+        }
+        int reuse = 1;
+        ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port_);
+        if (::bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener_, SOMAXCONN) != 0) {
+            ::close(listener_);
+            listener_ = -1;
+            throw std::runtime_error("Could not listen on port " + std::to_string(port_) + " for the feed server.");
+        }
+
+        running_.store(true, std::memory_order_release);
+        try {
+            for (std::size_t i = 0; i < thread_count_; ++i) {
+                loops_.push_back(std::make_unique<Loop>(*this));
+            }
+        } catch (...) {
+            stop();
+            throw;
+        }
+        for (auto& loop : loops_) {
+            loop->start();
+        }
+    }
+
+    /** @brief Disconnects every client and stops the event loops. */
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        for (auto& loop : loops_) {
+            loop->stop();
+        }
+        loops_.clear();
+        ::close(listener_);
+        listener_ = -1;
+    }
+#else
+    void start() { throw std::runtime_error("The feed server needs epoll, which is only available on Linux."); }
+    void stop() {}
+#endif
+
+    /** @brief The number of clients connected right now. */
+    std::size_t clientCount() const { return this->clients_.load(std::memory_order_relaxed); }
+
+private:
+    MatchingEngine& engine_;
+    const std::uint16_t port_;
+    const std::size_t thread_count_;
+    std::atomic<bool> running_{false};
+    std::atomic<std::size_t> clients_{0};
+
+#if defined(__linux__)
+    // Limits on what a client may send: a feed request is a single GET with no body.
+    static constexpr std::size_t kMaxRequestBytes = 8 * 1024;
+    static constexpr std::chrono::seconds kRequestTimeout{10};
+    // A client with this much still unwritten is not sent more until it catches up; meanwhile its
+    // subscriber queue fills and drops messages, as for a slow client of the HTTP server.
+    static constexpr std::size_t kMaxUnwrittenBytes = 1024 * 1024;
+    static constexpr int kMaxIovecs = 64;
+
+    int listener_ = -1;
+
+    /**
+     * @class Loop
+     * @brief One event-loop thread and the connections it accepted.
+     */
+    class Loop {
+    public:
+        explicit Loop(FeedServer& server) : server_(server) {
+            epoll_ = ::epoll_create1(EPOLL_CLOEXEC);
+            wakeup_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+            if (epoll_ < 0 || wakeup_ < 0) {
+                closeFds();
+                throw std::runtime_error("Could not create the feed server's event loop.");
+            }
+            // Every loop waits on the shared listener; EPOLLEXCLUSIVE wakes only one of them per client.
+            epoll_event listen_event{};
+            listen_event.events = EPOLLIN | EPOLLEXCLUSIVE;
+            listen_event.data.u64 = kListenerId;
+            epoll_event wakeup_event{};
+            wakeup_event.events = EPOLLIN;
+            wakeup_event.data.u64 = kWakeupId;
+            if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, server_.listener_, &listen_event) != 0 ||
+                ::epoll_ctl(epoll_, EPOLL_CTL_ADD, wakeup_, &wakeup_event) != 0) {
+                closeFds();
+                throw std::runtime_error("Could not set up the feed server's event loop.");
+            }
+        }
+
+        Loop(const Loop&) = delete;
+        Loop& operator=(const Loop&) = delete;
+
+        ~Loop() {
+            stop();
+            closeFds();
+        }
+
+        void start() {
+            running_.store(true, std::memory_order_release);
+            thread_ = std::thread([this] { run(); });
+        }
+
+        void stop() {
+            running_.store(false, std::memory_order_release);
+            wake();
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+
+    private:
+        using Clock = std::chrono::steady_clock;
+        static constexpr std::uint64_t kListenerId = 0;
+        static constexpr std::uint64_t kWakeupId = 1;
+
+        /** @brief One client: first the request being read, then the stream being written. */
+        struct Connection {
+            int fd = -1;
+            std::string request;                    // The request received so far (before streaming).
+            std::shared_ptr<Subscriber> subscriber; // Set once streaming.
+            std::chrono::milliseconds coalesce{0};
+            std::deque<Payload> unwritten;          // Taken from the subscriber, not yet fully written.
+            std::size_t offset = 0;                 // Bytes of unwritten.front() already written.
+            std::size_t unwrittenBytes = 0;
+            Clock::time_point deadline = Clock::time_point::max(); // When to flush (or give up on the request).
+            bool waitingForWritable = false;
+            bool closeWhenWritten = false;          // An error response: close once it is out.
+        };
+
+        FeedServer& server_;
+        int epoll_ = -1;
+        int wakeup_ = -1;
+        std::thread thread_;
+        std::atomic<bool> running_{false};
+
+        // Owned by the loop thread.
+        std::unordered_map<std::uint64_t, Connection> connections_;
+        std::uint64_t next_id_ = kWakeupId + 1;
+
+        // Connections whose subscribers have messages waiting, filled by the Publisher's thread.
+        std::mutex ready_mtx_;
+        std::vector<std::uint64_t> ready_;
+
+        void closeFds() {
+            if (epoll_ >= 0) ::close(epoll_);
+            if (wakeup_ >= 0) ::close(wakeup_);
+            epoll_ = wakeup_ = -1;
+        }
+
+        void wake() {
+            const std::uint64_t one = 1;
+            [[maybe_unused]] ssize_t written = ::write(wakeup_, &one, sizeof(one));
+        }
+
+        /** @brief Called on the Publisher's thread when a connection's subscriber has new messages. */
+        void notify(std::uint64_t id) {
+            bool first = false;
+            {
+                std::lock_guard<std::mutex> lock(ready_mtx_);
+                first = ready_.empty();
+                ready_.push_back(id);
+            }
+            if (first) {
+                wake(); // Later notifications find the loop already woken up.
+            }
+        }
+
+        void run() {
+            std::vector<epoll_event> events(256);
+            std::vector<std::uint64_t> ready;
+            while (running_.load(std::memory_order_acquire)) {
+                const int count = ::epoll_wait(epoll_, events.data(), static_cast<int>(events.size()), timeoutMillis());
+                for (int i = 0; i < count; ++i) {
+                    const std::uint64_t id = events[i].data.u64;
+                    if (id == kListenerId) {
+                        acceptClients();
+                    } else if (id == kWakeupId) {
+                        std::uint64_t value;
+                        [[maybe_unused]] ssize_t got = ::read(wakeup_, &value, sizeof(value));
+                    } else {
+                        handleEvent(id, events[i].events);
+                    }
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(ready_mtx_);
+                    ready.swap(ready_);
+                }
+                for (std::uint64_t id : ready) {
+                    auto it = connections_.find(id);
+                    if (it != connections_.end()) {
+                        drain(id, it->second);
+                    }
+                }
+                ready.clear();
+                expireDeadlines();
+            }
+            while (!connections_.empty()) {
+                close(connections_.begin()->first);
+            }
+        }
+
+        /** @brief Until the earliest deadline of any connection, or indefinitely (until woken) without one. */
+        int timeoutMillis() const {
+            Clock::time_point earliest = Clock::time_point::max();
+            for (const auto& [id, connection] : connections_) {
+                earliest = std::min(earliest, connection.deadline);
+            }
+            if (earliest == Clock::time_point::max()) {
+                return -1;
+            }
+            const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(earliest - Clock::now()).count();
+            return static_cast<int>(std::max<std::int64_t>(left + 1, 0));
+        }
+
+        void expireDeadlines() {
+            const Clock::time_point now = Clock::now();
+            std::vector<std::uint64_t> expired;
+            for (const auto& [id, connection] : connections_) {
+                if (connection.deadline <= now) {
+                    expired.push_back(id);
+                }
+            }
+            for (std::uint64_t id : expired) {
+                Connection& connection = connections_.at(id);
+                connection.deadline = Clock::time_point::max();
+                if (!connection.subscriber) {
+                    close(id); // Never sent a complete request.
+                } else {
+                    flush(id, connection);
+                }
+            }
+        }
+
+        void acceptClients() {
+            while (true) {
+                const int fd = ::accept4(server_.listener_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if (fd < 0) {
+                    return; // EAGAIN: another loop took it, or there is nobody left to accept.
+                }
+                int nodelay = 1;
+                ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+                const std::uint64_t id = next_id_++;
+                epoll_event event{};
+                event.events = EPOLLIN | EPOLLRDHUP;
+                event.data.u64 = id;
+                if (::epoll_ctl(epoll_, EPOLL_CTL_ADD, fd, &event) != 0) {
+                    ::close(fd);
+                    continue;
+                }
+                Connection& connection = connections_[id];
+                connection.fd = fd;
+                connection.deadline = Clock::now() + kRequestTimeout;
+                server_.clients_.fetch_add(1, std::memory_order_relaxed);
+            }
+        }
+
+        void handleEvent(std::uint64_t id, std::uint32_t events) {
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                return;
+            }
+            Connection& connection = it->second;
+            if (events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {
+                close(id);
+                return;
+            }
+            if (events & EPOLLIN) {
+                if (!readRequest(id, connection)) {
+                    return; // Closed.
+                }
+            }
+            if ((events & EPOLLOUT) && connections_.count(id) != 0) {
+                flush(id, connection);
+            }
+        }
+
+        /** @brief Reads what the client sent. Returns false if the connection was closed. */
+        bool readRequest(std::uint64_t id, Connection& connection) {
+            char buffer[4096];
+            while (true) {
+                const ssize_t received = ::read(connection.fd, buffer, sizeof(buffer));
+                if (received == 0 || (received < 0 && errno != EAGAIN && errno != EINTR)) {
+                    close(id);
+                    return false;
+                }
+                if (received < 0) {
+                    break;
+                }
+                if (connection.subscriber || connection.closeWhenWritten) {
+                    continue; // Anything a streaming client sends is ignored.
+                }
+                connection.request.append(buffer, static_cast<std::size_t>(received));
+                if (connection.request.size() > kMaxRequestBytes) {
+                    respondWithError(id, connection, 431, "Request Header Fields Too Large", "The request is too large.");
+                    return connections_.count(id) != 0;
+                }
+            }
+            if (!connection.subscriber && !connection.closeWhenWritten &&
+                connection.request.find("\r\n\r\n") != std::string::npos) {
+                startStreaming(id, connection);
+            }
+            return connections_.count(id) != 0;
+        }
+
+        /** @brief Interprets the complete request and, if it is valid, subscribes the client. */
+        void startStreaming(std::uint64_t id, Connection& connection) {
+            const std::string line = connection.request.substr(0, connection.request.find("\r\n"));
+            const std::size_t method_end = line.find(' ');
+            const std::size_t target_end = line.find(' ', method_end + 1);
+            if (method_end == std::string::npos || target_end == std::string::npos) {
+                respondWithError(id, connection, 400, "Bad Request", "Malformed request line.");
+                return;
+            }
+            if (line.compare(0, method_end, "GET") != 0) {
+                respondWithError(id, connection, 405, "Method Not Allowed", "Only GET is supported on the feed port.");
+                return;
+            }
+            const std::string target = line.substr(method_end + 1, target_end - method_end - 1);
+            const std::size_t query_start = target.find('?');
+            const std::string path = target.substr(0, query_start);
+            if (path != "/ws/trades" && path != "/ws/marketdata") {
+                respondWithError(id, connection, 404, "Not Found", "There is no feed at '" + path + "'.");
+                return;
+            }
+
+            FeedRequest request;
+            try {
+                request = ParseFeedRequest(path, parseQuery(query_start == std::string::npos ? "" : target.substr(query_start + 1)),
+                                           server_.engine_);
+                connection.subscriber = server_.engine_.subscribe(request.channel, request.filter, [this, id] { notify(id); });
+            } catch (const std::exception& e) {
+                respondWithError(id, connection, 400, "Bad Request", e.what());
+                return;
+            }
+            connection.coalesce = request.coalesce;
+            connection.request.clear();
+            connection.request.shrink_to_fit();
+            connection.deadline = Clock::time_point::max();
+            LOG_INFO("New client connected to {} on the feed port.", path);
+
+            static const Payload kHeaders = std::make_shared<const std::string>(
+                "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+                "Access-Control-Allow-Origin: *\r\nConnection: close\r\n\r\n");
+            enqueue(connection, kHeaders);
+            flush(id, connection); // Along with any messages queued before the notifier could reach us.
+        }
+
+        void respondWithError(std::uint64_t id, Connection& connection, int status, const char* reason,
+                              const std::string& message) {
+            nlohmann::json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = message;
+            const std::string body = error_response.dump(2);
+            enqueue(connection, std::make_shared<const std::string>(
+                                    "HTTP/1.1 " + std::to_string(status) + " " + reason +
+                                    "\r\nContent-Type: application/json\r\nAccess-Control-Allow-Origin: *\r\nContent-Length: " +
+                                    std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body));
+            connection.closeWhenWritten = true;
+            connection.deadline = Clock::time_point::max();
+            flush(id, connection);
+        }
+
+        /** @brief Takes the subscriber's waiting messages and writes them, now or when the coalescing window ends. */
+        void drain(std::uint64_t id, Connection& connection) {
+            Payload payload;
+            while (connection.subscriber && !connection.waitingForWritable) {
+                while (connection.unwrittenBytes < kMaxUnwrittenBytes && connection.subscriber->tryPop(payload)) {
+                    enqueue(connection, std::move(payload));
+                }
+                if (connection.unwritten.empty()) {
+                    return;
+                }
+                if (connection.coalesce.count() != 0 && connection.unwrittenBytes < kMaxCoalescedBytes) {
+                    if (connection.deadline == Clock::time_point::max()) {
+                        connection.deadline = Clock::now() + connection.coalesce;
+                    }
+                    return;
+                }
+                if (!write(id, connection)) {
+                    return; // Closed.
+                }
+            }
+            // Otherwise the socket is full and EPOLLOUT resumes the writing.
+        }
+
+        void enqueue(Connection& connection, Payload payload) {
+            connection.unwrittenBytes += payload->size();
+            connection.unwritten.push_back(std::move(payload));
+        }
+
+        /** @brief Writes what is pending, then keeps up with the subscriber. */
+        void flush(std::uint64_t id, Connection& connection) {
+            if (write(id, connection)) {
+                drain(id, connection); // Anything that was held back while we were behind.
+            }
+        }
+
+        /**
+         * @brief Writes as much as the socket takes, in as few system calls as possible.
+         * @return False if the connection was closed.
+         */
+        bool write(std::uint64_t id, Connection& connection) {
+            if (connection.subscriber) {
+                connection.deadline = Clock::time_point::max(); // Whatever was being coalesced goes out now.
+            }
+            while (!connection.unwritten.empty()) {
+                iovec iov[kMaxIovecs];
+                int count = 0;
+                for (auto it = connection.unwritten.begin(); it != connection.unwritten.end() && count < kMaxIovecs; ++it, ++count) {
+                    const std::size_t skip = (count == 0) ? connection.offset : 0;
+                    iov[count].iov_base = const_cast<char*>((*it)->data() + skip);
+                    iov[count].iov_len = (*it)->size() - skip;
+                }
+                const std::uint64_t write_start = Tsc::now();
+                const ssize_t written = ::writev(connection.fd, iov, count);
+                server_.engine_.metrics().sharedStage(Stage::Write).record(Tsc::toNanos(Tsc::now() - write_start));
+                if (written < 0) {
+                    if (errno == EAGAIN || errno == EINTR) {
+                        waitForWritable(id, connection, true);
+                        return true;
+                    }
+                    close(id);
+                    return false;
+                }
+                std::size_t left = static_cast<std::size_t>(written);
+                connection.unwrittenBytes -= left;
+                while (left > 0) {
+                    const std::size_t rest = connection.unwritten.front()->size() - connection.offset;
+                    if (left < rest) {
+                        connection.offset += left;
+                        break;
+                    }
+                    left -= rest;
+                    connection.offset = 0;
+                    connection.unwritten.pop_front();
+                }
+            }
+            waitForWritable(id, connection, false);
+            if (connection.closeWhenWritten) {
+                close(id);
+                return false;
+            }
+            return true;
+        }
+
+        void waitForWritable(std::uint64_t id, Connection& connection, bool wait) {
+            if (connection.waitingForWritable == wait) {
+                return;
+            }
+            connection.waitingForWritable = wait;
+            epoll_event event{};
+            event.events = EPOLLIN | EPOLLRDHUP | (wait ? EPOLLOUT : 0u);
+            event.data.u64 = id;
+            ::epoll_ctl(epoll_, EPOLL_CTL_MOD, connection.fd, &event);
+        }
+
+        void close(std::uint64_t id) {
+            auto it = connections_.find(id);
+            if (it == connections_.end()) {
+                return;
+            }
+            if (it->second.subscriber) {
+                server_.engine_.unsubscribe(it->second.subscriber); // No notification can arrive after this.
+                LOG_INFO("Feed port client disconnected.");
+            }
+            ::epoll_ctl(epoll_, EPOLL_CTL_DEL, it->second.fd, nullptr);
+            ::close(it->second.fd);
+            connections_.erase(it);
+            server_.clients_.fetch_sub(1, std::memory_order_relaxed);
+        }
+
+        /** @brief Splits a query string into its percent-decoded parameters. */
+        static FeedParams parseQuery(const std::string& query) {
+            FeedParams params;
+            std::size_t begin = 0;
+            while (begin < query.size()) {
+                std::size_t end = query.find('&', begin);
+                if (end == std::string::npos) {
+                    end = query.size();
+                }
+                const std::string pair = query.substr(begin, end - begin);
+                const std::size_t equals = pair.find('=');
+                if (!pair.empty()) {
+                    params.emplace(decode(pair.substr(0, equals)),
+                                   equals == std::string::npos ? std::string() : decode(pair.substr(equals + 1)));
+                }
+                begin = end + 1;
+            }
+            return params;
+        }
+
+        static std::string decode(const std::string& text) {
+            auto hex = [](char c) {
+                return (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            };
+            std::string decoded;
+            for (std::size_t i = 0; i < text.size(); ++i) {
+                if (text[i] == '+') {
+                    decoded += ' ';
+                } else if (text[i] == '%' && i + 2 < text.size() && hex(text[i + 1]) >= 0 && hex(text[i + 2]) >= 0) {
+                    decoded += static_cast<char>(hex(text[i + 1]) * 16 + hex(text[i + 2]));
+                    i += 2;
+                } else {
+                    decoded += text[i];
+                }
+            }
+            return decoded;
+        }
+    };
+
+    std::vector<std::unique_ptr<Loop>> loops_;
+#endif
+};
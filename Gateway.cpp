@@ -0,0 +1,399 @@
+/**
+ * @file Gateway.cpp
+ * @brief Entry point of the routing gateway, which serves the engine's REST API and feeds in front of several engine nodes.
+ *
+ * The gateway holds no books. It parses and validates each request exactly like the engine's
+ * own HTTP server (see HttpCommon.h), converts it to the ticks and lots of its symbol, and sends
+ * it to the node that owns the symbol over the persistent binary links of a NodeRouter. Feed
+ * clients get the feeds of every node they need merged into one stream by a FeedRelay.
+ */
+
+#include <atomic>    // For counting the feed clients
+#include <iostream>
+#include <limits>    // For the largest account ID
+#include <memory>    // For std::shared_ptr
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>   // For std::pair
+#include <vector>
+
+#include "httplib.h"
+#include "json.hpp"
+#include "HttpCommon.h" // The order parsing and feed streaming shared with the engine's server
+#include "Logger.h"
+#include "NodeRouter.h"
+
+using json = nlohmann::json;
+
+// --- Command-Line Options ---
+
+/**
+ * @struct GatewayOptions
+ * @brief The configuration of the gateway, taken from the command line.
+ */
+struct GatewayOptions {
+    std::vector<NodeAddress> nodes; // --nodes HOST:HTTP:BINARY:FEED,...: the engine nodes, in any order.
+    std::size_t links = 4;          // --links N: the binary sessions opened to each node.
+    int http_port = 8080;           // --http-port P: the port the gateway serves the REST API and feeds on.
+    LogLevel log_level = LogLevel::Info; // --log-level L: debug, info, warn, error or off.
+};
+
+/**
+ * @brief Reads one `HOST:HTTP_PORT:BINARY_PORT:FEED_PORT` node address.
+ * @throws std::invalid_argument if it is malformed.
+ */
+NodeAddress ParseNodeAddress(const std::string& value) {
+    std::vector<std::string> fields;
+    std::size_t begin = 0;
+    while (true) {
+        const std::size_t colon = value.find(':', begin);
+        fields.push_back(value.substr(begin, colon - begin));
+        if (colon == std::string::npos) {
+            break;
+        }
+        begin = colon + 1;
+    }
+    auto port = [&](const std::string& field) {
+        int parsed = 0;
+        try {
+            std::size_t used = 0;
+            parsed = std::stoi(field, &used);
+            parsed = (used == field.size()) ? parsed : 0;
+        } catch (const std::exception&) {
+        }
+        if (parsed <= 0 || parsed > 65535) {
+            throw std::invalid_argument("Invalid node '" + value + "'; expected HOST:HTTP_PORT:BINARY_PORT:FEED_PORT.");
+        }
+        return static_cast<std::uint16_t>(parsed);
+    };
+    if (fields.size() != 4 || fields[0].empty()) {
+        port(""); // Throws.
+    }
+    NodeAddress address;
+    address.host = fields[0];
+    address.httpPort = port(fields[1]);
+    address.binaryPort = port(fields[2]);
+    address.feedPort = port(fields[3]);
+    return address;
+}
+
+/**
+ * @brief Parses the command-line arguments into GatewayOptions.
+ * @throws std::invalid_argument on an unknown flag or a missing/invalid value.
+ */
+GatewayOptions ParseOptions(int argc, char* argv[]) {
+    GatewayOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for option '" + flag + "'.");
+        }
+        std::string value = argv[++i];
+        if (flag == "--nodes") {
+            std::size_t begin = 0;
+            while (begin <= value.size()) {
+                std::size_t end = value.find(',', begin);
+                if (end == std::string::npos) {
+                    end = value.size();
+                }
+                options.nodes.push_back(ParseNodeAddress(value.substr(begin, end - begin)));
+                begin = end + 1;
+            }
+        } else if (flag == "--links") {
+            options.links = std::stoul(value);
+            if (options.links == 0) {
+                throw std::invalid_argument("Invalid number of links '" + value + "'.");
+            }
+        } else if (flag == "--http-port") {
+            options.http_port = std::stoi(value);
+            if (options.http_port <= 0 || options.http_port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+        } else if (flag == "--log-level") {
+            options.log_level = ParseLogLevel(value);
+        } else {
+            throw std::invalid_argument("Unknown option '" + flag + "'.");
+        }
+    }
+    if (options.nodes.empty()) {
+        throw std::invalid_argument("--nodes is required.");
+    }
+    return options;
+}
+
+/** @brief Fills in the error response every handler sends for a request it could not carry out. */
+void SetError(httplib::Response& res, int status, const std::string& message) {
+    res.status = status;
+    json error_response;
+    error_response["status"] = "Error";
+    error_response["message"] = message;
+    res.set_content(error_response.dump(2), "application/json");
+}
+
+/** @brief The message for a request a node answered with Rejected, which carries no reason. */
+const char* const kRejectedByNode = "Rejected by the engine node (e.g. by a risk check or an invalid combination of fields).";
+
+// --- Main Gateway Application ---
+
+int main(int argc, char* argv[]) {
+    GatewayOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: engine_gateway --nodes HOST:HTTP_PORT:BINARY_PORT:FEED_PORT[,...] [--links N]"
+                     " [--http-port PORT] [--log-level LEVEL]" << std::endl;
+        return 1;
+    }
+    Logger::instance().setLevel(options.log_level);
+
+    // --- Learn which node owns which symbols ---
+    NodeRouter router(options.nodes.size(), options.links);
+    try {
+        for (const NodeAddress& address : options.nodes) {
+            router.addNode(address);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    std::cout << "Routing " << router.symbolCount() << " symbol(s) to " << router.nodeCount() << " engine node(s)"
+              << " over " << options.links << " link(s) each." << std::endl;
+
+    httplib::Server svr;
+
+    svr.set_pre_routing_handler([](const httplib::Request&, httplib::Response& res) {
+        res.set_header("Access-Control-Allow-Origin", "*");
+        res.set_header("Access-Control-Allow-Methods", "POST, GET, PATCH, DELETE, OPTIONS");
+        res.set_header("Access-Control-Allow-Headers", "Content-Type");
+        return httplib::Server::HandlerResponse::Unhandled;
+    });
+    svr.Options("/(.*)", [](const httplib::Request&, httplib::Response& res) {
+        res.status = 204;
+    });
+
+    // --- POST /order: the same body as the engine's, sent to the node of its symbol ---
+    auto order_handler = [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            auto j = json::parse(req.body);
+            OrderType type = StringToOrderType(j.at("order_type"));
+            Side side = StringToSide(j.at("side"));
+            SymbolId symbol_id = router.findSymbol(j.at("symbol"));
+            const Instrument& instrument = router.route(symbol_id).instrument;
+            Quantity quantity = instrument.toLots(j.at("quantity").get<double>());
+            Price price = instrument.toTicks(j.value("price", 0.0));
+            OrderOptions order_options = ParseOrderOptions(j, type, instrument);
+
+            const NodeAck ack = router.newOrder(symbol_id, type, side, quantity, price, order_options).get();
+            if (ack.status != binary::AckStatus::Accepted) {
+                SetError(res, 400, kRejectedByNode);
+                return;
+            }
+            json response_json;
+            response_json["status"] = "Order Received";
+            response_json["order_id"] = ack.orderId;
+            res.set_content(response_json.dump(2), "application/json");
+        } catch (const std::runtime_error& e) {
+            SetError(res, 503, e.what()); // The node could not be reached.
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
+        }
+    };
+    svr.Post("/order", order_handler);
+    svr.Post("/order/", order_handler);
+
+    // --- DELETE /order/{id}: sent to the node that created the order ---
+    svr.Delete(R"(/order/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            OrderId order_id = std::stoull(req.matches[1].str());
+            const NodeAck ack = router.cancel(order_id).get();
+            if (ack.status != binary::AckStatus::Accepted) {
+                SetError(res, 404, "Order " + std::to_string(order_id) + " is not resting on any book.");
+                return;
+            }
+            json response_json;
+            response_json["status"] = "Order Cancelled";
+            response_json["order_id"] = order_id;
+            res.set_content(response_json.dump(2), "application/json");
+        } catch (const std::runtime_error& e) {
+            SetError(res, 503, e.what());
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+        }
+    });
+
+    // --- PATCH /order/{id}: as on the engine, but the body must also name the order's "symbol" ---
+    // The node takes the new price and quantity in the symbol's ticks and lots, and the gateway
+    // does not remember which symbol each order is for.
+    svr.Patch(R"(/order/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            OrderId order_id = std::stoull(req.matches[1].str());
+            auto j = json::parse(req.body);
+            if (!j.contains("symbol")) {
+                throw std::invalid_argument("A modify sent to the gateway needs the order's 'symbol'.");
+            }
+            const NodeRouter::Route& route = router.route(router.findSymbol(j.at("symbol")));
+            std::optional<Price> price;
+            std::optional<Quantity> quantity;
+            if (j.contains("price")) price = route.instrument.toTicks(j.at("price").get<double>());
+            if (j.contains("quantity")) quantity = route.instrument.toLots(j.at("quantity").get<double>());
+
+            const NodeAck ack = (route.node == router.nodeOf(order_id)) ? router.modify(order_id, price, quantity).get()
+                                                                         : NodeAck{binary::AckStatus::NotFound, order_id};
+            json response_json;
+            switch (ack.status) {
+                case binary::AckStatus::Accepted:
+                case binary::AckStatus::Replaced:
+                    response_json["status"] = "Order Modified";
+                    response_json["order_id"] = order_id;
+                    response_json["priority"] = (ack.status == binary::AckStatus::Accepted) ? "kept" : "lost";
+                    break;
+                case binary::AckStatus::NotFound:
+                    SetError(res, 404, "Order " + std::to_string(order_id) + " is not resting on any book.");
+                    return;
+                case binary::AckStatus::Rejected:
+                    SetError(res, 400, kRejectedByNode);
+                    return;
+            }
+            res.set_content(response_json.dump(2), "application/json");
+        } catch (const std::runtime_error& e) {
+            SetError(res, 503, e.what());
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
+        }
+    });
+
+    // --- DELETE /orders?account=N[&symbol=S]: sent to the symbol's node, or to every node at once ---
+    // Nodes only report how many orders they cancelled, so the response has a count instead of the IDs.
+    svr.Delete("/orders", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            if (!req.has_param("account")) {
+                throw std::invalid_argument("A mass cancel needs an 'account'.");
+            }
+            const unsigned long account = std::stoul(req.get_param_value("account"));
+            if (account == kNoAccount || account > std::numeric_limits<AccountId>::max()) {
+                throw std::invalid_argument("'account' must be between 1 and 4294967295.");
+            }
+            std::optional<SymbolId> symbol;
+            if (req.has_param("symbol")) {
+                symbol = router.findSymbol(req.get_param_value("symbol"));
+            }
+            json response_json;
+            response_json["status"] = "Orders Cancelled";
+            response_json["cancelled_count"] = router.massCancel(static_cast<AccountId>(account), symbol);
+            res.set_content(response_json.dump(2), "application/json");
+        } catch (const std::runtime_error& e) {
+            SetError(res, 503, e.what());
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+        }
+    });
+
+    // --- GET /symbols: every node's symbols, with the node that trades each ---
+    svr.Get("/symbols", [&](const httplib::Request&, httplib::Response& res) {
+        json symbols_json = json::array();
+        for (std::size_t id = 0; id < router.symbolCount(); ++id) {
+            const NodeRouter::Route& route = router.route(static_cast<SymbolId>(id));
+            symbols_json.push_back({{"symbol", route.name},
+                                    {"symbol_id", id},
+                                    {"tick_size", route.instrument.getTickSize()},
+                                    {"lot_size", route.instrument.getLotSize()},
+                                    {"node", route.node}});
+        }
+        res.set_content(symbols_json.dump(2), "application/json");
+    });
+
+    // --- GET /book, /bbo, /trades and /candles/{symbol}: forwarded to the symbol's node ---
+    auto book_handler = [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            const NodeAddress& address = router.address(router.route(router.findSymbol(req.matches[1].str())).node);
+            httplib::Client client(address.host, address.httpPort);
+            httplib::Result result = client.Get(req.path, req.params, httplib::Headers());
+            if (!result) {
+                throw std::runtime_error("Could not reach the engine node " + address.host + ":" +
+                                         std::to_string(address.httpPort) + ".");
+            }
+            res.status = result->status;
+            res.set_content(result->body, "application/json");
+        } catch (const std::runtime_error& e) {
+            SetError(res, 503, e.what());
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+        }
+    };
+    svr.Get(R"(/book/([^/]+))", book_handler);
+    svr.Get(R"(/bbo/([^/]+))", book_handler);
+    svr.Get(R"(/trades/([^/]+))", book_handler);
+    svr.Get(R"(/candles/([^/]+))", book_handler);
+
+    // --- GET /ws/trades and GET /ws/marketdata: the same feeds as the engine's, merged from the nodes ---
+    // Every client is relayed the requested feed of each node that trades one of its symbols
+    // (all nodes without `symbols`), so it holds one HTTP thread here and one connection per node.
+    const int kMaxFeedClients = static_cast<int>(CPPHTTPLIB_THREAD_POOL_COUNT / 2);
+    auto feed_clients = std::make_shared<std::atomic<int>>(0);
+    auto feed_handler = [&router, kMaxFeedClients, feed_clients](const httplib::Request& req, httplib::Response& res) {
+        FeedRequest feed;
+        try {
+            feed = ParseFeedRequest(req.path, req.params, router);
+        } catch (const std::exception& e) {
+            SetError(res, 400, e.what());
+            return;
+        }
+        if (feed_clients->fetch_add(1) >= kMaxFeedClients) {
+            feed_clients->fetch_sub(1);
+            SetError(res, 503, "Too many feed clients.");
+            return;
+        }
+
+        // The nodes' feeds are asked for the same channel; the symbols are split by node, and the
+        // messages are coalesced here, at the edge.
+        httplib::Params upstream_params;
+        for (const auto& param : req.params) {
+            if (param.first != "symbols" && param.first != "coalesce_ms") {
+                upstream_params.insert(param);
+            }
+        }
+        std::vector<std::string> node_symbols(router.nodeCount());
+        for (SymbolId symbol : feed.filter.symbols) {
+            const NodeRouter::Route& route = router.route(symbol);
+            node_symbols[route.node] += (node_symbols[route.node].empty() ? "" : ",") + route.name;
+        }
+        std::vector<std::pair<std::size_t, std::string>> upstreams;
+        for (std::size_t node = 0; node < router.nodeCount(); ++node) {
+            if (router.symbolsOf(node).empty() || (!feed.filter.symbols.empty() && node_symbols[node].empty())) {
+                continue;
+            }
+            httplib::Params params = upstream_params;
+            if (!node_symbols[node].empty()) {
+                params.emplace("symbols", node_symbols[node]);
+            }
+            const std::string query = httplib::detail::params_to_query_str(params);
+            upstreams.emplace_back(node, req.path + (query.empty() ? "" : "?" + query));
+        }
+
+        const std::string path = req.path;
+        res.set_chunked_content_provider("text/event-stream",
+            [&router, feed, path, upstreams](size_t, httplib::DataSink& sink) {
+                LOG_INFO("New client connected to {}.", path);
+                Subscriber subscriber(feed.channel);
+                FeedRelay relay(router, subscriber, upstreams);
+                relay.start();
+                StreamFeed(subscriber, sink, nullptr, feed.coalesce);
+                relay.stop();
+                LOG_INFO("Feed client of {} disconnected.", path);
+                return true;
+            },
+            [feed_clients](bool) { feed_clients->fetch_sub(1); }
+        );
+    };
+    svr.Get("/ws/trades", feed_handler);
+    svr.Get("/ws/marketdata", feed_handler);
+
+    std::cout << "Gateway listening on http://localhost:" << options.http_port << std::endl;
+    svr.listen("0.0.0.0", options.http_port);
+
+    return 0;
+}
@@ -0,0 +1,119 @@
+/**
+ * @file Histogram.h
+ * @brief Defines the Histogram class, a fixed-size latency histogram in the style of HdrHistogram.
+ *
+ * Recording a latency must cost next to nothing and never allocate, yet the tail (p99.9, max)
+ * is what matters, so values cannot simply be averaged or sampled. The histogram uses
+ * log-linear buckets instead: every power of two is split into the same number of linear
+ * sub-buckets, which bounds the relative error of any reported value (below 1% here) over the
+ * whole 64-bit range with a few thousand counters.
+ */
+
+#pragma once
+
+#include <algorithm> // For std::min, std::max
+#include <array>
+#include <cstddef>   // For std::size_t
+#include <cstdint>
+#include <limits>
+
+/**
+ * @class Histogram
+ * @brief Counts non-negative integer values (e.g., latencies in nanoseconds) in log-linear buckets.
+ */
+class Histogram {
+public:
+    /** @brief Records one occurrence of a value. O(1), no allocation. */
+    void record(std::uint64_t value) {
+        ++this->counts_[indexOf(value)];
+        ++this->count_;
+        this->sum_ += value;
+        this->min_ = std::min(this->min_, value);
+        this->max_ = std::max(this->max_, value);
+    }
+
+    /** @brief Adds every value recorded by another histogram. */
+    void merge(const Histogram& other) {
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            this->counts_[i] += other.counts_[i];
+        }
+        this->count_ += other.count_;
+        this->sum_ += other.sum_;
+        this->min_ = std::min(this->min_, other.min_);
+        this->max_ = std::max(this->max_, other.max_);
+    }
+
+    /** @brief Forgets every recorded value. */
+    void reset() { *this = Histogram(); }
+
+    std::uint64_t count() const { return this->count_; }
+    std::uint64_t min() const { return this->count_ == 0 ? 0 : this->min_; }
+    std::uint64_t max() const { return this->max_; }
+    double mean() const { return this->count_ == 0 ? 0.0 : static_cast<double>(this->sum_) / this->count_; }
+
+    /**
+     * @brief The value at or below which `percentile` percent of the recorded values lie.
+     * Reported as the highest value of its bucket (never above the maximum recorded), so it
+     * overstates the true percentile by less than the bucket resolution and never understates it.
+     * @param percentile In [0, 100], e.g. 99.9.
+     */
+    std::uint64_t percentile(double percentile) const {
+        if (this->count_ == 0) {
+            return 0;
+        }
+        const double clamped = std::min(std::max(percentile, 0.0), 100.0);
+        std::uint64_t rank = static_cast<std::uint64_t>(clamped / 100.0 * static_cast<double>(this->count_) + 0.5);
+        rank = std::max<std::uint64_t>(rank, 1);
+        std::uint64_t seen = 0;
+        for (std::size_t i = 0; i < kBucketCount; ++i) {
+            seen += this->counts_[i];
+            if (seen >= rank) {
+                return std::min(highestValueOf(i), this->max_);
+            }
+        }
+        return this->max_;
+    }
+
+private:
+    // Values below 2^kSubBucketBits get a bucket each; above that, every power of two is split
+    // into kHalf buckets, so a bucket is never wider than 1/kHalf of the values in it.
+    static constexpr unsigned kSubBucketBits = 7;
+    static constexpr std::uint64_t kSubBuckets = std::uint64_t{1} << kSubBucketBits;
+    static constexpr std::uint64_t kHalf = kSubBuckets / 2;
+    static constexpr std::size_t kBucketCount = (64 - kSubBucketBits) * kHalf + kSubBuckets;
+
+    std::array<std::uint64_t, kBucketCount> counts_{};
+    std::uint64_t count_ = 0;
+    std::uint64_t sum_ = 0;
+    std::uint64_t min_ = std::numeric_limits<std::uint64_t>::max();
+    std::uint64_t max_ = 0;
+
+    static unsigned highestBit(std::uint64_t value) {
+#if defined(_MSC_VER)
+        unsigned bit = 0;
+        while (value >>= 1) {
+            ++bit;
+        }
+        return bit;
+#else
+        return 63 - static_cast<unsigned>(__builtin_clzll(value));
+#endif
+    }
+
+    static std::size_t indexOf(std::uint64_t value) {
+        if (value < kSubBuckets) {
+            return static_cast<std::size_t>(value);
+        }
+        const unsigned shift = highestBit(value) - kSubBucketBits + 1; // value >> shift is in [kHalf, kSubBuckets).
+        return static_cast<std::size_t>(shift * kHalf + (value >> shift));
+    }
+
+    static std::uint64_t highestValueOf(std::size_t index) {
+        if (index < kSubBuckets) {
+            return index;
+        }
+        const unsigned shift = static_cast<unsigned>(index / kHalf - 1);
+        const std::uint64_t sub = index - shift * kHalf;
+        return ((sub + 1) << shift) - 1;
+    }
+};
@@ -0,0 +1,135 @@
+/**
+ * @file HttpCommon.h
+ * @brief The request parsing and feed streaming shared by the engine's HTTP server and the routing gateway.
+ *
+ * The gateway (Gateway.cpp) accepts exactly the order requests and feed subscriptions the
+ * engine's own server (main.cpp) does, so both validate them with these same functions.
+ */
+
+#pragma once
+
+#include <chrono>    // For the coalescing interval
+#include <cstdint>
+#include <limits>    // For the largest account ID
+#include <stdexcept> // For std::invalid_argument
+#include <string>
+
+#include "httplib.h"    // For httplib::DataSink
+#include "json.hpp"
+#include "Command.h"    // For OrderOptions
+#include "FeedServer.h" // For the most bytes a coalesced write carries
+#include "Instrument.h"
+#include "Metrics.h"    // For Tsc and LatencyHistogram
+#include "Order.h"
+#include "Publisher.h"  // For Subscriber
+
+// --- Helper Functions: Data Validation and Conversion ---
+
+/**
+ * @brief Converts a string to a Side enum.
+ * @param s The input string ("buy" or "sell").
+ * @return The corresponding Side enum value.
+ * @throws std::invalid_argument if the string is not a valid side.
+ */
+inline Side StringToSide(const std::string& s) {
+    if (s == "buy") return Side::Buy;
+    if (s == "sell") return Side::Sell;
+    throw std::invalid_argument("Invalid side specified: '" + s + "'. Must be 'buy' or 'sell'.");
+}
+
+/**
+ * @brief Converts a string to an OrderType enum.
+ * @param s The input string ("market", "limit", "ioc", "fok", "stop_market", "stop_limit").
+ * @return The corresponding OrderType enum value.
+ * @throws std::invalid_argument if the string is not a valid order type.
+ */
+inline OrderType StringToOrderType(const std::string& s) {
+    if (s == "market") return OrderType::Market;
+    if (s == "limit") return OrderType::Limit;
+    if (s == "ioc") return OrderType::IOC;
+    if (s == "fok") return OrderType::FOK;
+    if (s == "stop_market") return OrderType::StopMarket;
+    if (s == "stop_limit") return OrderType::StopLimit;
+    throw std::invalid_argument("Invalid order_type specified: '" + s + "'.");
+}
+
+/**
+ * @brief Converts a string to a SelfTradePrevention enum.
+ * @param s The input string ("none", "cancel_newest", "cancel_oldest").
+ * @throws std::invalid_argument if the string is not a valid mode.
+ */
+inline SelfTradePrevention StringToSelfTradePrevention(const std::string& s) {
+    if (s == "none") return SelfTradePrevention::None;
+    if (s == "cancel_newest") return SelfTradePrevention::CancelNewest;
+    if (s == "cancel_oldest") return SelfTradePrevention::CancelOldest;
+    throw std::invalid_argument("Invalid stp specified: '" + s + "'.");
+}
+
+/**
+ * @brief Reads the optional "stop_price", "account" and "stp" fields of an order.
+ * @throws std::invalid_argument if a stop order has no stop price or a field is invalid.
+ */
+inline OrderOptions ParseOrderOptions(const nlohmann::json& j, OrderType type, const Instrument& instrument) {
+    OrderOptions options;
+    if (type == OrderType::StopMarket || type == OrderType::StopLimit) {
+        if (!j.contains("stop_price")) {
+            throw std::invalid_argument("Stop orders need a 'stop_price'.");
+        }
+        options.stopPrice = instrument.toTicks(j.at("stop_price").get<double>());
+    }
+    if (j.contains("account")) {
+        const std::uint64_t account = j.at("account").get<std::uint64_t>();
+        if (account == kNoAccount || account > std::numeric_limits<AccountId>::max()) {
+            throw std::invalid_argument("'account' must be between 1 and " +
+                                        std::to_string(std::numeric_limits<AccountId>::max()) + ".");
+        }
+        options.account = static_cast<AccountId>(account);
+    }
+    if (j.contains("stp")) {
+        options.selfTradePrevention = StringToSelfTradePrevention(j.at("stp"));
+    }
+    return options;
+}
+
+// --- Feed Streaming ---
+
+/**
+ * @brief Streams a subscriber's messages to its client until the client disconnects.
+ * Runs on the client's own HTTP thread, so a slow connection only ever delays itself.
+ * @param writes If set, records how long each write took.
+ * @param coalesce If not zero, the messages that arrive within this long of the first one
+ *                 (up to kMaxCoalescedBytes) are sent in a single write, trading that much
+ *                 latency for far fewer writes and chunks when the feed is busy.
+ */
+inline void StreamFeed(Subscriber& subscriber, httplib::DataSink& sink, LatencyHistogram* writes,
+                       std::chrono::milliseconds coalesce = std::chrono::milliseconds(0)) {
+    Payload payload;
+    std::string coalesced;
+    while (sink.is_writable()) {
+        // Wake up at least once a second to notice a client that went away while the feed was quiet.
+        if (!subscriber.pop(payload, std::chrono::seconds(1))) {
+            continue;
+        }
+        const std::string* data = payload.get();
+        if (coalesce.count() != 0) {
+            coalesced.assign(*payload);
+            const auto deadline = std::chrono::steady_clock::now() + coalesce;
+            while (coalesced.size() < kMaxCoalescedBytes) {
+                const auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0 || !subscriber.pop(payload, left)) {
+                    break;
+                }
+                coalesced += *payload;
+            }
+            data = &coalesced;
+        }
+        const std::uint64_t write_start = Tsc::now();
+        const bool written = sink.write(data->data(), data->size());
+        if (writes != nullptr) {
+            writes->record(Tsc::toNanos(Tsc::now() - write_start));
+        }
+        if (!written) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,106 @@
+/**
+ * @file Instrument.h
+ * @brief Defines the Instrument class, which describes the tick and lot size of a trading symbol.
+ *
+ * Inside the engine every price is an integer number of ticks and every quantity is an
+ * integer number of lots. This keeps price levels exact (no two floating-point keys for
+ * one logical price) and lets the order book index its levels directly by tick.
+ * The Instrument is the single place where the human-facing decimal values used by the
+ * JSON API are converted to and from that fixed-point representation.
+ */
+
+#pragma once
+
+#include <cmath>     // For std::llround, std::fabs
+#include <stdexcept> // For std::invalid_argument
+#include <string>    // For std::to_string
+
+#include "Order.h"   // For the Price and Quantity type aliases.
+
+/**
+ * @class Instrument
+ * @brief The fixed-point configuration (tick size and lot size) of one trading symbol.
+ */
+class Instrument {
+public:
+    /**
+     * @brief Constructs a new Instrument.
+     * @param tickSize The smallest allowed price increment (e.g., 0.01 for cents).
+     * @param lotSize The smallest allowed quantity increment (e.g., 0.000001).
+     * @throws std::invalid_argument if either increment is not strictly positive.
+     */
+    explicit Instrument(double tickSize = 0.01, double lotSize = 0.000001) {
+        if (!(tickSize > 0) || !(lotSize > 0)) {
+            throw std::invalid_argument("Tick size and lot size must be positive.");
+        }
+        this->tickSize_ = tickSize;
+        this->lotSize_ = lotSize;
+        // For the usual decimal increments (0.01, 0.000001, ...) the reciprocal is an exact
+        // integer. Dividing by it instead of multiplying by the increment makes the conversion
+        // back to double correctly rounded, so 3000050 ticks prints as 30000.5 and not 30000.500000000004.
+        this->ticksPerUnit_ = exactReciprocal(tickSize);
+        this->lotsPerUnit_ = exactReciprocal(lotSize);
+    }
+
+    double getTickSize() const { return this->tickSize_; }
+    double getLotSize() const { return this->lotSize_; }
+
+    /** @brief How many ticks make one unit of price (e.g., 100 for a 0.01 tick), or 0 if that is not a whole number. */
+    double getTicksPerUnit() const { return this->ticksPerUnit_; }
+    /** @brief How many lots make one unit of quantity, or 0 if that is not a whole number. */
+    double getLotsPerUnit() const { return this->lotsPerUnit_; }
+
+    // --- Conversions between decimal values and fixed-point integers ---
+
+    /**
+     * @brief Converts a decimal price into ticks.
+     * @throws std::invalid_argument if the price is not a whole multiple of the tick size.
+     */
+    Price toTicks(double price) const {
+        return toUnits(price, this->tickSize_, this->ticksPerUnit_, "Price");
+    }
+
+    /**
+     * @brief Converts a decimal quantity into lots.
+     * @throws std::invalid_argument if the quantity is not a whole multiple of the lot size.
+     */
+    Quantity toLots(double quantity) const {
+        return toUnits(quantity, this->lotSize_, this->lotsPerUnit_, "Quantity");
+    }
+
+    double fromTicks(Price ticks) const { return fromUnits(ticks, this->tickSize_, this->ticksPerUnit_); }
+    double fromLots(Quantity lots) const { return fromUnits(lots, this->lotSize_, this->lotsPerUnit_); }
+
+private:
+    double tickSize_;
+    double lotSize_;
+    double ticksPerUnit_; // 1 / tickSize_ when that is a whole number, otherwise 0.
+    double lotsPerUnit_;  // 1 / lotSize_ when that is a whole number, otherwise 0.
+
+    static double exactReciprocal(double increment) {
+        double reciprocal = std::round(1.0 / increment);
+        if (reciprocal >= 1.0 && std::fabs(reciprocal * increment - 1.0) < 1e-12) {
+            return reciprocal;
+        }
+        return 0.0;
+    }
+
+    static std::int64_t toUnits(double value, double increment, double perUnit, const char* what) {
+        double scaled = (perUnit != 0.0) ? value * perUnit : value / increment;
+        double rounded = std::round(scaled);
+        // Allow for the representation error of the decimal input, but reject values that
+        // genuinely fall between two increments (e.g., a price of 100.005 with a 0.01 tick).
+        if (std::fabs(scaled - rounded) > 1e-9 + 1e-14 * std::fabs(scaled)) {
+            throw std::invalid_argument(std::string(what) + " " + std::to_string(value) +
+                                        " is not a multiple of " + std::to_string(increment) + ".");
+        }
+        return static_cast<std::int64_t>(std::llround(scaled));
+    }
+
+    static double fromUnits(std::int64_t units, double increment, double perUnit) {
+        if (perUnit != 0.0) {
+            return static_cast<double>(units) / perUnit;
+        }
+        return static_cast<double>(units) * increment;
+    }
+};
@@ -0,0 +1,435 @@
+/**
+ * @file Journal.h
+ * @brief Defines the Journal, an append-only, memory-mapped log of every accepted command.
+ *
+ * Matching is deterministic: the same commands applied to the same books in the same order
+ * produce the same trades, the same resting orders and the same IDs. So instead of saving
+ * the books, the engine writes every command it accepts to the journal before applying it,
+ * and on startup replays the journal to rebuild everything.
+ *
+ * The journal is a preallocated file of fixed-size, 64-byte records. A single atomic
+ * counter hands out both a record's global sequence number and its slot in the file, so
+ * the shards append concurrently without a lock: a record is written into the mapping
+ * with plain stores and published by storing its type byte last. Nothing on the matching
+ * path waits for the disk. A flusher thread makes the records durable in groups
+ * (one `msync` for everything written since the previous one) and the threads that
+ * acknowledge commands to clients wait until their records are durable.
+ *
+ * File layout: a 64-byte header ("CRYPTOJ1", format version, shard count, node count, node
+ * index) followed by the records; record n (sequence number n) lives at offset 64 * (n + 1).
+ * Journals written before the node fields existed have zeros there, which read as node 0 of 1.
+ */
+
+#pragma once
+
+#include <algorithm>  // For std::min, std::max
+#include <atomic>
+#include <cstddef>    // For std::size_t
+#include <cstdint>
+#include <cstring>    // For std::memcpy, std::memcmp, std::memset
+#include <stdexcept>  // For std::runtime_error, std::invalid_argument
+#include <string>
+#include <thread>
+#include <utility>    // For std::forward
+
+#if !defined(_WIN32)
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap, msync, munmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For ftruncate, fsync, close, sysconf
+#endif
+
+#include "Order.h"
+#include "Backoff.h"
+#include "LittleEndian.h"
+
+/**
+ * @enum JournalRecordType
+ * @brief What a journal record describes. 0 marks a slot that has not been (fully) written.
+ */
+enum class JournalRecordType : std::uint8_t {
+    Symbol = 1,   // A symbol name was assigned an ID.
+    NewOrder = 2, // A new order was accepted (with the ID it was given).
+    Cancel = 3,   // A resting order was cancelled.
+    Modify = 4    // A resting order was modified to a new price and quantity.
+};
+
+/**
+ * @struct JournalRecord
+ * @brief A decoded journal record, as handed to the replay callback. Only the fields of `type` are set.
+ */
+struct JournalRecord {
+    JournalRecordType type = JournalRecordType::NewOrder;
+    std::uint64_t seq = 0;
+    OrderId orderId = 0;
+    SymbolId symbol = 0;
+    OrderType orderType = OrderType::Limit;
+    Side side = Side::Buy;
+    Price price = 0;
+    Quantity quantity = 0;
+    Price stopPrice = 0;
+    AccountId account = kNoAccount;
+    SelfTradePrevention selfTradePrevention = SelfTradePrevention::None;
+    std::string symbolName;
+};
+
+/**
+ * @class Journal
+ * @brief The write-ahead log of the engine. Appending is safe from any number of threads.
+ */
+class Journal {
+public:
+    static constexpr std::size_t kRecordSize = 64;
+    static constexpr std::size_t kMaxSymbolLength = kRecordSize - 16 - 5; // What fits into a Symbol record.
+    static constexpr std::uint64_t kDefaultCapacity = std::uint64_t{1} << 30; // 1 GiB, about 16 million records.
+
+    /**
+     * @brief Opens a journal file, creating it if it does not exist yet.
+     * The records already in the file can be read with replay(); new records are appended after them.
+     * @param path The journal file.
+     * @param shardCount The engine's shard count. Order IDs encode the shard that owns the order,
+     *        so a journal can only be replayed by an engine with the same number of shards.
+     * @param nodeIndex, nodeCount Which of the engine nodes behind a routing gateway the engine is.
+     *        Order IDs encode the node as well, so they must match just like the shard count.
+     * @param capacity The size of the file in bytes. The file is sparse, so unused space costs no disk.
+     * @throws std::runtime_error if the file cannot be opened or belongs to a different configuration.
+     */
+    Journal(const std::string& path, std::size_t shardCount, std::size_t nodeIndex = 0, std::size_t nodeCount = 1,
+            std::uint64_t capacity = kDefaultCapacity) {
+#if defined(_WIN32)
+        (void)path;
+        (void)shardCount;
+        (void)nodeIndex;
+        (void)nodeCount;
+        (void)capacity;
+        throw std::runtime_error("The journal is only supported on POSIX systems.");
+#else
+        this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->fd_ < 0) {
+            throw std::runtime_error("Could not open the journal '" + path + "'.");
+        }
+        struct stat info {};
+        ::fstat(this->fd_, &info);
+        const bool fresh = info.st_size == 0;
+        this->size_ = fresh ? capacity / kRecordSize * kRecordSize : static_cast<std::uint64_t>(info.st_size);
+        if (this->size_ < 2 * kRecordSize || (fresh && ::ftruncate(this->fd_, static_cast<off_t>(this->size_)) != 0)) {
+            ::close(this->fd_);
+            throw std::runtime_error("Could not size the journal '" + path + "'.");
+        }
+        void* base = ::mmap(nullptr, this->size_, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0);
+        if (base == MAP_FAILED) {
+            ::close(this->fd_);
+            throw std::runtime_error("Could not map the journal '" + path + "'.");
+        }
+        this->base_ = static_cast<unsigned char*>(base);
+        this->capacity_ = this->size_ / kRecordSize - 1;
+
+        if (fresh) {
+            std::memcpy(this->base_, kMagic, sizeof(kMagic));
+            binary::writeU32(this->base_ + 8, kVersion);
+            binary::writeU32(this->base_ + 12, static_cast<std::uint32_t>(shardCount));
+            binary::writeU32(this->base_ + 16, static_cast<std::uint32_t>(nodeCount));
+            binary::writeU32(this->base_ + 20, static_cast<std::uint32_t>(nodeIndex));
+            ::msync(this->base_, kRecordSize, MS_SYNC);
+            ::fsync(this->fd_); // Make the file's size durable too; from now on only its pages change.
+        } else if (std::memcmp(this->base_, kMagic, sizeof(kMagic)) != 0 || binary::readU32(this->base_ + 8) != kVersion) {
+            close();
+            throw std::runtime_error("'" + path + "' is not a journal of this engine version.");
+        } else if (binary::readU32(this->base_ + 12) != shardCount) {
+            const std::uint32_t journaled = binary::readU32(this->base_ + 12);
+            close();
+            throw std::runtime_error("The journal '" + path + "' was written with " + std::to_string(journaled) +
+                                     " shard(s); start the engine with --shards " + std::to_string(journaled) + ".");
+        } else if (std::max<std::uint32_t>(binary::readU32(this->base_ + 16), 1) != nodeCount ||
+                   binary::readU32(this->base_ + 20) != nodeIndex) {
+            const std::string node = std::to_string(binary::readU32(this->base_ + 20)) + "/" +
+                                     std::to_string(std::max<std::uint32_t>(binary::readU32(this->base_ + 16), 1));
+            close();
+            throw std::runtime_error("The journal '" + path + "' was written by node " + node +
+                                     "; start the engine with --node " + node + ".");
+        }
+
+        // Recover: the records form a contiguous prefix. Anything after the first slot that was
+        // never completed (a crash between reserving and publishing it) was never acknowledged.
+        std::uint64_t count = 0;
+        while (count < this->capacity_ && typeAt(count) != 0 && binary::readU64(slot(count) + 8) == count) {
+            ++count;
+        }
+        // Records published after the gap by other writers that were in flight at the time of the
+        // crash are discarded too; wipe them so that they cannot be mistaken for new records.
+        for (std::uint64_t i = count; i < std::min(this->capacity_, count + kTornTailWindow); ++i) {
+            if (typeAt(i) != 0) {
+                std::memset(slot(i), 0, kRecordSize);
+            }
+        }
+        this->next_.store(count, std::memory_order_relaxed);
+        this->written_ = count;
+        this->durable_.store(count, std::memory_order_relaxed);
+#endif
+    }
+
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    /** @brief Makes every published record durable and closes the file. */
+    ~Journal() {
+        stop();
+        close();
+    }
+
+    /** @brief The number of records in the journal (the next sequence number). */
+    std::uint64_t size() const { return std::min(this->next_.load(std::memory_order_acquire), this->capacity_); }
+
+    /**
+     * @brief Calls `fn(const JournalRecord&)` for every record from sequence number `from` on, oldest first.
+     * Must be called before any new record is appended.
+     */
+    template <typename Fn>
+    void replay(Fn&& fn, std::uint64_t from = 0) const {
+        JournalRecord record;
+        for (std::uint64_t seq = from; seq < this->written_; ++seq) {
+            decode(slot(seq), record);
+            fn(record);
+        }
+    }
+
+    /** @brief Decodes a record in the file's layout, e.g. one copied out with copyRecord(). */
+    static void decode(const unsigned char* p, JournalRecord& record) {
+        record.type = static_cast<JournalRecordType>(p[0]);
+        record.seq = binary::readU64(p + 8);
+        switch (record.type) {
+            case JournalRecordType::Symbol:
+                record.symbol = binary::readU32(p + 16);
+                record.symbolName.assign(reinterpret_cast<const char*>(p + 21),
+                                         std::min<std::size_t>(p[20], kMaxSymbolLength));
+                break;
+            case JournalRecordType::NewOrder:
+                record.orderId = binary::readU64(p + 16);
+                record.symbol = binary::readU32(p + 24);
+                record.orderType = static_cast<OrderType>(p[28]);
+                record.side = static_cast<Side>(p[29]);
+                record.price = static_cast<Price>(binary::readU64(p + 32));
+                record.quantity = static_cast<Quantity>(binary::readU64(p + 40));
+                record.selfTradePrevention = static_cast<SelfTradePrevention>(p[30]);
+                record.stopPrice = static_cast<Price>(binary::readU64(p + 48));
+                record.account = binary::readU32(p + 56);
+                break;
+            case JournalRecordType::Cancel:
+                record.orderId = binary::readU64(p + 16);
+                break;
+            case JournalRecordType::Modify:
+                record.orderId = binary::readU64(p + 16);
+                record.price = static_cast<Price>(binary::readU64(p + 24));
+                record.quantity = static_cast<Quantity>(binary::readU64(p + 32));
+                break;
+        }
+    }
+
+    /**
+     * @brief Copies record `seq` (kRecordSize bytes, in the file's layout) into `out` if it has been published.
+     * Safe from any thread while the shards append, so a replica can follow the journal as it grows.
+     * @return False if the record has not been published yet.
+     */
+    bool copyRecord(std::uint64_t seq, unsigned char* out) const {
+        if (seq >= this->capacity_ || typeAt(seq) == 0) {
+            return false;
+        }
+        std::memcpy(out, slot(seq), kRecordSize);
+        return true;
+    }
+
+    /** @brief Starts the group-commit thread. Call once replay has finished. */
+    void start() {
+        this->running_.store(true, std::memory_order_release);
+        this->flusher_ = std::thread([this] { flushLoop(); });
+    }
+
+    /** @brief Stops the group-commit thread after making every published record durable. */
+    void stop() {
+        this->running_.store(false, std::memory_order_release);
+        if (this->flusher_.joinable()) {
+            this->flusher_.join();
+        }
+    }
+
+    // --- Appending (safe from any thread; never blocks) ---
+    // Each returns the record's sequence number + 1: the durable size to wait for before acknowledging.
+
+    /**
+     * @brief Takes `count` consecutive slots and returns the sequence number of the first one.
+     * Lets a command that journals several records (a batch) find out that they do not fit before
+     * it applies any of them. Every slot taken must then be written, or the records appended
+     * after it are lost on the next start (see the constructor).
+     * @throws std::runtime_error if fewer than `count` slots are left; none are taken then.
+     */
+    std::uint64_t reserve(std::uint64_t count) {
+        std::uint64_t seq = this->next_.load(std::memory_order_relaxed);
+        do {
+            if (seq >= this->capacity_ || count > this->capacity_ - seq) {
+                throw std::runtime_error("The journal is full.");
+            }
+        } while (!this->next_.compare_exchange_weak(seq, seq + count, std::memory_order_relaxed));
+        return seq;
+    }
+
+    /** @throws std::invalid_argument if the name is too long to be journaled. */
+    std::uint64_t appendSymbol(SymbolId symbol, const std::string& name) {
+        if (name.size() > kMaxSymbolLength) {
+            throw std::invalid_argument("Symbol names are limited to " + std::to_string(kMaxSymbolLength) + " characters.");
+        }
+        return append(JournalRecordType::Symbol, [&](unsigned char* p) {
+            binary::writeU32(p + 16, symbol);
+            p[20] = static_cast<unsigned char>(name.size());
+            std::memcpy(p + 21, name.data(), name.size());
+        });
+    }
+
+    /** @brief Journals a new order as it was accepted: before matching, with its full quantity. */
+    std::uint64_t appendNewOrder(const Order& order) { return appendNewOrder(order, reserve(1)); }
+
+    /** @brief Journals a new order into a slot taken with reserve(). */
+    std::uint64_t appendNewOrder(const Order& order, std::uint64_t seq) {
+        return write(seq, JournalRecordType::NewOrder, [&](unsigned char* p) {
+            binary::writeU64(p + 16, order.getOrderID());
+            binary::writeU32(p + 24, order.getSymbolId());
+            p[28] = static_cast<unsigned char>(order.getType());
+            p[29] = static_cast<unsigned char>(order.getSide());
+            // The stop price, account and self-trade prevention use bytes that older records left
+            // zero, which reads back as "none", so those records still replay unchanged.
+            p[30] = static_cast<unsigned char>(order.getSelfTradePrevention());
+            binary::writeU64(p + 32, static_cast<std::uint64_t>(order.getPrice()));
+            binary::writeU64(p + 40, static_cast<std::uint64_t>(order.getQuantity()));
+            binary::writeU64(p + 48, static_cast<std::uint64_t>(order.getStopPrice()));
+            binary::writeU32(p + 56, order.getAccount());
+        });
+    }
+
+    std::uint64_t appendCancel(OrderId orderId) {
+        return append(JournalRecordType::Cancel, [&](unsigned char* p) { binary::writeU64(p + 16, orderId); });
+    }
+
+    std::uint64_t appendModify(OrderId orderId, Price price, Quantity quantity) {
+        return append(JournalRecordType::Modify, [&](unsigned char* p) {
+            binary::writeU64(p + 16, orderId);
+            binary::writeU64(p + 24, static_cast<std::uint64_t>(price));
+            binary::writeU64(p + 32, static_cast<std::uint64_t>(quantity));
+        });
+    }
+
+    /**
+     * @brief Appends a record copied from another engine's journal (see copyRecord()) verbatim.
+     * A replica appends the records in sequence order, so its journal stays a copy of the primary's.
+     * @throws std::runtime_error if the record is not the next one of this journal.
+     */
+    std::uint64_t appendCopy(const unsigned char* record) {
+        const std::uint64_t seq = binary::readU64(record + 8);
+        if (seq != this->next_.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Record " + std::to_string(seq) + " does not follow the " +
+                                     std::to_string(size()) + " record(s) of the journal.");
+        }
+        return append(static_cast<JournalRecordType>(record[0]),
+                      [&](unsigned char* p) { std::memcpy(p + 1, record + 1, kRecordSize - 1); });
+    }
+
+    /** @brief Blocks until the first `count` records are on disk. */
+    void waitDurable(std::uint64_t count) const {
+        Backoff backoff;
+        while (this->durable_.load(std::memory_order_acquire) < count) {
+            backoff.pause();
+        }
+    }
+
+private:
+    static constexpr char kMagic[8] = {'C', 'R', 'Y', 'P', 'T', 'O', 'J', '1'};
+    static constexpr std::uint32_t kVersion = 1;
+    // Far more records than can be in flight at once (one per shard and HTTP thread).
+    static constexpr std::uint64_t kTornTailWindow = 4096;
+
+    int fd_ = -1;
+    unsigned char* base_ = nullptr;
+    std::uint64_t size_ = 0;     // The size of the mapping in bytes.
+    std::uint64_t capacity_ = 0; // The number of record slots.
+    std::uint64_t written_ = 0;  // The flusher's scan position: every record before it is published.
+
+    std::atomic<std::uint64_t> next_{0};    // The next sequence number to hand out.
+    std::atomic<std::uint64_t> durable_{0}; // Every record before this one is on disk.
+    std::atomic<bool> running_{false};
+    std::thread flusher_;
+
+    unsigned char* slot(std::uint64_t seq) const { return this->base_ + (seq + 1) * kRecordSize; }
+
+    // The type byte of a record is its "published" flag, so it is accessed atomically:
+    // it is stored last (release) by the writer and loaded first (acquire) by the readers.
+    static std::atomic<std::uint8_t>& typeByte(unsigned char* record) {
+        static_assert(sizeof(std::atomic<std::uint8_t>) == 1, "The type byte must be a plain byte.");
+        return *reinterpret_cast<std::atomic<std::uint8_t>*>(record);
+    }
+
+    std::uint8_t typeAt(std::uint64_t seq) const { return typeByte(slot(seq)).load(std::memory_order_acquire); }
+
+    template <typename Fill>
+    std::uint64_t append(JournalRecordType type, Fill&& fill) {
+        return write(reserve(1), type, std::forward<Fill>(fill));
+    }
+
+    template <typename Fill>
+    std::uint64_t write(std::uint64_t seq, JournalRecordType type, Fill&& fill) {
+        unsigned char* p = slot(seq);
+        fill(p);
+        binary::writeU64(p + 8, seq);
+        typeByte(p).store(static_cast<std::uint8_t>(type), std::memory_order_release); // Publish the record.
+        return seq + 1;
+    }
+
+    void flushLoop() {
+        Backoff backoff;
+        while (true) {
+            const bool running = this->running_.load(std::memory_order_acquire);
+            if (flush()) {
+                backoff.reset();
+            } else if (running) {
+                backoff.pause();
+            } else {
+                break;
+            }
+        }
+    }
+
+    /** @brief Makes the records published since the last call durable. Returns false if there were none. */
+    bool flush() {
+#if defined(_WIN32)
+        return false;
+#else
+        const std::uint64_t reserved = std::min(this->next_.load(std::memory_order_acquire), this->capacity_);
+        std::uint64_t end = this->written_;
+        while (end < reserved && typeAt(end) != 0) {
+            ++end;
+        }
+        if (end == this->written_) {
+            return false;
+        }
+        // msync wants a page-aligned start; re-syncing the head of a partly synced page is harmless.
+        static const std::uint64_t page = static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+        const std::uint64_t from = (this->written_ + 1) * kRecordSize / page * page;
+        const std::uint64_t to = (end + 1) * kRecordSize;
+        ::msync(this->base_ + from, to - from, MS_SYNC);
+        this->written_ = end;
+        this->durable_.store(end, std::memory_order_release);
+        return true;
+#endif
+    }
+
+    void close() {
+#if !defined(_WIN32)
+        if (this->base_ != nullptr) {
+            flush();
+            ::munmap(this->base_, this->size_);
+            this->base_ = nullptr;
+        }
+        if (this->fd_ >= 0) {
+            ::close(this->fd_);
+            this->fd_ = -1;
+        }
+#endif
+    }
+};
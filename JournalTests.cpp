@@ -0,0 +1,155 @@
+/**
+ * @file JournalTests.cpp
+ * @brief Tests of the Journal and of rebuilding the engine from it.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include "Command.h"
+#include "Instrument.h"
+#include "Journal.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "TestHarness.h"
+#include "TestSupport.h"
+#include "Trade.h"
+
+using testing::SameLevels;
+using testing::Submit;
+using testing::TempFile;
+
+namespace {
+
+/** @brief Configures the two symbols of these tests, which go to different shards of a two-shard engine. */
+std::vector<SymbolId> ConfigureSymbols(MatchingEngine& engine) {
+    return {engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001)),
+            engine.configureSymbol("ETH-USDT", Instrument(0.01, 0.001))};
+}
+
+/** @brief Rests, trades, cancels and modifies orders on every symbol. */
+void RunWorkload(MatchingEngine& engine, const std::vector<SymbolId>& symbols) {
+    for (SymbolId symbol : symbols) {
+        for (Price price = 100; price < 105; ++price) {
+            engine.process(OrderType::Limit, Side::Buy, 10, symbol, price);
+            engine.process(OrderType::Limit, Side::Sell, 10, symbol, price + 10);
+        }
+        engine.process(OrderType::Market, Side::Sell, 15, symbol); // Trades with the two best bids.
+        const OrderId cancelled = engine.process(OrderType::Limit, Side::Buy, 7, symbol, 90);
+        engine.cancel(cancelled);
+        const OrderId modified = engine.process(OrderType::Limit, Side::Sell, 7, symbol, 130);
+        engine.modify(modified, 1.20, 0.005); // 120 ticks, 5 lots.
+        OrderOptions stop;
+        stop.stopPrice = 150;
+        engine.process(OrderType::StopLimit, Side::Buy, 3, symbol, 160, stop);
+    }
+}
+
+/** @brief The ID of a crossing buy order and of its first trade, which show where the ID sequences stand. */
+std::vector<std::uint64_t> NextIds(MatchingEngine& engine, SymbolId symbol) {
+    std::vector<Trade> trades;
+    CommandReply reply;
+    reply.trades = &trades;
+    Submit(engine, reply, OrderType::Market, Side::Buy, 1, symbol);
+    return {reply.orderId, trades.empty() ? 0 : trades.front().tradeID};
+}
+
+} // namespace
+
+TEST(ReplayRebuildsTheBooksAndTheIdSequences) {
+    TempFile journal("replay.journal");
+    std::vector<BookView> journaled;
+    {
+        MatchingEngine engine(2);
+        const std::vector<SymbolId> symbols = ConfigureSymbols(engine);
+        engine.openJournal(journal.path());
+        RunWorkload(engine, symbols);
+        for (SymbolId symbol : symbols) {
+            journaled.push_back(engine.getBookView(symbol));
+        }
+    }
+
+    // The same commands without a journal: where the books and the sequences stand had there been no restart.
+    MatchingEngine reference(2);
+    const std::vector<SymbolId> symbols = ConfigureSymbols(reference);
+    RunWorkload(reference, symbols);
+
+    MatchingEngine restored(2);
+    ConfigureSymbols(restored);
+    restored.openJournal(journal.path());
+    for (SymbolId symbol : symbols) {
+        CHECK(SameLevels(restored.getBookView(symbol), journaled[symbol]));
+        CHECK(SameLevels(restored.getBookView(symbol), reference.getBookView(symbol)));
+        const std::vector<std::uint64_t> ids = NextIds(restored, symbol);
+        CHECK(ids[1] != 0);
+        CHECK(ids == NextIds(reference, symbol));
+    }
+}
+
+TEST(AFullJournalRejectsCommandsWithoutApplyingThem) {
+    TempFile journal("full.journal");
+    MatchingEngine engine;
+    const SymbolId symbol = engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+    // Room for five records, the first of which journals the symbol.
+    engine.openJournal(journal.path(), "", Journal::kRecordSize * (1 + 5));
+    const OrderId first = engine.process(OrderType::Limit, Side::Buy, 10, symbol, 100);
+
+    // A batch that does not fit is rejected as a whole...
+    std::vector<BatchOrder> batch(4);
+    for (std::size_t i = 0; i < batch.size(); ++i) {
+        batch[i].symbol = symbol;
+        batch[i].quantity = 10;
+        batch[i].price = 90 + static_cast<Price>(i);
+    }
+    CHECK_THROWS(std::invalid_argument, engine.processBatch(batch));
+    CHECK(engine.getBookView(symbol).bidCount == 1);
+
+    // ...and takes no room, so a smaller one still fits.
+    batch.resize(3);
+    engine.processBatch(batch);
+    CHECK(engine.getBookView(symbol).bidCount == 4);
+
+    CHECK_THROWS(std::invalid_argument, engine.process(OrderType::Limit, Side::Buy, 10, symbol, 80));
+    CHECK_THROWS(std::invalid_argument, engine.cancel(first));
+    const BookView full = engine.getBookView(symbol);
+    CHECK(full.bidCount == 4);
+    CHECK(full.bids[0].price == 100);
+
+    MatchingEngine restored;
+    restored.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+    restored.openJournal(journal.path());
+    CHECK(SameLevels(restored.getBookView(symbol), full));
+}
+
+TEST(RecoveryStopsAtARecordThatWasNeverPublished) {
+    TempFile path("gap.journal");
+    {
+        Journal journal(path.path(), 1, 0, 1, Journal::kRecordSize * 16);
+        journal.appendNewOrder(Order(1, OrderType::Limit, Side::Buy, 10, 0, 100));
+        journal.appendNewOrder(Order(2, OrderType::Limit, Side::Buy, 10, 0, 101));
+        journal.reserve(1); // A writer that crashed between taking its slot and publishing the record.
+        journal.appendNewOrder(Order(3, OrderType::Limit, Side::Buy, 10, 0, 102));
+    }
+    {
+        Journal journal(path.path(), 1);
+        CHECK(journal.size() == 2);
+        std::vector<OrderId> replayed;
+        journal.replay([&](const JournalRecord& record) { replayed.push_back(record.orderId); });
+        CHECK((replayed == std::vector<OrderId>{1, 2}));
+        // The record published after the gap was discarded, so the next record takes the gap's place...
+        CHECK(journal.appendNewOrder(Order(4, OrderType::Limit, Side::Buy, 10, 0, 103)) == 3);
+    }
+    // ...and is not followed by the discarded one on the next start.
+    Journal journal(path.path(), 1);
+    std::vector<OrderId> replayed;
+    journal.replay([&](const JournalRecord& record) { replayed.push_back(record.orderId); });
+    CHECK((replayed == std::vector<OrderId>{1, 2, 4}));
+}
+
+TEST(AJournalOnlyOpensWithItsShardCount) {
+    TempFile path("shards.journal");
+    { Journal journal(path.path(), 2, 0, 1, Journal::kRecordSize * 16); }
+    CHECK_THROWS(std::runtime_error, Journal(path.path(), 1));
+    Journal journal(path.path(), 2);
+    CHECK(journal.size() == 0);
+}
@@ -0,0 +1,55 @@
+/**
+ * @file LittleEndian.h
+ * @brief Helpers to read and write little-endian integers in byte buffers.
+ *
+ * Used wherever the engine defines a byte layout of its own: the binary order-entry
+ * protocol and the journal. The values are assembled byte by byte, so the layout is the
+ * same on every host; compilers turn these into single loads and stores on little-endian
+ * machines.
+ */
+
+#pragma once
+
+#include <cstdint> // For the fixed-width integer types
+
+namespace binary {
+
+inline std::uint64_t readU64(const unsigned char* p) {
+    std::uint64_t value = 0;
+    for (int i = 7; i >= 0; --i) {
+        value = (value << 8) | p[i];
+    }
+    return value;
+}
+
+inline std::uint32_t readU32(const unsigned char* p) {
+    return static_cast<std::uint32_t>(p[0]) | (static_cast<std::uint32_t>(p[1]) << 8) |
+           (static_cast<std::uint32_t>(p[2]) << 16) | (static_cast<std::uint32_t>(p[3]) << 24);
+}
+
+inline std::uint16_t readU16(const unsigned char* p) {
+    return static_cast<std::uint16_t>(p[0] | (p[1] << 8));
+}
+
+inline std::int64_t readI64(const unsigned char* p) { return static_cast<std::int64_t>(readU64(p)); }
+
+inline void writeU64(unsigned char* p, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+inline void writeU32(unsigned char* p, std::uint32_t value) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<unsigned char>(value >> (8 * i));
+    }
+}
+
+inline void writeU16(unsigned char* p, std::uint16_t value) {
+    p[0] = static_cast<unsigned char>(value);
+    p[1] = static_cast<unsigned char>(value >> 8);
+}
+
+inline void writeI64(unsigned char* p, std::int64_t value) { writeU64(p, static_cast<std::uint64_t>(value)); }
+
+} // namespace binary
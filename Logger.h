@@ -0,0 +1,397 @@
+/**
+ * @file Logger.h
+ * @brief Defines the asynchronous Logger and the LOG_* macros used everywhere outside of startup.
+ *
+ * Writing to the console is synchronous, line-buffered and usually costs more than matching the
+ * order it describes. A log call therefore does no formatting and no I/O: it copies its format
+ * string pointer and its arguments into a fixed-size binary LogRecord in a ring owned by the
+ * calling thread, which is a handful of stores and never blocks or allocates. A background
+ * thread drains the rings, puts the records of all threads back into time order, formats them,
+ * and writes and flushes them in one go.
+ *
+ * A log call whose level is below the threshold costs one relaxed load. Call sites can be rate
+ * limited, in which case the excess is counted and the next line that gets through says how many
+ * were suppressed. If a thread logs faster than the background thread can write, its ring fills
+ * up and further records are dropped (and counted) rather than slowing the thread down.
+ *
+ * Usage: LOG_INFO("Order {} filled {} at {}", orderId, quantity, price); Arguments may be
+ * integers, floating-point numbers, booleans, characters and strings (which are copied, and
+ * truncated if a record's text space runs out).
+ */
+
+#pragma once
+
+#include <algorithm>   // For std::stable_sort, std::min
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>     // For std::size_t
+#include <cstdint>
+#include <cstdio>      // For std::fwrite, std::fflush, std::snprintf
+#include <cstring>     // For std::memcpy, std::strlen
+#include <ctime>       // For gmtime
+#include <memory>      // For std::shared_ptr, std::unique_ptr
+#include <mutex>
+#include <stdexcept>   // For std::invalid_argument
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include "Metrics.h"   // For Tsc, the timestamp source
+
+/**
+ * @enum LogLevel
+ * @brief The severity of a log record. Records below the logger's threshold are discarded at the call site.
+ */
+enum class LogLevel : std::uint8_t { Debug, Info, Warn, Error, Off };
+
+/**
+ * @brief Parses a log level name ("debug", "info", "warn", "error" or "off").
+ * @throws std::invalid_argument for any other name.
+ */
+inline LogLevel ParseLogLevel(const std::string& name) {
+    if (name == "debug") return LogLevel::Debug;
+    if (name == "info") return LogLevel::Info;
+    if (name == "warn") return LogLevel::Warn;
+    if (name == "error") return LogLevel::Error;
+    if (name == "off") return LogLevel::Off;
+    throw std::invalid_argument("Invalid log level '" + name + "'.");
+}
+
+/**
+ * @struct LogSite
+ * @brief One LOG_* statement in the source: its level, format and rate limit. Created once per call site.
+ */
+struct LogSite {
+    LogSite(LogLevel lvl, const char* fmt, std::uint32_t limit) : level(lvl), format(fmt), perSecond(limit) {}
+
+    const LogLevel level;
+    const char* const format;       // A string literal; "{}" marks where each argument goes.
+    const std::uint32_t perSecond;  // At most this many records per second, or 0 for no limit.
+
+    std::atomic<std::uint64_t> window{0};     // The second (in TSC ticks / ticks per second) being counted.
+    std::atomic<std::uint32_t> count{0};      // Records let through in that second.
+    std::atomic<std::uint64_t> suppressed{0}; // Records held back since the last one that got through.
+
+    /** @brief Applies the rate limit. Approximate when several threads share a site, which is fine for logging. */
+    bool allow(std::uint64_t now, std::uint64_t ticksPerSecond) {
+        if (this->perSecond == 0) {
+            return true;
+        }
+        const std::uint64_t current = now / ticksPerSecond;
+        if (this->window.load(std::memory_order_relaxed) != current) {
+            this->window.store(current, std::memory_order_relaxed);
+            this->count.store(0, std::memory_order_relaxed);
+        }
+        if (this->count.fetch_add(1, std::memory_order_relaxed) < this->perSecond) {
+            return true;
+        }
+        this->suppressed.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+};
+
+/**
+ * @struct LogRecord
+ * @brief A log call's raw data, formatted later by the background thread.
+ */
+struct LogRecord {
+    static constexpr std::size_t kMaxArgs = 8;
+    static constexpr std::size_t kTextSize = 152; // Room for the characters of all string arguments together.
+
+    enum class ArgType : std::uint8_t { Signed, Unsigned, Double, Bool, Char, String };
+
+    std::uint64_t tsc = 0;
+    const LogSite* site = nullptr;
+    std::uint64_t suppressed = 0; // Records of the same site suppressed just before this one.
+    std::uint8_t argCount = 0;
+    std::uint16_t textUsed = 0;
+    std::array<ArgType, kMaxArgs> types{};
+    std::array<std::uint64_t, kMaxArgs> values{}; // For strings: (offset into text << 16) | length.
+    char text[kTextSize];
+};
+
+/**
+ * @class LogRing
+ * @brief The records of one thread on their way to the background thread (single producer, single consumer).
+ */
+class LogRing {
+public:
+    static constexpr std::size_t kCapacity = 1024;
+
+    LogRing() : records_(new LogRecord[kCapacity]) {}
+
+    /** @brief The slot for the next record, or nullptr (after counting a drop) if the ring is full. */
+    LogRecord* claim() {
+        const std::uint64_t tail = this->tail_.load(std::memory_order_relaxed);
+        if (tail - this->head_.load(std::memory_order_acquire) == kCapacity) {
+            this->dropped_.fetch_add(1, std::memory_order_relaxed);
+            return nullptr;
+        }
+        return &this->records_[tail % kCapacity];
+    }
+
+    /** @brief Hands the claimed record to the consumer. */
+    void publish() { this->tail_.store(this->tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release); }
+
+    // --- Consumer side ---
+    std::uint64_t head() const { return this->head_.load(std::memory_order_relaxed); }
+    std::uint64_t tail() const { return this->tail_.load(std::memory_order_acquire); }
+    const LogRecord& at(std::uint64_t position) const { return this->records_[position % kCapacity]; }
+    void release(std::uint64_t head) { this->head_.store(head, std::memory_order_release); }
+    std::uint64_t takeDropped() { return this->dropped_.exchange(0, std::memory_order_relaxed); }
+
+private:
+    std::unique_ptr<LogRecord[]> records_;
+    alignas(64) std::atomic<std::uint64_t> head_{0}; // Written by the consumer.
+    alignas(64) std::atomic<std::uint64_t> tail_{0}; // Written by the producer.
+    std::atomic<std::uint64_t> dropped_{0};
+};
+
+/**
+ * @class Logger
+ * @brief The process-wide asynchronous logger. Its thread starts on first use and drains everything on exit.
+ */
+class Logger {
+public:
+    static Logger& instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    ~Logger() {
+        this->running_.store(false, std::memory_order_release);
+        if (this->thread_.joinable()) {
+            this->thread_.join();
+        }
+    }
+
+    void setLevel(LogLevel level) { this->level_.store(level, std::memory_order_relaxed); }
+
+    bool enabled(LogLevel level) const { return level >= this->level_.load(std::memory_order_relaxed); }
+
+    /** @brief Records a log call. Does no formatting or I/O; never blocks. */
+    template <typename... Args>
+    void log(LogSite& site, const Args&... args) {
+        static_assert(sizeof...(Args) <= LogRecord::kMaxArgs, "Too many arguments for one log record.");
+        const std::uint64_t now = Tsc::now();
+        if (!site.allow(now, this->ticks_per_second_)) {
+            return;
+        }
+        LogRing& ring = threadRing();
+        LogRecord* record = ring.claim();
+        if (record == nullptr) {
+            return;
+        }
+        record->tsc = now;
+        record->site = &site;
+        record->suppressed = (site.perSecond != 0) ? site.suppressed.exchange(0, std::memory_order_relaxed) : 0;
+        record->argCount = 0;
+        record->textUsed = 0;
+        (encode(*record, args), ...);
+        ring.publish();
+    }
+
+private:
+    std::atomic<LogLevel> level_{LogLevel::Info};
+    std::atomic<bool> running_{true};
+    std::thread thread_;
+
+    std::mutex mtx_; // Guards rings_, which threads join on their first log call.
+    std::vector<std::shared_ptr<LogRing>> rings_;
+
+    // For turning a record's TSC timestamp into wall-clock time.
+    const std::uint64_t start_tsc_;
+    const std::chrono::system_clock::time_point start_time_;
+    const std::uint64_t ticks_per_second_;
+
+    Logger()
+        : start_tsc_(Tsc::now()), start_time_(std::chrono::system_clock::now()),
+          ticks_per_second_(static_cast<std::uint64_t>(1e9 / Tsc::nanosPerTick()) + 1) {
+        this->thread_ = std::thread([this] { run(); });
+    }
+
+    /** @brief The calling thread's ring, registered with the logger on the thread's first log call. */
+    LogRing& threadRing() {
+        thread_local std::shared_ptr<LogRing> ring = [this] {
+            auto created = std::make_shared<LogRing>();
+            std::lock_guard<std::mutex> lock(this->mtx_);
+            this->rings_.push_back(created);
+            return created;
+        }();
+        return *ring;
+    }
+
+    // --- Argument encoding (on the logging thread) ---
+
+    template <typename T>
+    static void encode(LogRecord& record, const T& value) {
+        const std::size_t i = record.argCount++;
+        using Type = std::decay_t<T>;
+        if constexpr (std::is_same_v<Type, bool>) {
+            record.types[i] = LogRecord::ArgType::Bool;
+            record.values[i] = value ? 1 : 0;
+        } else if constexpr (std::is_same_v<Type, char>) {
+            record.types[i] = LogRecord::ArgType::Char;
+            record.values[i] = static_cast<unsigned char>(value);
+        } else if constexpr (std::is_integral_v<Type> && std::is_signed_v<Type>) {
+            record.types[i] = LogRecord::ArgType::Signed;
+            record.values[i] = static_cast<std::uint64_t>(static_cast<std::int64_t>(value));
+        } else if constexpr (std::is_integral_v<Type>) {
+            record.types[i] = LogRecord::ArgType::Unsigned;
+            record.values[i] = static_cast<std::uint64_t>(value);
+        } else if constexpr (std::is_floating_point_v<Type>) {
+            const double d = static_cast<double>(value);
+            record.types[i] = LogRecord::ArgType::Double;
+            std::memcpy(&record.values[i], &d, sizeof(d));
+        } else {
+            const std::string_view text(value); // Strings, string views and C strings.
+            const std::size_t length = std::min<std::size_t>(text.size(), LogRecord::kTextSize - record.textUsed);
+            std::memcpy(record.text + record.textUsed, text.data(), length);
+            record.types[i] = LogRecord::ArgType::String;
+            record.values[i] = (std::uint64_t{record.textUsed} << 16) | length;
+            record.textUsed = static_cast<std::uint16_t>(record.textUsed + length);
+        }
+    }
+
+    // --- Formatting and writing (on the background thread) ---
+
+    void run() {
+        std::vector<std::shared_ptr<LogRing>> rings;
+        std::vector<const LogRecord*> pending;
+        std::vector<std::uint64_t> tails;
+        std::string out;
+        while (true) {
+            const bool stopping = !this->running_.load(std::memory_order_acquire);
+            {
+                std::lock_guard<std::mutex> lock(this->mtx_);
+                rings = this->rings_;
+            }
+
+            // Take whatever each ring holds right now and put the records of all threads in time order.
+            pending.clear();
+            tails.assign(rings.size(), 0);
+            for (std::size_t r = 0; r < rings.size(); ++r) {
+                tails[r] = rings[r]->tail();
+                for (std::uint64_t position = rings[r]->head(); position < tails[r]; ++position) {
+                    pending.push_back(&rings[r]->at(position));
+                }
+                if (const std::uint64_t dropped = rings[r]->takeDropped()) {
+                    out += "WARN  Logger: dropped " + std::to_string(dropped) + " record(s) of a thread that logged too fast\n";
+                }
+            }
+            std::stable_sort(pending.begin(), pending.end(),
+                             [](const LogRecord* a, const LogRecord* b) { return a->tsc < b->tsc; });
+            for (const LogRecord* record : pending) {
+                format(*record, out);
+            }
+            for (std::size_t r = 0; r < rings.size(); ++r) {
+                rings[r]->release(tails[r]);
+            }
+
+            if (!out.empty()) {
+                std::fwrite(out.data(), 1, out.size(), stdout);
+                std::fflush(stdout);
+                out.clear();
+            } else if (stopping) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+    }
+
+    void format(const LogRecord& record, std::string& out) const {
+        static const char* const kLevelNames[] = {"DEBUG", "INFO ", "WARN ", "ERROR"};
+
+        // Wall-clock time of the record, in UTC with microseconds.
+        const auto since_start = std::chrono::nanoseconds(
+            static_cast<std::int64_t>(static_cast<double>(record.tsc - this->start_tsc_) * Tsc::nanosPerTick()));
+        const auto time = this->start_time_ + std::chrono::duration_cast<std::chrono::system_clock::duration>(since_start);
+        const std::time_t seconds = std::chrono::system_clock::to_time_t(time);
+        const auto micros = std::chrono::duration_cast<std::chrono::microseconds>(time.time_since_epoch()).count() % 1000000;
+        std::tm utc {};
+#if defined(_WIN32)
+        gmtime_s(&utc, &seconds);
+#else
+        gmtime_r(&seconds, &utc);
+#endif
+        char stamp[48];
+        std::snprintf(stamp, sizeof(stamp), "%04d-%02d-%02dT%02d:%02d:%02d.%06dZ ", utc.tm_year + 1900, utc.tm_mon + 1,
+                      utc.tm_mday, utc.tm_hour, utc.tm_min, utc.tm_sec, static_cast<int>(micros));
+        out += stamp;
+        out += kLevelNames[static_cast<std::size_t>(record.site->level)];
+        out += ' ';
+
+        std::size_t next_arg = 0;
+        for (const char* p = record.site->format; *p != '\0'; ++p) {
+            if (p[0] == '{' && p[1] == '}' && next_arg < record.argCount) {
+                appendArg(record, next_arg++, out);
+                ++p;
+            } else {
+                out += *p;
+            }
+        }
+        if (record.suppressed != 0) {
+            out += " (" + std::to_string(record.suppressed) + " similar message(s) suppressed)";
+        }
+        if (out.back() != '\n') {
+            out += '\n';
+        }
+    }
+
+    static void appendArg(const LogRecord& record, std::size_t i, std::string& out) {
+        const std::uint64_t value = record.values[i];
+        switch (record.types[i]) {
+            case LogRecord::ArgType::Signed:
+                out += std::to_string(static_cast<std::int64_t>(value));
+                break;
+            case LogRecord::ArgType::Unsigned:
+                out += std::to_string(value);
+                break;
+            case LogRecord::ArgType::Double: {
+                double d;
+                std::memcpy(&d, &value, sizeof(d));
+                char buffer[32];
+                std::snprintf(buffer, sizeof(buffer), "%.15g", d);
+                out += buffer;
+                break;
+            }
+            case LogRecord::ArgType::Bool:
+                out += value ? "true" : "false";
+                break;
+            case LogRecord::ArgType::Char:
+                out += static_cast<char>(value);
+                break;
+            case LogRecord::ArgType::String:
+                out.append(record.text + (value >> 16), value & 0xFFFF);
+                break;
+        }
+    }
+};
+
+/**
+ * @brief Logs at `level` if it is enabled, at most `perSecond` times per second (0: no limit).
+ * The first argument after the limit is the format string, which must be a string literal.
+ */
+#define LOG_RATE_LIMITED(level, perSecond, ...)                                        \
+    do {                                                                               \
+        if (Logger::instance().enabled(level)) {                                       \
+            static LogSite log_site_(level, LOG_FORMAT_(__VA_ARGS__, ""), perSecond);  \
+            LOG_CALL_(log_site_, __VA_ARGS__);                                         \
+        }                                                                              \
+    } while (false)
+
+#define LOG_DEBUG(...) LOG_RATE_LIMITED(LogLevel::Debug, 0, __VA_ARGS__)
+#define LOG_INFO(...) LOG_RATE_LIMITED(LogLevel::Info, 0, __VA_ARGS__)
+#define LOG_WARN(...) LOG_RATE_LIMITED(LogLevel::Warn, 0, __VA_ARGS__)
+#define LOG_ERROR(...) LOG_RATE_LIMITED(LogLevel::Error, 0, __VA_ARGS__)
+
+// Implementation details of the macros: split the format string from the arguments.
+#define LOG_FORMAT_(format, ...) format
+#define LOG_CALL_(site, format, ...) Logger::instance().log(site, ##__VA_ARGS__)
@@ -0,0 +1,155 @@
+/**
+ * @file MassCancelTests.cpp
+ * @brief Tests of mass cancels by account and of cancelling a session's orders (cancel-on-disconnect).
+ */
+
+#include <algorithm>  // For std::sort
+#include <stdexcept>
+#include <vector>
+
+#include "Instrument.h"
+#include "Journal.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "OrderOwners.h"
+#include "TestHarness.h"
+#include "TestSupport.h"
+
+using testing::SameLevels;
+using testing::TempFile;
+
+namespace {
+
+constexpr AccountId kMaker = 5;
+constexpr AccountId kOther = 6;
+
+std::vector<SymbolId> ConfigureSymbols(MatchingEngine& engine) {
+    return {engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001)),
+            engine.configureSymbol("ETH-USDT", Instrument(0.01, 0.001))};
+}
+
+OrderOptions Owner(AccountId account, SessionId session = kNoSession, Price stopPrice = 0) {
+    OrderOptions options;
+    options.account = account;
+    options.session = session;
+    options.stopPrice = stopPrice;
+    return options;
+}
+
+std::vector<OrderId> Sorted(std::vector<OrderId> ids) {
+    std::sort(ids.begin(), ids.end());
+    return ids;
+}
+
+} // namespace
+
+TEST(MassCancelRemovesTheAccountsRestingAndStopOrdersAndJournalsThem) {
+    TempFile journal("mass_cancel.journal");
+    std::vector<OrderId> cancelled;
+    std::vector<BookView> after;
+    std::vector<OrderId> on_btc;
+    OrderId other = 0;
+    {
+        MatchingEngine engine(2);
+        const std::vector<SymbolId> symbols = ConfigureSymbols(engine);
+        engine.openJournal(journal.path());
+        const SymbolId btc = symbols[0];
+        const SymbolId eth = symbols[1];
+        on_btc = {engine.process(OrderType::Limit, Side::Buy, 10, btc, 100, Owner(kMaker)),
+                  engine.process(OrderType::Limit, Side::Sell, 10, btc, 110, Owner(kMaker)),
+                  engine.process(OrderType::StopMarket, Side::Buy, 5, btc, 0, Owner(kMaker, kNoSession, 120))};
+        const OrderId on_eth = engine.process(OrderType::Limit, Side::Sell, 10, eth, 200, Owner(kMaker));
+        other = engine.process(OrderType::Limit, Side::Buy, 10, btc, 99, Owner(kOther));
+
+        // One symbol first: the account's order on the other symbol stays.
+        CHECK(Sorted(engine.massCancel(kMaker, btc)) == Sorted(on_btc));
+        CHECK(engine.getBookView(eth).askCount == 1);
+        CHECK(engine.massCancel(kMaker) == std::vector<OrderId>{on_eth});
+        CHECK(engine.massCancel(kMaker).empty());
+        CHECK(engine.getBookView(eth).askCount == 0);
+
+        const BookView view = engine.getBookView(btc);
+        CHECK(view.bidCount == 1 && view.bids[0].price == 99); // Only the other account's order is left.
+        CHECK(view.askCount == 0);
+        CHECK_THROWS(std::invalid_argument, engine.massCancel(kNoAccount));
+
+        cancelled = on_btc;
+        cancelled.push_back(on_eth);
+        for (SymbolId symbol : symbols) {
+            after.push_back(engine.getBookView(symbol));
+        }
+    }
+
+    // Each order is journaled as a plain cancel...
+    std::vector<OrderId> journaled;
+    {
+        Journal file(journal.path(), 2);
+        file.replay([&](const JournalRecord& record) {
+            if (record.type == JournalRecordType::Cancel) {
+                journaled.push_back(record.orderId);
+            }
+        });
+    }
+    CHECK(Sorted(journaled) == Sorted(cancelled));
+
+    // ...so a replay removes the same orders, stop order included.
+    MatchingEngine restored(2);
+    const std::vector<SymbolId> symbols = ConfigureSymbols(restored);
+    restored.openJournal(journal.path());
+    for (SymbolId symbol : symbols) {
+        CHECK(SameLevels(restored.getBookView(symbol), after[symbol]));
+    }
+    CHECK(restored.massCancel(kMaker).empty());
+    CHECK(restored.massCancel(kOther) == std::vector<OrderId>{other});
+}
+
+TEST(CancellingASessionRemovesOnlyThatSessionsOrders) {
+    TempFile journal("session.journal");
+    MatchingEngine engine(2);
+    const std::vector<SymbolId> symbols = ConfigureSymbols(engine);
+    engine.openJournal(journal.path());
+    const SessionId session = engine.openSession();
+    const SessionId other_session = engine.openSession();
+    CHECK(session != other_session);
+
+    const std::vector<OrderId> orders = {
+        engine.process(OrderType::Limit, Side::Buy, 10, symbols[0], 100, Owner(kMaker, session)),
+        engine.process(OrderType::StopLimit, Side::Sell, 5, symbols[0], 80, Owner(kMaker, session, 90)),
+        engine.process(OrderType::Limit, Side::Sell, 10, symbols[1], 200, Owner(kNoAccount, session))};
+    // The same account on another session, which stays connected.
+    const OrderId kept = engine.process(OrderType::Limit, Side::Buy, 10, symbols[0], 101, Owner(kMaker, other_session));
+
+    CHECK(Sorted(engine.cancelSession(session)) == Sorted(orders));
+    CHECK(engine.cancelSession(session).empty());
+    const BookView view = engine.getBookView(symbols[0]);
+    CHECK(view.bidCount == 1 && view.bids[0].price == 101);
+    CHECK(engine.getBookView(symbols[1]).askCount == 0);
+
+    // The pending stop order is gone too: a trade at its stop price fires nothing.
+    std::vector<Trade> trades;
+    CommandReply reply;
+    reply.trades = &trades;
+    testing::Submit(engine, reply, OrderType::Limit, Side::Sell, 1, symbols[0], 90);
+    CHECK(trades.size() == 1);
+    CHECK(engine.massCancel(kMaker) == std::vector<OrderId>{kept});
+}
+
+TEST(OwnerListsStayAllocatedWhileTheyEmpty) {
+    Order order(1, OrderType::Limit, Side::Buy, 10, 0, 100, 0, kMaker, SelfTradePrevention::None, 3);
+    OrderOwners owners;
+    owners.add(&order);
+    CHECK(owners.ownerCount() == 2);
+    owners.remove(&order);
+    CHECK(owners.ownerCount() == 2); // Re-adding an order of the same owners does not allocate.
+    std::size_t visited = 0;
+    owners.forEachOfAccount(kMaker, [&](const Order&) { ++visited; });
+    owners.forEachOfSession(3, [&](const Order&) { ++visited; });
+    CHECK(visited == 0);
+
+    owners.add(&order);
+    owners.releaseSession(3); // Still has an order: kept.
+    CHECK(owners.ownerCount() == 2);
+    owners.remove(&order);
+    owners.releaseSession(3);
+    CHECK(owners.ownerCount() == 1);
+}
@@ -1,4 +1,3 @@
-
 /**
  * @brief Defines the main MatchingEngine class, which orchestrates all trading activity.
  *
@@ -7,151 +6,1761 @@
  * 2. Receiving new orders and routing them to the correct OrderBook.
  * 3. Triggering the broadcast of real-time data (trades, market data) to subscribed clients
  *    after an order has been processed.
- * 4. Handling thread-safe access to the list of connected WebSocket/SSE clients.
+ * 4. Handing the serialized feed messages to the Publisher, which delivers them to the SSE clients,
+ *    and the binary ones to the MulticastFeed, if one was started.
+ *
+ * --- Threading Model ---
+ * The books are split into shards. Each shard owns the books of a fixed subset of symbols
+ * and is the only thread that ever reads or writes them (single writer), so the matching
+ * path needs no locks at all. API threads hand requests to the owning shard through a
+ * lock-free MPSC queue and wait for the reply. Symbols on different shards are matched in
+ * parallel; a burst on one pair never serializes behind another. Feed messages are
+ * serialized once on the shard and queued to the Publisher's thread, so no shard ever
+ * waits on a client connection.
  */
 
 #pragma once
 
+#include <algorithm>      // For std::any_of, std::sort
+#include <atomic>         // For the shards' running flags
+#include <chrono>         // For the snapshot interval
+#include <condition_variable> // For waking the snapshot thread on shutdown
+#include <cstddef>        // For std::size_t
+#include <cstdint>        // For std::uint64_t
+#include <functional>     // For the takeover callback
+#include <iostream>
+#include <memory>         // For std::unique_ptr
+#include <mutex>          // For the snapshot thread's state
+#include <optional>       // For the optional fields of a modify request
+#include <stdexcept>      // For std::invalid_argument, std::runtime_error
 #include <string>
+#include <thread>         // For the shards' matching threads
 #include <unordered_map>
+#include <utility>        // For std::pair
 #include <vector>
-#include <mutex>          // For std::mutex and std::lock_guard for thread safety
-#include "OrderBook.h"    // The core logic for a single symbol's order book
-#include "json.hpp"       // For creating JSON messages for broadcasting
-#include "httplib.h"      // For the httplib::DataSink type definition
 
-// Create a convenient alias for the nlohmann::json type.
-using json = nlohmann::json;
+#if defined(__linux__)
+#include <pthread.h>      // For pthread_setaffinity_np
+#include <sched.h>        // For cpu_set_t
+#endif
+
+#include "OrderBook.h"    // The core logic for a single symbol's order book
+#include "Instrument.h"   // Per-symbol tick and lot size
+#include "SymbolTable.h"  // The registry of symbol names, SymbolIds and instruments
+#include "Command.h"      // The requests passed from the API threads to the shards
+#include "MpscQueue.h"    // The lock-free ingress queue of each shard
+#include "Backoff.h"      // The idle strategy of the shard threads
+#include "Publisher.h"    // The fan-out of feed messages to the SSE clients
+#include "Journal.h"      // The write-ahead log that makes accepted commands survive a restart
+#include "Snapshot.h"     // The periodic copies of the books that bound the journal replayed on startup
+#include "Metrics.h"      // The latency histograms and counters exposed on GET /metrics
+#include "FeedEncoder.h"  // The serialization of the trade and market data messages
+#include "BookView.h"     // The copies of the top of each book that other threads read
+#include "MulticastFeed.h" // The sequenced binary feed sent to a multicast group
+#include "Risk.h"         // The pre-trade risk limits every new order is checked against
+#include "Replication.h"  // The journal stream from a primary to its hot standby
+#include "TradeHistory.h" // The queryable trade and candle history
+#include "Tracing.h"      // The sampled timelines of individual orders
+#include "Logger.h"       // The asynchronous logger used off the startup path
 
 class MatchingEngine {
 private:
-    // A map from a symbol string (e.g., "BTC-USDT") to its dedicated OrderBook object.
-    // std::unordered_map is used for fast O(1) average-case lookup of the correct book.
-    std::unordered_map<std::string, OrderBook> order_books_;
+    /**
+     * @class Shard
+     * @brief One matching thread and the order books of the symbols assigned to it.
+     *
+     * Order and trade IDs are drawn from per-shard sequences interleaved by shard index
+     * (ID = sequence * shardCount + shardIndex), so they are unique engine-wide without any
+     * shared counter, and a cancel or modify can be routed to the right shard from the ID alone.
+     * An engine that is one of several nodes behind a routing gateway interleaves those IDs once
+     * more by node index (ID = (sequence * shardCount + shardIndex) * nodeCount + nodeIndex), so
+     * they are unique across the nodes and the gateway routes by ID just like the engine does.
+     */
+    class Shard {
+    public:
+        static constexpr std::size_t kQueueCapacity = 16384;
+
+        Shard(MatchingEngine& engine, std::size_t index, std::size_t count, std::size_t nodeIndex, std::size_t nodeCount)
+            : engine_(engine), index_(index), count_(count), id_stride_(count * nodeCount),
+              id_offset_(index * nodeCount + nodeIndex), queue_(kQueueCapacity), feed_encoder_(engine.symbols_) {}
+
+        Shard(const Shard&) = delete;
+        Shard& operator=(const Shard&) = delete;
+
+        /**
+         * @brief Starts the shard's matching thread.
+         * @param core The CPU core to pin the thread to, or -1 to leave it unpinned.
+         */
+        void start(int core) {
+            running_.store(true, std::memory_order_release);
+            thread_ = std::thread([this] { run(); });
+            if (core >= 0) {
+                pinToCore(core);
+            }
+        }
+
+        /** @brief Stops the matching thread after it has drained its queue. */
+        void stop() {
+            running_.store(false, std::memory_order_release);
+            if (thread_.joinable()) {
+                thread_.join();
+            }
+        }
+
+        /** @brief Hands a command to the shard. Safe to call from any thread. */
+        void submit(Command&& command) {
+            command.submitted = Tsc::now();
+            if (command.received == 0) {
+                command.received = command.submitted;
+            }
+            Backoff backoff;
+            while (!queue_.tryPush(std::move(command))) {
+                backoff.pause(); // The queue is full: the shard is overloaded, so apply back-pressure.
+            }
+        }
+
+        /** @brief The shard's recent order traces. Safe to read from any thread. */
+        const TraceRing& traces() const { return traces_; }
+
+    private:
+        MatchingEngine& engine_;
+        const std::size_t index_;
+        const std::size_t count_;
+        const std::size_t id_stride_; // ID = sequence * id_stride_ + id_offset_ (see above).
+        const std::size_t id_offset_;
+        MpscQueue<Command> queue_;
+        std::thread thread_;
+        std::atomic<bool> running_{false};
+
+        // --- State owned exclusively by the shard's thread ---
+
+        // The books of this shard's symbols, indexed by symbol ID / shard count (the shard owns every
+        // count_-th ID, so the slots are dense). A book is created on its symbol's first order.
+        std::vector<std::unique_ptr<OrderBook>> order_books_;
+
+        // Every resting order of this shard's books, by ID. Shared by the books so that a cancel
+        // or modify request, which only carries the order ID, can find its order in O(1).
+        OrderIndex order_index_;
+
+        // The resting and stop orders of each account and session across this shard's books,
+        // so that a mass cancel only visits the orders it removes.
+        OrderOwners order_owners_;
+
+        // Reused by every mass cancel: the symbol and ID of each order it removes.
+        std::vector<std::pair<SymbolId, OrderId>> mass_cancel_;
+
+        // Reused for every order so that matching does not allocate a fresh vector of trades.
+        std::vector<Trade> trades_;
+
+        // Serializes this shard's feed messages into buffers reused from one message to the next.
+        FeedEncoder feed_encoder_;
+
+        std::uint64_t next_order_seq_ = 1;
+        std::uint64_t next_trade_seq_ = 1;
+
+        // When the command being executed was dequeued (a Tsc timestamp). The match stage is
+        // timed from here, which saves reading the clock again on the hot path.
+        std::uint64_t started_ = 0;
+        // Whether the command being executed is replayed from the journal (or a primary's stream).
+        bool replaying_ = false;
+
+        // The traces of the orders sampled during the change being applied, completed and pushed
+        // into traces_ once it has been published (see sampleTrace).
+        std::vector<OrderTrace> sampled_;
+        std::uint32_t orders_since_trace_ = 0;
+        TraceRing traces_;
+
+        void run() {
+            Backoff backoff;
+            Command command;
+            // Keep going until asked to stop, then drain whatever is still queued.
+            while (true) {
+                if (queue_.tryPop(command)) {
+                    execute(command);
+                    backoff.reset();
+                } else if (running_.load(std::memory_order_acquire)) {
+                    backoff.pause();
+                } else {
+                    break;
+                }
+            }
+        }
+
+        void execute(Command& command) {
+            if (command.type == CommandType::PublishSnapshots) {
+                for (auto& book : order_books_) {
+                    if (book) {
+                        engine_.broadcast_snapshot(feed_encoder_, *book, command.feedChannel);
+                    }
+                }
+                return;
+            }
+            if (isOrderEntry(command.type)) {
+                // Timestamps from two cores may be a few ticks apart, so never report a negative delay.
+                started_ = Tsc::now();
+                stage(Stage::Queue).recordExclusive(Tsc::toNanos(started_ > command.submitted ? started_ - command.submitted : 0));
+            }
+            CommandReply unused; // Replayed commands have nobody waiting for their outcome.
+            CommandReply* reply = (command.reply != nullptr) ? command.reply : &unused;
+            trades_.clear();
+            replaying_ = command.replay;
+            try {
+                if (!command.replay && isOrderEntry(command.type) && engine_.standby_.load(std::memory_order_relaxed)) {
+                    throw std::invalid_argument("This engine is a standby; send orders to the primary.");
+                }
+                switch (command.type) {
+                    case CommandType::NewOrder:
+                        reply->orderId = processNewOrder(command, *reply);
+                        break;
+                    case CommandType::NewOrderBatch:
+                        processBatch(command, *reply);
+                        break;
+                    case CommandType::Cancel:
+                        reply->found = cancel(command, *reply);
+                        break;
+                    case CommandType::Modify:
+                        reply->modifyResult = modify(command, *reply);
+                        break;
+                    case CommandType::MassCancel:
+                        massCancel(command, *reply);
+                        break;
+                    case CommandType::TakeSnapshot:
+                        takeSnapshot(*command.snapshot);
+                        break;
+                    case CommandType::RestoreSnapshot:
+                        restoreSnapshot(*command.snapshotFile);
+                        break;
+                    case CommandType::PublishSnapshots:
+                    case CommandType::Sync:
+                        break;
+                }
+                if (reply->trades != nullptr) {
+                    reply->trades->assign(trades_.begin(), trades_.end());
+                }
+            } catch (const std::exception& e) {
+                reply->error = e.what();
+                if (command.replay) {
+                    LOG_RATE_LIMITED(LogLevel::Warn, 10, "Replaying a journaled command failed: {}", e.what());
+                }
+            }
+            if (command.reply != nullptr) {
+                command.reply->complete();
+            }
+        }
+
+        /** @brief The ID for a new order: the next one of this shard, or the journaled one when replaying. */
+        OrderId nextOrderId(const Command& command, OrderId journaled) {
+            if (!command.replay) {
+                return next_order_seq_++ * id_stride_ + id_offset_;
+            }
+            next_order_seq_ = std::max(next_order_seq_, journaled / id_stride_ + 1);
+            return journaled;
+        }
+
+        /** @brief Whether a command comes from a client, as opposed to the engine's own housekeeping. */
+        static bool isOrderEntry(CommandType type) {
+            return type != CommandType::PublishSnapshots && type != CommandType::Sync &&
+                   type != CommandType::TakeSnapshot && type != CommandType::RestoreSnapshot;
+        }
+
+        /** @brief The engine's journal, unless there is none or the command is itself being replayed from it. */
+        Journal* journalFor(const Command& command) const { return command.replay ? nullptr : engine_.journal_.get(); }
+
+        /**
+         * @brief Checks the values of a new order. Every front end (REST, binary, gateway) relies on
+         * this check, so it lives here rather than in each of them.
+         * @throws std::invalid_argument if the quantity is not positive, an order type with a limit
+         *         price (every type but Market and StopMarket) has a price that is not positive, a stop
+         *         order has no stop price, or self-trade prevention has no account.
+         */
+        static void validateOrder(OrderType type, Quantity quantity, Price price, const OrderOptions& options) {
+            if (quantity <= 0) {
+                throw std::invalid_argument("Order quantity must be positive.");
+            }
+            if (type != OrderType::Market && type != OrderType::StopMarket && price <= 0) {
+                throw std::invalid_argument("Order price must be positive.");
+            }
+            if ((type == OrderType::StopMarket || type == OrderType::StopLimit) && options.stopPrice <= 0) {
+                throw std::invalid_argument("A stop order needs a positive stop price.");
+            }
+            if (options.selfTradePrevention != SelfTradePrevention::None && options.account == kNoAccount) {
+                throw std::invalid_argument("Self-trade prevention needs an account.");
+            }
+        }
+
+        static Order makeOrder(OrderId id, OrderType type, Side side, Quantity quantity, SymbolId symbol,
+                               Price price, const OrderOptions& options) {
+            return Order(id, type, side, quantity, symbol, price, options.stopPrice, options.account,
+                         options.selfTradePrevention, options.session);
+        }
+
+        /**
+         * @brief Checks an order against the risk limits of its account, unless there are none or it is a replay.
+         * @param pending What earlier orders of the same batch add to the account's exposure.
+         * @param replaces For a modify, the resting order being replaced (see RiskEngine::check).
+         * @throws std::invalid_argument if the order breaks a limit.
+         */
+        void checkRisk(const Command& command, const OrderBook& book, const Order& order,
+                       const AccountExposure& pending = AccountExposure(), const Order* replaces = nullptr) {
+            if (command.replay || !engine_.risk_.enabled()) {
+                return;
+            }
+            AccountExposure exposure = pending;
+            if (const AccountExposure* current = book.getExposure(order.getAccount())) {
+                exposure.openOrders += current->openOrders;
+                exposure.openNotional += current->openNotional;
+                exposure.position += current->position;
+            }
+            try {
+                engine_.risk_.check(book, order, exposure, replaces);
+            } catch (const std::invalid_argument&) {
+                SymbolMetrics::add(engine_.metrics_.symbol(order.getSymbolId()).riskRejects, 1);
+                throw;
+            }
+        }
+
+        /** @brief Hands the orders self-trade prevention cancelled during the last change to the reply. */
+        static void reportSelfTradeCancels(const OrderBook& book, CommandReply& reply) {
+            const std::vector<OrderId>& cancelled = book.getSelfTradeCancels();
+            reply.selfTradeCancels.insert(reply.selfTradeCancels.end(), cancelled.begin(), cancelled.end());
+        }
+
+        /**
+         * @brief Starts the trace of one in every MatchingEngine::setTraceSampling() orders.
+         * Called right after the order has been matched; applyAndBroadcast() adds the publishing time.
+         * @param trades How many trades matching the order caused.
+         */
+        void sampleTrace(const Command& command, const Order& order, std::size_t trades) {
+            const std::uint32_t every = engine_.trace_every_;
+            if (every == 0 || command.replay || ++orders_since_trace_ < every) {
+                return;
+            }
+            orders_since_trace_ = 0;
+            OrderTrace trace;
+            trace.orderId = order.getOrderID();
+            trace.symbol = order.getSymbolId();
+            trace.trades = static_cast<std::uint32_t>(trades);
+            trace.received = order.getReceivedTime();
+            trace.queued = command.submitted;
+            trace.accepted = order.getAcceptedTime();
+            sampled_.push_back(trace);
+        }
+
+        OrderId processNewOrder(const Command& command, CommandReply& reply) {
+            validateOrder(command.orderType, command.quantity, command.price, command.options);
+            Order order = makeOrder(nextOrderId(command, command.orderId), command.orderType, command.side,
+                                    command.quantity, command.symbol, command.price, command.options);
+            order.setTimestamps(command.received, started_);
+            OrderBook& book = getOrCreateBook(order.getSymbolId());
+            SymbolMetrics::add(engine_.metrics_.symbol(order.getSymbolId()).orders, 1);
+            checkRisk(command, book, order);
+            if (Journal* journal = journalFor(command)) {
+                reply.journalSize = journal->appendNewOrder(order);
+            }
+            applyAndBroadcast(book, [&](std::vector<Trade>& trades) {
+                book.processOrder(order, trades);
+                sampleTrace(command, order, trades.size());
+            });
+            reportSelfTradeCancels(book, reply);
+            return order.getOrderID();
+        }
+
+        /**
+         * @brief Matches the orders of a batch back to back, as one change to the book.
+         * The trades of the whole batch are broadcast together and at most one market data
+         * update is published, however many orders the batch holds.
+         */
+        void processBatch(const Command& command, CommandReply& reply) {
+            // Validate the whole batch first: a rejected batch must not be half applied.
+            for (const BatchOrder* entry : *command.batch) {
+                validateOrder(entry->type, entry->quantity, entry->price, entry->options);
+            }
+            OrderBook& book = getOrCreateBook(command.symbol);
+            SymbolMetrics::add(engine_.metrics_.symbol(command.symbol).orders, command.batch->size());
+            if (!command.replay && engine_.risk_.enabled()) {
+                // Each order is checked as if the ones before it in the batch had been accepted in full.
+                std::vector<std::pair<AccountId, AccountExposure>> pending;
+                for (const BatchOrder* entry : *command.batch) {
+                    const Order order = makeOrder(0, entry->type, entry->side, entry->quantity, command.symbol,
+                                                  entry->price, entry->options);
+                    auto it = std::find_if(pending.begin(), pending.end(),
+                                           [&](const auto& p) { return p.first == order.getAccount(); });
+                    if (it == pending.end()) {
+                        it = pending.insert(pending.end(), {order.getAccount(), AccountExposure()});
+                    }
+                    checkRisk(command, book, order, it->second);
+                    if (order.getType() == OrderType::Limit || order.getType() == OrderType::StopMarket ||
+                        order.getType() == OrderType::StopLimit) {
+                        ++it->second.openOrders;
+                        it->second.openNotional += OrderBook::exposurePrice(order) * order.getQuantity();
+                    }
+                    it->second.position += (order.getSide() == Side::Buy) ? order.getQuantity() : -order.getQuantity();
+                }
+            }
+            // Take the journal slots of the whole batch up front, so a full journal rejects it before any order is applied.
+            Journal* journal = journalFor(command);
+            std::uint64_t journal_seq = (journal != nullptr) ? journal->reserve(command.batch->size()) : 0;
+            applyAndBroadcast(book, [&](std::vector<Trade>& trades) {
+                for (BatchOrder* entry : *command.batch) {
+                    Order order = makeOrder(nextOrderId(command, entry->orderId), entry->type, entry->side,
+                                            entry->quantity, command.symbol, entry->price, entry->options);
+                    order.setTimestamps(command.received, started_);
+                    if (journal != nullptr) {
+                        reply.journalSize = journal->appendNewOrder(order, journal_seq++);
+                    }
+                    const std::size_t before = trades.size();
+                    book.processOrder(order, trades);
+                    sampleTrace(command, order, trades.size() - before);
+                    entry->orderId = order.getOrderID();
+                }
+            });
+            reportSelfTradeCancels(book, reply);
+        }
+
+        bool cancel(const Command& command, CommandReply& reply) {
+            const OrderId orderId = command.orderId;
+            OrderBook* book = findBookOfOrder(orderId);
+            if (book == nullptr) {
+                return false;
+            }
+            if (Journal* journal = journalFor(command)) {
+                reply.journalSize = journal->appendCancel(orderId);
+            }
+            applyAndBroadcast(*book, [&](std::vector<Trade>&) {
+                book->cancelOrder(orderId);
+            });
+            return true;
+        }
+
+        /**
+         * @brief Cancels every order of an account or session, each affected book in one change.
+         * The orders are found through their owner's list, so the cost is proportional to the
+         * number of orders cancelled, and every book publishes a single market data update (and
+         * order event message) for all of its cancelled orders. Each order is journaled as a
+         * plain cancel, so replaying the journal removes exactly the same orders.
+         */
+        void massCancel(const Command& command, CommandReply& reply) {
+            const AccountId account = command.options.account;
+            const SessionId session = command.options.session;
+            if (account == kNoAccount && session == kNoSession) {
+                throw std::invalid_argument("A mass cancel needs an account or a session.");
+            }
+            // Collect the orders first: cancelling them unlinks them from the list being walked.
+            mass_cancel_.clear();
+            auto collect = [&](const Order& order) {
+                if (command.allSymbols || order.getSymbolId() == command.symbol) {
+                    mass_cancel_.emplace_back(order.getSymbolId(), order.getOrderID());
+                }
+            };
+            if (session != kNoSession) {
+                order_owners_.forEachOfSession(session, collect);
+            } else {
+                order_owners_.forEachOfAccount(account, collect);
+            }
+            std::stable_sort(mass_cancel_.begin(), mass_cancel_.end(),
+                             [](const auto& a, const auto& b) { return a.first < b.first; });
+
+            Journal* journal = journalFor(command);
+            for (std::size_t first = 0, last = 0; first < mass_cancel_.size(); first = last) {
+                const SymbolId symbol = mass_cancel_[first].first;
+                while (last < mass_cancel_.size() && mass_cancel_[last].first == symbol) {
+                    ++last;
+                }
+                OrderBook& book = getOrCreateBook(symbol);
+                if (journal != nullptr) {
+                    for (std::size_t i = first; i < last; ++i) {
+                        reply.journalSize = journal->appendCancel(mass_cancel_[i].second);
+                    }
+                }
+                applyAndBroadcast(book, [&](std::vector<Trade>&) {
+                    for (std::size_t i = first; i < last; ++i) {
+                        book.cancelOrder(mass_cancel_[i].second);
+                        reply.cancelled.push_back(mass_cancel_[i].second);
+                    }
+                });
+            }
+            if (session != kNoSession && command.allSymbols) {
+                order_owners_.releaseSession(session); // Normally the session's cancel-on-disconnect.
+            }
+        }
+
+        ModifyResult modify(const Command& command, CommandReply& reply) {
+            const OrderId orderId = command.orderId;
+            OrderBook* book = findBookOfOrder(orderId);
+            if (book == nullptr) {
+                return ModifyResult::NotFound;
+            }
+
+            const Order& resting = *order_index_.find(orderId);
+            const Instrument& instrument = book->getInstrument();
+            Price new_price = command.newPriceTicks ? *command.newPriceTicks
+                              : command.newPrice   ? instrument.toTicks(*command.newPrice)
+                                                   : resting.getPrice();
+            Quantity new_quantity = command.newQuantityLots ? *command.newQuantityLots
+                                    : command.newQuantity   ? instrument.toLots(*command.newQuantity)
+                                                            : resting.getQuantity();
+            if (new_quantity <= 0) {
+                throw std::invalid_argument("Quantity must be positive; use DELETE to cancel an order.");
+            }
+            if (resting.hasPriceLimit() && new_price <= 0) {
+                throw std::invalid_argument("Order price must be positive.");
+            }
+            if (new_price != resting.getPrice() || new_quantity > resting.getQuantity()) {
+                // Checked as the order it becomes, in place of the one it replaces; a plain reduction always passes.
+                const Order replacement(orderId, resting.getType(), resting.getSide(), new_quantity, resting.getSymbolId(),
+                                        new_price, resting.getStopPrice(), resting.getAccount(),
+                                        resting.getSelfTradePrevention());
+                checkRisk(command, *book, replacement, AccountExposure(), &resting);
+            }
+            if (Journal* journal = journalFor(command)) {
+                reply.journalSize = journal->appendModify(orderId, new_price, new_quantity);
+            }
+
+            ModifyResult result = ModifyResult::NotFound;
+            applyAndBroadcast(*book, [&](std::vector<Trade>& trades) {
+                result = book->modifyOrder(orderId, new_price, new_quantity, trades);
+            });
+            reportSelfTradeCancels(*book, reply);
+            return result;
+        }
+
+        /**
+         * @brief Copies the books and ID sequences into a snapshot. This is the only part of taking a
+         * snapshot that runs on the matching thread, and it only walks the resting orders once.
+         */
+        void takeSnapshot(ShardSnapshot& snapshot) const {
+            // The shard appends its records synchronously, so every one of them is below the current size.
+            snapshot.journalSize = engine_.journal_ ? engine_.journal_->size() : 0;
+            snapshot.nextOrderSeq = next_order_seq_;
+            snapshot.nextTradeSeq = next_trade_seq_;
+            snapshot.books.reserve(order_books_.size() * ShardSnapshot::kBookHeaderSize +
+                                   order_index_.size() * ShardSnapshot::kOrderSize);
+            for (const auto& book : order_books_) {
+                if (book) {
+                    snapshot.appendBook(*book);
+                }
+            }
+        }
+
+        /** @brief Rebuilds the books and ID sequences from this shard's part of a snapshot. */
+        void restoreSnapshot(const SnapshotFile& file) {
+            file.restoreShard(index_, next_order_seq_, next_trade_seq_,
+                              [&](SymbolId symbol, std::uint64_t marketDataSeq, std::optional<Price> lastTradePrice,
+                                  const unsigned char* orders, std::uint64_t count,
+                                  const unsigned char* positions, std::uint64_t positionCount) {
+                OrderBook& book = getOrCreateBook(symbol);
+                for (std::uint64_t i = 0; i < count; ++i) {
+                    book.restoreOrder(SnapshotFile::readOrder(orders, i, symbol));
+                }
+                for (std::uint64_t i = 0; i < positionCount; ++i) {
+                    AccountId account = kNoAccount;
+                    Quantity position = 0;
+                    SnapshotFile::readPosition(positions, i, account, position);
+                    book.restorePosition(account, position);
+                }
+                book.restoreMarketDataSeq(marketDataSeq);
+                book.restoreLastTradePrice(lastTradePrice);
+                engine_.update_view(book);
+                book.clearChangedLevels();
+            });
+        }
+
+        /** @brief Returns the book for a symbol, creating it with the symbol's tick and lot size on first use. */
+        OrderBook& getOrCreateBook(SymbolId symbol) {
+            const std::size_t slot = symbol / count_;
+            if (slot >= order_books_.size()) {
+                order_books_.resize(slot + 1);
+            }
+            if (!order_books_[slot]) {
+                order_books_[slot] = std::make_unique<OrderBook>(symbol, order_index_, order_owners_,
+                                                                 engine_.getInstrument(symbol));
+            }
+            return *order_books_[slot];
+        }
+
+        /** @brief Returns the book on which an order is resting, or nullptr if it is not resting anywhere. */
+        OrderBook* findBookOfOrder(OrderId orderId) {
+            const Order* resting = order_index_.find(orderId);
+            if (resting == nullptr) {
+                return nullptr;
+            }
+            return order_books_[resting->getSymbolId() / count_].get();
+        }
+
+        /**
+         * @brief Applies a change to a book and broadcasts the trades and market data it caused.
+         * @param book The book being changed.
+         * @param mutate Called with the (cleared) trade buffer; performs the actual change.
+         */
+        template <typename Mutation>
+        void applyAndBroadcast(OrderBook& book, Mutation&& mutate) {
+            // --- State Change Detection ---
+            // The book records every level the change touches. To tell which of those are
+            // visible, we only need to know where the visible depth ended *before* the change.
+            BookBefore before;
+            engine_.capture_before(book, before);
+            book.clearChangedLevels();
+            MulticastFeed* multicast = engine_.multicast_.get();
+            const bool order_events =
+                multicast != nullptr || engine_.publisher_.hasSubscribers(FeedChannel::OrderEvents, book.getSymbolId());
+            book.setRecordOrderEvents(order_events);
+            const std::uint64_t market_data_seq = book.getMarketDataSeq();
+
+            // The core logic: apply the change to the book and collect the resulting trades.
+            std::vector<Trade>& trades = trades_;
+            trades.clear();
+            mutate(trades);
+            const std::uint64_t match_end = Tsc::now();
+
+            // --- Broadcast Events After Processing ---
+
+            // 1. Broadcast trades if they occurred.
+            // This is always done when a trade happens.
+            if (!trades.empty()) {
+                for (Trade& trade : trades) {
+                    trade.tradeID = next_trade_seq_++ * id_stride_ + id_offset_;
+                    trade.matched = match_end;
+                }
+                if (TradeHistory* history = engine_.history_.get()) {
+                    history->record(trades, WallClockNanos(), replaying_);
+                }
+                engine_.broadcast_trades(feed_encoder_, trades, book.getInstrument());
+            }
+
+            // 2. Broadcast market data if a visible level changed.
+            engine_.broadcast_market_data(feed_encoder_, book, before);
+
+            // 3. Broadcast the changes to individual orders to the market-by-order subscribers.
+            std::uint64_t order_event_seq = 0;
+            if (order_events && !book.getOrderEvents().empty()) {
+                order_event_seq = book.nextOrderEventSeq();
+                if (engine_.publisher_.hasSubscribers(FeedChannel::OrderEvents, book.getSymbolId())) {
+                    engine_.publisher_.publish({FeedChannel::OrderEvents,
+                                                feed_encoder_.encodeOrderEvents(book, order_event_seq, book.getOrderEvents()),
+                                                book.getSymbolId(), 0, 0, "order events"});
+                }
+            }
+
+            // 4. Send all of it to the multicast group as well.
+            if (multicast != nullptr) {
+                engine_.broadcast_multicast(*multicast, feed_encoder_, book, trades,
+                                            book.getMarketDataSeq() != market_data_seq, order_event_seq);
+            }
+
+            // --- Instrumentation ---
+            const std::uint64_t published = Tsc::now();
+            stage(Stage::Match).recordExclusive(Tsc::toNanos(match_end - started_));
+            stage(Stage::Publish).recordExclusive(Tsc::toNanos(published - match_end));
+            for (OrderTrace& trace : sampled_) {
+                trace.matched = match_end;
+                trace.published = published;
+                traces_.push(trace);
+            }
+            sampled_.clear();
+            SymbolMetrics& symbol = engine_.metrics_.symbol(book.getSymbolId());
+            SymbolMetrics::add(symbol.trades, trades.size());
+            SymbolMetrics::set(symbol.restingOrders, book.restingOrderCount());
+            SymbolMetrics::set(symbol.bidLevels, book.getLevelCount(Side::Buy));
+            SymbolMetrics::set(symbol.askLevels, book.getLevelCount(Side::Sell));
+        }
+
+        /** @brief This shard's own histogram for a stage. */
+        LatencyHistogram& stage(Stage s) { return engine_.metrics_.shardStage(index_, s); }
+
+        void pinToCore(int core) {
+#if defined(__linux__)
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(core, &cpus);
+            if (pthread_setaffinity_np(thread_.native_handle(), sizeof(cpus), &cpus) != 0) {
+                std::cerr << "Warning: could not pin shard " << index_ << " to core " << core << "." << std::endl;
+            }
+#else
+            (void)core;
+            std::cerr << "Warning: core pinning is only supported on Linux." << std::endl;
+#endif
+        }
+    };
+
+    // The registered symbols (e.g., "BTC-USDT"): their small integer IDs, carried by orders and
+    // trades instead of the names, and their tick/lot configuration.
+    SymbolTable symbols_;
+
+    // The latency histograms and counters, written by the shards and the HTTP threads.
+    Metrics metrics_;
+
+    // The top of every symbol's book, indexed by SymbolId. Each is written only by the shard that
+    // owns the symbol, after every change that reaches the top levels, and read by any thread.
+    std::unique_ptr<SeqLock<BookView>[]> book_views_{new SeqLock<BookView>[SymbolTable::kMaxSymbols]};
+
+    // The matching shards. A symbol belongs to shard (symbol ID % shard count).
+    std::vector<std::unique_ptr<Shard>> shards_;
+
+    // The write-ahead log, once openJournal() has been called. Written before the server starts
+    // taking requests and only read afterwards.
+    std::unique_ptr<Journal> journal_;
+
+    // Periodic snapshots of the books, if a snapshot path was given to openJournal().
+    std::string snapshot_path_;
+    std::thread snapshotter_;
+    std::mutex snapshot_mtx_;           // Guards stop_snapshots_.
+    std::mutex snapshot_write_mtx_;     // Keeps concurrent writeSnapshot() calls from sharing the temporary file.
+    std::condition_variable snapshot_cv_;
+    bool stop_snapshots_ = false;
+    SymbolId journaled_symbols_ = 0; // The symbols with IDs below this are in the journal.
+
+    // Set by standBy() and cleared when the standby takes over; the shards reject order entry while it is set.
+    std::atomic<bool> standby_{false};
+    std::unique_ptr<PrimaryFollower> follower_; // Applies the primary's journal, once followPrimary() has been called.
+    std::thread follower_thread_;
+
+    // The journal stream to the standbys, once startReplication() has been called.
+    std::unique_ptr<ReplicationServer> replication_;
+
+    // The trade and candle history, once openHistory() has been called. Like the journal, it is
+    // set before the server starts taking requests and only read afterwards.
+    std::unique_ptr<TradeHistory> history_;
+
+    // One in every trace_every_ orders is traced (0: none). Set by setTraceSampling() before the
+    // server starts taking requests.
+    std::uint32_t trace_every_ = 0;
 
     // --- WebSocket/SSE Broadcasting Members ---
-    
-    // A mutex is essential for thread safety. The cpp-httplib server processes each
-    // request in a separate thread. Therefore, adding a new client connection (from one thread)
-    // and broadcasting a message (from another thread) could happen simultaneously.
-    // The mutex ensures that the client lists are not modified while being iterated over.
-    std::mutex mtx_;
-
-    // A list of pointers to the active client connections (DataSinks) for the trade feed.
-    std::vector<httplib::DataSink*> trade_sinks_;
-    // A list of pointers to the active client connections for the market data feed.
-    std::vector<httplib::DataSink*> market_data_sinks_;
+
+    // Delivers the feed messages to the subscribed clients on its own thread.
+    // The shards publish into it, so it is stopped only after all of them have stopped.
+    Publisher publisher_;
+
+    // The binary feed to a multicast group, once startMulticast() has been called. Like the
+    // journal, it is set before the server starts taking requests and only read afterwards.
+    std::unique_ptr<MulticastFeed> multicast_;
+
+    // The pre-trade risk limits. Set by setRiskLimits() before the server starts taking requests.
+    RiskEngine risk_;
+
+    std::atomic<SessionId> next_session_{1};
+
+    // Which of the engine nodes whose order IDs are interleaved this is (0 of 1 unless behind a gateway).
+    const std::size_t node_index_;
+    const std::size_t node_count_;
 
 public:
-    void process(Order& order) {
-        const std::string& symbol = order.getSymbol();
-        
-        // Access the order book for the given symbol. If it doesn't exist,
-        // the [] operator of unordered_map conveniently creates a new, empty OrderBook.
-        OrderBook& book = order_books_[symbol];
+    // The number of levels per side that market data covers.
+    static constexpr int kMarketDataDepth = 10;
+    static_assert(BookView::kDepth == kMarketDataDepth, "The book views are refreshed whenever market data is published.");
+    // Delta subscribers get a full snapshot instead of a delta every this many updates of a book,
+    // so that a client that joined late or missed a message can resynchronize.
+    static constexpr std::uint64_t kSnapshotInterval = 100;
 
-        // --- State Change Detection ---
-        // To decide whether to broadcast a market data update, we must check if the
-        // visible state of the book has changed. We capture the top 10 levels of the
-        // book *before* the order is processed.
-        json old_asks_depth = book.getBookDepthAsJson(10, Side::Sell);
-        json old_bids_depth = book.getBookDepthAsJson(10, Side::Buy);
+    /**
+     * @brief Creates the engine and starts its matching threads.
+     * @param shardCount The number of matching threads (at least 1).
+     * @param firstCore If not -1, shard i is pinned to CPU core firstCore + i.
+     * @param nodeIndex, nodeCount Which of the engine nodes behind a routing gateway this is (see Shard).
+     *        A journal must always be replayed with the same node configuration it was written with.
+     */
+    explicit MatchingEngine(std::size_t shardCount = 1, int firstCore = -1, std::size_t nodeIndex = 0,
+                            std::size_t nodeCount = 1)
+        : metrics_(shardCount), node_index_(nodeIndex), node_count_(nodeCount) {
+        if (shardCount == 0) {
+            throw std::invalid_argument("The engine needs at least one shard.");
+        }
+        if (nodeIndex >= nodeCount) {
+            throw std::invalid_argument("The node index must be below the node count.");
+        }
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            shards_.push_back(std::make_unique<Shard>(*this, i, shardCount, nodeIndex, nodeCount));
+        }
+        publisher_.start();
+        for (std::size_t i = 0; i < shardCount; ++i) {
+            shards_[i]->start(firstCore < 0 ? -1 : firstCore + static_cast<int>(i));
+        }
+    }
 
-        // The core logic: process the order against the book and get resulting trades.
-        std::vector<Trade> trades = book.processOrder(order);
+    /** @brief Stops every shard after it has processed the commands already queued, then the publisher and the journal. */
+    ~MatchingEngine() {
+        if (follower_) {
+            follower_->stop();
+            follower_thread_.join();
+        }
+        {
+            std::lock_guard<std::mutex> lock(snapshot_mtx_);
+            stop_snapshots_ = true;
+        }
+        snapshot_cv_.notify_all();
+        if (snapshotter_.joinable()) {
+            snapshotter_.join();
+        }
+        symbols_.setListener(nullptr);
+        for (auto& shard : shards_) {
+            shard->stop();
+        }
+        publisher_.stop();
+        if (multicast_) {
+            multicast_->stop();
+        }
+        if (replication_) {
+            replication_->stop();
+        }
+        if (journal_) {
+            journal_->stop();
+        }
+    }
+
+    MatchingEngine(const MatchingEngine&) = delete;
+    MatchingEngine& operator=(const MatchingEngine&) = delete;
+
+    // --- Symbol Configuration ---
+
+    /**
+     * @brief Registers a symbol that can be traded, or changes the tick and lot size of one.
+     * Symbols get their IDs in the order they are first registered. Must be called before the
+     * first order for that symbol is processed, and before freezeSymbols().
+     * @throws std::logic_error once the symbols are frozen.
+     */
+    SymbolId configureSymbol(const std::string& symbol, const Instrument& instrument = Instrument()) {
+        return symbols_.add(symbol, instrument);
+    }
+
+    /**
+     * @brief Ends the registration of symbols. Called once the engine is set up and before it takes
+     * requests; from then on findSymbol() takes no lock and orders for other symbols are rejected.
+     */
+    void freezeSymbols() { symbols_.freeze(); }
 
-        // --- Broadcast Events After Processing ---
-        
-        // 1. Broadcast trades if they occurred.
-        // This is always done when a trade happens.
-        if (!trades.empty()) {
-            broadcast_trades(trades);
+    /**
+     * @brief Returns the ID of a registered symbol.
+     * @throws std::invalid_argument if the symbol is not registered.
+     */
+    SymbolId findSymbol(const std::string& symbol) const {
+        std::optional<SymbolId> id = symbols_.find(symbol);
+        if (!id) {
+            throw std::invalid_argument("Unknown symbol '" + symbol + "'.");
         }
+        return *id;
+    }
+
+    /** @brief Returns the name of a registered symbol's ID. */
+    const std::string& symbolName(SymbolId id) const { return symbols_.name(id); }
+
+    /** @brief The number of symbols registered; their IDs are 0 to symbolCount() - 1. */
+    std::size_t symbolCount() const { return symbols_.size(); }
 
-        // 2. Broadcast market data if the book's visible state has changed.
-        // We capture the new state of the book's depth.
-        json new_asks_depth = book.getBookDepthAsJson(10, Side::Sell);
-        json new_bids_depth = book.getBookDepthAsJson(10, Side::Buy);
+    /** @brief Returns the tick and lot configuration of a registered symbol. */
+    const Instrument& getInstrument(SymbolId symbol) const { return symbols_.instrument(symbol); }
 
-        // We compare the string representations of the JSON to see if anything changed.
-        // This robustly catches changes in price, quantity, or the number of levels.
-        if (old_asks_depth.dump() != new_asks_depth.dump() || old_bids_depth.dump() != new_bids_depth.dump()) {
-            broadcast_market_data(symbol, book);
+    /** @brief The number of matching shards. */
+    std::size_t shardCount() const { return shards_.size(); }
+
+    /** @brief Which node behind a routing gateway this engine is, from 0 to nodeCount() - 1. */
+    std::size_t nodeIndex() const { return node_index_; }
+
+    /** @brief The number of engine nodes behind the routing gateway (1 for a standalone engine). */
+    std::size_t nodeCount() const { return node_count_; }
+
+    // --- Instrumentation ---
+
+    /** @brief The engine's metrics, for the API threads to record their own stages into. */
+    Metrics& metrics() { return metrics_; }
+
+    /** @brief Every metric in the Prometheus text format, for GET /metrics. */
+    std::string renderMetrics() const { return metrics_.render(symbols_); }
+
+    // --- Durability ---
+
+    /**
+     * @brief Rebuilds the books from a journal (and snapshot), then journals every accepted command to it.
+     *
+     * Every journaled command is replayed through the shards exactly as it was originally
+     * executed (with the same order IDs), so the resting orders and the order and trade ID
+     * sequences continue where the previous run stopped. If a snapshot of the books exists,
+     * it is restored first and only the journal records written after it are replayed.
+     * Afterwards, every command is written to the journal before it is applied, and the
+     * engine only returns from an order entry call once the command is durable.
+     * Must be called after configuring the symbols and before any order is submitted.
+     * @param path The journal file; created if it does not exist.
+     * @param snapshotPath The snapshot file restored on startup and written by writeSnapshot(),
+     *        or empty to always replay the whole journal.
+     * @param capacity The size of a newly created journal file in bytes.
+     * @throws std::runtime_error if the journal or snapshot cannot be used with this configuration.
+     */
+    void openJournal(const std::string& path, const std::string& snapshotPath = "",
+                     std::uint64_t capacity = Journal::kDefaultCapacity) {
+        auto journal = std::make_unique<Journal>(path, shards_.size(), node_index_, node_count_, capacity);
+
+        // The journal size each shard's records resume from; everything before it is in the snapshot.
+        std::vector<std::uint64_t> resume(shards_.size(), 0);
+        SymbolId journaled_symbols = 0;
+        if (!snapshotPath.empty() && SnapshotFile::exists(snapshotPath)) {
+            journaled_symbols = restoreSnapshot(snapshotPath, *journal, resume);
         }
+        const std::uint64_t from = *std::min_element(resume.begin(), resume.end());
+
+        journal->replay([&](const JournalRecord& record) {
+            if (record.type == JournalRecordType::Symbol) {
+                checkJournaledSymbol(record);
+                journaled_symbols = std::max<SymbolId>(journaled_symbols, record.symbol + 1);
+                return;
+            }
+            Command command = replayCommand(record);
+            if (record.seq < resume[shardIndexOf(command)]) {
+                return; // Already part of the snapshot.
+            }
+            submit(std::move(command)); // No waiting: the shards replay their books in parallel.
+        }, from);
+        sync();
+        std::cout << "Replayed " << journal->size() - from << " journal record(s) from '" << path << "'." << std::endl;
+
+        journal_ = std::move(journal);
+        snapshot_path_ = snapshotPath;
+        journaled_symbols_ = journaled_symbols;
+        journal_->start();
+        if (!standby_.load(std::memory_order_relaxed)) {
+            journalNewSymbols(); // A standby's journal is a copy of the primary's; these come from there.
+        }
+        symbols_.setListener([this](SymbolId id, const std::string& name) {
+            journal_->waitDurable(journal_->appendSymbol(id, name));
+        });
     }
 
-    // --- Client Connection Management ---
+    /**
+     * @brief Writes a snapshot of every book every `interval` (if anything was journaled since the last one).
+     * @throws std::runtime_error if openJournal() was not given a snapshot path.
+     */
+    void startSnapshots(std::chrono::seconds interval) {
+        if (!journal_ || snapshot_path_.empty()) {
+            throw std::runtime_error("Snapshots need a journal and a snapshot path.");
+        }
+        snapshotter_ = std::thread([this, interval] {
+            std::uint64_t snapshotted = 0; // The journal size at the last snapshot.
+            std::unique_lock<std::mutex> lock(snapshot_mtx_);
+            while (!snapshot_cv_.wait_for(lock, interval, [this] { return stop_snapshots_; })) {
+                const std::uint64_t size = journal_->size();
+                if (size == snapshotted) {
+                    continue;
+                }
+                lock.unlock();
+                try {
+                    writeSnapshot();
+                    snapshotted = size;
+                } catch (const std::exception& e) {
+                    LOG_WARN("Writing a snapshot failed: {}", e.what());
+                }
+                lock.lock();
+            }
+        });
+    }
+
+    /**
+     * @brief Writes a snapshot of every book to the snapshot path given to openJournal().
+     * The shards only pause to copy their books; the file is written on the calling thread.
+     * Safe to call from any thread while the engine is running.
+     * @throws std::runtime_error if there is no snapshot path or the file cannot be written.
+     */
+    void writeSnapshot() {
+        if (!journal_ || snapshot_path_.empty()) {
+            throw std::runtime_error("Snapshots need a journal and a snapshot path.");
+        }
+        std::vector<ShardSnapshot> snapshots(shards_.size());
+        std::vector<CommandReply> replies(shards_.size());
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            Command command;
+            command.type = CommandType::TakeSnapshot;
+            command.snapshot = &snapshots[i];
+            command.reply = &replies[i];
+            shards_[i]->submit(std::move(command));
+        }
+        std::uint64_t journal_size = 0;
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            replies[i].wait();
+            journal_size = std::max(journal_size, snapshots[i].journalSize);
+        }
+        // Never let a snapshot get ahead of the journal: after a crash, the journal would restart
+        // below the snapshot's position and new records there would be skipped on the next replay.
+        journal_->waitDurable(journal_size);
+
+        // Read after the shards have replied, so every symbol that has a book is included.
+        std::vector<std::string> symbols;
+        for (SymbolId id = 0; id < symbols_.size(); ++id) {
+            symbols.push_back(symbols_.name(id));
+        }
+        std::lock_guard<std::mutex> lock(snapshot_write_mtx_);
+        SnapshotFile::write(snapshot_path_, symbols, snapshots, node_index_, node_count_);
+    }
+
+    /** @brief Blocks until the records of a command (CommandReply::journalSize) are durable. No-op without a journal. */
+    void waitDurable(std::uint64_t journalSize) const {
+        if (journal_ && journalSize != 0) {
+            journal_->waitDurable(journalSize);
+        }
+    }
+
+    // --- Multicast ---
+
+    /**
+     * @brief Starts sending every trade, market data delta and market-by-order change to a multicast
+     * group (see MulticastFeed), and the retransmit/snapshot service next to it.
+     * Must be called after configuring the symbols and before any order is submitted. From then on
+     * every book records its order events, whether or not the l3 SSE channel has subscribers.
+     * @throws std::runtime_error if the group cannot be sent to or the retransmit port cannot be bound.
+     */
+    void startMulticast(const MulticastConfig& config) {
+        auto feed = std::make_unique<MulticastFeed>(config, symbols_, [this](SymbolId symbol) { return getBookView(symbol); });
+        feed->start();
+        multicast_ = std::move(feed);
+    }
+
+    // --- Trade History ---
+
+    /**
+     * @brief Records every trade, and 1s/1m/1h candles, in memory-mapped files in `directory` (see TradeHistory).
+     * Call after configuring the symbols and before openJournal(), so that the trades of replayed
+     * commands that are missing from the history (those executed after it was last written) are recorded.
+     * @throws std::runtime_error if the directory or its files cannot be used.
+     */
+    void openHistory(const std::string& directory) { history_ = std::make_unique<TradeHistory>(directory, symbols_); }
+
+    /** @brief The trade and candle history, or nullptr if there is none. Its queries are safe from any thread. */
+    const TradeHistory* history() const { return history_.get(); }
+
+    // --- Replication ---
+
+    /**
+     * @brief Streams the journal to hot standbys (see ReplicationServer) on a background thread.
+     * Call after openJournal().
+     * @throws std::runtime_error if there is no journal or the port cannot be bound.
+     */
+    void startReplication(std::uint16_t port) {
+        if (!journal_) {
+            throw std::runtime_error("Replication streams the journal, so it needs one.");
+        }
+        auto server = std::make_unique<ReplicationServer>(*journal_, port);
+        server->start();
+        replication_ = std::move(server);
+    }
+
+    /**
+     * @brief Makes this engine a hot standby: it rejects order entry until it takes over from its primary.
+     * The books are only changed by the primary's journal records (see followPrimary()), while the
+     * book queries and the feeds keep working, so that clients can already be connected when it takes
+     * over. Call before openJournal(), so that the standby's own journal stays a copy of the primary's.
+     */
+    void standBy() { standby_.store(true, std::memory_order_release); }
+
+    /** @brief Whether this engine is a standby that has not taken over yet. */
+    bool isStandby() const { return standby_.load(std::memory_order_acquire); }
+
+    /**
+     * @brief Starts applying a primary's journal, and takes over once the primary has been lost.
+     *
+     * Each record the primary journals is applied here as it arrives, exactly as journal records are
+     * replayed on startup: with the primary's order IDs, so that the order and trade ID sequences stay
+     * in step too. If this engine has a journal of its own, the records are also appended to it, and
+     * following resumes after its last record. Once the primary has been silent for `timeout`, the
+     * standby finishes applying what it received, starts accepting orders itself and calls
+     * `onTakeover` (on the follower thread). The takeover is not fenced and the primary's acknowledgements
+     * do not wait for this standby; see Replication.h for what that means when it takes over.
+     * Call after standBy(), openJournal() and freezeSymbols().
+     * @throws std::logic_error if standBy() was not called.
+     */
+    void followPrimary(const std::string& host, std::uint16_t port, std::chrono::milliseconds timeout,
+                       std::function<void()> onTakeover = {}) {
+        if (!isStandby()) {
+            throw std::logic_error("Only a standby follows a primary.");
+        }
+        follower_ = std::make_unique<PrimaryFollower>(host, port, timeout);
+        const std::uint64_t from = journal_ ? journal_->size() : 0;
+        follower_thread_ = std::thread([this, from, onTakeover = std::move(onTakeover)] {
+            try {
+                if (!follower_->follow(from, [this](const unsigned char* record) { applyReplicated(record); })) {
+                    return; // The engine is shutting down.
+                }
+            } catch (const std::exception& e) {
+                // Out of step with the primary: taking over would serve different books.
+                LOG_ERROR("Stopped following the primary: {}", e.what());
+                return;
+            }
+            sync(); // Every record received is applied before the first order of our own.
+            if (journal_) {
+                journalNewSymbols();
+            }
+            standby_.store(false, std::memory_order_release);
+            LOG_WARN("Lost the primary; this engine has taken over.");
+            if (onTakeover) {
+                onTakeover();
+            }
+        });
+    }
+
+    /**
+     * @brief Sets the limits every new order and amendment is checked against (see RiskEngine).
+     * Must be called before any order is submitted; journaled orders are replayed without checks,
+     * since they were accepted when they were first submitted.
+     */
+    void setRiskLimits(RiskEngine risk) { risk_ = std::move(risk); }
+
+    // --- Tracing ---
+
+    /**
+     * @brief Traces one in every `every` new orders of each shard (0, the default, traces none).
+     * Must be called before any order is submitted. Each shard keeps its last
+     * TraceRing::kCapacity traces; see recentTraces().
+     */
+    void setTraceSampling(std::uint32_t every) { trace_every_ = every; }
+
+    std::uint32_t traceSampling() const { return trace_every_; }
+
+    /**
+     * @brief The most recent order traces of all shards, oldest first by receive time.
+     * Takes no lock and never delays the matching threads.
+     * @param limit The most traces to return.
+     */
+    std::vector<OrderTrace> recentTraces(std::size_t limit) const {
+        std::vector<OrderTrace> traces;
+        for (const auto& shard : shards_) {
+            shard->traces().forEach([&](const OrderTrace& trace) { traces.push_back(trace); });
+        }
+        std::sort(traces.begin(), traces.end(),
+                  [](const OrderTrace& a, const OrderTrace& b) { return a.received < b.received; });
+        if (traces.size() > limit) {
+            traces.erase(traces.begin(), traces.end() - static_cast<std::ptrdiff_t>(limit));
+        }
+        return traces;
+    }
+
+    // --- Book Queries (safe to call from any thread) ---
 
-    /** @brief Adds a new client connection to the trade feed subscription list. */
-    void add_trade_client(httplib::DataSink& sink) {
-        std::lock_guard<std::mutex> lock(mtx_); // Automatically lock and unlock the mutex.
-        trade_sinks_.push_back(&sink);
+    /**
+     * @brief The top BookView::kDepth levels of a symbol's book, as of its latest market data update.
+     * Takes no lock and never delays the matching thread; it may trail a change that is being
+     * applied at that moment, but is always a consistent copy of one update.
+     * @param symbol A symbol returned by findSymbol.
+     */
+    BookView getBookView(SymbolId symbol) const { return book_views_[symbol].load(); }
+
+    // --- Order Entry (safe to call from any thread) ---
+
+    /**
+     * @brief Processes a new order: matches it against its symbol's book and broadcasts the results.
+     * Blocks until the owning shard has executed the order.
+     * @param options The order's stop price, account and self-trade prevention, if any.
+     * @param selfTradeCancels If given, receives the orders self-trade prevention cancelled.
+     * @param received When the request carrying the order was read (a Tsc timestamp), or 0 for now.
+     * @return The ID assigned to the order.
+     * @throws std::invalid_argument if the options are inconsistent (see OrderOptions).
+     */
+    OrderId process(OrderType type, Side side, Quantity quantity, SymbolId symbol, Price price = 0,
+                    const OrderOptions& options = OrderOptions(), std::vector<OrderId>* selfTradeCancels = nullptr,
+                    std::uint64_t received = 0) {
+        CommandReply reply;
+        Command command;
+        command.type = CommandType::NewOrder;
+        command.orderType = type;
+        command.side = side;
+        command.quantity = quantity;
+        command.symbol = symbol;
+        command.price = price;
+        command.options = options;
+        command.received = received;
+        execute(std::move(command), reply);
+        if (selfTradeCancels != nullptr) {
+            *selfTradeCancels = std::move(reply.selfTradeCancels);
+        }
+        return reply.orderId;
     }
 
-    /** @brief Adds a new client connection to the market data feed subscription list. */
-    void add_market_data_client(httplib::DataSink& sink) {
-        std::lock_guard<std::mutex> lock(mtx_);
-        market_data_sinks_.push_back(&sink);
+    /**
+     * @brief Processes a batch of new orders, possibly for several symbols, and fills in their IDs.
+     * The orders of each symbol are matched back to back in the given order, and each touched
+     * symbol broadcasts its trades and its market data update once for the whole batch.
+     * Different symbols are processed concurrently by their shards. Blocks until all are done.
+     * @param orders The orders; every symbol must be one returned by findSymbol.
+     * @param selfTradeCancels If given, receives the orders self-trade prevention cancelled.
+     * @param received When the request carrying the orders was read (a Tsc timestamp), or 0 for now.
+     * @throws std::invalid_argument if the options of an order are inconsistent (see OrderOptions);
+     *         the orders of that symbol are then not processed.
+     */
+    void processBatch(std::vector<BatchOrder>& orders, std::vector<OrderId>* selfTradeCancels = nullptr,
+                      std::uint64_t received = 0) {
+        // Group the orders by symbol, keeping their relative order within each symbol.
+        std::vector<std::pair<SymbolId, std::vector<BatchOrder*>>> groups;
+        std::unordered_map<SymbolId, std::size_t> group_of_symbol;
+        for (BatchOrder& order : orders) {
+            auto [it, inserted] = group_of_symbol.try_emplace(order.symbol, groups.size());
+            if (inserted) {
+                groups.emplace_back(order.symbol, std::vector<BatchOrder*>());
+            }
+            groups[it->second].second.push_back(&order);
+        }
+
+        // Hand every group to its shard first and only then wait, so the shards work in parallel.
+        std::vector<CommandReply> replies(groups.size());
+        for (std::size_t i = 0; i < groups.size(); ++i) {
+            Command command;
+            command.type = CommandType::NewOrderBatch;
+            command.symbol = groups[i].first;
+            command.batch = &groups[i].second;
+            command.received = received;
+            command.reply = &replies[i];
+            submit(std::move(command));
+        }
+        std::string error;
+        std::uint64_t journal_size = 0;
+        for (CommandReply& reply : replies) {
+            reply.wait();
+            journal_size = std::max(journal_size, reply.journalSize);
+            if (error.empty()) {
+                error = reply.error;
+            }
+            if (selfTradeCancels != nullptr) {
+                selfTradeCancels->insert(selfTradeCancels->end(), reply.selfTradeCancels.begin(),
+                                         reply.selfTradeCancels.end());
+            }
+        }
+        waitDurable(journal_size);
+        if (!error.empty()) {
+            throw std::invalid_argument(error);
+        }
+    }
+
+    /**
+     * @brief Cancels a resting order.
+     * @param orderId The ID returned when the order was submitted.
+     * @return True if the order was resting and has been removed, false if it was not found.
+     */
+    bool cancel(OrderId orderId) {
+        CommandReply reply;
+        Command command;
+        command.type = CommandType::Cancel;
+        command.orderId = orderId;
+        execute(std::move(command), reply);
+        return reply.found;
     }
 
+    /**
+     * @brief Modifies the price and/or remaining quantity of a resting order.
+     * Fields that are not given keep their current value. See OrderBook::modifyOrder for
+     * when the order keeps or loses its time priority.
+     * @param orderId The ID returned when the order was submitted.
+     * @param price The new decimal price, if it should change.
+     * @param quantity The new decimal remaining quantity, if it should change.
+     * @throws std::invalid_argument if a value is off the tick/lot grid, or the quantity or (for an order with a
+     *         limit price) the price is not positive.
+     */
+    ModifyResult modify(OrderId orderId, const std::optional<double>& price, const std::optional<double>& quantity) {
+        CommandReply reply;
+        Command command;
+        command.type = CommandType::Modify;
+        command.orderId = orderId;
+        command.newPrice = price;
+        command.newQuantity = quantity;
+        execute(std::move(command), reply);
+        return reply.modifyResult;
+    }
+
+    /**
+     * @brief Cancels every resting and pending stop order of an account, on one symbol or on all of them.
+     * Each affected book publishes one market data update for all of its cancelled orders.
+     * @param symbol The symbol to cancel on, or nothing for every symbol.
+     * @return The IDs of the cancelled orders.
+     * @throws std::invalid_argument if the account is kNoAccount.
+     */
+    std::vector<OrderId> massCancel(AccountId account, std::optional<SymbolId> symbol = std::nullopt) {
+        Command command;
+        command.options.account = account;
+        return massCancel(std::move(command), symbol);
+    }
+
+    /**
+     * @brief Cancels every resting and pending stop order submitted on a session, e.g. once it has
+     * disconnected. See massCancel().
+     * @return The IDs of the cancelled orders.
+     */
+    std::vector<OrderId> cancelSession(SessionId session, std::optional<SymbolId> symbol = std::nullopt) {
+        Command command;
+        command.options.session = session;
+        return massCancel(std::move(command), symbol);
+    }
+
+    /** @brief Hands out a new session ID, for an order-entry session to tag its orders with. */
+    SessionId openSession() { return next_session_.fetch_add(1, std::memory_order_relaxed); }
+
+    /**
+     * @brief Hands a command to the shard that owns it without waiting for it to be executed.
+     * The caller waits on `command.reply` (which must be set) when it needs the result, so it
+     * can have many commands in flight at once. Used by the binary gateway to pipeline batches.
+     * A NewOrder's symbol must be one returned by findSymbol.
+     */
+    void submit(Command&& command) { shards_[shardIndexOf(command)]->submit(std::move(command)); }
+
+    // --- Client Connection Management ---
+
+    /**
+     * @brief Subscribes a new client to a feed. The caller drains the returned Subscriber and
+     * must unsubscribe it when the client goes away.
+     * A delta or market-by-order subscriber is sent a snapshot of every book straight away, so
+     * it has a base to apply the following deltas or order events to.
+     * @param filter The symbols to send (all if empty) and, for the l2update channel only, the
+     *               number of levels per side (1 to kMarketDataDepth; 0 means kMarketDataDepth).
+     * @param notifier If set, called instead of waking a blocked pop() when messages become available.
+     * @throws std::invalid_argument if the depth is out of range or given for another channel.
+     */
+    std::shared_ptr<Subscriber> subscribe(FeedChannel channel, SubscriptionFilter filter = {},
+                                          SubscriberNotifier notifier = nullptr) {
+        if (channel == FeedChannel::MarketData && filter.depth == 0) {
+            filter.depth = kMarketDataDepth;
+        } else if (channel == FeedChannel::MarketData && (filter.depth < 1 || filter.depth > kMarketDataDepth)) {
+            throw std::invalid_argument("depth must be between 1 and " + std::to_string(kMarketDataDepth) + ".");
+        } else if (channel != FeedChannel::MarketData && filter.depth != 0) {
+            throw std::invalid_argument("Only the l2update channel has a depth.");
+        }
+        std::shared_ptr<Subscriber> subscriber = publisher_.subscribe(channel, std::move(filter), std::move(notifier));
+        if (channel == FeedChannel::MarketDataDeltas || channel == FeedChannel::OrderEvents) {
+            for (auto& shard : shards_) {
+                Command command;
+                command.type = CommandType::PublishSnapshots;
+                command.feedChannel = channel;
+                shard->submit(std::move(command));
+            }
+        }
+        return subscriber;
+    }
+
+    /** @brief Removes a client previously added with subscribe(). */
+    void unsubscribe(const std::shared_ptr<Subscriber>& subscriber) { publisher_.unsubscribe(subscriber); }
+
 private:
+    /** @brief The shard a command belongs to: the symbol's for new orders and mass cancels, the order's otherwise. */
+    std::size_t shardIndexOf(const Command& command) const {
+        const bool bySymbol = command.type == CommandType::NewOrder || command.type == CommandType::NewOrderBatch ||
+                              command.type == CommandType::MassCancel;
+        return (bySymbol ? command.symbol : command.orderId / node_count_) % shards_.size();
+    }
+
+    /**
+     * @brief Checks that a journaled symbol still has the ID it was journaled with.
+     * @throws std::runtime_error if it does not.
+     */
+    void checkJournaledSymbol(const JournalRecord& record) const {
+        // The journal records the ID each symbol had when it was written. They only still
+        // mean the same books if the same symbols are registered in the same order.
+        if (symbols_.find(record.symbolName) != std::optional<SymbolId>(record.symbol)) {
+            throw std::runtime_error("The journal gives symbol '" + record.symbolName + "' ID " +
+                                     std::to_string(record.symbol) +
+                                     "; configure the same symbols in the same order as when it was written.");
+        }
+    }
+
+    /** @brief The command that replays a journaled order entry, with the order ID it was journaled with. */
+    static Command replayCommand(const JournalRecord& record) {
+        Command command;
+        command.replay = true;
+        command.orderId = record.orderId;
+        switch (record.type) {
+            case JournalRecordType::NewOrder:
+                command.type = CommandType::NewOrder;
+                command.symbol = record.symbol;
+                command.orderType = record.orderType;
+                command.side = record.side;
+                command.price = record.price;
+                command.quantity = record.quantity;
+                command.options.stopPrice = record.stopPrice;
+                command.options.account = record.account;
+                command.options.selfTradePrevention = record.selfTradePrevention;
+                break;
+            case JournalRecordType::Cancel:
+                command.type = CommandType::Cancel;
+                break;
+            case JournalRecordType::Modify:
+                command.type = CommandType::Modify;
+                command.newPriceTicks = record.price;
+                command.newQuantityLots = record.quantity;
+                break;
+            case JournalRecordType::Symbol:
+                break;
+        }
+        return command;
+    }
+
+    /** @brief Journals the symbols that were configured but are not in the journal yet. */
+    void journalNewSymbols() {
+        for (SymbolId id = journaled_symbols_; id < symbols_.size(); ++id) {
+            journal_->appendSymbol(id, symbols_.name(id));
+        }
+        journaled_symbols_ = static_cast<SymbolId>(symbols_.size());
+    }
+
+    /**
+     * @brief Applies one of the primary's journal records on the standby (see followPrimary()).
+     * @throws std::runtime_error if the record is invalid or does not fit this engine's symbols or journal.
+     */
+    void applyReplicated(const unsigned char* data) {
+        JournalRecord record;
+        Journal::decode(data, record);
+        switch (record.type) {
+            case JournalRecordType::Symbol:
+                checkJournaledSymbol(record);
+                journaled_symbols_ = std::max<SymbolId>(journaled_symbols_, record.symbol + 1);
+                break;
+            case JournalRecordType::NewOrder:
+                if (record.symbol >= symbols_.size()) {
+                    throw std::runtime_error("The primary sent an order for unknown symbol ID " +
+                                             std::to_string(record.symbol) + ".");
+                }
+                break;
+            case JournalRecordType::Cancel:
+            case JournalRecordType::Modify:
+                break;
+            default:
+                throw std::runtime_error("The primary sent a record of unknown type " + std::to_string(data[0]) + ".");
+        }
+        if (journal_) {
+            journal_->appendCopy(data);
+        }
+        if (record.type != JournalRecordType::Symbol) {
+            submit(replayCommand(record)); // No waiting, as on startup: the shards apply in parallel.
+        }
+    }
+
+    /**
+     * @brief Restores the books from a snapshot and reports where each shard's journal replay resumes.
+     * @return The number of symbols the snapshot contains (all of which are journaled).
+     */
+    SymbolId restoreSnapshot(const std::string& path, const Journal& journal, std::vector<std::uint64_t>& resume) {
+        SnapshotFile snapshot(path, shards_.size(), node_index_, node_count_);
+        const std::vector<std::string>& symbols = snapshot.symbols();
+        for (SymbolId id = 0; id < symbols.size(); ++id) {
+            if (symbols_.find(symbols[id]) != std::optional<SymbolId>(id)) {
+                throw std::runtime_error("The snapshot gives symbol '" + symbols[id] + "' ID " + std::to_string(id) +
+                                         "; configure the same symbols in the same order as when it was written.");
+            }
+        }
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            resume[i] = snapshot.journalSize(i);
+            if (resume[i] > journal.size()) {
+                throw std::runtime_error("The snapshot '" + path + "' is ahead of the journal; it belongs to another journal.");
+            }
+        }
+
+        std::vector<CommandReply> replies(shards_.size());
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            Command command;
+            command.type = CommandType::RestoreSnapshot;
+            command.snapshotFile = &snapshot;
+            command.reply = &replies[i];
+            shards_[i]->submit(std::move(command));
+        }
+        for (CommandReply& reply : replies) {
+            reply.wait();
+            if (!reply.error.empty()) {
+                throw std::runtime_error(reply.error);
+            }
+        }
+        std::cout << "Restored the books from snapshot '" << path << "' (journal record "
+                  << *std::min_element(resume.begin(), resume.end()) << ")." << std::endl;
+        return static_cast<SymbolId>(symbols.size());
+    }
+
+    /** @brief Waits until every shard has executed all the commands queued so far. */
+    void sync() {
+        std::vector<CommandReply> replies(shards_.size());
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            Command command;
+            command.type = CommandType::Sync;
+            command.reply = &replies[i];
+            shards_[i]->submit(std::move(command));
+        }
+        for (CommandReply& reply : replies) {
+            reply.wait();
+        }
+    }
+
+    /** @brief Runs a mass cancel on the symbol's shard, or on every shard at once if there is no symbol. */
+    std::vector<OrderId> massCancel(Command&& command, std::optional<SymbolId> symbol) {
+        command.type = CommandType::MassCancel;
+        if (symbol) {
+            CommandReply reply;
+            command.symbol = *symbol;
+            execute(std::move(command), reply);
+            return std::move(reply.cancelled);
+        }
+        std::vector<CommandReply> replies(shards_.size());
+        for (std::size_t i = 0; i < shards_.size(); ++i) {
+            Command copy = command;
+            copy.allSymbols = true;
+            copy.reply = &replies[i];
+            shards_[i]->submit(std::move(copy));
+        }
+        std::vector<OrderId> cancelled;
+        std::string error;
+        std::uint64_t journal_size = 0;
+        for (CommandReply& reply : replies) {
+            reply.wait();
+            journal_size = std::max(journal_size, reply.journalSize);
+            if (error.empty()) {
+                error = reply.error;
+            }
+            cancelled.insert(cancelled.end(), reply.cancelled.begin(), reply.cancelled.end());
+        }
+        waitDurable(journal_size);
+        if (!error.empty()) {
+            throw std::invalid_argument(error);
+        }
+        return cancelled;
+    }
+
+    /**
+     * @brief Submits a command to a shard and waits for it to be executed, and journaled if there is a journal.
+     * @throws std::invalid_argument if the shard rejected the command.
+     */
+    void execute(Command&& command, CommandReply& reply) {
+        command.reply = &reply;
+        submit(std::move(command));
+        reply.wait();
+        waitDurable(reply.journalSize);
+        if (!reply.error.empty()) {
+            throw std::invalid_argument(reply.error);
+        }
+    }
+
     // --- Private Broadcasting Helper Functions ---
 
-    /** @brief Serializes and broadcasts a list of trades to all trade subscribers using SSE format. */
-    void broadcast_trades(const std::vector<Trade>& trades) {
-        std::lock_guard<std::mutex> lock(mtx_);
-
-        for (const auto& trade : trades) {
-            // --- THIS PART WAS MISSING IN THE PREVIOUS SNIPPET ---
-            json trade_json;
-            trade_json["type"] = "trade";
-            trade_json["trade_id"] = trade.tradeID;
-            trade_json["symbol"] = trade.symbol;
-            trade_json["price"] = trade.price;
-            trade_json["quantity"] = trade.quantity;
-            trade_json["aggressor_side"] = (trade.aggressorSide == Side::Buy) ? "buy" : "sell";
-            trade_json["maker_order_id"] = trade.makerOrderID;
-            trade_json["taker_order_id"] = trade.takerOrderID;
-            // --- END OF MISSING PART ---
-            
-            // Format the message for Server-Sent Events (SSE)
-            std::string sse_msg = "data: " + trade_json.dump() + "\n\n";
-
-            std::cout << "[BROADCAST] Sending trade message: " << sse_msg; // Use one endl for tidiness
-            for (auto sink : trade_sinks_) {
-                sink->write(sse_msg.c_str(), sse_msg.length());
-            }
-        }
-    }
-
-    /** @brief Serializes and broadcasts the current market state to all market data subscribers using SSE format. */
-    void broadcast_market_data(const std::string& symbol, const OrderBook& book) {
-        std::lock_guard<std::mutex> lock(mtx_);
-
-        // --- THIS PART WAS MISSING IN THE PREVIOUS SNIPPET ---
-        json data_json;
-        data_json["type"] = "l2update";
-        data_json["symbol"] = symbol;
-        
-        BBO bbo;
-        if (book.getBBO(bbo)) {
-            data_json["best_bid"] = bbo.bestBid;
-            data_json["best_ask"] = bbo.bestAsk;
-        } else {
-            data_json["best_bid"] = nullptr;
-            data_json["best_ask"] = nullptr;
-        }
-        
-        data_json["bids"] = book.getBookDepthAsJson(10, Side::Buy);
-        data_json["asks"] = book.getBookDepthAsJson(10, Side::Sell);
-        // --- END OF MISSING PART ---
-
-        // Format the message for Server-Sent Events (SSE)
-        std::string sse_msg = "data: " + data_json.dump() + "\n\n";
-
-        std::cout << "[BROADCAST] Sending market data: " << sse_msg;
-        for (auto sink : market_data_sinks_) {
-            sink->write(sse_msg.c_str(), sse_msg.length());
+    /**
+     * @struct BookBefore
+     * @brief What the market data broadcast needs to remember about a book from just before a change.
+     */
+    struct BookBefore {
+        Price bidBoundary = 0; // The depth boundaries at kMarketDataDepth.
+        Price askBoundary = 0;
+        // The smaller depths that l2update subscribers of the book asked for (bit d for depth d),
+        // and the depth boundaries at each of them.
+        std::uint64_t depths = 0;
+        std::array<Price, kMarketDataDepth> bidBoundaries{};
+        std::array<Price, kMarketDataDepth> askBoundaries{};
+        // The best levels, captured only if the book has BBO subscribers.
+        bool hasBbo = false;
+        LevelQuote bestBid{};
+        LevelQuote bestAsk{};
+    };
+
+    /** @brief Records the state of a book that the broadcast after a change compares against. */
+    void capture_before(const OrderBook& book, BookBefore& before) const {
+        const SymbolId symbol = book.getSymbolId();
+        before.bidBoundary = book.getDepthBoundary(Side::Buy, kMarketDataDepth);
+        before.askBoundary = book.getDepthBoundary(Side::Sell, kMarketDataDepth);
+        if (publisher_.hasSubscribers(FeedChannel::MarketData, symbol)) {
+            before.depths = publisher_.depthMask(FeedChannel::MarketData) & ((std::uint64_t{1} << kMarketDataDepth) - 2);
+            for (int depth = 1; depth < kMarketDataDepth; ++depth) {
+                if ((before.depths >> depth) & 1) {
+                    before.bidBoundaries[depth] = book.getDepthBoundary(Side::Buy, depth);
+                    before.askBoundaries[depth] = book.getDepthBoundary(Side::Sell, depth);
+                }
+            }
+        }
+        before.hasBbo = publisher_.hasSubscribers(FeedChannel::Bbo, symbol);
+        if (before.hasBbo) {
+            before.bestBid = best_level(book, Side::Buy);
+            before.bestAsk = best_level(book, Side::Sell);
+        }
+    }
+
+    /**
+     * @brief Serializes the trades of one change once and queues them for all trade subscribers.
+     * On the trade channel every trade is its own SSE event, on the batch channel every taker
+     * order is; either way all of them travel (and are written) as a single frame.
+     */
+    void broadcast_trades(FeedEncoder& encoder, const std::vector<Trade>& trades, const Instrument& instrument) {
+        const SymbolId symbol = trades.front().symbolId;
+        if (publisher_.hasSubscribers(FeedChannel::Trades, symbol)) {
+            publisher_.publish({FeedChannel::Trades, encoder.encodeTrades(trades, instrument), symbol, 0, 0,
+                                trades.size() == 1 ? "trade message" : "trade messages"});
+        }
+        if (publisher_.hasSubscribers(FeedChannel::TradeBatches, symbol)) {
+            publisher_.publish({FeedChannel::TradeBatches, encoder.encodeTradeBatches(trades, instrument), symbol, 0, 0,
+                                "trade batch"});
+        }
+    }
+
+    /**
+     * @brief Broadcasts the market data update caused by a change to a book, if any level in view changed.
+     *
+     * Only the levels the book recorded as changed are inspected, so an order that never
+     * reaches the top of the book costs a couple of comparisons and publishes nothing.
+     * Otherwise the update gets the book's next sequence number and is sent as a full
+     * "l2update" to snapshot subscribers and as an "l2delta" to delta subscribers. Each message
+     * is serialized at most once per depth, and only if a subscriber wants the book's symbol;
+     * l2update subscribers of a smaller depth only get an update if the change is visible at it.
+     * @param encoder The calling shard's encoder.
+     * @param book The book that was just changed.
+     * @param before The state of the book before the change.
+     */
+    void broadcast_market_data(FeedEncoder& encoder, OrderBook& book, const BookBefore& before) {
+        std::vector<LevelQuote>& bids = encoder.levels(Side::Buy);
+        std::vector<LevelQuote>& asks = encoder.levels(Side::Sell);
+        changed_visible_levels(book, Side::Buy, before.bidBoundary, bids);
+        changed_visible_levels(book, Side::Sell, before.askBoundary, asks);
+        if (bids.empty() && asks.empty()) {
+            return;
+        }
+        const std::uint64_t seq = book.nextMarketDataSeq();
+        const SymbolId symbol = book.getSymbolId();
+        update_view(book);
+
+        // Messages are only built if somebody is going to receive them.
+        const bool snapshot_subscribers = publisher_.hasSubscribers(FeedChannel::MarketData, symbol) &&
+                                          ((publisher_.depthMask(FeedChannel::MarketData) >> kMarketDataDepth) & 1);
+        const bool delta_subscribers = publisher_.hasSubscribers(FeedChannel::MarketDataDeltas, symbol);
+        const bool periodic_snapshot = seq % kSnapshotInterval == 0;
+
+        for (int depth = 1; depth < kMarketDataDepth; ++depth) {
+            if (((before.depths >> depth) & 1) &&
+                changed_within_depth(book, depth, before.bidBoundaries[depth], before.askBoundaries[depth])) {
+                publisher_.publish({FeedChannel::MarketData, encoder.encodeSnapshot(book, depth), symbol, depth,
+                                    snapshot_key(book), "market data"});
+            }
+        }
+        if (before.hasBbo) {
+            broadcast_bbo(encoder, book, before);
+        }
+
+        if (snapshot_subscribers || (periodic_snapshot && delta_subscribers)) {
+            Payload snapshot = encoder.encodeSnapshot(book, kMarketDataDepth);
+            if (snapshot_subscribers) {
+                publisher_.publish({FeedChannel::MarketData, snapshot, symbol, kMarketDataDepth, snapshot_key(book), "market data"});
+            }
+            if (periodic_snapshot && delta_subscribers) {
+                publisher_.publish({FeedChannel::MarketDataDeltas, std::move(snapshot), symbol, 0, snapshot_key(book), "market data"});
+                return;
+            }
+        }
+
+        if (delta_subscribers) {
+            publisher_.publish({FeedChannel::MarketDataDeltas, encoder.encodeDelta(book, seq, bids, asks), symbol, 0, 0,
+                                "market data delta"});
+        }
+    }
+
+    /**
+     * @brief Queues the multicast messages of one change to a book: its trades, the delta of its top
+     * levels if market data was published, and its order events if there were any.
+     * @param marketDataChanged True if broadcast_market_data() published an update, whose levels are still in `encoder`.
+     * @param orderEventSeq The market-by-order sequence number of the change, or 0 if it had no order events.
+     */
+    static void broadcast_multicast(MulticastFeed& multicast, FeedEncoder& encoder, const OrderBook& book,
+                                    const std::vector<Trade>& trades, bool marketDataChanged, std::uint64_t orderEventSeq) {
+        std::string messages;
+        for (const Trade& trade : trades) {
+            multicast::appendTrade(messages, trade);
+        }
+        if (marketDataChanged) {
+            const std::vector<LevelQuote>& bids = encoder.levels(Side::Buy);
+            const std::vector<LevelQuote>& asks = encoder.levels(Side::Sell);
+            multicast::appendBook(messages, multicast::MessageType::BookDelta, book.getSymbolId(), book.getMarketDataSeq(),
+                                  bids.data(), bids.size(), asks.data(), asks.size());
+        }
+        if (orderEventSeq != 0) {
+            multicast::appendOrderEvents(messages, book.getSymbolId(), orderEventSeq, book.getOrderEvents());
+        }
+        if (!messages.empty()) {
+            multicast.publish(std::move(messages));
+        }
+    }
+
+    /** @brief Copies the top of a book into its symbol's view. Called by the shard that owns the book. */
+    void update_view(const OrderBook& book) { book_views_[book.getSymbolId()].store(BookView::of(book)); }
+
+    /** @brief Sends the book's best bid and offer to the BBO subscribers if either changed in price or quantity. */
+    void broadcast_bbo(FeedEncoder& encoder, const OrderBook& book, const BookBefore& before) {
+        const LevelQuote bid = best_level(book, Side::Buy);
+        const LevelQuote ask = best_level(book, Side::Sell);
+        if (bid.price == before.bestBid.price && bid.quantity == before.bestBid.quantity &&
+            ask.price == before.bestAsk.price && ask.quantity == before.bestAsk.quantity) {
+            return;
+        }
+        publisher_.publish({FeedChannel::Bbo, encoder.encodeBbo(book, bid, ask), book.getSymbolId(), 0,
+                            snapshot_key(book), "bbo"});
+    }
+
+    /**
+     * @brief Sends a snapshot of a book, at its current sequence number, to the subscribers of a channel:
+     * the top levels to the delta subscribers, or every resting order to the market-by-order subscribers.
+     */
+    void broadcast_snapshot(FeedEncoder& encoder, const OrderBook& book, FeedChannel channel) {
+        if (channel == FeedChannel::OrderEvents) {
+            if (publisher_.hasSubscribers(FeedChannel::OrderEvents, book.getSymbolId())) {
+                publisher_.publish({FeedChannel::OrderEvents, encoder.encodeOrderSnapshot(book), book.getSymbolId(), 0,
+                                    snapshot_key(book), "order snapshot"});
+            }
+            return;
+        }
+        if (publisher_.hasSubscribers(FeedChannel::MarketDataDeltas, book.getSymbolId())) {
+            publisher_.publish({FeedChannel::MarketDataDeltas, encoder.encodeSnapshot(book, kMarketDataDepth),
+                                book.getSymbolId(), 0, snapshot_key(book), "market data"});
+        }
+    }
+
+    /** @brief The best level of one side, or a level of quantity 0 if the side is empty. */
+    static LevelQuote best_level(const OrderBook& book, Side side) {
+        LevelQuote best{0, 0};
+        book.forEachLevel(side, [&](const PriceLevel& level) {
+            best = {level.price, level.totalQuantity};
+            return false;
+        });
+        return best;
+    }
+
+    /** @brief True if one of the levels a change touched is within the top `depth` levels of its side, before or after. */
+    static bool changed_within_depth(const OrderBook& book, int depth, Price oldBidBoundary, Price oldAskBoundary) {
+        const Price new_bid_boundary = book.getDepthBoundary(Side::Buy, depth);
+        const Price new_ask_boundary = book.getDepthBoundary(Side::Sell, depth);
+        for (const LevelChange& change : book.getChangedLevels()) {
+            const bool buy = change.side == Side::Buy;
+            if (OrderBook::isWithinBoundary(change.side, change.price, buy ? oldBidBoundary : oldAskBoundary) ||
+                OrderBook::isWithinBoundary(change.side, change.price, buy ? new_bid_boundary : new_ask_boundary)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** @brief A snapshot of a book supersedes any earlier snapshot of the same book that a client has not received yet. */
+    static std::uint64_t snapshot_key(const OrderBook& book) { return static_cast<std::uint64_t>(book.getSymbolId()) + 1; }
+
+    /**
+     * @brief Collects the `[price, quantity]` updates a client must apply to keep its top levels of one side correct.
+     *
+     * These are the changed levels that were in view before the change or are in view after
+     * it, plus the unchanged levels that moved into view because levels in front of them went
+     * away. After applying them (quantity 0 removes a level) the client truncates its side to
+     * kMarketDataDepth levels, which drops anything pushed out of view by new levels.
+     * @param levels Cleared, then filled with the updates.
+     */
+    void changed_visible_levels(const OrderBook& book, Side side, Price oldBoundary, std::vector<LevelQuote>& levels) const {
+        levels.clear();
+        const Price newBoundary = book.getDepthBoundary(side, kMarketDataDepth);
+        const auto& changes = book.getChangedLevels();
+
+        for (const LevelChange& change : changes) {
+            if (change.side == side && (OrderBook::isWithinBoundary(side, change.price, oldBoundary) ||
+                                        OrderBook::isWithinBoundary(side, change.price, newBoundary))) {
+                levels.push_back({change.price, book.getLevelQuantity(side, change.price)});
+            }
+        }
+
+        // The view now reaches further than it did: send the levels that were hidden before.
+        if (!OrderBook::isWithinBoundary(side, newBoundary, oldBoundary)) {
+            book.forEachLevel(side, [&](const PriceLevel& level) {
+                if (!OrderBook::isWithinBoundary(side, level.price, newBoundary)) {
+                    return false;
+                }
+                const bool changed = std::any_of(changes.begin(), changes.end(), [&](const LevelChange& change) {
+                    return change.side == side && change.price == level.price;
+                });
+                if (!OrderBook::isWithinBoundary(side, level.price, oldBoundary) && !changed) {
+                    levels.push_back({level.price, level.totalQuantity});
+                }
+                return true;
+            });
         }
     }
 };
@@ -0,0 +1,298 @@
+/**
+ * @file Metrics.h
+ * @brief Defines the engine's always-on instrumentation: cheap timestamps, lock-free latency
+ * histograms and per-symbol counters, rendered in the Prometheus text format for GET /metrics.
+ *
+ * Instrumentation that is too expensive gets switched off exactly when it is needed, so
+ * recording must cost a few nanoseconds. Timestamps are read from the CPU's time-stamp counter
+ * (one instruction, no system call) and only converted to nanoseconds when recorded. Each shard
+ * records into histograms of its own, which it is the only writer of, so an update is a plain
+ * relaxed load and store with no locked instruction and no cache line shared with another
+ * shard. Readers (the /metrics handler) merely sum the counters up; a scrape that races with an
+ * update may be off by the one sample in flight, which is fine for monitoring.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>    // For std::size_t
+#include <cstdint>
+#include <cstdio>     // For std::snprintf
+#include <memory>     // For std::unique_ptr
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // For __rdtsc
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>    // For __rdtsc
+#endif
+
+#include "Order.h"       // For SymbolId
+#include "SymbolTable.h" // For the names of the per-symbol series
+
+/**
+ * @class Tsc
+ * @brief Reads the CPU's time-stamp counter and converts its ticks to nanoseconds.
+ *
+ * Modern x86 CPUs have an invariant TSC that ticks at a constant rate and is synchronized
+ * across cores, so timestamps taken on different threads can be subtracted. On other
+ * architectures the steady clock is used instead, whose ticks are nanoseconds already.
+ */
+class Tsc {
+public:
+    /** @brief The current timestamp, in ticks. */
+    static std::uint64_t now() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        return __rdtsc();
+#else
+        return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+    }
+
+    /** @brief Converts a difference between two timestamps to nanoseconds. */
+    static std::uint64_t toNanos(std::uint64_t ticks) {
+        return static_cast<std::uint64_t>(static_cast<double>(ticks) * nanosPerTick());
+    }
+
+    /**
+     * @brief The length of a tick in nanoseconds. The first call measures it against the steady
+     * clock, which takes about 10 ms, so call it once at startup rather than on a hot path.
+     */
+    static double nanosPerTick() {
+        static const double ratio = calibrate();
+        return ratio;
+    }
+
+private:
+    static double calibrate() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        using Clock = std::chrono::steady_clock;
+        const Clock::time_point start = Clock::now();
+        const std::uint64_t start_ticks = now();
+        Clock::time_point end;
+        do {
+            end = Clock::now();
+        } while (end - start < std::chrono::milliseconds(10));
+        const std::uint64_t ticks = now() - start_ticks;
+        const double nanos = static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+        return ticks == 0 ? 1.0 : nanos / static_cast<double>(ticks);
+#else
+        return 1.0;
+#endif
+    }
+};
+
+/**
+ * @class LatencyHistogram
+ * @brief Counts durations in power-of-two nanosecond buckets: bucket i holds [2^(i-1), 2^i) ns.
+ */
+class LatencyHistogram {
+public:
+    static constexpr std::size_t kBuckets = 40; // Up to about 9 minutes; anything longer lands in the last bucket.
+
+    /** @brief Records a duration. Safe to call from any number of threads at once. */
+    void record(std::uint64_t nanos) {
+        this->buckets_[bucketOf(nanos)].fetch_add(1, std::memory_order_relaxed);
+        this->sum_.fetch_add(nanos, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Records a duration without a locked instruction.
+     * Only correct if every writer of this histogram is the same thread.
+     */
+    void recordExclusive(std::uint64_t nanos) {
+        std::atomic<std::uint64_t>& bucket = this->buckets_[bucketOf(nanos)];
+        bucket.store(bucket.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        this->sum_.store(this->sum_.load(std::memory_order_relaxed) + nanos, std::memory_order_relaxed);
+    }
+
+    std::uint64_t bucket(std::size_t i) const { return this->buckets_[i].load(std::memory_order_relaxed); }
+    std::uint64_t sumNanos() const { return this->sum_.load(std::memory_order_relaxed); }
+
+    /** @brief The inclusive upper bound of bucket i, in nanoseconds. */
+    static std::uint64_t upperBound(std::size_t i) { return (std::uint64_t{1} << i) - 1; }
+
+private:
+    std::array<std::atomic<std::uint64_t>, kBuckets> buckets_{};
+    std::atomic<std::uint64_t> sum_{0};
+
+    static std::size_t bucketOf(std::uint64_t nanos) {
+        if (nanos == 0) {
+            return 0;
+        }
+#if defined(_MSC_VER)
+        std::size_t bits = 0;
+        while (nanos != 0) {
+            nanos >>= 1;
+            ++bits;
+        }
+#else
+        const std::size_t bits = 64 - static_cast<std::size_t>(__builtin_clzll(nanos));
+#endif
+        return bits < kBuckets ? bits : kBuckets - 1;
+    }
+};
+
+/**
+ * @enum Stage
+ * @brief The steps of handling an order that are timed.
+ */
+enum class Stage {
+    Parse,   // Turning an HTTP request body into a validated order (HTTP thread).
+    Queue,   // Waiting in the shard's queue until the shard picks the command up.
+    Match,   // Applying the command to its book (lookup, matching, resting, cancelling), from dequeue on.
+    Publish, // Serializing the trades and the market data update for the feeds.
+    Write    // Writing a feed message to a subscriber's connection (HTTP thread).
+};
+
+inline constexpr std::size_t kStageCount = 5;
+
+/**
+ * @struct SymbolMetrics
+ * @brief The counters and gauges of one symbol. Written only by the shard that owns the symbol.
+ * Cache-line aligned so that neighbouring symbols, which belong to different shards, never share a line.
+ */
+struct alignas(64) SymbolMetrics {
+    std::atomic<std::uint64_t> orders{0};       // New orders received.
+    std::atomic<std::uint64_t> trades{0};       // Trades executed.
+    std::atomic<std::uint64_t> riskRejects{0};  // New orders and amendments rejected by the pre-trade risk checks.
+    std::atomic<std::uint64_t> restingOrders{0};
+    std::atomic<std::uint64_t> bidLevels{0};
+    std::atomic<std::uint64_t> askLevels{0};
+
+    /** @brief Single-writer helpers: a relaxed load and store instead of a locked instruction. */
+    static void add(std::atomic<std::uint64_t>& counter, std::uint64_t n) {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+    static void set(std::atomic<std::uint64_t>& gauge, std::uint64_t value) {
+        gauge.store(value, std::memory_order_relaxed);
+    }
+};
+
+/**
+ * @class Metrics
+ * @brief All of the engine's metrics. Each shard owns a set of stage histograms; the HTTP threads share another.
+ */
+class Metrics {
+public:
+    /** @param shardCount The number of shards, each of which gets histograms of its own. */
+    explicit Metrics(std::size_t shardCount)
+        : shard_count_(shardCount), stages_(new StageHistograms[shardCount + 1]),
+          symbols_(new SymbolMetrics[SymbolTable::kMaxSymbols]) {
+        Tsc::nanosPerTick(); // Calibrate now rather than on the first order.
+    }
+
+    Metrics(const Metrics&) = delete;
+    Metrics& operator=(const Metrics&) = delete;
+
+    /** @brief A shard's own histogram for a stage; only that shard may record into it (recordExclusive). */
+    LatencyHistogram& shardStage(std::size_t shard, Stage stage) { return this->stages_[shard].stages[index(stage)]; }
+
+    /** @brief The histogram for a stage shared by the HTTP threads (record). */
+    LatencyHistogram& sharedStage(Stage stage) { return this->stages_[this->shard_count_].stages[index(stage)]; }
+
+    SymbolMetrics& symbol(SymbolId id) { return this->symbols_[id]; }
+
+    /** @brief Renders every metric in the Prometheus text exposition format (version 0.0.4). */
+    std::string render(const SymbolTable& symbols) const {
+        static const char* const kStageNames[kStageCount] = {"parse", "queue", "match", "publish", "write"};
+        std::string out;
+        out += "# HELP engine_stage_latency_seconds Time spent in each stage of handling an order.\n"
+               "# TYPE engine_stage_latency_seconds histogram\n";
+        for (std::size_t stage = 0; stage < kStageCount; ++stage) {
+            std::uint64_t cumulative = 0;
+            std::uint64_t sum = 0;
+            for (std::size_t slot = 0; slot <= this->shard_count_; ++slot) {
+                sum += this->stages_[slot].stages[stage].sumNanos();
+            }
+            for (std::size_t i = 0; i < LatencyHistogram::kBuckets; ++i) {
+                for (std::size_t slot = 0; slot <= this->shard_count_; ++slot) {
+                    cumulative += this->stages_[slot].stages[stage].bucket(i);
+                }
+                if (i + 1 < LatencyHistogram::kBuckets) {
+                    appendSample(out, "engine_stage_latency_seconds_bucket", std::string("stage=\"") + kStageNames[stage] +
+                                 "\",le=\"" + seconds(LatencyHistogram::upperBound(i)) + "\"", cumulative);
+                }
+            }
+            appendSample(out, "engine_stage_latency_seconds_bucket",
+                         std::string("stage=\"") + kStageNames[stage] + "\",le=\"+Inf\"", cumulative);
+            out += std::string("engine_stage_latency_seconds_sum{stage=\"") + kStageNames[stage] + "\"} " + seconds(sum) + "\n";
+            appendSample(out, "engine_stage_latency_seconds_count", std::string("stage=\"") + kStageNames[stage] + "\"", cumulative);
+        }
+
+        const std::size_t count = symbols.size();
+        auto family = [&](const char* name, const char* type, const char* help, auto&& value) {
+            out += std::string("# HELP ") + name + " " + help + "\n# TYPE " + name + " " + type + "\n";
+            for (SymbolId id = 0; id < count; ++id) {
+                value(id, "symbol=\"" + escape(symbols.name(id)) + "\"");
+            }
+        };
+        family("engine_orders_total", "counter", "New orders received.", [&](SymbolId id, const std::string& labels) {
+            appendSample(out, "engine_orders_total", labels, load(this->symbols_[id].orders));
+        });
+        family("engine_trades_total", "counter", "Trades executed.", [&](SymbolId id, const std::string& labels) {
+            appendSample(out, "engine_trades_total", labels, load(this->symbols_[id].trades));
+        });
+        family("engine_risk_rejects_total", "counter", "Orders and amendments rejected by the pre-trade risk checks.",
+               [&](SymbolId id, const std::string& labels) {
+            appendSample(out, "engine_risk_rejects_total", labels, load(this->symbols_[id].riskRejects));
+        });
+        family("engine_resting_orders", "gauge", "Orders resting on the book.", [&](SymbolId id, const std::string& labels) {
+            appendSample(out, "engine_resting_orders", labels, load(this->symbols_[id].restingOrders));
+        });
+        family("engine_price_levels", "gauge", "Non-empty price levels per side of the book.",
+               [&](SymbolId id, const std::string& labels) {
+            appendSample(out, "engine_price_levels", labels + ",side=\"bid\"", load(this->symbols_[id].bidLevels));
+            appendSample(out, "engine_price_levels", labels + ",side=\"ask\"", load(this->symbols_[id].askLevels));
+        });
+        return out;
+    }
+
+private:
+    // Aligned so that the histograms of two shards never share a cache line.
+    struct alignas(64) StageHistograms {
+        std::array<LatencyHistogram, kStageCount> stages;
+    };
+
+    const std::size_t shard_count_;
+    std::unique_ptr<StageHistograms[]> stages_; // One set per shard, plus the shared set at index shard_count_.
+    std::unique_ptr<SymbolMetrics[]> symbols_;  // Indexed by SymbolId.
+
+    static std::size_t index(Stage stage) { return static_cast<std::size_t>(stage); }
+
+    static std::uint64_t load(const std::atomic<std::uint64_t>& value) { return value.load(std::memory_order_relaxed); }
+
+    /** @brief Escapes a label value: symbol names come from clients and may contain anything. */
+    static std::string escape(const std::string& value) {
+        std::string escaped;
+        for (char c : value) {
+            if (c == '\\' || c == '"') {
+                escaped += '\\';
+                escaped += c;
+            } else if (c == '\n') {
+                escaped += "\\n";
+            } else {
+                escaped += c;
+            }
+        }
+        return escaped;
+    }
+
+    static std::string seconds(std::uint64_t nanos) {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.9g", static_cast<double>(nanos) / 1e9);
+        return buffer;
+    }
+
+    static void appendSample(std::string& out, const char* name, const std::string& labels, std::uint64_t value) {
+        out += name;
+        out += '{';
+        out += labels;
+        out += "} ";
+        out += std::to_string(value);
+        out += '\n';
+    }
+};
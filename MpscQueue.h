@@ -0,0 +1,106 @@
+/**
+ * @file MpscQueue.h
+ * @brief Defines MpscQueue, a bounded, lock-free multi-producer/single-consumer queue.
+ *
+ * Any number of threads (e.g., HTTP handler threads) can push into the queue concurrently,
+ * and exactly one thread (e.g., a matching shard) pops from it. The implementation is the
+ * well-known bounded ring with a sequence number per cell (after Dmitry Vyukov): producers
+ * claim a cell with one compare-and-swap, and neither side ever takes a lock or allocates.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>   // For std::size_t
+#include <cstdint>   // For std::intptr_t
+#include <memory>    // For std::unique_ptr
+#include <stdexcept> // For std::invalid_argument
+#include <utility>   // For std::move
+
+/**
+ * @class MpscQueue
+ * @brief A fixed-capacity queue that never blocks: tryPush fails when full, tryPop fails when empty.
+ * @tparam T The element type. It must be default-constructible and move-assignable.
+ */
+template <typename T>
+class MpscQueue {
+public:
+    /**
+     * @brief Constructs an empty queue.
+     * @param capacity The maximum number of queued elements; must be a power of two.
+     */
+    explicit MpscQueue(std::size_t capacity) : cells_(new Cell[capacity]), mask_(capacity - 1) {
+        if (capacity < 2 || (capacity & (capacity - 1)) != 0) {
+            throw std::invalid_argument("MpscQueue capacity must be a power of two.");
+        }
+        for (std::size_t i = 0; i < capacity; ++i) {
+            this->cells_[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /**
+     * @brief Appends an element. Safe to call from any number of threads at once.
+     * @return False (and leaves `value` untouched) if the queue is full.
+     */
+    bool tryPush(T&& value) {
+        std::size_t pos = this->enqueuePos_.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = this->cells_[pos & this->mask_];
+            const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+            const std::intptr_t diff = static_cast<std::intptr_t>(seq) - static_cast<std::intptr_t>(pos);
+            if (diff == 0) {
+                // The cell is free for position `pos`; try to claim it.
+                if (this->enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.data = std::move(value);
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false; // The consumer has not freed this cell yet: the queue is full.
+            } else {
+                pos = this->enqueuePos_.load(std::memory_order_relaxed); // Another producer won; retry.
+            }
+        }
+    }
+
+    bool tryPush(const T& value) {
+        T copy(value);
+        return tryPush(std::move(copy));
+    }
+
+    /**
+     * @brief Removes the oldest element. Must only be called from the single consumer thread.
+     * @return False if the queue is empty.
+     */
+    bool tryPop(T& out) {
+        Cell& cell = this->cells_[this->dequeuePos_ & this->mask_];
+        const std::size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if (seq != this->dequeuePos_ + 1) {
+            return false;
+        }
+        out = std::move(cell.data);
+        // Mark the cell as free for the producer that will wrap around to it next.
+        cell.sequence.store(this->dequeuePos_ + this->mask_ + 1, std::memory_order_release);
+        ++this->dequeuePos_;
+        return true;
+    }
+
+    /** @brief The number of elements the queue can hold. */
+    std::size_t capacity() const { return this->mask_ + 1; }
+
+private:
+    struct Cell {
+        std::atomic<std::size_t> sequence;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    const std::size_t mask_;
+
+    // The producer and consumer positions live on separate cache lines to avoid false sharing.
+    alignas(64) std::atomic<std::size_t> enqueuePos_{0};
+    alignas(64) std::size_t dequeuePos_ = 0;
+};
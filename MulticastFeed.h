@@ -0,0 +1,494 @@
+/**
+ * @file MulticastFeed.h
+ * @brief Defines the MulticastFeed, which sends the trades and book changes to a UDP multicast group.
+ *
+ * The SSE feeds cost the engine a little for every client: each one gets its own copy of every
+ * message over its own TCP connection. Consumers inside the same network (pricers, risk,
+ * surveillance) instead join a multicast group, and the switch does the copying, so adding a
+ * consumer costs the engine nothing. The shards encode the messages of each change to a book
+ * (see MulticastProtocol.h) and queue them; one sender thread numbers them and packs as many as
+ * fit into each datagram, sending a datagram when it is full or when nothing more is queued.
+ *
+ * UDP may drop packets, so the sender keeps the most recent ones, and a small TCP service next to
+ * it retransmits them on request and serves a snapshot of the top of every book (taken from the
+ * books' lock-free views, so it never involves the shards) to receivers that join late or lost
+ * more than is retained.
+ */
+
+#pragma once
+
+#include <algorithm> // For std::min
+#include <atomic>
+#include <chrono>    // For the heartbeat interval
+#include <cstddef>   // For std::size_t
+#include <cstdint>
+#include <functional> // For std::function
+#include <mutex>
+#include <stdexcept> // For std::runtime_error
+#include <string>
+#include <thread>
+#include <utility>   // For std::move
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>   // For htons, htonl, inet_pton
+#include <netinet/in.h>  // For sockaddr_in, IP_MULTICAST_*
+#include <sys/socket.h>
+#include <sys/time.h>    // For timeval
+#include <unistd.h>      // For close
+#endif
+
+#include "Backoff.h"           // The idle strategy of the sender thread
+#include "BookView.h"          // The top of the books, for snapshots
+#include "Logger.h"
+#include "MpscQueue.h"         // The queue from the shards to the sender thread
+#include "MulticastProtocol.h" // The layout of the packets and messages
+#include "SymbolTable.h"
+
+/**
+ * @struct MulticastConfig
+ * @brief Where and how the MulticastFeed sends its packets.
+ */
+struct MulticastConfig {
+    std::string group;                   // The IPv4 multicast group, e.g. "239.1.1.1".
+    std::uint16_t port = 0;              // The UDP port of the group.
+    std::string interfaceAddress;        // The address of the local interface to send from; empty for the default route.
+    int ttl = 1;                         // How many routers the packets may cross; 1 keeps them on the local network.
+    std::uint16_t retransmitPort = 9001; // The TCP port of the retransmit/snapshot service; 0 disables it.
+};
+
+/**
+ * @class MulticastFeed
+ * @brief Sequences, batches and multicasts the messages the shards publish, and serves gap fills over TCP.
+ */
+class MulticastFeed {
+public:
+    static constexpr std::size_t kQueueCapacity = 65536;
+    // The number of most recent packets kept for retransmission (at most kMaxPacketSize bytes each).
+    static constexpr std::size_t kRetainedPackets = 8192;
+    // While nothing is sent, a heartbeat goes out this often so that receivers notice a lost last packet.
+    static constexpr auto kHeartbeatInterval = std::chrono::seconds(1);
+    // A retransmit client that sends nothing for this long is disconnected, so it cannot hold up the others.
+    static constexpr int kClientTimeoutSeconds = 5;
+
+    /** @brief Returns the top of a symbol's book. Called from the retransmit service's thread. */
+    using ViewSource = std::function<BookView(SymbolId)>;
+
+    /**
+     * @brief Creates a feed; call start() to open the sockets and start its threads.
+     * @param config The group to send to and the port of the retransmit service.
+     * @param symbols The registered symbols, for snapshots. Must outlive the feed.
+     * @param views Returns the top of a book, for snapshots.
+     */
+    MulticastFeed(MulticastConfig config, const SymbolTable& symbols, ViewSource views)
+        : config_(std::move(config)), symbols_(symbols), views_(std::move(views)), queue_(kQueueCapacity),
+          retained_(kRetainedPackets) {
+        this->session_ = static_cast<std::uint32_t>(
+            std::chrono::duration_cast<std::chrono::seconds>(std::chrono::system_clock::now().time_since_epoch()).count());
+    }
+
+    MulticastFeed(const MulticastFeed&) = delete;
+    MulticastFeed& operator=(const MulticastFeed&) = delete;
+
+    ~MulticastFeed() { stop(); }
+
+    /**
+     * @brief Opens the multicast socket and the retransmit port and starts the sender and service threads.
+     * @throws std::runtime_error if the group address is invalid or a socket cannot be set up.
+     */
+    void start() {
+        sockaddr_in group{};
+        group.sin_family = AF_INET;
+        group.sin_port = htons(this->config_.port);
+        if (::inet_pton(AF_INET, this->config_.group.c_str(), &group.sin_addr) != 1 ||
+            (ntohl(group.sin_addr.s_addr) >> 28) != 0xE) {
+            throw std::runtime_error("'" + this->config_.group + "' is not an IPv4 multicast group.");
+        }
+        this->sender_socket_ = ::socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (this->sender_socket_ == kInvalidSocket) {
+            throw std::runtime_error("Could not create the multicast socket.");
+        }
+        const int ttl = this->config_.ttl;
+        ::setsockopt(this->sender_socket_, IPPROTO_IP, IP_MULTICAST_TTL, reinterpret_cast<const char*>(&ttl), sizeof(ttl));
+        if (!this->config_.interfaceAddress.empty()) {
+            in_addr local{};
+            if (::inet_pton(AF_INET, this->config_.interfaceAddress.c_str(), &local) != 1 ||
+                ::setsockopt(this->sender_socket_, IPPROTO_IP, IP_MULTICAST_IF, reinterpret_cast<const char*>(&local),
+                             sizeof(local)) != 0) {
+                closeSocket(this->sender_socket_);
+                this->sender_socket_ = kInvalidSocket;
+                throw std::runtime_error("Cannot send multicast from interface '" + this->config_.interfaceAddress + "'.");
+            }
+        }
+        // Connecting only fixes the destination, so every packet can be sent with a plain send().
+        if (::connect(this->sender_socket_, reinterpret_cast<const sockaddr*>(&group), sizeof(group)) != 0) {
+            closeSocket(this->sender_socket_);
+            this->sender_socket_ = kInvalidSocket;
+            throw std::runtime_error("Cannot send to the multicast group " + this->config_.group + ":" +
+                                     std::to_string(this->config_.port) + ".");
+        }
+
+        if (this->config_.retransmitPort != 0) {
+            try {
+                listen();
+            } catch (...) {
+                closeSocket(this->sender_socket_);
+                this->sender_socket_ = kInvalidSocket;
+                throw;
+            }
+        }
+
+        this->running_.store(true, std::memory_order_release);
+        this->sender_ = std::thread([this] { run(); });
+        if (this->listener_ != kInvalidSocket) {
+            this->service_ = std::thread([this] { serve(); });
+        }
+    }
+
+    /** @brief Sends what is already queued, then stops both threads and closes the sockets. */
+    void stop() {
+        if (!this->running_.exchange(false)) {
+            return;
+        }
+        if (this->sender_.joinable()) {
+            this->sender_.join();
+        }
+        if (this->listener_ != kInvalidSocket) {
+            shutdownSocket(this->listener_); // Wakes up the blocked accept().
+            {
+                std::lock_guard<std::mutex> lock(this->client_mtx_);
+                if (this->client_ != kInvalidSocket) {
+                    shutdownSocket(this->client_); // Wakes up the blocked recv().
+                }
+            }
+            if (this->service_.joinable()) {
+                this->service_.join();
+            }
+            closeSocket(this->listener_);
+            this->listener_ = kInvalidSocket;
+        }
+        closeSocket(this->sender_socket_);
+        this->sender_socket_ = kInvalidSocket;
+    }
+
+    /**
+     * @brief Queues the messages of one change to a book, which are sent in the order they were queued.
+     * Safe to call from any number of threads at once.
+     * @param messages One or more messages, each starting with its header (see MulticastProtocol.h).
+     */
+    void publish(std::string&& messages) {
+        Backoff backoff;
+        while (!this->queue_.tryPush(std::move(messages))) {
+            backoff.pause(); // Only if the sender thread itself falls behind; receivers can never cause this.
+        }
+    }
+
+private:
+#if defined(_WIN32)
+    using Socket = SOCKET;
+    static constexpr Socket kInvalidSocket = INVALID_SOCKET;
+    static void closeSocket(Socket socket) { ::closesocket(socket); }
+    static void shutdownSocket(Socket socket) { ::shutdown(socket, SD_BOTH); }
+#else
+    using Socket = int;
+    static constexpr Socket kInvalidSocket = -1;
+    static void closeSocket(Socket socket) { ::close(socket); }
+    static void shutdownSocket(Socket socket) { ::shutdown(socket, SHUT_RDWR); }
+#endif
+
+    /** @brief A packet being filled with messages. */
+    struct Packet {
+        std::string bytes = std::string(multicast::kPacketHeaderSize, '\0');
+        std::uint16_t count = 0;
+
+        bool fits(std::size_t length) const { return this->bytes.size() + length <= multicast::kMaxPacketSize; }
+
+        void add(const char* message, std::size_t length) {
+            this->bytes.append(message, length);
+            ++this->count;
+        }
+
+        /** @brief Fills in the header, once the packet holds all its messages. */
+        void seal(std::uint32_t session, std::uint64_t seq) {
+            multicast::writePacketHeader(reinterpret_cast<unsigned char*>(&this->bytes[0]), session, this->count, seq);
+        }
+
+        void clear() {
+            this->bytes.resize(multicast::kPacketHeaderSize);
+            this->count = 0;
+        }
+    };
+
+    const MulticastConfig config_;
+    const SymbolTable& symbols_;
+    const ViewSource views_;
+    std::uint32_t session_ = 0;
+
+    MpscQueue<std::string> queue_;
+    std::thread sender_;
+    std::atomic<bool> running_{false};
+    Socket sender_socket_ = kInvalidSocket;
+
+    // Only used by the sender thread.
+    Packet packet_;
+    std::uint64_t next_seq_ = 1; // The sequence number of the first message of packet_.
+    std::chrono::steady_clock::time_point last_send_;
+
+    // The latest packets sent, the one with number n at retained_[n % kRetainedPackets].
+    // Written by the sender thread and read by the retransmit service.
+    std::mutex retained_mtx_;
+    std::vector<std::string> retained_;
+    std::uint64_t packets_sent_ = 0; // Guarded by retained_mtx_.
+    std::uint64_t sent_seq_ = 1;     // Guarded by retained_mtx_: the sequence number of the next message to be sent.
+
+    Socket listener_ = kInvalidSocket;
+    std::thread service_;
+    std::mutex client_mtx_;          // Guards client_.
+    Socket client_ = kInvalidSocket; // The retransmit client being served, if any.
+
+    // --- Sending ---
+
+    void run() {
+        Backoff backoff;
+        std::string messages;
+        this->last_send_ = std::chrono::steady_clock::now();
+        // Keep going until asked to stop, then send whatever is still queued.
+        while (true) {
+            if (this->queue_.tryPop(messages)) {
+                add(messages);
+                backoff.reset();
+                continue;
+            }
+            // Nothing more is waiting: send what we have rather than wait for the packet to fill up.
+            flush();
+            if (!this->running_.load(std::memory_order_acquire)) {
+                break;
+            }
+            if (std::chrono::steady_clock::now() - this->last_send_ >= kHeartbeatInterval) {
+                send(this->packet_);
+            }
+            backoff.pause();
+        }
+    }
+
+    /** @brief Numbers the messages of one change and adds them to the packet, sending each packet that fills up. */
+    void add(const std::string& messages) {
+        std::size_t offset = 0;
+        while (offset + multicast::kHeaderSize <= messages.size()) {
+            const std::size_t length = multicast::readU16(reinterpret_cast<const unsigned char*>(messages.data() + offset));
+            if (!this->packet_.fits(length)) {
+                flush();
+            }
+            this->packet_.add(messages.data() + offset, length);
+            offset += length;
+        }
+    }
+
+    /** @brief Sends the packet, if it holds any messages, and keeps it for retransmission. */
+    void flush() {
+        if (this->packet_.count == 0) {
+            return;
+        }
+        send(this->packet_);
+        const std::uint64_t seq = this->next_seq_ + this->packet_.count;
+        {
+            std::lock_guard<std::mutex> lock(this->retained_mtx_);
+            this->retained_[this->packets_sent_ % kRetainedPackets].assign(this->packet_.bytes); // Reuses the old buffer.
+            ++this->packets_sent_;
+            this->sent_seq_ = seq;
+        }
+        this->next_seq_ = seq;
+        this->packet_.clear();
+    }
+
+    /** @brief Sends a packet (or a heartbeat, if it is empty) to the group. A lost or failed send is left to the receivers to recover. */
+    void send(Packet& packet) {
+        packet.seal(this->session_, this->next_seq_);
+        if (::send(this->sender_socket_, packet.bytes.data(), static_cast<int>(packet.bytes.size()), 0) < 0) {
+            LOG_DEBUG("Could not send a multicast packet.");
+        }
+        this->last_send_ = std::chrono::steady_clock::now();
+    }
+
+    // --- Retransmit Service ---
+
+    void listen() {
+        this->listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (this->listener_ == kInvalidSocket) {
+            throw std::runtime_error("Could not create the retransmit socket.");
+        }
+        int reuse = 1;
+        ::setsockopt(this->listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(this->config_.retransmitPort);
+        if (::bind(this->listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(this->listener_, SOMAXCONN) != 0) {
+            closeSocket(this->listener_);
+            this->listener_ = kInvalidSocket;
+            throw std::runtime_error("Could not listen on port " + std::to_string(this->config_.retransmitPort) +
+                                     " for the multicast retransmit service.");
+        }
+    }
+
+    /** @brief Serves the retransmit clients one at a time: gap fills are rare, short and never on the matching path. */
+    void serve() {
+        while (this->running_.load(std::memory_order_acquire)) {
+            Socket client = ::accept(this->listener_, nullptr, nullptr);
+            if (client == kInvalidSocket) {
+                continue; // Either stop() shut the listener down or the connection went away before we took it.
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->client_mtx_);
+                this->client_ = client;
+            }
+            if (this->running_.load(std::memory_order_acquire)) {
+                serveClient(client);
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->client_mtx_);
+                this->client_ = kInvalidSocket;
+            }
+            closeSocket(client);
+        }
+    }
+
+    void serveClient(Socket client) {
+#if defined(_WIN32)
+        const DWORD timeout = kClientTimeoutSeconds * 1000;
+#else
+        timeval timeout{};
+        timeout.tv_sec = kClientTimeoutSeconds;
+#endif
+        ::setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+
+        unsigned char request[multicast::kRequestSize];
+        std::string reply;
+        while (receiveAll(client, request, sizeof(request))) {
+            reply.clear();
+            switch (static_cast<multicast::RequestType>(request[0])) {
+                case multicast::RequestType::Retransmit:
+                    retransmit(multicast::readU64(request + 8), multicast::readU32(request + 4), reply);
+                    break;
+                case multicast::RequestType::Snapshot:
+                    snapshot(reply);
+                    break;
+                default:
+                    return; // Not a request we know; the stream can no longer be trusted.
+            }
+            reply.append(2, '\0'); // The end of the reply.
+            if (!sendAll(client, reply)) {
+                return;
+            }
+        }
+    }
+
+    /** @brief Appends the retained packets that hold any of the `count` messages starting at `seq`. */
+    void retransmit(std::uint64_t seq, std::uint32_t count, std::string& reply) {
+        const std::uint64_t end = seq + std::min(count, multicast::kMaxRetransmitCount);
+        std::lock_guard<std::mutex> lock(this->retained_mtx_);
+        std::uint64_t first = (this->packets_sent_ > kRetainedPackets) ? this->packets_sent_ - kRetainedPackets : 0;
+        // The retained packets are in sequence number order: find the first one that ends after `seq`.
+        std::uint64_t last = this->packets_sent_;
+        while (first < last) {
+            const std::uint64_t middle = first + (last - first) / 2;
+            const std::string& packet = this->retained_[middle % kRetainedPackets];
+            if (packetSeq(packet) + packetCount(packet) <= seq) {
+                first = middle + 1;
+            } else {
+                last = middle;
+            }
+        }
+        for (std::uint64_t n = first; n < this->packets_sent_; ++n) {
+            const std::string& packet = this->retained_[n % kRetainedPackets];
+            if (packetSeq(packet) >= end) {
+                break;
+            }
+            appendFrame(reply, packet);
+        }
+    }
+
+    /** @brief Appends packets holding the name, instrument and top levels of every registered symbol. */
+    void snapshot(std::string& reply) {
+        std::uint64_t seq = 0;
+        {
+            std::lock_guard<std::mutex> lock(this->retained_mtx_);
+            seq = this->sent_seq_;
+        }
+        Packet packet;
+        std::string messages;
+        const std::size_t symbol_count = this->symbols_.size();
+        for (SymbolId symbol = 0; symbol < symbol_count; ++symbol) {
+            const BookView view = this->views_(symbol);
+            messages.clear();
+            multicast::appendSymbol(messages, symbol, this->symbols_.name(symbol), this->symbols_.instrument(symbol));
+            multicast::appendBook(messages, multicast::MessageType::BookSnapshot, symbol, view.seq,
+                                  view.bids, view.bidCount, view.asks, view.askCount);
+            if (!packet.fits(messages.size())) {
+                packet.seal(this->session_, seq);
+                appendFrame(reply, packet.bytes);
+                packet.clear();
+            }
+            std::size_t offset = 0;
+            while (offset < messages.size()) {
+                const std::size_t length = multicast::readU16(reinterpret_cast<const unsigned char*>(messages.data() + offset));
+                packet.add(messages.data() + offset, length);
+                offset += length;
+            }
+        }
+        if (packet.count != 0) {
+            packet.seal(this->session_, seq);
+            appendFrame(reply, packet.bytes);
+        }
+    }
+
+    static std::uint64_t packetSeq(const std::string& packet) {
+        return multicast::readU64(reinterpret_cast<const unsigned char*>(packet.data() + 8));
+    }
+
+    static std::uint16_t packetCount(const std::string& packet) {
+        return multicast::readU16(reinterpret_cast<const unsigned char*>(packet.data() + 4));
+    }
+
+    /** @brief Appends a packet to a reply, preceded by its length. */
+    static void appendFrame(std::string& reply, const std::string& packet) {
+        unsigned char length[2];
+        multicast::writeU16(length, static_cast<std::uint16_t>(packet.size()));
+        reply.append(reinterpret_cast<const char*>(length), sizeof(length));
+        reply += packet;
+    }
+
+    static bool receiveAll(Socket socket, unsigned char* data, std::size_t size) {
+        std::size_t received = 0;
+        while (received < size) {
+            const int n = ::recv(socket, reinterpret_cast<char*>(data + received), static_cast<int>(size - received), 0);
+            if (n <= 0) {
+                return false; // Closed, failed or timed out.
+            }
+            received += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    static bool sendAll(Socket socket, const std::string& data) {
+#if defined(MSG_NOSIGNAL)
+        constexpr int flags = MSG_NOSIGNAL; // A client that went away must not kill the server with SIGPIPE.
+#else
+        constexpr int flags = 0;
+#endif
+        std::size_t sent = 0;
+        while (sent < data.size()) {
+            const int n = ::send(socket, data.data() + sent, static_cast<int>(data.size() - sent), flags);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+};
@@ -0,0 +1,243 @@
+/**
+ * @file MulticastProtocol.h
+ * @brief Defines the binary layout of the multicast market data feed and of its retransmit/snapshot service.
+ *
+ * The MulticastFeed sends UDP datagrams ("packets") to a multicast group. Each packet holds one
+ * or more messages back to back, after a 16-byte packet header:
+ *
+ *     offset 0  u32  session: changes whenever the engine restarts, which restarts the sequence numbers
+ *     offset 4  u16  number of messages in the packet (0 for a heartbeat)
+ *     offset 6  u16  reserved, 0
+ *     offset 8  u64  sequence number of the first message (of the next message, for a heartbeat)
+ *
+ * Every message of a session has its own sequence number, starting at 1 and without gaps, so a
+ * receiver that sees a packet starting past the next number it expects knows exactly which
+ * messages it lost and can ask the retransmit service for them. While there is nothing to send,
+ * a heartbeat goes out every second, so a loss at the end of a burst is noticed too.
+ *
+ * A message starts with the same 4-byte header as a frame of the order-entry protocol (see
+ * BinaryProtocol.h): u16 length of the whole message, u8 message type, u8 reserved. All fields
+ * are little-endian; prices are in ticks and quantities in lots of the symbol.
+ *
+ * The retransmit service is a TCP port. A client sends 16-byte requests:
+ *
+ *     offset 0  u8   request type (RequestType)
+ *     offset 1  u8[3] reserved, 0
+ *     offset 4  u32  Retransmit: the number of messages wanted (at most kMaxRetransmitCount)
+ *     offset 8  u64  Retransmit: the sequence number of the first message wanted
+ *
+ * and gets back, for each request, a series of packets in the multicast format, each preceded by
+ * its u16 length, and then a u16 0. A retransmit reply holds the retained packets that contain
+ * any of the messages asked for (so it can start before and end after them); messages that are no
+ * longer retained are simply missing, and the client must then resynchronize from a snapshot. A
+ * snapshot reply holds one Symbol and one BookSnapshot message for every symbol; the sequence
+ * number in its packet headers is the next one the feed will send.
+ */
+
+#pragma once
+
+#include <algorithm> // For std::min
+#include <cstddef>   // For std::size_t
+#include <cstdint>   // For the fixed-width integer types
+#include <cstring>   // For std::memcpy
+#include <string>
+#include <vector>
+
+#include "BookView.h"    // For LevelQuote
+#include "Instrument.h"
+#include "LittleEndian.h"
+#include "OrderBook.h"   // For OrderEvent
+#include "Trade.h"
+
+namespace multicast {
+
+using binary::readU16;
+using binary::readU32;
+using binary::readU64;
+using binary::writeI64;
+using binary::writeU16;
+using binary::writeU32;
+using binary::writeU64;
+
+/**
+ * @enum MessageType
+ * @brief The type byte of a message.
+ */
+enum class MessageType : std::uint8_t {
+    Trade = 0x01,        // One trade.
+    BookDelta = 0x02,    // The changed top levels of a book, as in an l2delta.
+    BookSnapshot = 0x03, // All the top levels of a book (snapshot replies only).
+    OrderEvents = 0x04,  // Changes to individual resting orders, as in an l3 message.
+    Symbol = 0x05        // A symbol's ID, name, tick and lot size (snapshot replies only).
+};
+
+/**
+ * @enum RequestType
+ * @brief The type byte of a request to the retransmit service.
+ */
+enum class RequestType : std::uint8_t {
+    Retransmit = 0x01,
+    Snapshot = 0x02
+};
+
+// --- Sizes ---
+
+constexpr std::size_t kPacketHeaderSize = 16;
+// The largest packet sent. Stays below a 1500-byte Ethernet MTU after the IP and UDP headers.
+constexpr std::size_t kMaxPacketSize = 1400;
+constexpr std::size_t kHeaderSize = 4;
+constexpr std::size_t kRequestSize = 16;
+constexpr std::uint32_t kMaxRetransmitCount = 65536;
+
+/**
+ * Trade (52 bytes):
+ *     4  u32 symbol ID
+ *     8  u64 trade ID
+ *    16  u64 taker order ID
+ *    24  u64 maker order ID
+ *    32  i64 price in ticks
+ *    40  i64 quantity in lots
+ *    48  u8  aggressor side (0 = buy, 1 = sell)
+ *    49  u8[3] reserved, 0
+ */
+constexpr std::size_t kTradeSize = 52;
+
+/**
+ * BookDelta and BookSnapshot (20 bytes + 16 per level):
+ *     4  u32 symbol ID
+ *     8  u64 market data sequence number of the book (the "seq" of its l2delta messages)
+ *    16  u8  number of bid levels
+ *    17  u8  number of ask levels
+ *    18  u16 reserved, 0
+ *    20  the bid levels, then the ask levels, best first: i64 price in ticks, i64 quantity in lots
+ *
+ * A delta carries the changed levels, where quantity 0 removes a level; after applying it the
+ * receiver truncates each side to BookView::kDepth levels. A receiver applies a book's deltas in
+ * sequence number order, starting after the sequence number of the snapshot it started from.
+ */
+constexpr std::size_t kBookHeaderSize = 20;
+constexpr std::size_t kLevelSize = 16;
+
+/**
+ * OrderEvents (20 bytes + 32 per event):
+ *     4  u32 symbol ID
+ *     8  u64 market-by-order sequence number of the book (the "seq" of its l3 messages)
+ *    16  u8  number of events
+ *    17  u8[3] reserved, 0
+ *    20  the events, in the order they happened:
+ *             0  u8  event type (0 = add, 1 = execute, 2 = delete, 3 = replace)
+ *             1  u8  side (0 = buy, 1 = sell)
+ *             2  u8[6] reserved, 0
+ *             8  u64 order ID
+ *            16  i64 price in ticks
+ *            24  i64 quantity in lots (see OrderEvent)
+ *
+ * The events of one change to a book that do not fit into one message are split across several
+ * messages with the same sequence number.
+ */
+constexpr std::size_t kOrderEventsHeaderSize = 20;
+constexpr std::size_t kOrderEventSize = 32;
+constexpr std::size_t kMaxOrderEventsPerMessage = 40;
+
+/**
+ * Symbol (25 bytes + the name):
+ *     4  u32 symbol ID
+ *     8  f64 tick size
+ *    16  f64 lot size
+ *    24  u8  length of the name
+ *    25  the name
+ */
+constexpr std::size_t kSymbolHeaderSize = 25;
+
+// Every message fits into a packet on its own.
+// A delta side holds at most the kDepth levels that left the view and the kDepth that entered it.
+static_assert(kPacketHeaderSize + kBookHeaderSize + 2 * 2 * BookView::kDepth * kLevelSize <= kMaxPacketSize);
+static_assert(kPacketHeaderSize + kOrderEventsHeaderSize + kMaxOrderEventsPerMessage * kOrderEventSize <= kMaxPacketSize);
+static_assert(kPacketHeaderSize + kSymbolHeaderSize + 255 <= kMaxPacketSize);
+
+/** @brief Writes a packet header. */
+inline void writePacketHeader(unsigned char* p, std::uint32_t session, std::uint16_t count, std::uint64_t seq) {
+    writeU32(p, session);
+    writeU16(p + 4, count);
+    writeU16(p + 6, 0);
+    writeU64(p + 8, seq);
+}
+
+/** @brief Appends `size` zero bytes for a message and writes its header. @return The start of the message. */
+inline unsigned char* appendMessage(std::string& out, std::size_t size, MessageType type) {
+    const std::size_t start = out.size();
+    out.resize(start + size);
+    unsigned char* p = reinterpret_cast<unsigned char*>(&out[start]);
+    writeU16(p, static_cast<std::uint16_t>(size));
+    p[2] = static_cast<unsigned char>(type);
+    return p;
+}
+
+/** @brief Appends a Trade message. */
+inline void appendTrade(std::string& out, const Trade& trade) {
+    unsigned char* p = appendMessage(out, kTradeSize, MessageType::Trade);
+    writeU32(p + 4, trade.symbolId);
+    writeU64(p + 8, trade.tradeID);
+    writeU64(p + 16, trade.takerOrderID);
+    writeU64(p + 24, trade.makerOrderID);
+    writeI64(p + 32, trade.price);
+    writeI64(p + 40, trade.quantity);
+    p[48] = (trade.aggressorSide == Side::Buy) ? 0 : 1;
+}
+
+/** @brief Appends a BookDelta or BookSnapshot message. Each side must hold at most 2 * BookView::kDepth levels. */
+inline void appendBook(std::string& out, MessageType type, SymbolId symbol, std::uint64_t seq,
+                       const LevelQuote* bids, std::size_t bidCount, const LevelQuote* asks, std::size_t askCount) {
+    unsigned char* p = appendMessage(out, kBookHeaderSize + (bidCount + askCount) * kLevelSize, type);
+    writeU32(p + 4, symbol);
+    writeU64(p + 8, seq);
+    p[16] = static_cast<unsigned char>(bidCount);
+    p[17] = static_cast<unsigned char>(askCount);
+    p += kBookHeaderSize;
+    for (const LevelQuote* level = bids; level != bids + bidCount; ++level, p += kLevelSize) {
+        writeI64(p, level->price);
+        writeI64(p + 8, level->quantity);
+    }
+    for (const LevelQuote* level = asks; level != asks + askCount; ++level, p += kLevelSize) {
+        writeI64(p, level->price);
+        writeI64(p + 8, level->quantity);
+    }
+}
+
+/** @brief Appends the OrderEvents messages of one change to a book: as many as it takes to hold all the events. */
+inline void appendOrderEvents(std::string& out, SymbolId symbol, std::uint64_t seq, const std::vector<OrderEvent>& events) {
+    for (std::size_t first = 0; first < events.size(); first += kMaxOrderEventsPerMessage) {
+        const std::size_t count = std::min(kMaxOrderEventsPerMessage, events.size() - first);
+        unsigned char* p = appendMessage(out, kOrderEventsHeaderSize + count * kOrderEventSize, MessageType::OrderEvents);
+        writeU32(p + 4, symbol);
+        writeU64(p + 8, seq);
+        p[16] = static_cast<unsigned char>(count);
+        p += kOrderEventsHeaderSize;
+        for (std::size_t i = first; i < first + count; ++i, p += kOrderEventSize) {
+            const OrderEvent& event = events[i];
+            p[0] = static_cast<unsigned char>(event.type);
+            p[1] = (event.side == Side::Buy) ? 0 : 1;
+            writeU64(p + 8, event.orderId);
+            writeI64(p + 16, event.price);
+            writeI64(p + 24, event.quantity);
+        }
+    }
+}
+
+/** @brief Appends a Symbol message. Names longer than 255 bytes are truncated. */
+inline void appendSymbol(std::string& out, SymbolId symbol, const std::string& name, const Instrument& instrument) {
+    const std::size_t length = std::min<std::size_t>(name.size(), 255);
+    unsigned char* p = appendMessage(out, kSymbolHeaderSize + length, MessageType::Symbol);
+    writeU32(p + 4, symbol);
+    const double tick_size = instrument.getTickSize();
+    const double lot_size = instrument.getLotSize();
+    std::uint64_t bits = 0;
+    std::memcpy(&bits, &tick_size, sizeof(bits));
+    writeU64(p + 8, bits);
+    std::memcpy(&bits, &lot_size, sizeof(bits));
+    writeU64(p + 16, bits);
+    p[24] = static_cast<unsigned char>(length);
+    std::memcpy(p + kSymbolHeaderSize, name.data(), length);
+}
+
+} // namespace multicast
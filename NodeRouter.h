@@ -0,0 +1,618 @@
+/**
+ * @file NodeRouter.h
+ * @brief Defines the NodeRouter, which lets the gateway (Gateway.cpp) spread the symbols over several engine nodes.
+ *
+ * One engine process holds every symbol's book, so a venue listing more symbols than one box
+ * can match outgrows it. Instead, each engine node is started with its own symbol file and its
+ * place in the cluster (`--node I/N`), and a gateway in front of them parses the client requests
+ * and routes each one to the node that owns its symbol:
+ *
+ * - Orders travel over persistent binary order-entry sessions (BinaryProtocol.h), several per
+ *   node. The requests of every gateway thread are pipelined over them, so a node batches them
+ *   like any other binary client's, and the symbols of a node are spread over its links so that
+ *   a hot symbol only queues up behind itself.
+ * - Order IDs interleave the nodes (ID % N is the node), so cancels and amendments, which only
+ *   name an order, are routed without the gateway remembering anything about the order.
+ * - The feeds of the nodes are merged per client by a FeedRelay, which subscribes to the nodes'
+ *   feed servers and interleaves what they send.
+ */
+
+#pragma once
+
+#include <algorithm>    // For std::max
+#include <chrono>       // For the reconnection delay
+#include <cstddef>      // For std::size_t
+#include <cstdint>
+#include <cstring>      // For std::memmove
+#include <deque>
+#include <future>       // For the acks awaited by the request threads
+#include <memory>       // For std::unique_ptr, std::make_shared
+#include <mutex>
+#include <optional>
+#include <stdexcept>    // For std::invalid_argument, std::runtime_error
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>      // For std::pair, std::move
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <netdb.h>       // For getaddrinfo
+#include <netinet/in.h>
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <sys/socket.h>
+#include <unistd.h>      // For close
+#endif
+
+#include "httplib.h"        // For reading each node's configuration
+#include "json.hpp"
+#include "BinaryProtocol.h" // The frames sent to the nodes
+#include "Command.h"        // For OrderOptions
+#include "Instrument.h"
+#include "Logger.h"
+#include "Publisher.h"      // For the Subscriber a FeedRelay fills
+#include "SymbolTable.h"    // For SymbolId
+
+/**
+ * @class NodeSocket
+ * @brief The few socket calls the links to the nodes need.
+ */
+class NodeSocket {
+public:
+#if defined(_WIN32)
+    using Socket = SOCKET;
+    static constexpr Socket kInvalidSocket = INVALID_SOCKET;
+    static void close(Socket socket) { ::closesocket(socket); }
+    static void shutdown(Socket socket) { ::shutdown(socket, SD_BOTH); }
+#else
+    using Socket = int;
+    static constexpr Socket kInvalidSocket = -1;
+    static void close(Socket socket) { ::close(socket); }
+    static void shutdown(Socket socket) { ::shutdown(socket, SHUT_RDWR); }
+#endif
+
+    /**
+     * @brief Opens a TCP connection with Nagle's algorithm off, since every frame should leave at once.
+     * @throws std::runtime_error if the host cannot be resolved or reached.
+     */
+    static Socket connect(const std::string& host, std::uint16_t port) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (::getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &addresses) != 0) {
+            throw std::runtime_error("Could not resolve engine node '" + host + "'.");
+        }
+        Socket socket = kInvalidSocket;
+        for (addrinfo* address = addresses; address != nullptr && socket == kInvalidSocket; address = address->ai_next) {
+            socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket != kInvalidSocket &&
+                ::connect(socket, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0) {
+                close(socket);
+                socket = kInvalidSocket;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        if (socket == kInvalidSocket) {
+            throw std::runtime_error("Could not connect to engine node " + host + ":" + std::to_string(port) + ".");
+        }
+        int nodelay = 1;
+        ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+        return socket;
+    }
+
+    /** @brief Writes all of `data`. @return False if the connection is gone. */
+    static bool sendAll(Socket socket, const void* data, std::size_t size) {
+#if defined(MSG_NOSIGNAL)
+        constexpr int flags = MSG_NOSIGNAL; // A node that went away must not kill the gateway with SIGPIPE.
+#else
+        constexpr int flags = 0;
+#endif
+        const char* bytes = static_cast<const char*>(data);
+        std::size_t sent = 0;
+        while (sent < size) {
+            const int n = ::send(socket, bytes + sent, static_cast<int>(size - sent), flags);
+            if (n <= 0) {
+                return false;
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+};
+
+/**
+ * @struct NodeAck
+ * @brief What a node answered to one request.
+ */
+struct NodeAck {
+    binary::AckStatus status = binary::AckStatus::Rejected;
+    std::uint64_t orderId = 0; // As in the Ack frame: the new order's ID, or a mass cancel's count.
+};
+
+/**
+ * @class NodeLink
+ * @brief One persistent binary order-entry session with an engine node, shared by any number of threads.
+ *
+ * A thread sends its request and waits for the ack, while other threads' requests follow it
+ * over the same connection: the node answers a session's requests in order, so the acks are
+ * matched to the waiting threads first in, first out. The Fill frames that follow an ack are
+ * skipped; clients of the gateway get their trades from the trade feed.
+ *
+ * A link connects on its first request. If the connection drops, the requests waiting on it
+ * fail and the next request reconnects.
+ */
+class NodeLink {
+public:
+    NodeLink(std::string host, std::uint16_t port) : host_(std::move(host)), port_(port) {}
+
+    NodeLink(const NodeLink&) = delete;
+    NodeLink& operator=(const NodeLink&) = delete;
+
+    ~NodeLink() {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx_);
+            if (this->socket_ != NodeSocket::kInvalidSocket) {
+                NodeSocket::shutdown(this->socket_); // Wakes up the reader, which closes the socket.
+            }
+        }
+        if (this->reader_.joinable()) {
+            this->reader_.join();
+        }
+    }
+
+    /**
+     * @brief Sends a request frame; its client tag field (offset 4) is overwritten with the link's own tag.
+     * @return The node's ack, once it arrives. Its get() throws std::runtime_error if the link drops first.
+     * @throws std::runtime_error if the node cannot be connected to.
+     */
+    std::future<NodeAck> send(unsigned char* frame, std::size_t length) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        if (this->socket_ == NodeSocket::kInvalidSocket) {
+            connect();
+        }
+        const std::uint64_t tag = this->next_tag_++;
+        binary::writeU64(frame + 4, tag);
+        this->in_flight_.emplace_back(tag, std::promise<NodeAck>());
+        std::future<NodeAck> ack = this->in_flight_.back().second.get_future();
+        if (!NodeSocket::sendAll(this->socket_, frame, length)) {
+            NodeSocket::shutdown(this->socket_); // The reader fails every request in flight, this one included.
+        }
+        return ack;
+    }
+
+private:
+    const std::string host_;
+    const std::uint16_t port_;
+    std::mutex mtx_; // Guards everything below, and keeps the frames and in_flight_ in the same order.
+    NodeSocket::Socket socket_ = NodeSocket::kInvalidSocket;
+    std::thread reader_;
+    std::deque<std::pair<std::uint64_t, std::promise<NodeAck>>> in_flight_;
+    std::uint64_t next_tag_ = 1;
+
+    /** @brief Connects and starts the reader. Requires mtx_ and no connection. */
+    void connect() {
+        if (this->reader_.joinable()) {
+            this->reader_.join(); // The previous reader gave up the connection; it is on its way out.
+        }
+        this->socket_ = NodeSocket::connect(this->host_, this->port_);
+        LOG_INFO("Connected to engine node {}:{}.", this->host_, this->port_);
+        const NodeSocket::Socket socket = this->socket_;
+        this->reader_ = std::thread([this, socket] { read(socket); });
+    }
+
+    /** @brief Hands every ack arriving on a connection to its waiting request, until the connection drops. */
+    void read(NodeSocket::Socket socket) {
+        std::vector<unsigned char> in(64 * 1024);
+        std::size_t filled = 0;
+        bool open = true;
+        while (open) {
+            const int received = ::recv(socket, reinterpret_cast<char*>(in.data() + filled),
+                                        static_cast<int>(in.size() - filled), 0);
+            if (received <= 0) {
+                break;
+            }
+            filled += static_cast<std::size_t>(received);
+
+            std::size_t offset = 0;
+            while (filled - offset >= binary::kHeaderSize) {
+                const std::size_t length = binary::readU16(in.data() + offset);
+                if (length < binary::kHeaderSize) {
+                    open = false; // The stream can no longer be framed.
+                    break;
+                }
+                if (filled - offset < length) {
+                    break;
+                }
+                const unsigned char* frame = in.data() + offset;
+                offset += length;
+                if (static_cast<binary::MessageType>(frame[2]) != binary::MessageType::Ack || length != binary::kAckSize) {
+                    continue; // A Fill.
+                }
+                std::promise<NodeAck> waiting;
+                {
+                    std::lock_guard<std::mutex> lock(this->mtx_);
+                    if (this->in_flight_.empty() || this->in_flight_.front().first != binary::readU64(frame + 4)) {
+                        open = false; // An ack for a request we did not send: the session is out of step.
+                        break;
+                    }
+                    waiting = std::move(this->in_flight_.front().second);
+                    this->in_flight_.pop_front();
+                }
+                NodeAck ack;
+                ack.orderId = binary::readU64(frame + 12);
+                ack.status = static_cast<binary::AckStatus>(frame[20]);
+                waiting.set_value(ack);
+            }
+            std::memmove(in.data(), in.data() + offset, filled - offset);
+            filled -= offset;
+        }
+
+        std::deque<std::pair<std::uint64_t, std::promise<NodeAck>>> failed;
+        {
+            std::lock_guard<std::mutex> lock(this->mtx_);
+            NodeSocket::close(socket);
+            this->socket_ = NodeSocket::kInvalidSocket;
+            failed.swap(this->in_flight_);
+        }
+        LOG_WARN("Lost the connection to engine node {}:{} with {} request(s) in flight.", this->host_, this->port_,
+                 failed.size());
+        for (auto& request : failed) {
+            request.second.set_exception(std::make_exception_ptr(
+                std::runtime_error("Lost the connection to the engine node " + this->host_ + ":" +
+                                   std::to_string(this->port_) + " before it answered.")));
+        }
+    }
+};
+
+/**
+ * @struct NodeAddress
+ * @brief Where an engine node listens, as given to the gateway with `--nodes`.
+ */
+struct NodeAddress {
+    std::string host;
+    std::uint16_t httpPort = 8080;   // For reading the node's symbols and place in the cluster.
+    std::uint16_t binaryPort = 9000; // Its binary gateway, which the order links connect to.
+    std::uint16_t feedPort = 8081;   // Its feed server, which the FeedRelays subscribe to.
+};
+
+/**
+ * @class NodeRouter
+ * @brief Knows which node owns each symbol, and sends the requests about it there.
+ *
+ * All nodes are added at startup; afterwards the router is only read, and its links are
+ * safe to use from every request thread.
+ */
+class NodeRouter {
+public:
+    /** @brief Where a symbol trades. */
+    struct Route {
+        std::string name;
+        Instrument instrument;
+        std::size_t node = 0;
+        SymbolId nodeSymbol = 0; // The symbol's ID on its node.
+    };
+
+    /**
+     * @param nodeCount The number of nodes that will be added, which must be the N of every node's `--node I/N`.
+     * @param linksPerNode The number of binary sessions opened to each node (at least 1).
+     */
+    NodeRouter(std::size_t nodeCount, std::size_t linksPerNode)
+        : links_per_node_(std::max<std::size_t>(linksPerNode, 1)), nodes_(nodeCount) {}
+
+    /**
+     * @brief Reads a node's place in the cluster and its symbols, and routes those symbols to it.
+     * @throws std::runtime_error if the node cannot be reached, was started as another node, or
+     *         lists a symbol another node already has.
+     */
+    void addNode(const NodeAddress& address) {
+        const std::string where = address.host + ":" + std::to_string(address.httpPort);
+        httplib::Client client(address.host, address.httpPort);
+        auto read = [&](const char* path) {
+            httplib::Result result = client.Get(path);
+            if (!result || result->status != 200) {
+                throw std::runtime_error("Could not read " + std::string(path) + " from engine node " + where + ".");
+            }
+            return nlohmann::json::parse(result->body);
+        };
+
+        const nlohmann::json node = read("/node");
+        const std::size_t index = node.at("node").get<std::size_t>();
+        if (node.at("nodes").get<std::size_t>() != this->nodes_.size() || index >= this->nodes_.size() ||
+            this->nodes_[index].links.size() != 0) {
+            throw std::runtime_error("Engine node " + where + " runs as node " + std::to_string(index) + " of " +
+                                     node.at("nodes").dump() + ", which does not fit the " +
+                                     std::to_string(this->nodes_.size()) + " nodes given.");
+        }
+        Node& entry = this->nodes_[index];
+        entry.address = address;
+        for (std::size_t i = 0; i < this->links_per_node_; ++i) {
+            entry.links.push_back(std::make_unique<NodeLink>(address.host, address.binaryPort));
+        }
+
+        for (const nlohmann::json& symbol : read("/symbols")) {
+            Route route;
+            route.name = symbol.at("symbol").get<std::string>();
+            route.instrument = Instrument(symbol.at("tick_size").get<double>(), symbol.at("lot_size").get<double>());
+            route.node = index;
+            route.nodeSymbol = symbol.at("symbol_id").get<SymbolId>();
+            if (!this->ids_.emplace(route.name, static_cast<SymbolId>(this->routes_.size())).second) {
+                throw std::runtime_error("Symbol '" + route.name + "' is listed by more than one engine node.");
+            }
+            entry.symbols.push_back(route.name);
+            this->routes_.push_back(std::move(route));
+        }
+        LOG_INFO("Routing {} symbol(s) to engine node {} at {}.", entry.symbols.size(), index, where);
+    }
+
+    /**
+     * @brief The gateway's ID of a symbol (its position in symbolCount()), as for MatchingEngine::findSymbol.
+     * @throws std::invalid_argument if no node lists the symbol.
+     */
+    SymbolId findSymbol(const std::string& symbol) const {
+        auto it = this->ids_.find(symbol);
+        if (it == this->ids_.end()) {
+            throw std::invalid_argument("Unknown symbol '" + symbol + "'.");
+        }
+        return it->second;
+    }
+
+    const Route& route(SymbolId symbol) const { return this->routes_[symbol]; }
+    std::size_t symbolCount() const { return this->routes_.size(); }
+    std::size_t nodeCount() const { return this->nodes_.size(); }
+    const NodeAddress& address(std::size_t node) const { return this->nodes_[node].address; }
+
+    /** @brief The names of the symbols a node owns. */
+    const std::vector<std::string>& symbolsOf(std::size_t node) const { return this->nodes_[node].symbols; }
+
+    /** @brief The node that created an order (see MatchingEngine::Shard). */
+    std::size_t nodeOf(OrderId orderId) const { return orderId % this->nodes_.size(); }
+
+    /**
+     * @brief Sends a new order to its symbol's node.
+     * @param quantity, price, options In the symbol's lots and ticks, as for MatchingEngine::process.
+     */
+    std::future<NodeAck> newOrder(SymbolId symbol, OrderType type, Side side, Quantity quantity, Price price,
+                                  const OrderOptions& options) {
+        const Route& where = this->routes_[symbol];
+        unsigned char frame[binary::kNewOrderWithOptionsSize] = {};
+        binary::writeHeader(frame, sizeof(frame), binary::MessageType::NewOrderWithOptions);
+        binary::writeU32(frame + 12, where.nodeSymbol);
+        frame[16] = (side == Side::Buy) ? 0 : 1;
+        frame[17] = static_cast<unsigned char>(type);
+        binary::writeI64(frame + 20, price);
+        binary::writeI64(frame + 28, quantity);
+        binary::writeI64(frame + 36, options.stopPrice);
+        binary::writeU32(frame + 44, options.account);
+        frame[48] = static_cast<unsigned char>(options.selfTradePrevention);
+        // The node's symbols take turns over its links, so one busy symbol holds up only a share of the rest.
+        return link(where.node, where.nodeSymbol).send(frame, sizeof(frame));
+    }
+
+    /** @brief Sends a cancel to the node that created the order. */
+    std::future<NodeAck> cancel(OrderId orderId) {
+        unsigned char frame[binary::kCancelSize] = {};
+        binary::writeHeader(frame, sizeof(frame), binary::MessageType::Cancel);
+        binary::writeU64(frame + 12, orderId);
+        return link(nodeOf(orderId), orderId / this->nodes_.size()).send(frame, sizeof(frame));
+    }
+
+    /** @brief Sends an amendment, in the ticks and lots of the order's symbol, to the node that created the order. */
+    std::future<NodeAck> modify(OrderId orderId, std::optional<Price> price, std::optional<Quantity> quantity) {
+        unsigned char frame[binary::kModifySize] = {};
+        binary::writeHeader(frame, sizeof(frame), binary::MessageType::Modify);
+        binary::writeU64(frame + 12, orderId);
+        binary::writeI64(frame + 20, price.value_or(0));
+        binary::writeI64(frame + 28, quantity.value_or(0));
+        frame[36] = static_cast<unsigned char>((price ? binary::kModifyPrice : 0) | (quantity ? binary::kModifyQuantity : 0));
+        return link(nodeOf(orderId), orderId / this->nodes_.size()).send(frame, sizeof(frame));
+    }
+
+    /**
+     * @brief Cancels every order of an account, on one symbol's node or on all nodes at once.
+     * @return The number of orders cancelled.
+     * @throws std::runtime_error if a node rejected the request or could not be reached.
+     */
+    std::uint64_t massCancel(AccountId account, std::optional<SymbolId> symbol) {
+        std::vector<std::future<NodeAck>> acks;
+        for (std::size_t node = 0; node < this->nodes_.size(); ++node) {
+            if (symbol && this->routes_[*symbol].node != node) {
+                continue;
+            }
+            unsigned char frame[binary::kMassCancelSize] = {};
+            binary::writeHeader(frame, sizeof(frame), binary::MessageType::MassCancel);
+            binary::writeU32(frame + 12, symbol ? this->routes_[*symbol].nodeSymbol : binary::kAllSymbols);
+            binary::writeU32(frame + 16, account);
+            acks.push_back(link(node, account).send(frame, sizeof(frame)));
+        }
+        // Wait for every node before reporting a failure, so none is left working on a cancel nobody awaits.
+        std::uint64_t cancelled = 0;
+        std::string error;
+        for (std::future<NodeAck>& ack : acks) {
+            try {
+                const NodeAck result = ack.get();
+                if (result.status != binary::AckStatus::Accepted) {
+                    error = "An engine node rejected the mass cancel.";
+                }
+                cancelled += result.orderId;
+            } catch (const std::exception& e) {
+                error = e.what();
+            }
+        }
+        if (!error.empty()) {
+            throw std::runtime_error(error);
+        }
+        return cancelled;
+    }
+
+private:
+    struct Node {
+        NodeAddress address;
+        std::vector<std::unique_ptr<NodeLink>> links;
+        std::vector<std::string> symbols;
+    };
+
+    const std::size_t links_per_node_;
+    std::vector<Node> nodes_;
+    std::vector<Route> routes_;
+    std::unordered_map<std::string, SymbolId> ids_;
+
+    NodeLink& link(std::size_t node, std::uint64_t key) {
+        std::vector<std::unique_ptr<NodeLink>>& links = this->nodes_[node].links;
+        return *links[key % links.size()];
+    }
+};
+
+/**
+ * @class FeedRelay
+ * @brief Merges the feed one gateway client subscribed to from every node that has symbols it wants.
+ *
+ * Each node's part is streamed from the node's feed server by a thread of its own, which splits
+ * the stream into its SSE messages and queues them into the client's Subscriber as they come.
+ * The messages of one node keep their order (and their symbols' sequence numbers); those of
+ * different nodes, which are about different symbols, are interleaved as they arrive. A client of
+ * the stateful channels (l2delta, l3) gets the snapshots each node sends its new subscribers.
+ */
+class FeedRelay {
+public:
+    /**
+     * @param target The subscriber every message is queued into. Must outlive the relay.
+     * @param requests For each node to subscribe to, the node and the request line's target (path and query).
+     */
+    FeedRelay(const NodeRouter& router, Subscriber& target, std::vector<std::pair<std::size_t, std::string>> requests)
+        : router_(router), target_(target), upstreams_(requests.size()) {
+        for (std::size_t i = 0; i < requests.size(); ++i) {
+            this->upstreams_[i].node = requests[i].first;
+            this->upstreams_[i].target = std::move(requests[i].second);
+        }
+    }
+
+    FeedRelay(const FeedRelay&) = delete;
+    FeedRelay& operator=(const FeedRelay&) = delete;
+
+    ~FeedRelay() { stop(); }
+
+    /** @brief Connects to the nodes. A node that cannot be reached is retried every second until stop(). */
+    void start() {
+        for (Upstream& upstream : this->upstreams_) {
+            upstream.thread = std::thread([this, &upstream] { relay(upstream); });
+        }
+    }
+
+    /** @brief Disconnects from the nodes and waits for the relaying threads to finish. */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(this->mtx_);
+            this->stopping_ = true;
+            for (Upstream& upstream : this->upstreams_) {
+                if (upstream.socket != NodeSocket::kInvalidSocket) {
+                    NodeSocket::shutdown(upstream.socket); // Wakes up its blocked recv().
+                }
+            }
+        }
+        for (Upstream& upstream : this->upstreams_) {
+            if (upstream.thread.joinable()) {
+                upstream.thread.join();
+            }
+        }
+    }
+
+private:
+    struct Upstream {
+        std::size_t node = 0;
+        std::string target;
+        std::thread thread;
+        NodeSocket::Socket socket = NodeSocket::kInvalidSocket; // Guarded by mtx_.
+    };
+
+    // The largest SSE message (or response header) we accept from a node.
+    static constexpr std::size_t kMaxMessageBytes = 1024 * 1024;
+
+    const NodeRouter& router_;
+    Subscriber& target_;
+    std::vector<Upstream> upstreams_;
+    std::mutex mtx_;
+    bool stopping_ = false;
+
+    void relay(Upstream& upstream) {
+        const NodeAddress& address = this->router_.address(upstream.node);
+        const std::string request = "GET " + upstream.target + " HTTP/1.1\r\nHost: " + address.host +
+                                    "\r\nAccept: text/event-stream\r\n\r\n";
+        while (true) {
+            NodeSocket::Socket socket = NodeSocket::kInvalidSocket;
+            try {
+                socket = NodeSocket::connect(address.host, address.feedPort);
+            } catch (const std::exception& e) {
+                LOG_RATE_LIMITED(LogLevel::Warn, 10, "Feed relay: {}", e.what());
+            }
+            {
+                std::lock_guard<std::mutex> lock(this->mtx_);
+                if (this->stopping_) {
+                    if (socket != NodeSocket::kInvalidSocket) {
+                        NodeSocket::close(socket);
+                    }
+                    return;
+                }
+                upstream.socket = socket;
+            }
+            if (socket != NodeSocket::kInvalidSocket) {
+                if (NodeSocket::sendAll(socket, request.data(), request.size())) {
+                    stream(socket);
+                }
+                std::lock_guard<std::mutex> lock(this->mtx_);
+                NodeSocket::close(socket);
+                upstream.socket = NodeSocket::kInvalidSocket;
+                if (this->stopping_) {
+                    return;
+                }
+            }
+            std::this_thread::sleep_for(std::chrono::seconds(1));
+        }
+    }
+
+    /** @brief Queues every SSE message of a node's response into the target, until the connection ends. */
+    void stream(NodeSocket::Socket socket) {
+        std::string buffer;
+        bool headers = true;
+        char chunk[16 * 1024];
+        while (true) {
+            const int received = ::recv(socket, chunk, static_cast<int>(sizeof(chunk)), 0);
+            if (received <= 0) {
+                return;
+            }
+            buffer.append(chunk, static_cast<std::size_t>(received));
+
+            std::size_t begin = 0;
+            if (headers) {
+                const std::size_t end = buffer.find("\r\n\r\n");
+                if (end == std::string::npos) {
+                    if (buffer.size() > kMaxMessageBytes) {
+                        return;
+                    }
+                    continue;
+                }
+                if (buffer.compare(0, 12, "HTTP/1.1 200") != 0) {
+                    LOG_RATE_LIMITED(LogLevel::Warn, 10, "Feed relay: a node refused the subscription: {}",
+                                     buffer.substr(0, buffer.find("\r\n")));
+                    return;
+                }
+                headers = false;
+                begin = end + 4;
+            }
+            // Every complete message (ending in a blank line) is passed on as it is.
+            for (std::size_t end; (end = buffer.find("\n\n", begin)) != std::string::npos; begin = end + 2) {
+                FeedMessage message;
+                message.channel = this->target_.channel();
+                message.payload = std::make_shared<const std::string>(buffer, begin, end + 2 - begin);
+                this->target_.push(message);
+            }
+            buffer.erase(0, begin);
+            if (buffer.size() > kMaxMessageBytes) {
+                return;
+            }
+        }
+    }
+};
@@ -1,7 +0,0 @@
-// --- START OF FILE Order.cpp ---
-
-#include "Order.h" // We include the header to get the class definition.
-
-// This is called the "definition" of the static member variable.
-// We are giving it its initial value here.
-int Order::next_order_id_ = 1;
\ No newline at end of file
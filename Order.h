@@ -11,7 +11,31 @@
 // of this file are only included once per compilation unit, preventing redefinition errors.
 #pragma once
 
-#include <string> // Required for using std::string to store the order's symbol.
+#include <cstdint> // For the fixed-width integer types used by prices, quantities and symbol IDs.
+
+// --- Fixed-Point Value Types ---
+// Prices and quantities are stored as whole numbers of ticks and lots respectively.
+// The Instrument class (Instrument.h) converts them to and from the decimal values used by the API.
+using Price = std::int64_t;    // A price expressed as an integer number of ticks.
+using Quantity = std::int64_t; // A quantity expressed as an integer number of lots.
+
+// Symbols are registered under small integer IDs by the SymbolTable (SymbolTable.h), so an order
+// carries a plain number instead of owning a heap-allocated std::string.
+using SymbolId = std::uint32_t;
+
+// A 64-bit order ID cannot wrap around no matter how long the engine stays up.
+using OrderId = std::uint64_t;
+
+// The account (e.g., one trading strategy) an order belongs to, used for self-trade prevention.
+// Orders submitted without an account are never checked against each other.
+using AccountId = std::uint32_t;
+constexpr AccountId kNoAccount = 0;
+
+// The order-entry session (e.g., one binary gateway connection) an order was submitted on, so
+// that the session's orders can be cancelled when it disconnects. Sessions do not outlive the
+// process: orders restored from the journal or a snapshot belong to no session.
+using SessionId = std::uint32_t;
+constexpr SessionId kNoSession = 0;
 
 // --- Enumerations for Order Properties ---
 
@@ -34,7 +58,20 @@ enum class OrderType {
     Market, // An order to execute immediately at the best available market price.
     Limit,  // An order to execute at a specific price or better.
     IOC,    // Immediate-Or-Cancel: Executes all or part of the order immediately, cancels the rest.
-    FOK     // Fill-Or-Kill: Executes the entire order immediately, or cancels if it can't be fully filled.
+    FOK,    // Fill-Or-Kill: Executes the entire order immediately, or cancels if it can't be fully filled.
+    StopMarket, // Waits until a trade reaches its stop price (at or above for buys, at or below for sells), then becomes a Market order.
+    StopLimit   // Waits for its stop price like StopMarket, then becomes a Limit order at its price.
+};
+
+/**
+ * @enum SelfTradePrevention
+ * @brief What happens when an order would trade against a resting order of its own account.
+ * The incoming order's setting decides; the two orders never trade with each other.
+ */
+enum class SelfTradePrevention : std::uint8_t {
+    None,         // No check: orders of the same account trade with each other like any others.
+    CancelNewest, // Cancel the rest of the incoming order; the resting order stays.
+    CancelOldest  // Cancel the resting order and keep matching the incoming one.
 };
 
 /**
@@ -44,6 +81,11 @@ enum class OrderType {
  * This class encapsulates all the necessary data for an order, such as its unique ID,
  * type, side, quantity, price, and symbol. It is designed to be a simple data
  * container with controlled access to its properties.
+ *
+ * While an order rests on the book it lives in a slot of the book's OrderPool and is
+ * linked into its price level's FIFO queue through the intrusive prev/next pointers,
+ * so resting an order or filling it never touches the heap. An order with an account or a
+ * session is also linked into that owner's list by the OrderOwners of its shard.
  */
 class Order {
 public: // Public interface of the class.
@@ -51,62 +93,145 @@ public: // Public interface of the class.
     /**
      * @brief Constructs a new Order object.
      * The constructor is responsible for initializing an order into a valid state.
-     * It automatically assigns a new, unique order ID.
+     * @param id The unique order ID. IDs are handed out by the matching shard that owns the
+     *           order's symbol (see MatchingEngine), so they stay unique across threads.
      * @param type The type of the order (Market, Limit, etc.).
      * @param side The side of the order (Buy or Sell).
-     * @param quantity The quantity of the asset to be traded.
-     * @param symbol The trading symbol (e.g., "BTC-USDT").
-     * @param price The limit price for the order. Defaults to 0.0 for Market orders.
+     * @param quantity The quantity of the asset to be traded, in lots.
+     * @param symbol The interned ID of the trading symbol (e.g., the ID of "BTC-USDT").
+     * @param price The limit price for the order, in ticks. Defaults to 0 for Market orders.
+     * @param stopPrice The trigger price of a StopMarket or StopLimit order, in ticks.
+     * @param account The account the order belongs to, or kNoAccount.
+     * @param stp How the order avoids trading against its own account's resting orders.
+     * @param session The session the order was submitted on, or kNoSession.
      */
-    Order(OrderType type, Side side, double quantity, const std::string& symbol, double price = 0.0) {
-        // Assign a unique ID from the shared counter and then increment the counter.
-        this->orderID_ = next_order_id_++;
+    Order(OrderId id, OrderType type, Side side, Quantity quantity, SymbolId symbol, Price price = 0,
+          Price stopPrice = 0, AccountId account = kNoAccount, SelfTradePrevention stp = SelfTradePrevention::None,
+          SessionId session = kNoSession) {
+        this->orderID_ = id;
         this->type_ = type;
         this->side_ = side;
         this->price_ = price;
+        this->stopPrice_ = stopPrice;
         this->quantity_ = quantity;
         this->symbol_ = symbol;
+        this->account_ = account;
+        this->stp_ = stp;
+        this->session_ = session;
+        this->received_ = 0;
+        this->accepted_ = 0;
+        this->prev_ = nullptr;
+        this->next_ = nullptr;
+        this->accountPrev_ = nullptr;
+        this->accountNext_ = nullptr;
+        this->sessionPrev_ = nullptr;
+        this->sessionNext_ = nullptr;
     }
 
     // --- Public "Getter" Methods ---
     // These methods provide read-only access to the order's private data members.
     // The 'const' keyword at the end is a promise that these methods will not modify the object's state.
 
-    int getOrderID() const { return this->orderID_; }
+    OrderId getOrderID() const { return this->orderID_; }
     OrderType getType() const { return this->type_; }
     Side getSide() const { return this->side_; }
-    double getPrice() const { return this->price_; }
-    double getQuantity() const { return this->quantity_; }
-    // Returning a const reference (&) to the symbol is an optimization that avoids
-    // making an unnecessary and potentially expensive copy of the string.
-    const std::string& getSymbol() const { return this->symbol_; }
+    Price getPrice() const { return this->price_; }
+    Quantity getQuantity() const { return this->quantity_; }
+    SymbolId getSymbolId() const { return this->symbol_; }
+    Price getStopPrice() const { return this->stopPrice_; }
+    AccountId getAccount() const { return this->account_; }
+    SelfTradePrevention getSelfTradePrevention() const { return this->stp_; }
+    SessionId getSession() const { return this->session_; }
+    std::uint64_t getReceivedTime() const { return this->received_; }
+    std::uint64_t getAcceptedTime() const { return this->accepted_; }
+
+    /**
+     * @brief True if the order must not trade through its price.
+     * Only (stop) market orders trade at any price; Limit, IOC, FOK and StopLimit orders all carry a limit price.
+     */
+    bool hasPriceLimit() const { return this->type_ != OrderType::Market && this->type_ != OrderType::StopMarket; }
+
+    /** @brief True for a stop order that has not been triggered yet. */
+    bool isStop() const { return this->type_ == OrderType::StopMarket || this->type_ == OrderType::StopLimit; }
+
+    /**
+     * @brief The account whose resting orders this order must not trade against, or kNoAccount
+     * if it may trade against anyone.
+     */
+    AccountId getSelfTradeAccount() const {
+        return (this->stp_ != SelfTradePrevention::None) ? this->account_ : kNoAccount;
+    }
+
+    /** @brief The next (younger) order at the same price level, or nullptr if this is the last one. */
+    const Order* getNext() const { return this->next_; }
 
     // --- Public "Setter" Method ---
     /**
      * @brief Reduces the quantity of the order, typically after a partial fill.
      * This method is not 'const' because its purpose is to modify the object's state.
-     * @param amount The amount by which to reduce the quantity.
+     * @param amount The amount (in lots) by which to reduce the quantity.
      */
-    void reduceQuantity(double amount) {
+    void reduceQuantity(Quantity amount) {
         if (amount <= this->quantity_) {
             this->quantity_ -= amount;
         }
     }
 
+    /**
+     * @brief Gives the order a new price and remaining quantity, keeping its ID.
+     * Used by cancel/replace, where the order re-enters the book as if it were new.
+     */
+    void replace(Price price, Quantity quantity) {
+        this->price_ = price;
+        this->quantity_ = quantity;
+    }
+
+    /**
+     * @brief Records when the order arrived and when its shard accepted it (Tsc timestamps, see Metrics.h).
+     * Called by the matching shard before the order is matched; both stay 0 on orders restored
+     * from a snapshot, since timestamps of a previous run mean nothing to this one.
+     * @param received When the gateway read the request that carried the order.
+     * @param accepted When the shard picked the order up. Replacing the order does not change it.
+     */
+    void setTimestamps(std::uint64_t received, std::uint64_t accepted) {
+        this->received_ = received;
+        this->accepted_ = accepted;
+    }
+
+    /** @brief Turns a triggered stop order into the Market or Limit order it releases. */
+    void trigger() {
+        this->type_ = (this->type_ == OrderType::StopLimit) ? OrderType::Limit : OrderType::Market;
+    }
+
 private: // Private members can only be accessed by methods within this class.
 
     // --- Member Variables ---
     // The trailing underscore is a common C++ coding style to distinguish private member variables.
-    int orderID_;
+    OrderId orderID_;
     OrderType type_;
     Side side_;
-    double price_;
-    double quantity_;
-    std::string symbol_;
-
-    // --- Static ID Counter ---
-    // The 'static' keyword means this variable is shared across ALL instances of the Order class.
-    // It belongs to the class itself, not to any single object. This is how we ensure
-    // every order created gets a unique, incrementing ID.
-    static int next_order_id_;
+    Price price_;
+    Price stopPrice_;
+    Quantity quantity_;
+    SymbolId symbol_;
+    AccountId account_;
+    SelfTradePrevention stp_;
+    SessionId session_;
+    std::uint64_t received_; // Tsc timestamps, see setTimestamps().
+    std::uint64_t accepted_;
+
+    // --- Intrusive Queue Links ---
+    // Maintained by PriceLevel while the order rests on the book.
+    Order* prev_;
+    Order* next_;
+    friend struct PriceLevel;
+
+    // --- Intrusive Owner Links ---
+    // Maintained by OrderOwners while the order rests on the book (or waits as a stop order).
+    Order* accountPrev_;
+    Order* accountNext_;
+    Order* sessionPrev_;
+    Order* sessionNext_;
+    friend class OrderOwners;
+
 };
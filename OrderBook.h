@@ -5,21 +5,35 @@
  * @brief Defines the OrderBook class, which stores and manages orders for a single trading symbol.
  *
  * This class is the heart of the matching engine's logic for one instrument (e.g., "BTC-USDT").
- * It maintains two sorted lists of orders (bids and asks) and implements the
- * price-time priority matching algorithm.
+ * It maintains two tick-indexed ladders of price levels (bids and asks) and implements the
+ * price-time priority matching algorithm. All prices and quantities are integer ticks and lots.
+ *
+ * Stop orders wait in two more ladders keyed by their stop price, ordered so that the next stop
+ * to fire is always the best level: buy stops lowest first (they fire as the price rises), sell
+ * stops highest first. After every order, the lowest and highest prices it traded at are compared
+ * against those best levels only, so each trade costs O(1) whether or not thousands of stops are
+ * pending, and a stop that fires is matched straight away, in the same pass as the trades that
+ * released it (which may in turn release more).
  */
 
 #pragma once
 
-#include <map>
-#include <list>
 #include <vector>
 #include <iostream>
 #include <algorithm> // For std::min
+#include <cstdint>   // For std::uint64_t
+#include <limits>    // For the depth boundary sentinels
+#include <optional>  // For the last trade price
 #include <string>    // For std::to_string
+#include <unordered_map> // For the account exposures
 
 #include "Order.h"
 #include "Trade.h"
+#include "Instrument.h"  // Tick and lot size used to convert prices/quantities for display.
+#include "PriceLadder.h" // The flat, tick-indexed storage for each side of the book.
+#include "OrderPool.h"   // The preallocated slots that resting orders live in.
+#include "OrderIndex.h"  // The order ID -> resting order index used by cancel and modify.
+#include "OrderOwners.h" // The per-account and per-session order lists used by mass cancel.
 #include "json.hpp"   // Defines the nlohmann::json type, which was missing.
 
 // Create a convenient alias for the nlohmann::json type within this file's scope.
@@ -27,11 +41,63 @@ using json = nlohmann::json;
 
 /**
  * @struct BBO
- * @brief A simple data structure to hold the Best Bid and Offer price.
+ * @brief A simple data structure to hold the Best Bid and Offer price, in ticks.
  */
 struct BBO {
-    double bestBid;
-    double bestAsk;
+    Price bestBid;
+    Price bestAsk;
+};
+
+/**
+ * @struct LevelChange
+ * @brief Identifies a price level whose total quantity changed (or that appeared or disappeared).
+ */
+struct LevelChange {
+    Side side;
+    Price price;
+};
+
+/**
+ * @enum OrderEventType
+ * @brief What happened to an order on the book, as reported by the market-by-order feed.
+ */
+enum class OrderEventType : std::uint8_t {
+    Add,     // The order joined the back of its level's queue.
+    Execute, // Part or all of the order traded; it leaves the book once its quantity is used up.
+    Delete,  // The order was cancelled (or replaced by a new one at another price or size).
+    Replace  // The order's quantity was reduced in place; it keeps its place in the queue.
+};
+
+/**
+ * @struct OrderEvent
+ * @brief One change to one resting order, in the order the changes happened.
+ */
+struct OrderEvent {
+    OrderEventType type;
+    Side side;
+    OrderId orderId;
+    Price price;       // The level the order rests on (for Execute, also the trade price).
+    Quantity quantity; // Add: the quantity added. Execute: the quantity traded. Replace: the new quantity. Delete: 0.
+};
+
+/**
+ * @struct AccountExposure
+ * @brief What one account has at stake on one book, kept up to date as its orders rest, fill and leave.
+ */
+struct AccountExposure {
+    std::uint32_t openOrders = 0;  // Resting orders and pending stop orders.
+    std::int64_t openNotional = 0; // Price times remaining quantity of those orders, in ticks times lots.
+    Quantity position = 0;         // Lots bought minus lots sold.
+};
+
+/**
+ * @enum ModifyResult
+ * @brief The outcome of an attempt to modify a resting order.
+ */
+enum class ModifyResult {
+    NotFound, // No resting order has that ID (it never existed, or was already filled/cancelled).
+    Amended,  // The quantity was reduced in place; the order kept its time priority.
+    Replaced  // The price changed or the quantity grew; the order re-entered the book at the back of the queue.
 };
 
 /**
@@ -40,38 +106,291 @@ struct BBO {
  */
 class OrderBook {
 public:
+    /**
+     * @brief Constructs an empty order book.
+     * @param symbol The ID of the symbol this book trades.
+     * @param index The order ID index this book registers its resting orders in. Several
+     *              books may share one index; it must outlive the book.
+     * @param owners The account and session lists this book links its resting orders into;
+     *               shared and outliving the book like `index`.
+     * @param instrument The tick and lot size of the symbol this book trades.
+     * @param initialCapacity The number of resting orders to preallocate room for.
+     */
+    OrderBook(SymbolId symbol, OrderIndex& index, OrderOwners& owners, const Instrument& instrument = Instrument(),
+              std::size_t initialCapacity = OrderPool::kBlockSize)
+        : symbol_(symbol), instrument_(instrument), buy_stops_(kStopWindow), sell_stops_(kStopWindow),
+          pool_(initialCapacity), index_(index), owners_(owners) {}
+
+    /** @brief The ID of the symbol this book trades. */
+    SymbolId getSymbolId() const { return this->symbol_; }
+
+    /** @brief The tick and lot configuration of this book's symbol. */
+    const Instrument& getInstrument() const { return this->instrument_; }
+
     /**
      * @brief The main entry point for processing an order against this order book.
-     * It orchestrates the matching logic based on the order's type and returns any
-     * trades that were executed.
+     * It orchestrates the matching logic based on the order's type and appends any
+     * trades that were executed to `trades`. A stop order whose stop price has not been
+     * reached yet is put aside until a trade reaches it.
      * @param order The order to be processed. Passed by non-const reference because its
      *              quantity may be modified during matching.
-     * @return A std::vector of Trade objects that resulted from this order.
+     * @param trades Receives the Trade objects that resulted from this order, followed by those
+     *               of any stop orders it triggered. The caller owns (and should reuse) the
+     *               vector so that matching does not allocate.
      */
-    std::vector<Trade> processOrder(Order& order) {
-        std::vector<Trade> trades;
+    void processOrder(Order& order, std::vector<Trade>& trades) {
+        const std::size_t first = trades.size();
+        executeOrder(order, trades);
+        triggerStops(trades, first);
+    }
 
-        if (order.getType() == OrderType::FOK) {
-            if (!canFOKfill(order)) {
-                return trades;
+    /**
+     * @brief Removes a resting order from the book in constant time.
+     * @param orderId The ID of the order to cancel.
+     * @return True if the order was resting on this book and has been removed.
+     */
+    bool cancelOrder(OrderId orderId) {
+        Order* order = findOwnOrder(orderId);
+        if (order == nullptr) {
+            return false;
+        }
+        removeRestingOrder(order);
+        return true;
+    }
+
+    /**
+     * @brief Changes the price and/or remaining quantity of a resting order.
+     *
+     * Reducing the quantity at the same price is done in place and keeps the order's time
+     * priority. Any other change (a new price, or more quantity) is a cancel/replace: the
+     * order keeps its ID but re-enters the book as a new limit order, so it can trade
+     * immediately if the new price crosses the spread and otherwise joins the back of the queue.
+     * @param orderId The ID of the order to modify.
+     * @param newPrice The new limit price, in ticks.
+     * @param newQuantity The new remaining quantity, in lots. Must be positive.
+     * @param trades Receives any trades caused by a replaced order crossing the spread.
+     */
+    ModifyResult modifyOrder(OrderId orderId, Price newPrice, Quantity newQuantity, std::vector<Trade>& trades) {
+        Order* order = findOwnOrder(orderId);
+        if (order == nullptr) {
+            return ModifyResult::NotFound;
+        }
+
+        if (newPrice == order->getPrice() && newQuantity <= order->getQuantity()) {
+            Quantity reduction = order->getQuantity() - newQuantity;
+            levelOf(*order).reduce(reduction);
+            reduceExposure(*order, reduction);
+            order->reduceQuantity(reduction);
+            if (!order->isStop()) {
+                markChanged(order->getSide(), order->getPrice());
+                recordOrderEvent(OrderEventType::Replace, *order, order->getPrice(), newQuantity);
             }
+            return ModifyResult::Amended;
         }
 
-        if (order.getSide() == Side::Buy) {
-            matchBuyOrder(order, trades);
+        Order replacement = *order;
+        replacement.replace(newPrice, newQuantity);
+        removeRestingOrder(order);
+        processOrder(replacement, trades);
+        return ModifyResult::Replaced;
+    }
+
+    // --- Change Tracking for Incremental Market Data ---
+
+    /**
+     * @brief The levels touched since the last clearChangedLevels(), each listed once.
+     * Every add, fill, cancel and amendment records the level it changed, so market data can be
+     * published as a delta of exactly those levels instead of by diffing whole-book snapshots.
+     */
+    const std::vector<LevelChange>& getChangedLevels() const { return this->changed_levels_; }
+
+    /** @brief Forgets the recorded level changes, order events and self-trade cancels (the buffers' memory is kept for reuse). */
+    void clearChangedLevels() {
+        this->changed_levels_.clear();
+        this->order_events_.clear();
+        this->self_trade_cancels_.clear();
+    }
+
+    // --- Order Events for the Market-By-Order Feed ---
+
+    /**
+     * @brief Turns the recording of order events on or off. Recording costs an append per event,
+     * so the engine only turns it on for the changes of books that have market-by-order subscribers.
+     */
+    void setRecordOrderEvents(bool record) { this->record_order_events_ = record; }
+
+    /**
+     * @brief The changes to individual resting orders since the last clearChangedLevels(), while recording.
+     * They are collected as the book is mutated (adds, fills, cancels and amendments), never by diffing.
+     */
+    const std::vector<OrderEvent>& getOrderEvents() const { return this->order_events_; }
+
+    /** @brief Advances and returns this book's market-by-order sequence number (1 for the first message). */
+    std::uint64_t nextOrderEventSeq() { return ++this->order_event_seq_; }
+
+    /** @brief The sequence number of the latest market-by-order message published for this book. */
+    std::uint64_t getOrderEventSeq() const { return this->order_event_seq_; }
+
+    /**
+     * @brief The orders cancelled by self-trade prevention since the last clearChangedLevels():
+     * incoming orders whose rest was cancelled (CancelNewest) and resting orders removed (CancelOldest).
+     */
+    const std::vector<OrderId>& getSelfTradeCancels() const { return this->self_trade_cancels_; }
+
+    /** @brief The total quantity resting at a price on one side, or 0 if there is no such level. */
+    Quantity getLevelQuantity(Side side, Price price) const {
+        const PriceLevel* level = (side == Side::Buy) ? bids_.find(price) : asks_.find(price);
+        return (level != nullptr) ? level->totalQuantity : 0;
+    }
+
+    /**
+     * @brief The price of the n-th best level on one side: the worst price still within a depth-n view.
+     * If the side has fewer than n levels, every price is within view and the worst possible
+     * price for that side is returned instead (the lowest price for bids, the highest for asks).
+     */
+    Price getDepthBoundary(Side side, int n) const {
+        Price boundary = (side == Side::Buy) ? std::numeric_limits<Price>::min() : std::numeric_limits<Price>::max();
+        int count = 0;
+        auto visit = [&](const PriceLevel& level) {
+            if (++count == n) {
+                boundary = level.price;
+                return false;
+            }
+            return true;
+        };
+        if (side == Side::Buy) {
+            bids_.forEachLevel(visit);
         } else {
-            matchSellOrder(order, trades);
+            asks_.forEachLevel(visit);
         }
+        return boundary;
+    }
 
-        if (order.getQuantity() > 0) {
-            if (order.getType() == OrderType::Limit) {
-                addLimitOrder(order);
+    /** @brief True if `price` is at or better than `boundary` on the given side. */
+    static bool isWithinBoundary(Side side, Price price, Price boundary) {
+        return (side == Side::Buy) ? price >= boundary : price <= boundary;
+    }
+
+    /**
+     * @brief Visits the levels of one side from the best price outwards.
+     * @param fn Called with each `const PriceLevel&`; return false from it to stop early.
+     */
+    template <typename Fn>
+    void forEachLevel(Side side, Fn&& fn) const {
+        if (side == Side::Buy) {
+            bids_.forEachLevel(fn);
+        } else {
+            asks_.forEachLevel(fn);
+        }
+    }
+
+    /**
+     * @brief Visits the resting orders of one side in time priority order: best price first,
+     * and within a level, oldest first.
+     * @param fn Called with each `const Order&`.
+     */
+    template <typename Fn>
+    void forEachOrder(Side side, Fn&& fn) const {
+        forEachLevel(side, [&](const PriceLevel& level) {
+            for (const Order* order = level.head; order != nullptr; order = order->getNext()) {
+                fn(*order);
             }
+            return true;
+        });
+    }
+
+    /** @brief Visits the pending stop orders in the order they would fire: buy stops, then sell stops. */
+    template <typename Fn>
+    void forEachStopOrder(Fn&& fn) const {
+        auto visit = [&](const PriceLevel& level) {
+            for (const Order* order = level.head; order != nullptr; order = order->getNext()) {
+                fn(*order);
+            }
+            return true;
+        };
+        buy_stops_.forEachLevel(visit);
+        sell_stops_.forEachLevel(visit);
+    }
+
+    /** @brief The price of the latest trade on this book, or nothing if it has not traded yet. */
+    std::optional<Price> getLastTradePrice() const { return this->last_trade_price_; }
+
+    /** @brief The best price of one side, or nothing if the side is empty. */
+    std::optional<Price> getBestPrice(Side side) const {
+        if (side == Side::Buy) {
+            return bids_.empty() ? std::nullopt : std::optional<Price>(bids_.best().price);
+        }
+        return asks_.empty() ? std::nullopt : std::optional<Price>(asks_.best().price);
+    }
+
+    // --- Account Exposure for Pre-Trade Risk ---
+
+    /**
+     * @brief The open orders, open notional and position of an account on this book, or nullptr if it
+     * never had any. Only orders with an account are tracked; the counters change with every rest,
+     * fill, amendment and removal of the account's orders, so reading them costs one lookup.
+     */
+    const AccountExposure* getExposure(AccountId account) const {
+        auto it = this->exposures_.find(account);
+        return (it != this->exposures_.end()) ? &it->second : nullptr;
+    }
+
+    /** @brief Visits the accounts that have an exposure on this book, as `fn(AccountId, const AccountExposure&)`. */
+    template <typename Fn>
+    void forEachExposure(Fn&& fn) const {
+        for (const auto& [account, exposure] : this->exposures_) {
+            fn(account, exposure);
+        }
+    }
+
+    /**
+     * @brief The price an order's notional is counted at while it waits: its limit price, or the stop
+     * price of a stop-market order.
+     */
+    static Price exposurePrice(const Order& order) {
+        return order.hasPriceLimit() ? order.getPrice() : order.getStopPrice();
+    }
+
+    // --- Snapshot Restore ---
+
+    /**
+     * @brief Puts a previously resting order (or pending stop order) back at the end of its level's
+     * queue, without matching it. Used to rebuild a book from a snapshot; the order must not cross the book.
+     */
+    void restoreOrder(const Order& order) {
+        if (order.isStop()) {
+            addStopOrder(order);
+        } else {
+            addLimitOrder(order);
         }
+    }
+
+    /** @brief Restores an account's position on this book; its open orders are counted as they are restored. */
+    void restorePosition(AccountId account, Quantity position) { this->exposures_[account].position = position; }
+
+    /** @brief Restores the price that pending stop orders are compared with. */
+    void restoreLastTradePrice(std::optional<Price> price) { this->last_trade_price_ = price; }
+
+    /** @brief Continues the market data sequence of a restored book from where the snapshot left it. */
+    void restoreMarketDataSeq(std::uint64_t seq) { this->market_data_seq_ = seq; }
+
+    /** @brief Advances and returns this book's market data sequence number (1 for the first update). */
+    std::uint64_t nextMarketDataSeq() { return ++this->market_data_seq_; }
+
+    /** @brief The sequence number of the latest market data update published for this book. */
+    std::uint64_t getMarketDataSeq() const { return this->market_data_seq_; }
 
-        return trades;
+    /** @brief The number of non-empty price levels on one side of the book. */
+    std::size_t getLevelCount(Side side) const {
+        return (side == Side::Buy) ? this->bids_.levelCount() : this->asks_.levelCount();
     }
 
+    /** @brief The number of orders currently resting on the book (not counting pending stop orders). */
+    std::size_t restingOrderCount() const { return this->pool_.size() - this->stop_count_; }
+
+    /** @brief The number of stop orders waiting for their stop price. */
+    std::size_t pendingStopCount() const { return this->stop_count_; }
+
     /**
      * @brief Retrieves the Best Bid and Offer (BBO) from the book.
      * @param bbo_out A reference to a BBO struct that will be filled with the result.
@@ -81,8 +400,8 @@ public:
         if (bids_.empty() || asks_.empty()) {
             return false;
         }
-        bbo_out.bestBid = bids_.begin()->first;
-        bbo_out.bestAsk = asks_.begin()->first;
+        bbo_out.bestBid = bids_.best().price;
+        bbo_out.bestAsk = asks_.best().price;
         return true;
     }
 
@@ -99,30 +418,33 @@ public:
         if (asks_.empty()) {
             cout << "  (empty)" << endl;
         } else {
-            for (const auto& [price, orders_at_price] : asks_) {
-                double total_quantity = 0;
-                for (const auto& order : orders_at_price) {
-                    total_quantity += order.getQuantity();
-                }
-                cout << "  Price: " << price << " | Total Quantity: " << total_quantity << " | Orders: " << orders_at_price.size() << endl;
-            }
+            asks_.forEachLevel([&](const PriceLevel& level) {
+                printLevel(level);
+                return true;
+            });
         }
         cout << "--------------------" << endl;
         cout << "BIDS:" << endl;
         if (bids_.empty()) {
             cout << "  (empty)" << endl;
         } else {
-            for (const auto& [price, orders_at_price] : bids_) {
-                double total_quantity = 0;
-                for (const auto& order : orders_at_price) {
-                    total_quantity += order.getQuantity();
-                }
-                cout << "  Price: " << price << " | Total Quantity: " << total_quantity << " | Orders: " << orders_at_price.size() << endl;
-            }
+            bids_.forEachLevel([&](const PriceLevel& level) {
+                printLevel(level);
+                return true;
+            });
         }
         cout << "--------------------" << endl << endl;
     }
 
+    /**
+     * @brief Formats one price level as a `[price, quantity]` pair of decimal strings.
+     * This is the format of every level in the depth arrays and in incremental updates;
+     * a quantity of zero means the level no longer exists.
+     */
+    json getLevelAsJson(Price price, Quantity quantity) const {
+        return json::array({std::to_string(instrument_.fromTicks(price)), std::to_string(instrument_.fromLots(quantity))});
+    }
+
     /**
      * @brief Gets the top N price levels of one side of the book.
      * @param n The number of levels to retrieve.
@@ -132,123 +454,407 @@ public:
     json getBookDepthAsJson(int n, Side side) const {
         json depth_json = json::array();
 
+        int count = 0;
+        auto append_level = [&](const PriceLevel& level) {
+            if (count++ >= n) return false;
+            depth_json.push_back(getLevelAsJson(level.price, level.totalQuantity));
+            return true;
+        };
+
         if (side == Side::Buy) {
-            int count = 0;
-            for (const auto& [price, orders_at_price] : bids_) {
-                if (count++ >= n) break;
-                double total_quantity = 0;
-                for (const auto& order : orders_at_price) {
-                    total_quantity += order.getQuantity();
-                }
-                depth_json.push_back({std::to_string(price), std::to_string(total_quantity)});
-            }
+            bids_.forEachLevel(append_level);
         } else { // Side::Sell
-            int count = 0;
-            for (const auto& [price, orders_at_price] : asks_) {
-                if (count++ >= n) break;
-                double total_quantity = 0;
-                for (const auto& order : orders_at_price) {
-                    total_quantity += order.getQuantity();
-                }
-                depth_json.push_back({std::to_string(price), std::to_string(total_quantity)});
-            }
+            asks_.forEachLevel(append_level);
         }
         
         return depth_json;
     }
 
 private:
-    std::map<double, std::list<Order>> asks_;
-    std::map<double, std::list<Order>, std::greater<double>> bids_;
+    // Stops rarely cluster the way resting orders do, so their ladders start small.
+    static constexpr std::size_t kStopWindow = 256;
+
+    SymbolId symbol_;
+    Instrument instrument_;
+    PriceLadder<Side::Sell> asks_;
+    PriceLadder<Side::Buy> bids_;
+    // Pending stop orders by stop price. Keyed like asks (lowest first) for buy stops and like
+    // bids (highest first) for sell stops, so the best level is the next one to fire.
+    PriceLadder<Side::Sell> buy_stops_;
+    PriceLadder<Side::Buy> sell_stops_;
+    std::size_t stop_count_ = 0;
+    std::optional<Price> last_trade_price_;
+    OrderPool pool_; // Holds the resting orders and the pending stop orders.
+    OrderIndex& index_;
+    OrderOwners& owners_;
+    std::vector<LevelChange> changed_levels_;
+    std::vector<OrderId> self_trade_cancels_;
+    std::vector<Order> triggered_; // Reused by triggerStops().
+    bool record_order_events_ = false;
+    std::vector<OrderEvent> order_events_;
+    std::uint64_t order_event_seq_ = 0;
+    std::uint64_t market_data_seq_ = 0;
+    std::unordered_map<AccountId, AccountExposure> exposures_; // Only for orders with an account.
+
+    /** @brief Records that a level changed, unless it is already recorded. */
+    void markChanged(Side side, Price price) {
+        // Almost every change repeats the previous one (a sweep fills the same level several times),
+        // so check the last entry first; otherwise the list is short enough for a linear scan.
+        for (auto it = changed_levels_.rbegin(); it != changed_levels_.rend(); ++it) {
+            if (it->side == side && it->price == price) {
+                return;
+            }
+        }
+        changed_levels_.push_back({side, price});
+    }
+
+    /** @brief Looks an ID up in the (possibly shared) index and checks that the order lives on this book. */
+    Order* findOwnOrder(OrderId orderId) const {
+        Order* order = index_.find(orderId);
+        return (order != nullptr && order->getSymbolId() == symbol_) ? order : nullptr;
+    }
+
+    PriceLevel& levelOf(const Order& order) {
+        if (order.isStop()) {
+            return *((order.getSide() == Side::Buy) ? buy_stops_.find(order.getStopPrice())
+                                                    : sell_stops_.find(order.getStopPrice()));
+        }
+        return *((order.getSide() == Side::Buy) ? bids_.find(order.getPrice()) : asks_.find(order.getPrice()));
+    }
+
+    /** @brief Unlinks a resting order (or pending stop) from its level, drops it from the index and frees its slot. */
+    void removeRestingOrder(Order* order) {
+        PriceLevel& level = levelOf(*order);
+        level.remove(order);
+        if (order->isStop()) {
+            if (level.empty()) {
+                if (order->getSide() == Side::Buy) {
+                    buy_stops_.erase(order->getStopPrice());
+                } else {
+                    sell_stops_.erase(order->getStopPrice());
+                }
+            }
+            --stop_count_;
+        } else {
+            markChanged(order->getSide(), order->getPrice());
+            recordOrderEvent(OrderEventType::Delete, *order, order->getPrice(), 0);
+            if (level.empty()) {
+                if (order->getSide() == Side::Buy) {
+                    bids_.erase(order->getPrice());
+                } else {
+                    asks_.erase(order->getPrice());
+                }
+            }
+        }
+        removeExposure(*order);
+        owners_.remove(order);
+        index_.erase(order->getOrderID());
+        pool_.release(order);
+    }
+
+    /** @brief Counts a newly resting order (or pending stop) towards its account's exposure. */
+    void addExposure(const Order& order) {
+        if (order.getAccount() != kNoAccount) {
+            AccountExposure& exposure = exposures_[order.getAccount()];
+            ++exposure.openOrders;
+            exposure.openNotional += exposurePrice(order) * order.getQuantity();
+        }
+    }
+
+    /** @brief Takes a resting order (or pending stop) that leaves the book out of its account's exposure. */
+    void removeExposure(const Order& order) {
+        if (order.getAccount() != kNoAccount) {
+            AccountExposure& exposure = exposures_[order.getAccount()];
+            --exposure.openOrders;
+            exposure.openNotional -= exposurePrice(order) * order.getQuantity();
+        }
+    }
+
+    /** @brief Lowers the open notional of an order's account by `quantity` of the order. */
+    void reduceExposure(const Order& order, Quantity quantity) {
+        if (order.getAccount() != kNoAccount) {
+            exposures_[order.getAccount()].openNotional -= exposurePrice(order) * quantity;
+        }
+    }
+
+    /** @brief Moves `quantity` of a resting order from its account's open notional to its position. */
+    void fillExposure(const Order& resting, Quantity quantity) {
+        if (resting.getAccount() != kNoAccount) {
+            AccountExposure& exposure = exposures_[resting.getAccount()];
+            exposure.openNotional -= resting.getPrice() * quantity;
+            exposure.position += (resting.getSide() == Side::Buy) ? quantity : -quantity;
+            if (quantity == resting.getQuantity()) {
+                --exposure.openOrders;
+            }
+        }
+    }
+
+    /** @brief Matches an order and rests what is left of a limit order, or sets a stop order aside. */
+    void executeOrder(Order& order, std::vector<Trade>& trades) {
+        if (order.isStop()) {
+            if (!isStopReached(order.getSide(), order.getStopPrice())) {
+                addStopOrder(order);
+                return;
+            }
+            order.trigger(); // The market is already there.
+        }
+
+        if (order.getType() == OrderType::FOK) {
+            if (!canFOKfill(order)) {
+                return;
+            }
+        }
+
+        const Quantity filled = (order.getSide() == Side::Buy) ? matchBuyOrder(order, trades) : matchSellOrder(order, trades);
+        if (filled > 0 && order.getAccount() != kNoAccount) {
+            exposures_[order.getAccount()].position += (order.getSide() == Side::Buy) ? filled : -filled;
+        }
+
+        if (order.getQuantity() > 0) {
+            if (order.getType() == OrderType::Limit) {
+                addLimitOrder(order);
+            }
+        }
+    }
+
+    /** @brief True if the latest trade is at or beyond a stop price (above it for buys, below it for sells). */
+    bool isStopReached(Side side, Price stopPrice) const {
+        if (!last_trade_price_) {
+            return false;
+        }
+        return (side == Side::Buy) ? *last_trade_price_ >= stopPrice : *last_trade_price_ <= stopPrice;
+    }
+
+    /**
+     * @brief Fires the stop orders reached by the trades from `from` on and matches them, repeating
+     * for the trades those cause until no more stops fire. Stops fire in price order, and those at
+     * the same stop price in the order they were placed.
+     */
+    void triggerStops(std::vector<Trade>& trades, std::size_t from) {
+        while (from < trades.size()) {
+            if (stop_count_ == 0) {
+                last_trade_price_ = trades.back().price; // All a book without stops needs.
+                return;
+            }
+            Price low = trades[from].price;
+            Price high = low;
+            for (std::size_t i = from + 1; i < trades.size(); ++i) {
+                low = std::min(low, trades[i].price);
+                high = std::max(high, trades[i].price);
+            }
+            last_trade_price_ = trades.back().price;
+            from = trades.size();
+
+            triggered_.clear();
+            while (!buy_stops_.empty() && buy_stops_.best().price <= high) {
+                takeStops(buy_stops_.best());
+                buy_stops_.eraseBest();
+            }
+            while (!sell_stops_.empty() && sell_stops_.best().price >= low) {
+                takeStops(sell_stops_.best());
+                sell_stops_.eraseBest();
+            }
+            // executeOrder() never touches triggered_, so it can be walked while the stops are matched.
+            for (Order& order : triggered_) {
+                order.trigger();
+                executeOrder(order, trades);
+            }
+        }
+    }
+
+    /** @brief Moves every stop order of a stop level to triggered_, leaving the level empty. */
+    void takeStops(PriceLevel& level) {
+        while (!level.empty()) {
+            Order* order = level.head;
+            level.remove(order);
+            triggered_.push_back(*order);
+            removeExposure(*order);
+            owners_.remove(order);
+            index_.erase(order->getOrderID());
+            pool_.release(order);
+            --stop_count_;
+        }
+    }
+
+    void addStopOrder(const Order& order) {
+        Order* pending = pool_.acquire(order);
+        if (order.getSide() == Side::Buy) {
+            buy_stops_.getOrCreate(order.getStopPrice()).pushBack(pending);
+        } else {
+            sell_stops_.getOrCreate(order.getStopPrice()).pushBack(pending);
+        }
+        index_.insert(order.getOrderID(), pending);
+        owners_.add(pending);
+        addExposure(order);
+        ++stop_count_;
+    }
 
-    void matchBuyOrder(Order& buyOrder, std::vector<Trade>& trades) {
+    /**
+     * @brief Applies self-trade prevention to an incoming order that reached a resting order of its own account.
+     * @return True if matching may continue (the resting order was cancelled), false if the
+     *         incoming order was cancelled instead.
+     */
+    bool preventSelfTrade(Order& incoming, Order& resting) {
+        if (incoming.getSelfTradePrevention() == SelfTradePrevention::CancelOldest) {
+            self_trade_cancels_.push_back(resting.getOrderID());
+            removeRestingOrder(&resting);
+            return true;
+        }
+        self_trade_cancels_.push_back(incoming.getOrderID());
+        incoming.reduceQuantity(incoming.getQuantity());
+        return false;
+    }
+
+    void printLevel(const PriceLevel& level) const {
+        std::cout << "  Price: " << instrument_.fromTicks(level.price)
+                  << " | Total Quantity: " << instrument_.fromLots(level.totalQuantity)
+                  << " | Orders: " << level.orderCount << std::endl;
+    }
+
+    /** @return The quantity the buy order traded. */
+    Quantity matchBuyOrder(Order& buyOrder, std::vector<Trade>& trades) {
+        const AccountId selfTradeAccount = buyOrder.getSelfTradeAccount();
+        Quantity filled = 0;
         while (buyOrder.getQuantity() > 0 && !asks_.empty()) {
-            auto bestAskIt = asks_.begin();
-            std::list<Order>& askQueue = bestAskIt->second;
-            Order& restingAsk = askQueue.front();
+            PriceLevel& bestAsk = asks_.best();
+            Order& restingAsk = *bestAsk.head;
 
-            if (buyOrder.getType() == OrderType::Limit && buyOrder.getPrice() < restingAsk.getPrice()) {
+            if (buyOrder.hasPriceLimit() && buyOrder.getPrice() < restingAsk.getPrice()) {
                 break;
             }
+            if (selfTradeAccount != kNoAccount && restingAsk.getAccount() == selfTradeAccount) {
+                if (!preventSelfTrade(buyOrder, restingAsk)) {
+                    break;
+                }
+                continue; // Look at the best ask again: the cancel may have changed it.
+            }
 
-            double tradeQuantity = std::min(buyOrder.getQuantity(), restingAsk.getQuantity());
-            trades.emplace_back(restingAsk.getOrderID(), buyOrder.getOrderID(), restingAsk.getPrice(), tradeQuantity, Side::Buy, restingAsk.getSymbol());
-            
+            Quantity tradeQuantity = std::min(buyOrder.getQuantity(), restingAsk.getQuantity());
+            trades.emplace_back(restingAsk.getOrderID(), buyOrder.getOrderID(), restingAsk.getPrice(), tradeQuantity, Side::Buy,
+                                restingAsk.getSymbolId(), buyOrder.getReceivedTime(), buyOrder.getAcceptedTime(),
+                                restingAsk.getAcceptedTime());
+            filled += tradeQuantity;
+
+            fillExposure(restingAsk, tradeQuantity);
             restingAsk.reduceQuantity(tradeQuantity);
             buyOrder.reduceQuantity(tradeQuantity);
+            bestAsk.reduce(tradeQuantity);
+            markChanged(Side::Sell, bestAsk.price);
+            recordOrderEvent(OrderEventType::Execute, restingAsk, bestAsk.price, tradeQuantity);
 
             if (restingAsk.getQuantity() == 0) {
-                askQueue.pop_front();
+                bestAsk.popFront();
+                owners_.remove(&restingAsk);
+                index_.erase(restingAsk.getOrderID());
+                pool_.release(&restingAsk);
             }
-            if (askQueue.empty()) {
-                asks_.erase(bestAskIt);
+            if (bestAsk.empty()) {
+                asks_.eraseBest();
             }
         }
+        return filled;
     }
 
-    void matchSellOrder(Order& sellOrder, std::vector<Trade>& trades) {
+    /** @return The quantity the sell order traded. */
+    Quantity matchSellOrder(Order& sellOrder, std::vector<Trade>& trades) {
+        const AccountId selfTradeAccount = sellOrder.getSelfTradeAccount();
+        Quantity filled = 0;
         while (sellOrder.getQuantity() > 0 && !bids_.empty()) {
-            auto bestBidIt = bids_.begin();
-            std::list<Order>& bidQueue = bestBidIt->second;
-            Order& restingBid = bidQueue.front();
+            PriceLevel& bestBid = bids_.best();
+            Order& restingBid = *bestBid.head;
 
-            if (sellOrder.getType() == OrderType::Limit && sellOrder.getPrice() > restingBid.getPrice()) {
+            if (sellOrder.hasPriceLimit() && sellOrder.getPrice() > restingBid.getPrice()) {
                 break;
             }
+            if (selfTradeAccount != kNoAccount && restingBid.getAccount() == selfTradeAccount) {
+                if (!preventSelfTrade(sellOrder, restingBid)) {
+                    break;
+                }
+                continue; // Look at the best bid again: the cancel may have changed it.
+            }
+
+            Quantity tradeQuantity = std::min(sellOrder.getQuantity(), restingBid.getQuantity());
+            trades.emplace_back(restingBid.getOrderID(), sellOrder.getOrderID(), restingBid.getPrice(), tradeQuantity, Side::Sell,
+                                restingBid.getSymbolId(), sellOrder.getReceivedTime(), sellOrder.getAcceptedTime(),
+                                restingBid.getAcceptedTime());
+            filled += tradeQuantity;
 
-            double tradeQuantity = std::min(sellOrder.getQuantity(), restingBid.getQuantity());
-            trades.emplace_back(restingBid.getOrderID(), sellOrder.getOrderID(), restingBid.getPrice(), tradeQuantity, Side::Sell, restingBid.getSymbol());
-            
+            fillExposure(restingBid, tradeQuantity);
             restingBid.reduceQuantity(tradeQuantity);
             sellOrder.reduceQuantity(tradeQuantity);
+            bestBid.reduce(tradeQuantity);
+            markChanged(Side::Buy, bestBid.price);
+            recordOrderEvent(OrderEventType::Execute, restingBid, bestBid.price, tradeQuantity);
 
             if (restingBid.getQuantity() == 0) {
-                bidQueue.pop_front();
+                bestBid.popFront();
+                owners_.remove(&restingBid);
+                index_.erase(restingBid.getOrderID());
+                pool_.release(&restingBid);
             }
-            if (bidQueue.empty()) {
-                bids_.erase(bestBidIt);
+            if (bestBid.empty()) {
+                bids_.eraseBest();
             }
         }
+        return filled;
     }
 
     void addLimitOrder(const Order& order) {
+        Order* resting = pool_.acquire(order);
         if (order.getSide() == Side::Buy) {
-            bids_[order.getPrice()].push_back(order);
+            bids_.getOrCreate(order.getPrice()).pushBack(resting);
         } else {
-            asks_[order.getPrice()].push_back(order);
+            asks_.getOrCreate(order.getPrice()).pushBack(resting);
+        }
+        index_.insert(order.getOrderID(), resting);
+        owners_.add(resting);
+        addExposure(order);
+        markChanged(order.getSide(), order.getPrice());
+        recordOrderEvent(OrderEventType::Add, order, order.getPrice(), order.getQuantity());
+    }
+
+    void recordOrderEvent(OrderEventType type, const Order& order, Price price, Quantity quantity) {
+        if (record_order_events_) {
+            order_events_.push_back({type, order.getSide(), order.getOrderID(), price, quantity});
         }
     }
 
     bool canFOKfill(const Order& order) const {
-        double quantity_needed = order.getQuantity();
-        double quantity_available = 0;
+        Quantity quantity_needed = order.getQuantity();
+        Quantity quantity_available = 0;
 
-        if (order.getSide() == Side::Buy) {
-            for (const auto& pair : asks_) {
-                const double price_level = pair.first;
-                if (order.getType() == OrderType::Limit && price_level > order.getPrice()) {
-                    continue;
-                }
-                for (const auto& resting_order : pair.second) {
-                    quantity_available += resting_order.getQuantity();
-                }
-                if (quantity_available >= quantity_needed) {
-                    return true;
-                }
+        // Only the levels the order is allowed to cross are visited: the walk stops at the
+        // first level beyond the limit price, or as soon as enough quantity has been found.
+        const AccountId selfTradeAccount = order.getSelfTradeAccount();
+        auto accumulate = [&](const PriceLevel& level) {
+            if (order.getSide() == Side::Buy ? level.price > order.getPrice() : level.price < order.getPrice()) {
+                return false;
             }
-        } else {
-            for (const auto& pair : bids_) {
-                const double price_level = pair.first;
-                if (order.getType() == OrderType::Limit && price_level < order.getPrice()) {
+            if (selfTradeAccount == kNoAccount) {
+                quantity_available += level.totalQuantity;
+                return quantity_available < quantity_needed;
+            }
+            // With self-trade prevention, the account's own orders are skipped (CancelOldest) or
+            // end the fill (CancelNewest), so they cannot count towards it.
+            for (const Order* resting = level.head; resting != nullptr; resting = resting->getNext()) {
+                if (resting->getAccount() == selfTradeAccount) {
+                    if (order.getSelfTradePrevention() == SelfTradePrevention::CancelNewest) {
+                        return false;
+                    }
                     continue;
                 }
-                for (const auto& resting_order : pair.second) {
-                    quantity_available += resting_order.getQuantity();
-                }
+                quantity_available += resting->getQuantity();
                 if (quantity_available >= quantity_needed) {
-                    return true;
+                    return false;
                 }
             }
+            return true;
+        };
+
+        if (order.getSide() == Side::Buy) {
+            asks_.forEachLevel(accumulate);
+        } else {
+            bids_.forEachLevel(accumulate);
         }
         
         return quantity_available >= quantity_needed;
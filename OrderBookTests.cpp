@@ -0,0 +1,209 @@
+/**
+ * @file OrderBookTests.cpp
+ * @brief Tests of the matching core (OrderBook), run by ctest as part of engine_tests.
+ *
+ * Each test drives an OrderBook directly, like the benchmark's "book" mode, and checks the
+ * trades and the book it leaves behind.
+ */
+
+#include <vector>
+
+#include "Instrument.h"
+#include "Order.h"
+#include "OrderBook.h"
+#include "OrderIndex.h"
+#include "OrderOwners.h"
+#include "TestHarness.h"
+#include "Trade.h"
+
+namespace {
+
+constexpr AccountId kOwn = 7;
+constexpr AccountId kForeign = 8;
+
+/** @brief A book with everything it needs, driven directly like the benchmark's "book" mode. */
+struct TestBook {
+    Instrument instrument{0.01, 0.001};
+    OrderIndex index;
+    OrderOwners owners;
+    OrderBook book{0, index, owners, instrument};
+    std::vector<Trade> trades;
+    OrderId nextId = 1;
+
+    /** @brief Processes a new order and returns its ID. `trades` holds the trades of this order only. */
+    OrderId add(OrderType type, Side side, Quantity quantity, Price price, AccountId account = kNoAccount,
+                SelfTradePrevention stp = SelfTradePrevention::None, Price stopPrice = 0) {
+        const OrderId id = this->nextId++;
+        Order order(id, type, side, quantity, 0, price, stopPrice, account, stp);
+        this->trades.clear();
+        this->book.clearChangedLevels(); // As the shard does after each change, which also resets the STP cancels.
+        this->book.processOrder(order, this->trades);
+        return id;
+    }
+
+    std::vector<OrderId> makers() const {
+        std::vector<OrderId> ids;
+        for (const Trade& trade : this->trades) {
+            ids.push_back(trade.makerOrderID);
+        }
+        return ids;
+    }
+
+    std::vector<OrderId> takers() const {
+        std::vector<OrderId> ids;
+        for (const Trade& trade : this->trades) {
+            ids.push_back(trade.takerOrderID);
+        }
+        return ids;
+    }
+
+    std::vector<OrderId> stops() const {
+        std::vector<OrderId> ids;
+        this->book.forEachStopOrder([&](const Order& order) { ids.push_back(order.getOrderID()); });
+        return ids;
+    }
+};
+
+} // namespace
+
+/**
+ * @brief A cancel_oldest limit order that cancels the last resting order of the price window
+ * must not trade with the next level pulled in from the overflow if that is beyond its limit.
+ */
+TEST(SelfTradeCancelDoesNotTradeThroughLimit) {
+    const Instrument instrument(0.01, 0.000001);
+    OrderIndex index;
+    OrderOwners owners;
+    OrderBook book(0, index, owners, instrument);
+    std::vector<Trade> trades;
+
+    const AccountId account = 7;
+    const Quantity quantity = instrument.toLots(1.0);
+    const Price own = instrument.toTicks(30000.00);
+    const Price foreign = instrument.toTicks(31000.00); // Further than the ladder's window reaches: an overflow level.
+
+    Order own_ask(1, OrderType::Limit, Side::Sell, quantity, 0, own, 0, account);
+    book.processOrder(own_ask, trades);
+    Order foreign_ask(2, OrderType::Limit, Side::Sell, quantity, 0, foreign);
+    book.processOrder(foreign_ask, trades);
+    CHECK(trades.empty());
+
+    Order buy(3, OrderType::Limit, Side::Buy, quantity, 0, own, 0, account, SelfTradePrevention::CancelOldest);
+    book.processOrder(buy, trades);
+
+    CHECK(trades.empty());
+    CHECK(book.getSelfTradeCancels() == std::vector<OrderId>{1});
+    BBO bbo;
+    CHECK(book.getBBO(bbo));
+    CHECK(bbo.bestBid == own);   // The buy rested at its limit...
+    CHECK(bbo.bestAsk == foreign); // ...and the foreign ask is still there.
+    CHECK(book.restingOrderCount() == 2);
+}
+
+TEST(SelfTradePreventionNoneTradesWithTheSameAccount) {
+    TestBook t;
+    const OrderId ask = t.add(OrderType::Limit, Side::Sell, 10, 100, kOwn);
+    t.add(OrderType::Limit, Side::Buy, 10, 100, kOwn, SelfTradePrevention::None);
+    CHECK(t.makers() == std::vector<OrderId>{ask});
+    CHECK(t.book.getSelfTradeCancels().empty());
+    CHECK(t.book.restingOrderCount() == 0);
+}
+
+TEST(CancelNewestCancelsTheRestOfTheIncomingOrder) {
+    TestBook t;
+    const OrderId foreign = t.add(OrderType::Limit, Side::Sell, 5, 99, kForeign);
+    const OrderId own = t.add(OrderType::Limit, Side::Sell, 10, 100, kOwn);
+    const OrderId behind = t.add(OrderType::Limit, Side::Sell, 10, 100, kForeign);
+    const OrderId buy = t.add(OrderType::Limit, Side::Buy, 20, 100, kOwn, SelfTradePrevention::CancelNewest);
+
+    // It trades up to its own order, and the rest is cancelled instead of resting or skipping ahead.
+    CHECK(t.makers() == std::vector<OrderId>{foreign});
+    CHECK(t.book.getSelfTradeCancels() == std::vector<OrderId>{buy});
+    CHECK(t.book.restingOrderCount() == 2);
+    CHECK(!t.book.getBestPrice(Side::Buy));
+    CHECK(t.index.find(own) != nullptr);
+    CHECK(t.index.find(behind) != nullptr);
+}
+
+TEST(CancelOldestCancelsTheRestingOrderAndKeepsMatching) {
+    TestBook t;
+    const OrderId own = t.add(OrderType::Limit, Side::Sell, 10, 100, kOwn);
+    const OrderId foreign = t.add(OrderType::Limit, Side::Sell, 10, 100, kForeign);
+    t.add(OrderType::Limit, Side::Buy, 10, 100, kOwn, SelfTradePrevention::CancelOldest);
+
+    CHECK(t.makers() == std::vector<OrderId>{foreign});
+    CHECK(t.book.getSelfTradeCancels() == std::vector<OrderId>{own});
+    CHECK(t.book.restingOrderCount() == 0);
+    CHECK(t.index.find(own) == nullptr);
+}
+
+TEST(FillOrKillDoesNotCountOwnOrdersTheFillWouldSkip) {
+    TestBook t;
+    const OrderId own = t.add(OrderType::Limit, Side::Sell, 10, 100, kOwn);
+    const OrderId foreign = t.add(OrderType::Limit, Side::Sell, 5, 100, kForeign);
+
+    // 15 lots rest, but 10 are the account's own: a 10 lot fill-or-kill cannot fill, so nothing happens.
+    t.add(OrderType::FOK, Side::Buy, 10, 100, kOwn, SelfTradePrevention::CancelOldest);
+    CHECK(t.trades.empty());
+    CHECK(t.book.getSelfTradeCancels().empty());
+    CHECK(t.book.restingOrderCount() == 2);
+
+    // Without self-trade prevention the own order counts (and trades).
+    t.add(OrderType::FOK, Side::Buy, 15, 100, kOwn, SelfTradePrevention::None);
+    CHECK((t.makers() == std::vector<OrderId>{own, foreign}));
+    CHECK(t.book.restingOrderCount() == 0);
+}
+
+TEST(FillOrKillWithCancelNewestStopsCountingAtTheOwnOrder) {
+    TestBook t;
+    t.add(OrderType::Limit, Side::Sell, 10, 99, kForeign);
+    t.add(OrderType::Limit, Side::Sell, 10, 100, kOwn);
+    t.add(OrderType::Limit, Side::Sell, 10, 100, kForeign);
+
+    // The fill would end at the own order after 10 lots, although 20 foreign lots rest within the limit.
+    t.add(OrderType::FOK, Side::Buy, 15, 100, kOwn, SelfTradePrevention::CancelNewest);
+    CHECK(t.trades.empty());
+    CHECK(t.book.restingOrderCount() == 3);
+
+    // CancelOldest skips the own order, so the same order fills from the foreign ones.
+    const OrderId buy = t.add(OrderType::FOK, Side::Buy, 15, 100, kOwn, SelfTradePrevention::CancelOldest);
+    CHECK(t.takers() == std::vector<OrderId>(2, buy));
+    CHECK(t.book.getSelfTradeCancels().size() == 1);
+    CHECK(t.book.restingOrderCount() == 1);
+}
+
+TEST(StopOrdersCascade) {
+    TestBook t;
+    t.add(OrderType::Limit, Side::Sell, 5, 101);
+    t.add(OrderType::Limit, Side::Sell, 5, 103);
+    t.add(OrderType::Limit, Side::Sell, 5, 106);
+    const OrderId first = t.add(OrderType::StopMarket, Side::Buy, 5, 0, kNoAccount, SelfTradePrevention::None, 101);
+    const OrderId second = t.add(OrderType::StopMarket, Side::Buy, 5, 0, kNoAccount, SelfTradePrevention::None, 103);
+    const OrderId untouched = t.add(OrderType::StopLimit, Side::Buy, 5, 120, kNoAccount, SelfTradePrevention::None, 110);
+    CHECK(t.trades.empty());
+    CHECK((t.stops() == std::vector<OrderId>{first, second, untouched}));
+
+    // A trade at 101 fires the first stop, whose trade at 103 fires the second.
+    const OrderId taker = t.add(OrderType::Limit, Side::Buy, 5, 101);
+    CHECK((t.takers() == std::vector<OrderId>{taker, first, second}));
+    CHECK(t.trades.size() == 3 && t.trades[1].price == 103 && t.trades[2].price == 106);
+    CHECK(t.stops() == std::vector<OrderId>{untouched});
+    CHECK(t.book.getLastTradePrice() == std::optional<Price>(106));
+    CHECK(t.index.find(first) == nullptr);
+}
+
+TEST(StopOrdersAtOneStopPriceFireInTheOrderTheyWerePlaced) {
+    TestBook t;
+    t.add(OrderType::Limit, Side::Buy, 1, 99);
+    t.add(OrderType::Limit, Side::Buy, 10, 95);
+    const OrderId first = t.add(OrderType::StopLimit, Side::Sell, 4, 90, kNoAccount, SelfTradePrevention::None, 99);
+    const OrderId second = t.add(OrderType::StopLimit, Side::Sell, 4, 90, kNoAccount, SelfTradePrevention::None, 99);
+    const OrderId taker = t.add(OrderType::Market, Side::Sell, 1, 0);
+    CHECK((t.takers() == std::vector<OrderId>{taker, first, second}));
+    CHECK(t.stops().empty());
+
+    // A stop price the market has already reached fires straight away.
+    const OrderId reached = t.add(OrderType::StopMarket, Side::Sell, 1, 0, kNoAccount, SelfTradePrevention::None, 96);
+    CHECK(t.takers() == std::vector<OrderId>{reached});
+    CHECK(t.stops().empty());
+}
@@ -0,0 +1,133 @@
+/**
+ * @file OrderIndex.h
+ * @brief Defines the OrderIndex class, a hash index from order ID to the resting order.
+ *
+ * Cancels and amendments arrive with nothing but an order ID, so the engine needs to go
+ * from an ID straight to the order's slot in its price level. The index is a flat,
+ * open-addressing hash table (linear probing with backward-shift deletion): lookups touch
+ * one or two adjacent cache lines, and inserting or erasing never allocates unless the
+ * table has to grow.
+ */
+
+#pragma once
+
+#include <cstddef> // For std::size_t
+#include <cstdint> // For std::uint64_t
+#include <utility> // For std::swap
+#include <vector>
+
+#include "Order.h"
+
+/**
+ * @class OrderIndex
+ * @brief Maps the ID of every resting order to the Order object in its OrderPool slot.
+ */
+class OrderIndex {
+public:
+    /**
+     * @brief Constructs an empty index.
+     * @param initialCapacity The number of slots to start with (rounded up to a power of two).
+     */
+    explicit OrderIndex(std::size_t initialCapacity = 65536) {
+        std::size_t capacity = 16;
+        while (capacity < initialCapacity) {
+            capacity *= 2;
+        }
+        resize(capacity);
+    }
+
+    /** @brief Returns the resting order with the given ID, or nullptr if there is none. */
+    Order* find(OrderId id) const {
+        for (std::size_t i = home(id);; i = (i + 1) & this->mask_) {
+            const Entry& entry = this->entries_[i];
+            if (entry.id == id) {
+                return entry.order;
+            }
+            if (entry.id == kEmpty) {
+                return nullptr;
+            }
+        }
+    }
+
+    /** @brief Adds (or replaces) the entry for an order ID. */
+    void insert(OrderId id, Order* order) {
+        if ((this->size_ + 1) * 2 > this->entries_.size()) {
+            resize(this->entries_.size() * 2); // Keep the load factor at or below 50%.
+        }
+        place(id, order);
+    }
+
+    /** @brief Removes the entry for an order ID, if present. */
+    void erase(OrderId id) {
+        std::size_t hole = home(id);
+        while (this->entries_[hole].id != id) {
+            if (this->entries_[hole].id == kEmpty) {
+                return;
+            }
+            hole = (hole + 1) & this->mask_;
+        }
+
+        // Backward-shift deletion: pull later entries of the same probe run back into the hole,
+        // so that lookups never need tombstones.
+        for (std::size_t next = (hole + 1) & this->mask_; this->entries_[next].id != kEmpty;
+             next = (next + 1) & this->mask_) {
+            const std::size_t ideal = home(this->entries_[next].id);
+            const bool staysPut = (hole <= next) ? (hole < ideal && ideal <= next)
+                                                 : (hole < ideal || ideal <= next);
+            if (!staysPut) {
+                this->entries_[hole] = this->entries_[next];
+                hole = next;
+            }
+        }
+        this->entries_[hole] = Entry();
+        --this->size_;
+    }
+
+    /** @brief The number of orders in the index. */
+    std::size_t size() const { return this->size_; }
+
+private:
+    static constexpr OrderId kEmpty = 0; // Order IDs start at 1, so 0 marks a free slot.
+
+    struct Entry {
+        OrderId id = kEmpty;
+        Order* order = nullptr;
+    };
+
+    std::vector<Entry> entries_;
+    std::size_t mask_ = 0;
+    std::size_t size_ = 0;
+    unsigned shift_ = 0;
+
+    // Fibonacci hashing spreads the (mostly sequential) order IDs evenly over the table.
+    std::size_t home(OrderId id) const {
+        return static_cast<std::size_t>((static_cast<std::uint64_t>(id) * 0x9E3779B97F4A7C15ULL) >> this->shift_);
+    }
+
+    void place(OrderId id, Order* order) {
+        std::size_t i = home(id);
+        while (this->entries_[i].id != kEmpty && this->entries_[i].id != id) {
+            i = (i + 1) & this->mask_;
+        }
+        if (this->entries_[i].id == kEmpty) {
+            ++this->size_;
+        }
+        this->entries_[i] = Entry{id, order};
+    }
+
+    void resize(std::size_t capacity) {
+        std::vector<Entry> old(capacity);
+        std::swap(old, this->entries_);
+        this->mask_ = capacity - 1;
+        this->shift_ = 64;
+        for (std::size_t c = capacity; c > 1; c >>= 1) {
+            --this->shift_;
+        }
+        this->size_ = 0;
+        for (const Entry& entry : old) {
+            if (entry.id != kEmpty) {
+                place(entry.id, entry.order);
+            }
+        }
+    }
+};
@@ -0,0 +1,129 @@
+/**
+ * @file OrderOwners.h
+ * @brief Defines the OrderOwners class, the lists of the resting orders of each account and session.
+ *
+ * A mass cancel ("cancel all my orders", or every order of a session that disconnected) must
+ * not scan the whole book to find the orders it removes: during a volatile market every market
+ * maker pulls its quotes at once, and each of them would pay for everyone else's orders. Instead,
+ * every resting order (and pending stop order) with an account is linked into its account's list,
+ * and every one with a session into its session's list, through intrusive links in the Order
+ * itself. Finding an owner's orders is then one hash lookup plus a walk of exactly those orders,
+ * and linking or unlinking an order is O(1) and allocation-free once the owner is known.
+ */
+
+#pragma once
+
+#include <cstddef> // For std::size_t
+#include <unordered_map>
+
+#include "Order.h"
+
+/**
+ * @class OrderOwners
+ * @brief The orders of each account and session, shared by the books of one shard like its OrderIndex.
+ *
+ * The lists keep the order in which the orders were linked, so walking one visits its orders
+ * oldest first. Orders whose price or quantity is amended in place keep their position.
+ */
+class OrderOwners {
+public:
+    /** @brief Links a resting (or pending stop) order into the lists of its account and session. */
+    void add(Order* order) {
+        if (order->getAccount() != kNoAccount) {
+            link<&Order::accountPrev_, &Order::accountNext_>(this->accounts_[order->getAccount()], order);
+        }
+        if (order->getSession() != kNoSession) {
+            link<&Order::sessionPrev_, &Order::sessionNext_>(this->sessions_[order->getSession()], order);
+        }
+    }
+
+    /** @brief Unlinks an order that leaves the book from the lists of its account and session. */
+    void remove(Order* order) {
+        if (order->getAccount() != kNoAccount) {
+            unlink<&Order::accountPrev_, &Order::accountNext_>(this->accounts_, order->getAccount(), order);
+        }
+        if (order->getSession() != kNoSession) {
+            unlink<&Order::sessionPrev_, &Order::sessionNext_>(this->sessions_, order->getSession(), order);
+        }
+    }
+
+    /**
+     * @brief Forgets a session that has no orders left, e.g. once it has disconnected. Sessions are
+     * never reused, so their empty lists would otherwise pile up; accounts are few and stay.
+     */
+    void releaseSession(SessionId session) {
+        auto it = this->sessions_.find(session);
+        if (it != this->sessions_.end() && it->second.head == nullptr) {
+            this->sessions_.erase(it);
+        }
+    }
+
+    /** @brief The number of accounts and sessions that have a list, with orders or without. */
+    std::size_t ownerCount() const { return this->accounts_.size() + this->sessions_.size(); }
+
+    /** @brief Visits the orders of an account, oldest first, as `fn(const Order&)`. `fn` must not remove any. */
+    template <typename Fn>
+    void forEachOfAccount(AccountId account, Fn&& fn) const {
+        auto it = this->accounts_.find(account);
+        for (const Order* order = (it != this->accounts_.end()) ? it->second.head : nullptr; order != nullptr;
+             order = order->accountNext_) {
+            fn(*order);
+        }
+    }
+
+    /** @brief Visits the orders of a session, oldest first, as `fn(const Order&)`. `fn` must not remove any. */
+    template <typename Fn>
+    void forEachOfSession(SessionId session, Fn&& fn) const {
+        auto it = this->sessions_.find(session);
+        for (const Order* order = (it != this->sessions_.end()) ? it->second.head : nullptr; order != nullptr;
+             order = order->sessionNext_) {
+            fn(*order);
+        }
+    }
+
+private:
+    struct List {
+        Order* head = nullptr;
+        Order* tail = nullptr;
+    };
+
+    std::unordered_map<AccountId, List> accounts_;
+    std::unordered_map<SessionId, List> sessions_;
+
+    template <Order* Order::*Prev, Order* Order::*Next>
+    static void link(List& list, Order* order) {
+        order->*Prev = list.tail;
+        order->*Next = nullptr;
+        if (list.tail != nullptr) {
+            list.tail->*Next = order;
+        } else {
+            list.head = order;
+        }
+        list.tail = order;
+    }
+
+    template <Order* Order::*Prev, Order* Order::*Next, typename Key>
+    static void unlink(std::unordered_map<Key, List>& lists, Key owner, Order* order) {
+        // Only the ends of a list are stored, so an order in the middle needs no lookup.
+        if (order->*Prev != nullptr && order->*Next != nullptr) {
+            (order->*Prev)->*Next = order->*Next;
+            (order->*Next)->*Prev = order->*Prev;
+        } else {
+            // The list stays in the map when it empties, so an owner that keeps replacing its only
+            // order (a market maker requoting) never allocates. See releaseSession().
+            List& list = lists.find(owner)->second;
+            if (order->*Prev != nullptr) {
+                (order->*Prev)->*Next = order->*Next;
+            } else {
+                list.head = order->*Next;
+            }
+            if (order->*Next != nullptr) {
+                (order->*Next)->*Prev = order->*Prev;
+            } else {
+                list.tail = order->*Prev;
+            }
+        }
+        order->*Prev = nullptr;
+        order->*Next = nullptr;
+    }
+};
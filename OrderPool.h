@@ -0,0 +1,94 @@
+/**
+ * @file OrderPool.h
+ * @brief Defines the OrderPool class, a slab allocator for the orders resting on a book.
+ *
+ * Orders that rest on the book are stored in large, preallocated blocks of slots. Freed
+ * slots go onto an intrusive free list and are handed out again by the next acquire, so
+ * once the pool has grown to the book's working size, adding and filling orders performs
+ * no heap allocations at all.
+ */
+
+#pragma once
+
+#include <cstddef> // For std::size_t
+#include <memory>  // For std::unique_ptr
+#include <new>     // For placement new
+#include <vector>
+
+#include "Order.h"
+
+/**
+ * @class OrderPool
+ * @brief A growable pool of fixed-size Order slots with O(1) acquire and release.
+ */
+class OrderPool {
+public:
+    static constexpr std::size_t kBlockSize = 4096; // The number of orders per allocated block.
+
+    /**
+     * @brief Constructs a pool with room for at least `initialCapacity` orders.
+     */
+    explicit OrderPool(std::size_t initialCapacity = kBlockSize) {
+        while (this->capacity_ < initialCapacity) {
+            grow();
+        }
+    }
+
+    OrderPool(const OrderPool&) = delete;
+    OrderPool& operator=(const OrderPool&) = delete;
+    OrderPool(OrderPool&&) = default;
+    OrderPool& operator=(OrderPool&&) = default;
+
+    /**
+     * @brief Copies an order into a free slot and returns a pointer to the pooled copy.
+     * The pointer stays valid until the order is released.
+     */
+    Order* acquire(const Order& order) {
+        if (this->freeList_ == nullptr) {
+            grow(); // Only happens while the book is still growing to its working size.
+        }
+        Slot* slot = this->freeList_;
+        this->freeList_ = slot->nextFree;
+        ++this->inUse_;
+        return new (slot->storage) Order(order);
+    }
+
+    /** @brief Returns an order's slot to the pool. */
+    void release(Order* order) {
+        order->~Order();
+        Slot* slot = reinterpret_cast<Slot*>(order);
+        slot->nextFree = this->freeList_;
+        this->freeList_ = slot;
+        --this->inUse_;
+    }
+
+    /** @brief The number of orders currently held by the pool. */
+    std::size_t size() const { return this->inUse_; }
+
+    /** @brief The number of slots allocated so far. */
+    std::size_t capacity() const { return this->capacity_; }
+
+private:
+    // A slot either holds an Order or, while free, the link to the next free slot.
+    union Slot {
+        Slot* nextFree;
+        alignas(Order) unsigned char storage[sizeof(Order)];
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> blocks_;
+    Slot* freeList_ = nullptr;
+    std::size_t capacity_ = 0;
+    std::size_t inUse_ = 0;
+
+    void grow() {
+        std::unique_ptr<Slot[]> block(new Slot[kBlockSize]);
+        // Thread the new slots onto the free list in address order, so consecutive orders
+        // end up next to each other in memory.
+        for (std::size_t i = kBlockSize; i-- > 0;) {
+            block[i].nextFree = this->freeList_;
+            this->freeList_ = &block[i];
+        }
+        this->blocks_.push_back(std::move(block));
+        this->capacity_ += kBlockSize;
+    }
+};
@@ -0,0 +1,265 @@
+/**
+ * @file PriceLadder.h
+ * @brief Defines the PriceLadder class, a flat, tick-indexed array of price levels for one side of a book.
+ *
+ * Because prices are integer ticks, a price level can be found by simple index arithmetic
+ * instead of a tree walk. The ladder keeps a contiguous window of levels anchored just
+ * behind the best price, plus a bitmap of which levels are occupied, so finding the best
+ * level, the next level after a sweep, or the level for an incoming price is O(1) and
+ * touches adjacent memory. The rare orders priced far away from the touch are kept in a
+ * small overflow map and pulled into the window when the market moves towards them.
+ */
+
+#pragma once
+
+#include <cstddef>  // For std::size_t
+#include <cstdint>  // For std::uint64_t
+#include <map>      // For the overflow levels far away from the touch
+#include <utility>  // For std::move, std::pair
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h> // For _BitScanForward64
+#endif
+
+#include "Order.h"
+#include "PriceLevel.h"
+
+/**
+ * @brief Returns the index of the lowest set bit of a non-zero 64-bit word.
+ */
+inline std::size_t lowestSetBit(std::uint64_t word) {
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward64(&index, word);
+    return static_cast<std::size_t>(index);
+#else
+    return static_cast<std::size_t>(__builtin_ctzll(word));
+#endif
+}
+
+/**
+ * @class PriceLadder
+ * @brief One side (bids or asks) of an order book, stored as a flat array of price levels.
+ *
+ * Internally every price is turned into a "key" where a lower key is always a better price:
+ * asks use the price itself and bids use its negation. This lets both sides share one
+ * implementation in which the best level is simply the lowest occupied slot.
+ * @tparam S The side of the book this ladder holds.
+ */
+template <Side S>
+class PriceLadder {
+public:
+    static constexpr std::size_t kDefaultWindow = 4096;  // Initial number of tick slots.
+    static constexpr std::size_t kMaxWindow = 65536;     // The window never grows past this many slots.
+
+    /** @param window The initial number of tick slots: a power of two, at least 64. */
+    explicit PriceLadder(std::size_t window = kDefaultWindow) {
+        this->slots_.resize(window);
+        this->occupied_.assign(window / 64, 0);
+    }
+
+    /** @brief True if there are no price levels on this side of the book. */
+    bool empty() const { return this->windowLevels_ == 0; }
+
+    /** @brief The number of non-empty price levels on this side of the book. */
+    std::size_t levelCount() const { return this->windowLevels_ + this->overflow_.size(); }
+
+    /** @brief The best price level. Must only be called when the ladder is not empty. */
+    PriceLevel& best() { return this->slots_[this->bestIndex_]; }
+    const PriceLevel& best() const { return this->slots_[this->bestIndex_]; }
+
+    /**
+     * @brief Returns the level for a price, creating an empty one if none exists yet.
+     * The caller is expected to add an order to a newly created level straight away.
+     */
+    PriceLevel& getOrCreate(Price price) {
+        const Price key = toKey(price);
+
+        if (this->windowLevels_ == 0) {
+            // The ladder is completely empty, so we are free to re-anchor the window here.
+            this->baseKey_ = key - headroom();
+        } else if (key < this->baseKey_) {
+            // A new best price beyond the start of the window: shift the window towards it.
+            const Price newBase = key - headroom();
+            rebuild(newBase, windowSizeFor(this->baseKey_ + static_cast<Price>(this->slots_.size()) - newBase));
+        } else if (key - this->baseKey_ >= static_cast<Price>(this->slots_.size())) {
+            // Worse than anything the window covers: grow it if we may, otherwise use the overflow.
+            const Price span = key - this->baseKey_ + 1;
+            if (span > static_cast<Price>(kMaxWindow)) {
+                PriceLevel& level = this->overflow_[key];
+                level.price = price;
+                return level;
+            }
+            rebuild(this->baseKey_, windowSizeFor(span));
+        }
+
+        const std::size_t index = static_cast<std::size_t>(key - this->baseKey_);
+        if (!isOccupied(index)) {
+            markOccupied(index);
+            this->slots_[index] = PriceLevel();
+            this->slots_[index].price = price;
+            if (this->windowLevels_++ == 0 || index < this->bestIndex_) {
+                this->bestIndex_ = index;
+            }
+        }
+        return this->slots_[index];
+    }
+
+    /** @brief Returns the level for a price, or nullptr if there are no orders at that price. */
+    PriceLevel* find(Price price) {
+        const Price key = toKey(price);
+        if (inWindow(key)) {
+            const std::size_t index = static_cast<std::size_t>(key - this->baseKey_);
+            return isOccupied(index) ? &this->slots_[index] : nullptr;
+        }
+        auto it = this->overflow_.find(key);
+        return it == this->overflow_.end() ? nullptr : &it->second;
+    }
+
+    const PriceLevel* find(Price price) const { return const_cast<PriceLadder*>(this)->find(price); }
+
+    /** @brief Removes the best level, which must already be empty. */
+    void eraseBest() {
+        clearOccupied(this->bestIndex_);
+        if (--this->windowLevels_ > 0) {
+            this->bestIndex_ = nextOccupied(this->bestIndex_ + 1);
+        } else if (!this->overflow_.empty()) {
+            // The window has been swept clean; bring the overflow levels in around the new best price.
+            rebuild(this->overflow_.begin()->first - headroom(), this->slots_.size());
+        }
+    }
+
+    /** @brief Removes the (already empty) level at the given price. */
+    void erase(Price price) {
+        const Price key = toKey(price);
+        if (!inWindow(key)) {
+            this->overflow_.erase(key);
+            return;
+        }
+        const std::size_t index = static_cast<std::size_t>(key - this->baseKey_);
+        if (!isOccupied(index)) {
+            return;
+        }
+        if (index == this->bestIndex_) {
+            eraseBest();
+        } else {
+            clearOccupied(index);
+            --this->windowLevels_;
+        }
+    }
+
+    /**
+     * @brief Visits the levels from the best price outwards.
+     * @param fn Called with each `const PriceLevel&`; return false from it to stop early.
+     */
+    template <typename Fn>
+    void forEachLevel(Fn&& fn) const {
+        if (this->windowLevels_ == 0) {
+            return;
+        }
+        for (std::size_t i = this->bestIndex_; i < this->slots_.size(); i = nextOccupied(i + 1)) {
+            if (!fn(this->slots_[i])) {
+                return;
+            }
+        }
+        for (const auto& [key, level] : this->overflow_) {
+            if (!fn(level)) {
+                return;
+            }
+        }
+    }
+
+private:
+    std::vector<PriceLevel> slots_;          // slots_[i] holds the level whose key is baseKey_ + i.
+    std::vector<std::uint64_t> occupied_;    // One bit per slot, set when the slot holds orders.
+    Price baseKey_ = 0;                      // The key of slots_[0].
+    std::size_t bestIndex_ = 0;              // The lowest occupied slot (valid while windowLevels_ > 0).
+    std::size_t windowLevels_ = 0;           // The number of occupied slots.
+    std::map<Price, PriceLevel> overflow_;   // Levels beyond the window; always worse than every slot.
+
+    static Price toKey(Price price) { return S == Side::Sell ? price : -price; }
+
+    // Leave a quarter of the window free in front of the best price so that orders
+    // improving the touch usually land inside the window without a rebuild.
+    Price headroom() const { return static_cast<Price>(this->slots_.size() / 4); }
+
+    bool inWindow(Price key) const {
+        return key >= this->baseKey_ && key - this->baseKey_ < static_cast<Price>(this->slots_.size());
+    }
+
+    bool isOccupied(std::size_t index) const { return (this->occupied_[index >> 6] >> (index & 63)) & 1; }
+    void markOccupied(std::size_t index) { this->occupied_[index >> 6] |= (std::uint64_t{1} << (index & 63)); }
+    void clearOccupied(std::size_t index) { this->occupied_[index >> 6] &= ~(std::uint64_t{1} << (index & 63)); }
+
+    /** @brief The first occupied slot at or after `from`, or slots_.size() if there is none. */
+    std::size_t nextOccupied(std::size_t from) const {
+        std::size_t word = from >> 6;
+        if (word >= this->occupied_.size()) {
+            return this->slots_.size();
+        }
+        std::uint64_t bits = this->occupied_[word] & (~std::uint64_t{0} << (from & 63));
+        while (bits == 0) {
+            if (++word == this->occupied_.size()) {
+                return this->slots_.size();
+            }
+            bits = this->occupied_[word];
+        }
+        return (word << 6) + lowestSetBit(bits);
+    }
+
+    /** @brief The smallest power-of-two window (within limits) that covers `span` slots. */
+    std::size_t windowSizeFor(Price span) const {
+        std::size_t size = this->slots_.size();
+        while (static_cast<Price>(size) < span && size < kMaxWindow) {
+            size *= 2;
+        }
+        return size;
+    }
+
+    /**
+     * @brief Re-anchors the window at `newBase` with `newSize` slots and redistributes every level.
+     * This is O(levels) and only happens when the market moves far outside the current window.
+     */
+    void rebuild(Price newBase, std::size_t newSize) {
+        std::vector<std::pair<Price, PriceLevel>> levels;
+        levels.reserve(levelCount());
+        forEachSlot([&](std::size_t index) {
+            levels.emplace_back(this->baseKey_ + static_cast<Price>(index), std::move(this->slots_[index]));
+        });
+        for (auto& [key, level] : this->overflow_) {
+            levels.emplace_back(key, std::move(level));
+        }
+
+        this->overflow_.clear();
+        this->slots_.clear();
+        this->slots_.resize(newSize);
+        this->occupied_.assign(newSize / 64, 0);
+        this->baseKey_ = newBase;
+        this->windowLevels_ = 0;
+
+        // The levels were collected best-first, so the first one placed in the window is the new best.
+        for (auto& [key, level] : levels) {
+            if (inWindow(key)) {
+                const std::size_t index = static_cast<std::size_t>(key - newBase);
+                this->slots_[index] = std::move(level);
+                markOccupied(index);
+                if (this->windowLevels_++ == 0) {
+                    this->bestIndex_ = index;
+                }
+            } else {
+                this->overflow_.emplace(key, std::move(level));
+            }
+        }
+    }
+
+    template <typename Fn>
+    void forEachSlot(Fn&& fn) {
+        if (this->windowLevels_ == 0) {
+            return;
+        }
+        for (std::size_t i = this->bestIndex_; i < this->slots_.size(); i = nextOccupied(i + 1)) {
+            fn(i);
+        }
+    }
+};
@@ -0,0 +1,77 @@
+/**
+ * @file PriceLevel.h
+ * @brief Defines the PriceLevel struct, the FIFO queue of resting orders at a single price.
+ */
+
+#pragma once
+
+#include <cstdint> // For std::uint32_t
+
+#include "Order.h"
+
+/**
+ * @struct PriceLevel
+ * @brief All resting orders at a single price, in time priority (oldest first).
+ *
+ * The queue is intrusive: the orders themselves carry the prev/next links, and the level
+ * only remembers the two ends. The level also keeps a running total quantity and order
+ * count, updated on every add, fill and cancel, so depth queries never walk the queue.
+ * This makes every operation on a level O(1) and allocation-free.
+ */
+struct PriceLevel {
+    Price price = 0;
+    Quantity totalQuantity = 0; // The sum of the remaining quantity of every order at this level.
+    std::uint32_t orderCount = 0; // The number of orders queued at this level.
+    Order* head = nullptr;      // The oldest order (first in line to be filled).
+    Order* tail = nullptr;      // The youngest order.
+
+    bool empty() const { return this->head == nullptr; }
+
+    /** @brief Appends an order to the back of the queue (lowest time priority). */
+    void pushBack(Order* order) {
+        order->prev_ = this->tail;
+        order->next_ = nullptr;
+        if (this->tail != nullptr) {
+            this->tail->next_ = order;
+        } else {
+            this->head = order;
+        }
+        this->tail = order;
+        this->totalQuantity += order->getQuantity();
+        ++this->orderCount;
+    }
+
+    /** @brief Unlinks the order at the front of the queue. Its remaining quantity must already be zero. */
+    void popFront() {
+        Order* order = this->head;
+        this->head = order->next_;
+        if (this->head != nullptr) {
+            this->head->prev_ = nullptr;
+        } else {
+            this->tail = nullptr;
+        }
+        order->next_ = nullptr;
+        --this->orderCount;
+    }
+
+    /** @brief Unlinks an order from anywhere in the queue and removes its quantity from the level. */
+    void remove(Order* order) {
+        if (order->prev_ != nullptr) {
+            order->prev_->next_ = order->next_;
+        } else {
+            this->head = order->next_;
+        }
+        if (order->next_ != nullptr) {
+            order->next_->prev_ = order->prev_;
+        } else {
+            this->tail = order->prev_;
+        }
+        order->prev_ = nullptr;
+        order->next_ = nullptr;
+        this->totalQuantity -= order->getQuantity();
+        --this->orderCount;
+    }
+
+    /** @brief Records that `amount` of this level's quantity has been filled or cancelled. */
+    void reduce(Quantity amount) { this->totalQuantity -= amount; }
+};
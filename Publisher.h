@@ -0,0 +1,408 @@
+/**
+ * @file Publisher.h
+ * @brief Defines the Publisher, which fans serialized feed messages out to the SSE subscribers.
+ *
+ * The matching threads must never wait on a client. They serialize each event once into a
+ * shared, reference-counted buffer and hand it to the Publisher through a lock-free queue,
+ * which costs the same whether there are zero subscribers or a thousand. The Publisher's own
+ * thread then copies the pointer (not the bytes) into every interested Subscriber's bounded
+ * ring, and each client's HTTP thread drains its own ring onto its own socket. A slow client
+ * therefore only ever falls behind itself: when its ring is full, superseded snapshots are
+ * conflated and other messages are dropped for that client alone.
+ */
+
+#pragma once
+
+#include <algorithm>          // For std::remove, std::sort, std::unique
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>            // For std::size_t
+#include <cstdint>            // For std::uint64_t
+#include <functional>         // For std::function
+#include <memory>             // For std::shared_ptr
+#include <mutex>
+#include <stdexcept>          // For std::invalid_argument
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <utility>            // For std::move
+#include <vector>
+
+#include "MpscQueue.h"
+#include "Backoff.h"
+#include "Logger.h"
+#include "SymbolTable.h" // For SymbolId and the most symbols there can be
+
+/** @brief A serialized SSE message, shared by every subscriber it is delivered to. */
+using Payload = std::shared_ptr<const std::string>;
+
+/**
+ * @enum FeedChannel
+ * @brief The streams a client can subscribe to.
+ */
+enum class FeedChannel {
+    Trades,           // Every trade.
+    MarketData,       // A full "l2update" of the top levels whenever they change.
+    MarketDataDeltas, // "l2delta" messages with only the levels that changed, plus periodic "l2update" snapshots.
+    TradeBatches,     // One "trade_batch" per taker order: all its fills and a summary of them.
+    Bbo,              // A "bbo" whenever the best bid or ask (price or quantity) changes.
+    OrderEvents       // Market by order: "l3" messages with every change to every resting order, after an "l3snapshot".
+};
+
+inline constexpr std::size_t kFeedChannelCount = 6;
+
+/**
+ * @struct SubscriptionFilter
+ * @brief The part of a channel a client is interested in.
+ */
+struct SubscriptionFilter {
+    std::vector<SymbolId> symbols; // The symbols to receive; empty for all of them.
+    int depth = 0;                 // For depth-dependent messages: the number of levels per side (0 if not applicable).
+};
+
+/**
+ * @struct FeedMessage
+ * @brief One message on its way from a matching thread to the subscribers of a channel.
+ */
+struct FeedMessage {
+    FeedChannel channel = FeedChannel::Trades;
+    Payload payload;
+    SymbolId symbol = 0; // The symbol the message is about; only subscribers that want it get the message.
+    int depth = 0;       // If not 0, only subscribers of exactly this depth get the message.
+    // Messages with the same non-zero key supersede each other (e.g., the snapshots of one symbol):
+    // a subscriber that has not sent the older one yet only gets the newer one. 0 is never conflated.
+    std::uint64_t conflationKey = 0;
+    const char* description = ""; // For the "[BROADCAST] Sending ..." log line.
+};
+
+/**
+ * @brief Called by the Publisher's thread when a message is queued for a subscriber that had none queued.
+ * Lets an event loop learn that a client has something to send without a thread waiting on it.
+ */
+using SubscriberNotifier = std::function<void()>;
+
+/**
+ * @class Subscriber
+ * @brief The bounded queue of messages waiting to be written to one client.
+ *
+ * Filled by the Publisher's thread and drained either by a thread of the client's own that
+ * blocks in pop(), or by an event loop that is notified and then calls tryPop().
+ */
+class Subscriber {
+public:
+    static constexpr std::size_t kDefaultCapacity = 1024;
+
+    explicit Subscriber(FeedChannel channel, SubscriptionFilter filter = {}, SubscriberNotifier notifier = nullptr,
+                        std::size_t capacity = kDefaultCapacity)
+        : channel_(channel), filter_(std::move(filter)), notifier_(std::move(notifier)), ring_(capacity) {}
+
+    Subscriber(const Subscriber&) = delete;
+    Subscriber& operator=(const Subscriber&) = delete;
+
+    FeedChannel channel() const { return this->channel_; }
+    const SubscriptionFilter& filter() const { return this->filter_; }
+
+    /** @brief The number of messages this client missed because it was not keeping up. */
+    std::uint64_t dropped() const { return this->dropped_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Queues a message for the client. Never blocks on the client.
+     * A message that supersedes one still queued replaces it in place; otherwise, if the
+     * ring is full, the message is dropped.
+     */
+    void push(const FeedMessage& message) {
+        bool was_empty = false;
+        {
+            std::lock_guard<std::mutex> lock(this->mtx_);
+            if (message.conflationKey != 0) {
+                auto it = this->pending_.find(message.conflationKey);
+                if (it != this->pending_.end() && it->second >= this->popped_) {
+                    Entry& entry = this->ring_[it->second % this->ring_.size()];
+                    if (entry.key == message.conflationKey) {
+                        entry.payload = message.payload;
+                        return; // Already queued, so no need to wake the reader again.
+                    }
+                }
+            }
+            if (this->pushed_ - this->popped_ == this->ring_.size()) {
+                this->dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            if (message.conflationKey != 0) {
+                this->pending_[message.conflationKey] = this->pushed_;
+            }
+            was_empty = this->pushed_ == this->popped_;
+            this->ring_[this->pushed_++ % this->ring_.size()] = Entry{message.payload, message.conflationKey};
+        }
+        if (this->notifier_) {
+            if (was_empty) {
+                this->notifier_();
+            }
+        } else {
+            this->ready_.notify_one();
+        }
+    }
+
+    /**
+     * @brief Takes the oldest queued message, waiting up to `timeout` for one to arrive.
+     * @return False if nothing arrived in time.
+     */
+    bool pop(Payload& payload, std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> lock(this->mtx_);
+        if (!this->ready_.wait_for(lock, timeout, [this] { return this->pushed_ != this->popped_; })) {
+            return false;
+        }
+        take(payload);
+        return true;
+    }
+
+    /**
+     * @brief Takes the oldest queued message if there is one, without waiting.
+     * A notified subscriber is only notified again once this has returned false.
+     */
+    bool tryPop(Payload& payload) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        if (this->pushed_ == this->popped_) {
+            return false;
+        }
+        take(payload);
+        return true;
+    }
+
+private:
+    struct Entry {
+        Payload payload;
+        std::uint64_t key = 0;
+    };
+
+    const FeedChannel channel_;
+    const SubscriptionFilter filter_;
+    const SubscriberNotifier notifier_; // If set, replaces waking up a thread blocked in pop().
+    std::mutex mtx_;
+    std::condition_variable ready_;
+    std::vector<Entry> ring_;
+    std::uint64_t pushed_ = 0; // The number of messages ever queued; ring_[pushed_ % size] is the next free slot.
+    std::uint64_t popped_ = 0; // The number of messages ever taken.
+    // Where the latest message of each conflation key was queued. Entries that have already
+    // been taken are stale and recognized by their position being below popped_.
+    std::unordered_map<std::uint64_t, std::uint64_t> pending_;
+    std::atomic<std::uint64_t> dropped_{0};
+
+    /** @brief Takes the oldest message out of the ring. Requires mtx_ and a non-empty ring. */
+    void take(Payload& payload) {
+        Entry& entry = this->ring_[this->popped_++ % this->ring_.size()];
+        payload = std::move(entry.payload);
+        entry.key = 0;
+    }
+};
+
+/**
+ * @class Publisher
+ * @brief Owns the subscribers and the thread that distributes messages to them.
+ */
+class Publisher {
+public:
+    static constexpr std::size_t kQueueCapacity = 65536;
+
+    // Depths in a subscription filter must be in [1, kMaxDepth].
+    static constexpr int kMaxDepth = 63;
+
+    Publisher()
+        : queue_(kQueueCapacity),
+          symbol_counts_(new std::atomic<std::uint32_t>[kFeedChannelCount * SymbolTable::kMaxSymbols]()) {}
+
+    Publisher(const Publisher&) = delete;
+    Publisher& operator=(const Publisher&) = delete;
+
+    ~Publisher() { stop(); }
+
+    /** @brief Starts the publishing thread. */
+    void start() {
+        running_.store(true, std::memory_order_release);
+        thread_ = std::thread([this] { run(); });
+    }
+
+    /** @brief Stops the publishing thread after it has delivered the messages already queued. */
+    void stop() {
+        running_.store(false, std::memory_order_release);
+        if (thread_.joinable()) {
+            thread_.join();
+        }
+    }
+
+    /**
+     * @brief Registers a new client for (part of) a channel. Safe to call from any thread.
+     * @throws std::invalid_argument if the filter's depth is outside [0, kMaxDepth].
+     */
+    std::shared_ptr<Subscriber> subscribe(FeedChannel channel, SubscriptionFilter filter = {},
+                                          SubscriberNotifier notifier = nullptr) {
+        if (filter.depth < 0 || filter.depth > kMaxDepth) {
+            throw std::invalid_argument("Invalid subscription depth " + std::to_string(filter.depth) + ".");
+        }
+        std::sort(filter.symbols.begin(), filter.symbols.end());
+        filter.symbols.erase(std::unique(filter.symbols.begin(), filter.symbols.end()), filter.symbols.end());
+        auto subscriber = std::make_shared<Subscriber>(channel, std::move(filter), std::move(notifier));
+
+        std::lock_guard<std::mutex> lock(mtx_);
+        Route& route = routes_[index(channel)];
+        if (subscriber->filter().symbols.empty()) {
+            route.allSymbols.push_back(subscriber);
+            all_symbol_counts_[index(channel)].fetch_add(1, std::memory_order_relaxed);
+        }
+        for (SymbolId symbol : subscriber->filter().symbols) {
+            route.bySymbol[symbol].push_back(subscriber);
+            symbolCount(channel, symbol).fetch_add(1, std::memory_order_relaxed);
+        }
+        route.depths[subscriber->filter().depth]++;
+        updateDepthMask(channel);
+        subscriber_counts_[index(channel)].fetch_add(1, std::memory_order_relaxed);
+        return subscriber;
+    }
+
+    /** @brief Removes a client, e.g. once its connection has closed. Safe to call from any thread. */
+    void unsubscribe(const std::shared_ptr<Subscriber>& subscriber) {
+        const FeedChannel channel = subscriber->channel();
+        std::lock_guard<std::mutex> lock(mtx_);
+        Route& route = routes_[index(channel)];
+        bool found = false;
+        if (subscriber->filter().symbols.empty()) {
+            found = erase(route.allSymbols, subscriber);
+            if (found) {
+                all_symbol_counts_[index(channel)].fetch_sub(1, std::memory_order_relaxed);
+            }
+        }
+        for (SymbolId symbol : subscriber->filter().symbols) {
+            auto it = route.bySymbol.find(symbol);
+            if (it != route.bySymbol.end() && erase(it->second, subscriber)) {
+                found = true;
+                symbolCount(channel, symbol).fetch_sub(1, std::memory_order_relaxed);
+                if (it->second.empty()) {
+                    route.bySymbol.erase(it);
+                }
+            }
+        }
+        if (found) {
+            route.depths[subscriber->filter().depth]--;
+            updateDepthMask(channel);
+            subscriber_counts_[index(channel)].fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief True if anybody listens on a channel, so a producer can skip serializing messages nobody reads.
+     * A client that subscribes concurrently may miss the message being decided about, exactly as
+     * if it had subscribed a moment later.
+     */
+    bool hasSubscribers(FeedChannel channel) const {
+        return subscriber_counts_[index(channel)].load(std::memory_order_relaxed) > 0;
+    }
+
+    /** @brief True if anybody listening on a channel wants the messages about a symbol. Lock-free, like hasSubscribers(). */
+    bool hasSubscribers(FeedChannel channel, SymbolId symbol) const {
+        return all_symbol_counts_[index(channel)].load(std::memory_order_relaxed) > 0 ||
+               symbolCount(channel, symbol).load(std::memory_order_relaxed) > 0;
+    }
+
+    /** @brief The depths the subscribers of a channel asked for: bit d is set if some subscriber has depth d. */
+    std::uint64_t depthMask(FeedChannel channel) const {
+        return depth_masks_[index(channel)].load(std::memory_order_relaxed);
+    }
+
+    /** @brief Hands a message to the publishing thread. Safe to call from any thread; O(1). */
+    void publish(FeedMessage&& message) {
+        Backoff backoff;
+        while (!queue_.tryPush(std::move(message))) {
+            backoff.pause(); // Only if the publishing thread itself falls behind; clients can never cause this.
+        }
+    }
+
+private:
+    MpscQueue<FeedMessage> queue_;
+    std::thread thread_;
+    std::atomic<bool> running_{false};
+
+    /** @brief The subscribers of one channel, indexed by the symbols they want. */
+    struct Route {
+        std::vector<std::shared_ptr<Subscriber>> allSymbols; // Subscribers without a symbol filter.
+        std::unordered_map<SymbolId, std::vector<std::shared_ptr<Subscriber>>> bySymbol;
+        std::array<std::size_t, kMaxDepth + 1> depths{};     // The number of subscribers of each depth.
+    };
+
+    // Guards the routes, which are written by the HTTP threads and read by the publishing thread.
+    std::mutex mtx_;
+    std::array<Route, kFeedChannelCount> routes_;
+
+    // What the routes hold, readable without the lock by the producers deciding what to serialize.
+    std::array<std::atomic<std::size_t>, kFeedChannelCount> subscriber_counts_{};
+    std::array<std::atomic<std::size_t>, kFeedChannelCount> all_symbol_counts_{};
+    std::unique_ptr<std::atomic<std::uint32_t>[]> symbol_counts_; // By channel, then by symbol.
+    std::array<std::atomic<std::uint64_t>, kFeedChannelCount> depth_masks_{};
+
+    static std::size_t index(FeedChannel channel) { return static_cast<std::size_t>(channel); }
+
+    std::atomic<std::uint32_t>& symbolCount(FeedChannel channel, SymbolId symbol) const {
+        return symbol_counts_[index(channel) * SymbolTable::kMaxSymbols + symbol];
+    }
+
+    void updateDepthMask(FeedChannel channel) {
+        const Route& route = routes_[index(channel)];
+        std::uint64_t mask = 0;
+        for (int depth = 0; depth <= kMaxDepth; ++depth) {
+            if (route.depths[depth] != 0) {
+                mask |= std::uint64_t{1} << depth;
+            }
+        }
+        depth_masks_[index(channel)].store(mask, std::memory_order_relaxed);
+    }
+
+    static bool erase(std::vector<std::shared_ptr<Subscriber>>& subscribers, const std::shared_ptr<Subscriber>& subscriber) {
+        auto it = std::remove(subscribers.begin(), subscribers.end(), subscriber);
+        if (it == subscribers.end()) {
+            return false;
+        }
+        subscribers.erase(it, subscribers.end());
+        return true;
+    }
+
+    void run() {
+        Backoff backoff;
+        FeedMessage message;
+        // Keep going until asked to stop, then drain whatever is still queued.
+        while (true) {
+            if (queue_.tryPop(message)) {
+                deliver(message);
+                message = FeedMessage(); // Release our reference to the payload.
+                backoff.reset();
+            } else if (running_.load(std::memory_order_acquire)) {
+                backoff.pause();
+            } else {
+                break;
+            }
+        }
+    }
+
+    void deliver(const FeedMessage& message) {
+        if (Logger::instance().enabled(LogLevel::Debug)) {
+            std::string_view text(*message.payload);
+            text = text.substr(0, text.find_last_not_of('\n') + 1); // The SSE framing ends in a blank line.
+            LOG_DEBUG("[BROADCAST] Sending {}: {}", message.description, text);
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        const Route& route = routes_[index(message.channel)];
+        auto deliverTo = [&](const std::vector<std::shared_ptr<Subscriber>>& subscribers) {
+            for (const auto& subscriber : subscribers) {
+                if (message.depth == 0 || subscriber->filter().depth == message.depth) {
+                    subscriber->push(message);
+                }
+            }
+        };
+        deliverTo(route.allSymbols);
+        auto it = route.bySymbol.find(message.symbol);
+        if (it != route.bySymbol.end()) {
+            deliverTo(it->second);
+        }
+    }
+};
@@ -0,0 +1,485 @@
+/**
+ * @file Replication.h
+ * @brief Defines the ReplicationServer and the PrimaryFollower, which keep a hot standby engine in step with a primary.
+ *
+ * The journal is already the sequenced stream of every command the engine accepted, and replaying
+ * it reproduces the books and the order and trade IDs exactly. So a standby does not need more
+ * than the journal: the primary's ReplicationServer streams the journal records to it as they are
+ * published, and the standby applies each one the moment it arrives, the same way the records are
+ * replayed on startup. Its books therefore trail the primary's by the network latency, and taking
+ * over needs no replay at all.
+ *
+ * The stream is a TCP connection on which the standby sends one hello naming the first record it
+ * needs, and the primary answers with the records (kRecordSize bytes each, in the journal's layout)
+ * from there on. While nothing is journaled the primary sends a heartbeat instead, so the standby
+ * can tell an idle primary from a dead one.
+ *
+ * Two guarantees are deliberately not given. The primary acknowledges a command once it is durable
+ * in its own journal and never waits for a standby to receive it, so when the primary dies, the
+ * commands it acknowledged but had not streamed yet are missing on the standby that takes over.
+ * And there is no fencing: the standby takes over whenever it stops hearing from the primary,
+ * including when only the link between them failed, and nothing stops a primary that is still
+ * running from accepting orders too (there is no epoch the two could compare). Two engines would
+ * then hand out the same IDs and their books would diverge, so the primary must be stopped, or cut
+ * off from its clients, before clients are sent to the standby.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>    // For errno
+#include <chrono>    // For the heartbeats and the takeover timeout
+#include <cstddef>   // For std::size_t
+#include <cstdint>
+#include <cstring>   // For std::memmove, std::memset
+#include <memory>    // For std::unique_ptr
+#include <mutex>
+#include <stdexcept> // For std::runtime_error, std::invalid_argument
+#include <string>
+#include <thread>
+#include <utility>   // For std::move
+#include <vector>
+
+#if defined(_WIN32)
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#else
+#include <arpa/inet.h>   // For htons, htonl
+#include <netdb.h>       // For getaddrinfo
+#include <netinet/in.h>  // For sockaddr_in
+#include <netinet/tcp.h> // For TCP_NODELAY
+#include <sys/socket.h>
+#include <sys/time.h>    // For timeval
+#include <unistd.h>      // For close
+#endif
+
+#include "Backoff.h"      // The idle strategy of the streaming threads
+#include "Journal.h"      // The records that are streamed
+#include "LittleEndian.h"
+#include "Logger.h"
+
+namespace replication {
+
+// The first eight bytes of the hello, so that something else connecting to the port is turned away.
+constexpr std::uint64_t kMagic = 0x3130504552454e45ULL; // "ENEREP01"
+// The hello: the magic, then the sequence number of the first record the standby needs.
+constexpr std::size_t kHelloSize = 16;
+// Every frame from the primary is one journal record, or a heartbeat of the same size.
+constexpr std::size_t kFrameSize = Journal::kRecordSize;
+// The type byte of a heartbeat; journal record types are small numbers. A heartbeat carries the
+// primary's journal size at byte 8.
+constexpr std::uint8_t kHeartbeat = 0x80;
+// How long the primary stays silent before it sends a heartbeat.
+constexpr auto kHeartbeatInterval = std::chrono::milliseconds(100);
+
+#if defined(_WIN32)
+using Socket = SOCKET;
+constexpr Socket kInvalidSocket = INVALID_SOCKET;
+inline void closeSocket(Socket socket) { ::closesocket(socket); }
+inline void shutdownSocket(Socket socket) { ::shutdown(socket, SD_BOTH); }
+#else
+using Socket = int;
+constexpr Socket kInvalidSocket = -1;
+inline void closeSocket(Socket socket) { ::close(socket); }
+inline void shutdownSocket(Socket socket) { ::shutdown(socket, SHUT_RDWR); }
+#endif
+
+/** @brief Writes all of `data`. @return False if the connection is gone. */
+inline bool sendAll(Socket socket, const void* data, std::size_t size) {
+#if defined(MSG_NOSIGNAL)
+    constexpr int flags = MSG_NOSIGNAL; // A standby that went away must not kill the primary with SIGPIPE.
+#else
+    constexpr int flags = 0;
+#endif
+    const char* bytes = static_cast<const char*>(data);
+    std::size_t sent = 0;
+    while (sent < size) {
+        const int n = ::send(socket, bytes + sent, static_cast<int>(size - sent), flags);
+        if (n <= 0) {
+            return false;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/** @brief Reads exactly `size` bytes. @return False if the connection closed or timed out first. */
+inline bool receiveAll(Socket socket, void* data, std::size_t size) {
+    char* bytes = static_cast<char*>(data);
+    std::size_t received = 0;
+    while (received < size) {
+        const int n = ::recv(socket, bytes + received, static_cast<int>(size - received), 0);
+        if (n <= 0) {
+            return false;
+        }
+        received += static_cast<std::size_t>(n);
+    }
+    return true;
+}
+
+/** @brief Turns off Nagle's algorithm: a record should reach the standby as soon as it is journaled. */
+inline void setNoDelay(Socket socket) {
+    int nodelay = 1;
+    ::setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char*>(&nodelay), sizeof(nodelay));
+}
+
+/** @brief Makes a blocked recv() on `socket` give up after `timeout`. */
+inline void setReceiveTimeout(Socket socket, std::chrono::milliseconds timeout) {
+#if defined(_WIN32)
+    const DWORD value = static_cast<DWORD>(timeout.count());
+#else
+    timeval value{};
+    value.tv_sec = static_cast<long>(timeout.count() / 1000);
+    value.tv_usec = static_cast<long>(timeout.count() % 1000) * 1000;
+#endif
+    ::setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+} // namespace replication
+
+/**
+ * @class ReplicationServer
+ * @brief Streams a primary's journal to the standbys that connect to it, each on its own thread.
+ *
+ * A session copies the records out of the journal as the shards publish them (see
+ * Journal::copyRecord()) and sends whatever is ready in one write, so a burst of orders costs
+ * a few large writes rather than one per record. It never touches the shards.
+ */
+class ReplicationServer {
+public:
+    // The most records a session sends in one write.
+    static constexpr std::size_t kMaxBatch = 256;
+
+    /**
+     * @brief Creates a server; call start() to begin accepting standbys.
+     * @param journal The journal to stream. Must outlive the server.
+     * @param port The TCP port to listen on.
+     */
+    ReplicationServer(const Journal& journal, std::uint16_t port) : journal_(journal), port_(port) {}
+
+    ReplicationServer(const ReplicationServer&) = delete;
+    ReplicationServer& operator=(const ReplicationServer&) = delete;
+
+    ~ReplicationServer() { stop(); }
+
+    /**
+     * @brief Binds the port and starts accepting standbys on a background thread.
+     * @throws std::runtime_error if the port cannot be bound.
+     */
+    void start() {
+        listener_ = ::socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+        if (listener_ == replication::kInvalidSocket) {
+            throw std::runtime_error("Could not create the replication socket.");
+        }
+        int reuse = 1;
+        ::setsockopt(listener_, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char*>(&reuse), sizeof(reuse));
+
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_ANY);
+        address.sin_port = htons(port_);
+        if (::bind(listener_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener_, SOMAXCONN) != 0) {
+            replication::closeSocket(listener_);
+            listener_ = replication::kInvalidSocket;
+            throw std::runtime_error("Could not listen on port " + std::to_string(port_) + " for replication.");
+        }
+
+        running_.store(true, std::memory_order_release);
+        acceptor_ = std::thread([this] { acceptLoop(); });
+    }
+
+    /** @brief Stops accepting, disconnects every standby and waits for the session threads to finish. */
+    void stop() {
+        if (!running_.exchange(false)) {
+            return;
+        }
+        replication::shutdownSocket(listener_); // Wakes up the blocked accept().
+        replication::closeSocket(listener_);
+        if (acceptor_.joinable()) {
+            acceptor_.join();
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& session : sessions_) {
+            replication::shutdownSocket(session->socket); // Fails a write blocked on a standby that stopped reading.
+        }
+        for (auto& session : sessions_) {
+            session->thread.join();
+            replication::closeSocket(session->socket);
+        }
+        sessions_.clear();
+    }
+
+private:
+    /** @brief One connected standby. The socket is only closed once the thread has been joined. */
+    struct Session {
+        replication::Socket socket = replication::kInvalidSocket;
+        std::thread thread;
+        std::atomic<bool> finished{false};
+    };
+
+    const Journal& journal_;
+    const std::uint16_t port_;
+    replication::Socket listener_ = replication::kInvalidSocket;
+    std::thread acceptor_;
+    std::atomic<bool> running_{false};
+
+    std::mutex mtx_; // Guards sessions_.
+    std::vector<std::unique_ptr<Session>> sessions_;
+
+    void acceptLoop() {
+        while (running_.load(std::memory_order_acquire)) {
+            replication::Socket client = ::accept(listener_, nullptr, nullptr);
+            if (client == replication::kInvalidSocket) {
+                continue; // Either stop() closed the listener or the connection went away before we took it.
+            }
+            replication::setNoDelay(client);
+
+            std::lock_guard<std::mutex> lock(mtx_);
+            reapFinishedSessions();
+            auto session = std::make_unique<Session>();
+            session->socket = client;
+            Session* raw = session.get();
+            session->thread = std::thread([this, raw] {
+                serve(raw->socket);
+                raw->finished.store(true, std::memory_order_release);
+            });
+            sessions_.push_back(std::move(session));
+        }
+    }
+
+    /** @brief Joins and forgets the sessions whose standbys have disconnected. Requires mtx_. */
+    void reapFinishedSessions() {
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            if ((*it)->finished.load(std::memory_order_acquire)) {
+                (*it)->thread.join();
+                replication::closeSocket((*it)->socket);
+                it = sessions_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+    }
+
+    void serve(replication::Socket socket) {
+        // A client that connects but never says hello must not hold the session forever.
+        replication::setReceiveTimeout(socket, std::chrono::seconds(5));
+        unsigned char hello[replication::kHelloSize];
+        if (!replication::receiveAll(socket, hello, sizeof(hello)) || binary::readU64(hello) != replication::kMagic) {
+            return;
+        }
+        std::uint64_t seq = binary::readU64(hello + 8);
+        if (seq > journal_.size()) {
+            LOG_WARN("A standby asked for journal record {}, but the journal only has {}; refusing it.", seq, journal_.size());
+            return;
+        }
+        LOG_INFO("A standby connected; streaming the journal from record {}.", seq);
+
+        std::vector<unsigned char> out(kMaxBatch * replication::kFrameSize);
+        Backoff backoff;
+        auto last_sent = std::chrono::steady_clock::now();
+        bool open = true;
+        while (open && running_.load(std::memory_order_acquire)) {
+            // Records are published in sequence order by each shard but may complete out of order
+            // across shards, so stop at the first one still being written.
+            std::size_t count = 0;
+            while (count < kMaxBatch && journal_.copyRecord(seq, out.data() + count * replication::kFrameSize)) {
+                ++seq;
+                ++count;
+            }
+            if (count > 0) {
+                open = replication::sendAll(socket, out.data(), count * replication::kFrameSize);
+                last_sent = std::chrono::steady_clock::now();
+                backoff.reset();
+            } else if (std::chrono::steady_clock::now() - last_sent >= replication::kHeartbeatInterval) {
+                unsigned char heartbeat[replication::kFrameSize] = {};
+                heartbeat[0] = replication::kHeartbeat;
+                binary::writeU64(heartbeat + 8, journal_.size());
+                open = replication::sendAll(socket, heartbeat, sizeof(heartbeat));
+                last_sent = std::chrono::steady_clock::now();
+            } else {
+                backoff.pause();
+            }
+        }
+        LOG_INFO("A standby disconnected after journal record {}.", seq);
+    }
+};
+
+/**
+ * @class PrimaryFollower
+ * @brief The standby's end of the replication stream: receives the primary's journal records and applies them.
+ *
+ * A dropped connection is retried, resuming after the last record applied, as long as the
+ * primary has been heard from within the takeover timeout. Once it has been silent for longer
+ * (no records, no heartbeats and no successful reconnect), it is considered lost and follow()
+ * returns so that the standby can take over.
+ */
+class PrimaryFollower {
+public:
+    /**
+     * @param host, port The primary's replication service.
+     * @param timeout How long the primary may stay silent before the standby takes over. Should be
+     *        several heartbeat intervals, so that one delayed heartbeat does not cause a takeover.
+     */
+    PrimaryFollower(std::string host, std::uint16_t port, std::chrono::milliseconds timeout)
+        : host_(std::move(host)), port_(port), timeout_(timeout) {
+        if (timeout_ <= replication::kHeartbeatInterval) {
+            throw std::invalid_argument("The takeover timeout must be longer than the " +
+                                        std::to_string(replication::kHeartbeatInterval.count()) +
+                                        " ms heartbeat interval.");
+        }
+    }
+
+    PrimaryFollower(const PrimaryFollower&) = delete;
+    PrimaryFollower& operator=(const PrimaryFollower&) = delete;
+
+    /**
+     * @brief Applies the primary's records from `from` on until the primary is lost or stop() is called.
+     * Calls apply(record) with each record (kRecordSize bytes in the journal's layout), in sequence
+     * order, on the calling thread. A primary that was never reached is not considered lost: without
+     * ever having been in step, the standby must not take over.
+     * @return True if the primary was lost, false if stop() was called.
+     * @throws std::runtime_error if the stream skips a record; whatever `apply` throws.
+     */
+    template <typename Apply>
+    bool follow(std::uint64_t from, Apply&& apply) {
+        std::uint64_t next = from;
+        bool connected = false; // Whether the primary has been reached at least once.
+        auto last_heard = std::chrono::steady_clock::now();
+        std::vector<unsigned char> in(PrimaryFollower::kBufferFrames * replication::kFrameSize);
+        while (running_.load(std::memory_order_acquire)) {
+            replication::Socket socket = connect(next);
+            if (socket == replication::kInvalidSocket) {
+                if (connected && std::chrono::steady_clock::now() - last_heard >= timeout_) {
+                    return true;
+                }
+                std::this_thread::sleep_for(kRetryInterval);
+                continue;
+            }
+            if (!connected) {
+                LOG_INFO("Following the primary at {}:{} from journal record {}.", host_, port_, next);
+            }
+            connected = true;
+            last_heard = std::chrono::steady_clock::now();
+
+            std::size_t filled = 0;
+            while (running_.load(std::memory_order_acquire)) {
+                const int received = ::recv(socket, reinterpret_cast<char*>(in.data() + filled),
+                                            static_cast<int>(in.size() - filled), 0);
+                if (received == 0 || (received < 0 && !timedOut())) {
+                    break; // The primary closed the connection or it broke; try to reconnect.
+                }
+                if (received < 0) {
+                    if (std::chrono::steady_clock::now() - last_heard >= timeout_) {
+                        closeConnection();
+                        return true;
+                    }
+                    continue;
+                }
+                last_heard = std::chrono::steady_clock::now();
+                filled += static_cast<std::size_t>(received);
+
+                std::size_t offset = 0;
+                for (; filled - offset >= replication::kFrameSize; offset += replication::kFrameSize) {
+                    const unsigned char* frame = in.data() + offset;
+                    if (frame[0] == replication::kHeartbeat) {
+                        continue;
+                    }
+                    if (binary::readU64(frame + 8) != next) {
+                        closeConnection();
+                        throw std::runtime_error("The primary sent journal record " + std::to_string(binary::readU64(frame + 8)) +
+                                                 " where record " + std::to_string(next) + " was expected.");
+                    }
+                    apply(frame);
+                    ++next;
+                }
+                std::memmove(in.data(), in.data() + offset, filled - offset);
+                filled -= offset;
+            }
+            closeConnection();
+        }
+        return false;
+    }
+
+    /** @brief Makes follow() return soon after, from any thread. */
+    void stop() {
+        running_.store(false, std::memory_order_release);
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (socket_ != replication::kInvalidSocket) {
+            replication::shutdownSocket(socket_); // Wakes up the blocked recv().
+        }
+    }
+
+private:
+    // How many frames one read can take in.
+    static constexpr std::size_t kBufferFrames = 1024;
+    // How long to wait between attempts to reach the primary.
+    static constexpr auto kRetryInterval = std::chrono::milliseconds(20);
+
+    const std::string host_;
+    const std::uint16_t port_;
+    const std::chrono::milliseconds timeout_;
+    std::atomic<bool> running_{true};
+
+    std::mutex mtx_; // Guards socket_, which stop() shuts down.
+    replication::Socket socket_ = replication::kInvalidSocket;
+
+    static bool timedOut() {
+#if defined(_WIN32)
+        return ::WSAGetLastError() == WSAETIMEDOUT;
+#else
+        return errno == EAGAIN || errno == EWOULDBLOCK;
+#endif
+    }
+
+    /** @brief Connects to the primary and asks for the records from `from` on. @return kInvalidSocket on failure. */
+    replication::Socket connect(std::uint64_t from) {
+        addrinfo hints{};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (::getaddrinfo(host_.c_str(), std::to_string(port_).c_str(), &hints, &addresses) != 0) {
+            return replication::kInvalidSocket;
+        }
+        replication::Socket socket = replication::kInvalidSocket;
+        for (addrinfo* address = addresses; address != nullptr && socket == replication::kInvalidSocket;
+             address = address->ai_next) {
+            socket = ::socket(address->ai_family, address->ai_socktype, address->ai_protocol);
+            if (socket != replication::kInvalidSocket &&
+                ::connect(socket, address->ai_addr, static_cast<int>(address->ai_addrlen)) != 0) {
+                replication::closeSocket(socket);
+                socket = replication::kInvalidSocket;
+            }
+        }
+        ::freeaddrinfo(addresses);
+        if (socket == replication::kInvalidSocket) {
+            return socket;
+        }
+        replication::setNoDelay(socket);
+        // Wake up regularly, so that a primary that stopped sending is noticed within the timeout.
+        replication::setReceiveTimeout(socket, replication::kHeartbeatInterval);
+
+        unsigned char hello[replication::kHelloSize];
+        binary::writeU64(hello, replication::kMagic);
+        binary::writeU64(hello + 8, from);
+        if (!replication::sendAll(socket, hello, sizeof(hello))) {
+            replication::closeSocket(socket);
+            return replication::kInvalidSocket;
+        }
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (!running_.load(std::memory_order_acquire)) {
+            replication::closeSocket(socket); // stop() was called while connecting.
+            return replication::kInvalidSocket;
+        }
+        socket_ = socket;
+        return socket;
+    }
+
+    void closeConnection() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        if (socket_ != replication::kInvalidSocket) {
+            replication::closeSocket(socket_);
+            socket_ = replication::kInvalidSocket;
+        }
+    }
+};
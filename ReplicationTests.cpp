@@ -0,0 +1,127 @@
+/**
+ * @file ReplicationTests.cpp
+ * @brief Tests of a hot standby following a primary over the replication stream and taking over from it.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "Instrument.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "TestHarness.h"
+#include "TestSupport.h"
+#include "Trade.h"
+
+using testing::SameLevels;
+using testing::Submit;
+using testing::TempFile;
+
+namespace {
+
+std::vector<SymbolId> ConfigureSymbols(MatchingEngine& engine) {
+    return {engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001)),
+            engine.configureSymbol("ETH-USDT", Instrument(0.01, 0.001))};
+}
+
+/** @brief Rests, trades, cancels and modifies orders on every symbol; `round` varies the prices. */
+void RunWorkload(MatchingEngine& engine, const std::vector<SymbolId>& symbols, Price round) {
+    for (SymbolId symbol : symbols) {
+        for (Price price = 100; price < 104; ++price) {
+            engine.process(OrderType::Limit, Side::Buy, 10, symbol, price + round);
+            engine.process(OrderType::Limit, Side::Sell, 10, symbol, price + round + 20);
+        }
+        engine.process(OrderType::Market, Side::Sell, 15, symbol);
+        engine.cancel(engine.process(OrderType::Limit, Side::Buy, 7, symbol, 90));
+        engine.modify(engine.process(OrderType::Limit, Side::Sell, 7, symbol, 150), 1.40, std::nullopt);
+    }
+}
+
+/** @brief The ID of a crossing buy order and of its first trade, which show where the ID sequences stand. */
+std::vector<std::uint64_t> NextIds(MatchingEngine& engine, SymbolId symbol) {
+    std::vector<Trade> trades;
+    CommandReply reply;
+    reply.trades = &trades;
+    Submit(engine, reply, OrderType::Market, Side::Buy, 1, symbol);
+    return {reply.orderId, trades.empty() ? 0 : trades.front().tradeID};
+}
+
+/** @brief Waits up to a few seconds for `done()` to hold. */
+template <typename Fn>
+bool WaitFor(Fn&& done) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!done()) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return true;
+}
+
+/** @brief Starts replication on the first free port of a range; returns the port. */
+std::uint16_t StartReplication(MatchingEngine& engine) {
+    for (std::uint16_t port = 47100; port < 47200; ++port) {
+        try {
+            engine.startReplication(port);
+            return port;
+        } catch (const std::runtime_error&) {
+            // Taken; try the next one.
+        }
+    }
+    throw std::runtime_error("No free port for replication.");
+}
+
+} // namespace
+
+TEST(AStandbyMatchesItsPrimaryAndContinuesItsIdsAfterTakingOver) {
+    TempFile primary_journal("primary.journal");
+    TempFile standby_journal("standby.journal");
+
+    auto primary = std::make_unique<MatchingEngine>(2);
+    const std::vector<SymbolId> symbols = ConfigureSymbols(*primary);
+    primary->openJournal(primary_journal.path());
+    const std::uint16_t port = StartReplication(*primary);
+    RunWorkload(*primary, symbols, 0); // Journaled before the standby connects: it catches up on these.
+
+    MatchingEngine standby(2);
+    ConfigureSymbols(standby);
+    standby.standBy();
+    standby.openJournal(standby_journal.path());
+    standby.freezeSymbols();
+    standby.followPrimary("127.0.0.1", port, std::chrono::milliseconds(500));
+    RunWorkload(*primary, symbols, 1); // Streamed as they are journaled.
+
+    auto in_step = [&] {
+        for (SymbolId symbol : symbols) {
+            const BookView a = primary->getBookView(symbol);
+            const BookView b = standby.getBookView(symbol);
+            if (!SameLevels(a, b) || a.seq != b.seq) {
+                return false;
+            }
+        }
+        return true;
+    };
+    CHECK(WaitFor(in_step));
+    CHECK(standby.isStandby());
+    CHECK_THROWS(std::invalid_argument, standby.process(OrderType::Limit, Side::Buy, 1, symbols[0], 100));
+
+    // The same commands on an engine that was never replicated: where the ID sequences stand.
+    MatchingEngine reference(2);
+    ConfigureSymbols(reference);
+    RunWorkload(reference, symbols, 0);
+    RunWorkload(reference, symbols, 1);
+
+    primary.reset(); // The primary is lost...
+    CHECK(WaitFor([&] { return !standby.isStandby(); }));
+    for (SymbolId symbol : symbols) {
+        // ...and the standby hands out the IDs it would have handed out next.
+        const std::vector<std::uint64_t> ids = NextIds(standby, symbol);
+        CHECK(ids[1] != 0);
+        CHECK(ids == NextIds(reference, symbol));
+    }
+}
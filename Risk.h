@@ -0,0 +1,157 @@
+/**
+ * @file Risk.h
+ * @brief Defines the pre-trade risk checks that every new order and amendment passes before it is journaled.
+ *
+ * The checks run on the matching thread of the order's shard, right before the order is
+ * journaled and matched. Everything they read is either fixed at startup (the limits) or
+ * owned by that thread (the book's best prices and the account's AccountExposure, which the
+ * book keeps up to date as orders rest, fill and leave), so a check takes no lock and costs a
+ * couple of hash lookups and comparisons.
+ *
+ * Because the exposures live in the books, the stateful limits (open orders, open notional and
+ * position) apply to an account's activity on one symbol: an account trading on several symbols
+ * has each of them checked separately.
+ */
+
+#pragma once
+
+#include <cmath>         // For std::fabs
+#include <cstdint>
+#include <cstdlib>       // For std::llabs
+#include <optional>      // For the best price of a side
+#include <sstream>       // For formatting the limits in rejection messages
+#include <stdexcept>     // For std::invalid_argument
+#include <string>
+#include <unordered_map>
+
+#include "Order.h"
+#include "OrderBook.h"   // For AccountExposure and the best prices the price band is relative to
+
+/**
+ * @struct RiskLimits
+ * @brief The limits of one account. A limit of 0 is no limit.
+ */
+struct RiskLimits {
+    double maxOrderQuantity = 0;     // The largest quantity of one order, in units of the symbol.
+    std::uint32_t maxOpenOrders = 0; // Resting and pending stop orders, per symbol.
+    double maxNotional = 0;          // Price times quantity of those orders, in the quote currency, per symbol.
+    double maxPosition = 0;          // The largest long or short position the account may reach, in units, per symbol.
+    double priceBand = 0;            // How far (as a fraction, e.g. 0.05) a buy may be above the best ask, or a sell below the best bid.
+
+    bool any() const {
+        return maxOrderQuantity > 0 || maxOpenOrders > 0 || maxNotional > 0 || maxPosition > 0 || priceBand > 0;
+    }
+};
+
+/**
+ * @class RiskEngine
+ * @brief The configured limits, and the checks of an order against them.
+ *
+ * Configured once before the engine takes requests and only read afterwards, so the shards
+ * share it without locking.
+ */
+class RiskEngine {
+public:
+    /** @brief Sets the limits of every account that has no limits of its own (and of orders without an account). */
+    void setDefaultLimits(const RiskLimits& limits) {
+        this->default_ = limits;
+        this->enabled_ = this->enabled_ || limits.any();
+    }
+
+    /** @brief Sets the limits of one account, replacing the default limits for it. */
+    void setAccountLimits(AccountId account, const RiskLimits& limits) {
+        this->accounts_[account] = limits;
+        this->enabled_ = this->enabled_ || limits.any();
+    }
+
+    /** @brief False while no limit is set, in which case there is nothing to check. */
+    bool enabled() const { return this->enabled_; }
+
+    /** @brief The limits an account's orders are checked against. */
+    const RiskLimits& limitsFor(AccountId account) const {
+        if (!this->accounts_.empty()) {
+            auto it = this->accounts_.find(account);
+            if (it != this->accounts_.end()) {
+                return it->second;
+            }
+        }
+        return this->default_;
+    }
+
+    /**
+     * @brief Checks a new order against the limits of its account.
+     * @param exposure What the account has at stake on the order's book before the order (all zero
+     *        for orders without an account, which are only checked against the size and price limits).
+     * @param replaces For a modify, the resting order that `order` takes the place of: it is part of
+     *        `exposure`, but no longer counts once replaced. nullptr for a new order.
+     * @throws std::invalid_argument naming the limit the order would break.
+     */
+    void check(const OrderBook& book, const Order& order, const AccountExposure& exposure,
+               const Order* replaces = nullptr) const {
+        const RiskLimits& limits = limitsFor(order.getAccount());
+        const Instrument& instrument = book.getInstrument();
+        const OrderType type = order.getType();
+
+        if (limits.maxOrderQuantity > 0 && instrument.fromLots(order.getQuantity()) > limits.maxOrderQuantity) {
+            reject("the quantity is above the maximum order quantity of ", limits.maxOrderQuantity);
+        }
+
+        // Only orders that trade on arrival are held to the band; stop orders wait for the market to move.
+        if (limits.priceBand > 0 && (type == OrderType::Limit || type == OrderType::IOC || type == OrderType::FOK)) {
+            const Side opposite = (order.getSide() == Side::Buy) ? Side::Sell : Side::Buy;
+            if (const std::optional<Price> best = book.getBestPrice(opposite)) {
+                const double price = static_cast<double>(order.getPrice());
+                if (order.getSide() == Side::Buy ? price > static_cast<double>(*best) * (1 + limits.priceBand)
+                                                 : price < static_cast<double>(*best) * (1 - limits.priceBand)) {
+                    reject("the price is outside the price band of ", limits.priceBand,
+                           (order.getSide() == Side::Buy) ? " above the best ask" : " below the best bid");
+                }
+            }
+        }
+
+        if (order.getAccount() == kNoAccount) {
+            return;
+        }
+
+        // Orders that may rest count towards the open orders and notional.
+        if (type == OrderType::Limit || type == OrderType::StopMarket || type == OrderType::StopLimit) {
+            std::uint32_t open_orders = exposure.openOrders;
+            std::int64_t open_notional = exposure.openNotional;
+            if (replaces != nullptr) {
+                open_orders -= (open_orders > 0) ? 1 : 0;
+                open_notional -= OrderBook::exposurePrice(*replaces) * replaces->getQuantity();
+            }
+            if (limits.maxOpenOrders > 0 && open_orders >= limits.maxOpenOrders) {
+                reject("the account already has the maximum of ", limits.maxOpenOrders, " open orders");
+            }
+            if (limits.maxNotional > 0) {
+                const std::int64_t notional = open_notional + OrderBook::exposurePrice(order) * order.getQuantity();
+                if (static_cast<double>(notional) * instrument.getTickSize() * instrument.getLotSize() > limits.maxNotional) {
+                    reject("the open notional would be above the maximum of ", limits.maxNotional);
+                }
+            }
+        }
+
+        // The position the account reaches if the whole order fills.
+        if (limits.maxPosition > 0) {
+            const Quantity position = exposure.position + ((order.getSide() == Side::Buy) ? order.getQuantity()
+                                                                                          : -order.getQuantity());
+            if (std::fabs(instrument.fromLots(position)) > limits.maxPosition &&
+                std::llabs(position) > std::llabs(exposure.position)) {
+                reject("the position would be above the maximum of ", limits.maxPosition);
+            }
+        }
+    }
+
+private:
+    RiskLimits default_;
+    std::unordered_map<AccountId, RiskLimits> accounts_;
+    bool enabled_ = false;
+
+    template <typename Limit>
+    [[noreturn]] static void reject(const char* what, Limit limit, const char* suffix = "") {
+        std::ostringstream message;
+        message << "Rejected by risk check: " << what << limit << suffix << ".";
+        throw std::invalid_argument(message.str());
+    }
+};
@@ -0,0 +1,125 @@
+/**
+ * @file RiskTests.cpp
+ * @brief Tests of the pre-trade risk limits, driven through the engine so they run where the shards run them.
+ */
+
+#include <optional>
+#include <stdexcept>
+
+#include "Instrument.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "Risk.h"
+#include "TestHarness.h"
+
+namespace {
+
+constexpr AccountId kAccount = 5;
+
+// A tick of 0.01 and a lot of 0.001: 100 ticks is a price of 1.00 and 1000 lots a quantity of 1.
+const Instrument kInstrument(0.01, 0.001);
+
+/** @brief An engine whose account kAccount (and only it) has the given limits. */
+struct RiskTest {
+    MatchingEngine engine;
+    SymbolId symbol;
+
+    explicit RiskTest(const RiskLimits& limits) {
+        RiskEngine risk;
+        risk.setAccountLimits(kAccount, limits);
+        this->engine.setRiskLimits(risk);
+        this->symbol = this->engine.configureSymbol("BTC-USDT", kInstrument);
+    }
+
+    OrderId add(OrderType type, Side side, Quantity quantity, Price price = 0, AccountId account = kAccount,
+                Price stopPrice = 0) {
+        OrderOptions options;
+        options.account = account;
+        options.stopPrice = stopPrice;
+        return this->engine.process(type, side, quantity, this->symbol, price, options);
+    }
+
+    bool rejects(OrderType type, Side side, Quantity quantity, Price price = 0, Price stopPrice = 0) {
+        return testing::Throws<std::invalid_argument>([&] { add(type, side, quantity, price, kAccount, stopPrice); });
+    }
+};
+
+} // namespace
+
+TEST(RiskMaxOrderQuantity) {
+    RiskLimits limits;
+    limits.maxOrderQuantity = 0.01; // 10 lots.
+    RiskTest t(limits);
+    CHECK(t.rejects(OrderType::Limit, Side::Buy, 11, 100));
+    CHECK(t.rejects(OrderType::Market, Side::Sell, 11));
+    t.add(OrderType::Limit, Side::Buy, 10, 100);
+    t.add(OrderType::Limit, Side::Buy, 11, 100, 9); // Other accounts have no limits.
+    CHECK(t.engine.getBookView(t.symbol).bids[0].quantity == 21);
+}
+
+TEST(RiskMaxOpenOrders) {
+    RiskLimits limits;
+    limits.maxOpenOrders = 2;
+    RiskTest t(limits);
+    const OrderId first = t.add(OrderType::Limit, Side::Buy, 10, 100);
+    t.add(OrderType::StopMarket, Side::Buy, 10, 0, kAccount, 150); // Stop orders count too.
+    CHECK(t.rejects(OrderType::Limit, Side::Buy, 10, 99));
+    CHECK(t.rejects(OrderType::StopLimit, Side::Buy, 10, 160, 150));
+    t.add(OrderType::IOC, Side::Buy, 10, 99); // Cannot rest, so does not count.
+
+    // A modify replaces the order, so it does not need a free slot.
+    CHECK(t.engine.modify(first, 0.98, std::nullopt) == ModifyResult::Replaced);
+    CHECK(t.engine.modify(first, std::nullopt, 0.02) == ModifyResult::Replaced);
+
+    t.engine.cancel(first);
+    t.add(OrderType::Limit, Side::Buy, 10, 99);
+}
+
+TEST(RiskMaxNotional) {
+    RiskLimits limits;
+    limits.maxNotional = 10.0;
+    RiskTest t(limits);
+    const OrderId first = t.add(OrderType::Limit, Side::Buy, 5000, 100); // 5 at 1.00.
+    t.add(OrderType::StopMarket, Side::Buy, 2500, 0, kAccount, 200);     // 2.5 at its stop price of 2.00.
+    CHECK(t.rejects(OrderType::Limit, Side::Buy, 1, 100));
+
+    // The modified order counts instead of the one it replaces, not on top of it.
+    CHECK(t.engine.modify(first, 0.50, 10.0) == ModifyResult::Replaced); // 10 at 0.50: still 5.
+    CHECK_THROWS(std::invalid_argument, t.engine.modify(first, 0.51, std::nullopt));
+    const BookView view = t.engine.getBookView(t.symbol);
+    CHECK(view.bidCount == 1 && view.bids[0].price == 50 && view.bids[0].quantity == 10000);
+    CHECK(t.engine.modify(first, std::nullopt, 4.0) == ModifyResult::Amended); // Reductions always pass.
+}
+
+TEST(RiskMaxPosition) {
+    RiskLimits limits;
+    limits.maxPosition = 0.02; // 20 lots, long or short.
+    RiskTest t(limits);
+    t.add(OrderType::Limit, Side::Sell, 100, 100, 9);
+    t.add(OrderType::Market, Side::Buy, 15); // Long 15.
+    CHECK(t.rejects(OrderType::Limit, Side::Buy, 6, 90)); // Counted as if it filled, though it rests.
+    t.engine.cancel(t.add(OrderType::Limit, Side::Buy, 5, 90));
+
+    t.add(OrderType::Limit, Side::Buy, 100, 80, 9);
+    t.add(OrderType::Market, Side::Sell, 35); // Reduces the position to short 20.
+    CHECK(t.rejects(OrderType::Market, Side::Sell, 1));
+    t.add(OrderType::Market, Side::Buy, 1); // Buying reduces it, so it passes.
+}
+
+TEST(RiskPriceBand) {
+    RiskLimits limits;
+    limits.priceBand = 0.05;
+    RiskTest t(limits);
+    t.add(OrderType::Limit, Side::Buy, 10, 105); // No ask yet, so nothing to measure against.
+    t.engine.cancel(t.add(OrderType::Limit, Side::Buy, 10, 105));
+    t.add(OrderType::Limit, Side::Sell, 10, 200, 9);
+    t.add(OrderType::Limit, Side::Buy, 10, 100, 9);
+
+    CHECK(t.rejects(OrderType::Limit, Side::Buy, 1, 211)); // Over 5% above the best ask of 200.
+    CHECK(t.rejects(OrderType::IOC, Side::Buy, 1, 211));
+    CHECK(t.rejects(OrderType::Limit, Side::Sell, 1, 94)); // Over 5% below the best bid of 105.
+    t.add(OrderType::IOC, Side::Buy, 1, 210);
+    t.add(OrderType::IOC, Side::Sell, 1, 100);
+    t.add(OrderType::StopLimit, Side::Buy, 1, 300, kAccount, 250); // Stop orders wait for the market.
+    t.add(OrderType::Market, Side::Buy, 1);                        // Market orders have no price to band.
+}
@@ -0,0 +1,382 @@
+/**
+ * @file Snapshot.h
+ * @brief Defines the on-disk snapshot of the order books, which bounds how much journal a restart must replay.
+ *
+ * Replaying the journal from the beginning gets slower the longer the engine runs. A snapshot
+ * records the complete state of every shard at one point of the journal: its resting orders
+ * (in time priority order), its pending stop orders, the positions of the accounts on its books, its order and
+ * trade ID sequences and the journal position it corresponds to. A restart then maps the latest snapshot, puts its orders straight back onto
+ * the books without matching them, and replays only the journal records written after it.
+ *
+ * Taking a snapshot is a short handoff: each shard copies its books into a flat buffer between
+ * two commands (a memcpy-speed walk of its resting orders), and everything slow (assembling the
+ * file, writing it and syncing it) happens on the thread that asked for the snapshot. The file is
+ * written next to its final path and renamed over it once it is on disk, so a crash never leaves
+ * a partial snapshot behind.
+ *
+ * File layout. All fields are little-endian and every section starts at a multiple of 8 bytes:
+ *
+ *     header (64 bytes)   "CRYPTOS1", u32 version, u32 shard count, u32 symbol count,
+ *                         u32 node count, u64 file size, u32 node index
+ *     shard table         one u64 file offset per shard
+ *     symbol names        per symbol in ID order: u8 length, then the name
+ *     shard sections      one per shard:
+ *                             u64 journal size, u64 next order sequence, u64 next trade sequence,
+ *                             u32 book count, u32 reserved,
+ *                             then per book: u32 symbol ID, u32 flags (bit 0: has traded),
+ *                             u64 market data sequence, u64 order count, i64 last trade price,
+ *                             u64 position count,
+ *                             then that many 40-byte orders:
+ *                             u64 order ID, i64 price, i64 quantity, i64 stop price, u32 account,
+ *                             u8 side, u8 type, u8 self-trade prevention, u8 reserved,
+ *                             then that many 16-byte positions:
+ *                             u32 account, u32 reserved, i64 position in lots
+ *
+ * The orders of a book are stored bids first, each side best price first and each level
+ * oldest order first, so re-adding them in file order restores the exact queues. The pending
+ * stop orders follow, buy stops then sell stops, each in the order they would fire. Only accounts
+ * with a non-zero position are stored; the open order counts and notionals of the risk checks are
+ * rebuilt from the orders themselves.
+ */
+
+#pragma once
+
+#include <cstddef>    // For std::size_t
+#include <cstdint>
+#include <cstring>    // For std::memcpy, std::memcmp
+#include <optional>   // For the last trade price of a book
+#include <stdexcept>  // For std::runtime_error
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap, munmap
+#include <sys/stat.h> // For fstat
+#include <unistd.h>   // For write, fsync, close
+#include <cstdio>     // For std::rename
+#endif
+
+#include "Order.h"
+#include "OrderBook.h"
+#include "LittleEndian.h"
+
+/**
+ * @struct ShardSnapshot
+ * @brief The state of one shard, copied out by the shard's thread for a snapshot.
+ */
+struct ShardSnapshot {
+    // Every record the shard journaled before the snapshot has a sequence number below this,
+    // and none after it does, so replay resumes the shard's records here.
+    std::uint64_t journalSize = 0;
+    std::uint64_t nextOrderSeq = 1;
+    std::uint64_t nextTradeSeq = 1;
+    std::uint32_t bookCount = 0;
+    std::vector<unsigned char> books; // The encoded books, see appendBook().
+
+    static constexpr std::uint32_t kHasTraded = 1; // Book flag: the last trade price is set.
+
+    static constexpr std::size_t kHeaderSize = 32;
+    static constexpr std::size_t kBookHeaderSize = 40;
+    static constexpr std::size_t kOrderSize = 40;
+    static constexpr std::size_t kPositionSize = 16;
+
+    /**
+     * @brief Appends a book (its resting orders in time priority order, then its stop orders, then the
+     * non-zero account positions) to `books`.
+     */
+    void appendBook(const OrderBook& book) {
+        const std::size_t header = this->books.size();
+        this->books.resize(header + kBookHeaderSize);
+        std::uint64_t orders = 0;
+        auto append_order = [&](const Order& order) {
+            const std::size_t at = this->books.size();
+            this->books.resize(at + kOrderSize);
+            unsigned char* p = this->books.data() + at;
+            binary::writeU64(p, order.getOrderID());
+            binary::writeI64(p + 8, order.getPrice());
+            binary::writeI64(p + 16, order.getQuantity());
+            binary::writeI64(p + 24, order.getStopPrice());
+            binary::writeU32(p + 32, order.getAccount());
+            p[36] = static_cast<unsigned char>(order.getSide());
+            p[37] = static_cast<unsigned char>(order.getType());
+            p[38] = static_cast<unsigned char>(order.getSelfTradePrevention());
+            p[39] = 0;
+            ++orders;
+        };
+        book.forEachOrder(Side::Buy, append_order);
+        book.forEachOrder(Side::Sell, append_order);
+        book.forEachStopOrder(append_order);
+
+        std::uint64_t positions = 0;
+        book.forEachExposure([&](AccountId account, const AccountExposure& exposure) {
+            if (exposure.position != 0) {
+                const std::size_t at = this->books.size();
+                this->books.resize(at + kPositionSize);
+                unsigned char* p = this->books.data() + at;
+                binary::writeU32(p, account);
+                binary::writeU32(p + 4, 0);
+                binary::writeI64(p + 8, exposure.position);
+                ++positions;
+            }
+        });
+
+        const std::optional<Price> last_trade = book.getLastTradePrice();
+        unsigned char* p = this->books.data() + header;
+        binary::writeU32(p, book.getSymbolId());
+        binary::writeU32(p + 4, last_trade ? kHasTraded : 0);
+        binary::writeU64(p + 8, book.getMarketDataSeq());
+        binary::writeU64(p + 16, orders);
+        binary::writeI64(p + 24, last_trade.value_or(0));
+        binary::writeU64(p + 32, positions);
+        ++this->bookCount;
+    }
+};
+
+/**
+ * @class SnapshotFile
+ * @brief A snapshot file mapped read-only into memory. Nothing is decoded until it is asked for.
+ */
+class SnapshotFile {
+public:
+    /**
+     * @brief Writes a snapshot atomically: to `path + ".tmp"` first, then renamed over `path` once durable.
+     * @param symbols The names of the symbols, in ID order; must cover every book in the shards.
+     * @param nodeIndex, nodeCount Which of the engine nodes behind a routing gateway wrote the snapshot.
+     * @throws std::runtime_error if the file cannot be written.
+     */
+    static void write(const std::string& path, const std::vector<std::string>& symbols,
+                      const std::vector<ShardSnapshot>& shards, std::size_t nodeIndex = 0, std::size_t nodeCount = 1) {
+        std::vector<unsigned char> head(kHeaderSize + 8 * shards.size());
+        for (const std::string& name : symbols) {
+            head.push_back(static_cast<unsigned char>(name.size()));
+            head.insert(head.end(), name.begin(), name.end());
+        }
+        head.resize(align(head.size()));
+
+        std::uint64_t offset = head.size();
+        for (std::size_t i = 0; i < shards.size(); ++i) {
+            binary::writeU64(head.data() + kHeaderSize + 8 * i, offset);
+            offset += ShardSnapshot::kHeaderSize + shards[i].books.size();
+        }
+        std::memcpy(head.data(), kMagic, sizeof(kMagic));
+        binary::writeU32(head.data() + 8, kVersion);
+        binary::writeU32(head.data() + 12, static_cast<std::uint32_t>(shards.size()));
+        binary::writeU32(head.data() + 16, static_cast<std::uint32_t>(symbols.size()));
+        binary::writeU32(head.data() + 20, static_cast<std::uint32_t>(nodeCount));
+        binary::writeU64(head.data() + 24, offset);
+        binary::writeU32(head.data() + 32, static_cast<std::uint32_t>(nodeIndex));
+
+#if defined(_WIN32)
+        (void)path;
+        throw std::runtime_error("Snapshots are only supported on POSIX systems.");
+#else
+        const std::string temp = path + ".tmp";
+        const int fd = ::open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0) {
+            throw std::runtime_error("Could not create the snapshot '" + temp + "'.");
+        }
+        bool ok = writeAll(fd, head.data(), head.size());
+        for (const ShardSnapshot& shard : shards) {
+            unsigned char header[ShardSnapshot::kHeaderSize];
+            binary::writeU64(header, shard.journalSize);
+            binary::writeU64(header + 8, shard.nextOrderSeq);
+            binary::writeU64(header + 16, shard.nextTradeSeq);
+            binary::writeU32(header + 24, shard.bookCount);
+            binary::writeU32(header + 28, 0);
+            ok = ok && writeAll(fd, header, sizeof(header)) && writeAll(fd, shard.books.data(), shard.books.size());
+        }
+        ok = ok && ::fsync(fd) == 0;
+        ::close(fd);
+        if (!ok || std::rename(temp.c_str(), path.c_str()) != 0) {
+            throw std::runtime_error("Could not write the snapshot '" + path + "'.");
+        }
+#endif
+    }
+
+    /**
+     * @brief Maps a snapshot file and checks that it fits this engine.
+     * @throws std::runtime_error if the file cannot be read, is damaged, or was written with another shard
+     *         count or by another node.
+     */
+    SnapshotFile(const std::string& path, std::size_t shardCount, std::size_t nodeIndex = 0, std::size_t nodeCount = 1)
+        : path_(path) {
+#if defined(_WIN32)
+        (void)shardCount;
+        (void)nodeIndex;
+        (void)nodeCount;
+        throw std::runtime_error("Snapshots are only supported on POSIX systems.");
+#else
+        const int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            throw std::runtime_error("Could not open the snapshot '" + path + "'.");
+        }
+        struct stat info {};
+        ::fstat(fd, &info);
+        this->size_ = static_cast<std::size_t>(info.st_size);
+        void* base = (this->size_ >= kHeaderSize) ? ::mmap(nullptr, this->size_, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+        ::close(fd);
+        if (base == MAP_FAILED) {
+            throw std::runtime_error("Could not map the snapshot '" + path + "'.");
+        }
+        this->base_ = static_cast<const unsigned char*>(base);
+
+        if (std::memcmp(this->base_, kMagic, sizeof(kMagic)) != 0 || binary::readU32(this->base_ + 8) != kVersion ||
+            binary::readU64(this->base_ + 24) != this->size_) {
+            unmap();
+            throw std::runtime_error("'" + path + "' is not a complete snapshot of this engine version.");
+        }
+        if (binary::readU32(this->base_ + 12) != shardCount) {
+            const std::uint32_t written = binary::readU32(this->base_ + 12);
+            unmap();
+            throw std::runtime_error("The snapshot '" + path + "' was written with " + std::to_string(written) +
+                                     " shard(s); start the engine with --shards " + std::to_string(written) + ".");
+        }
+        if (binary::readU32(this->base_ + 20) != nodeCount || binary::readU32(this->base_ + 32) != nodeIndex) {
+            const std::string node = std::to_string(binary::readU32(this->base_ + 32)) + "/" +
+                                     std::to_string(binary::readU32(this->base_ + 20));
+            unmap();
+            throw std::runtime_error("The snapshot '" + path + "' was written by node " + node +
+                                     "; start the engine with --node " + node + ".");
+        }
+        this->shard_count_ = shardCount;
+
+        try {
+            std::size_t at = kHeaderSize + 8 * shardCount;
+            require(at <= this->size_);
+            const std::uint32_t symbols = binary::readU32(this->base_ + 16);
+            for (std::uint32_t i = 0; i < symbols; ++i) {
+                require(at < this->size_ && at + 1 + this->base_[at] <= this->size_);
+                this->symbols_.emplace_back(reinterpret_cast<const char*>(this->base_ + at + 1), this->base_[at]);
+                at += 1 + this->base_[at];
+            }
+        } catch (...) {
+            unmap(); // The destructor does not run for an object whose constructor threw.
+            throw;
+        }
+#endif
+    }
+
+    /** @brief True if there is a file at `path` (a snapshot to restore on startup). */
+    static bool exists(const std::string& path) {
+#if defined(_WIN32)
+        (void)path;
+        return false;
+#else
+        struct stat info {};
+        return ::stat(path.c_str(), &info) == 0;
+#endif
+    }
+
+    SnapshotFile(const SnapshotFile&) = delete;
+    SnapshotFile& operator=(const SnapshotFile&) = delete;
+
+    ~SnapshotFile() { unmap(); }
+
+    /** @brief The names of the symbols at the time of the snapshot, in ID order. */
+    const std::vector<std::string>& symbols() const { return this->symbols_; }
+
+    /** @brief The journal size a shard resumes replaying from. */
+    std::uint64_t journalSize(std::size_t shard) const { return binary::readU64(section(shard)); }
+
+    /**
+     * @brief Restores the state of one shard.
+     * @param nextOrderSeq, nextTradeSeq Receive the shard's ID sequences.
+     * @param restoreBook Called as `fn(SymbolId, std::uint64_t marketDataSeq, std::optional<Price> lastTradePrice,
+     *        const unsigned char* orders, std::uint64_t orderCount, const unsigned char* positions,
+     *        std::uint64_t positionCount)` for every book; decode the orders with readOrder() and the
+     *        positions with readPosition().
+     * @throws std::runtime_error if the section is damaged.
+     */
+    template <typename Fn>
+    void restoreShard(std::size_t shard, std::uint64_t& nextOrderSeq, std::uint64_t& nextTradeSeq, Fn&& restoreBook) const {
+        const unsigned char* p = section(shard);
+        nextOrderSeq = binary::readU64(p + 8);
+        nextTradeSeq = binary::readU64(p + 16);
+        const std::uint32_t books = binary::readU32(p + 24);
+        std::size_t at = static_cast<std::size_t>(p - this->base_) + ShardSnapshot::kHeaderSize;
+        for (std::uint32_t i = 0; i < books; ++i) {
+            require(at + ShardSnapshot::kBookHeaderSize <= this->size_);
+            const unsigned char* book = this->base_ + at;
+            const std::uint64_t orders = binary::readU64(book + 16);
+            const std::uint64_t positions = binary::readU64(book + 32);
+            at += ShardSnapshot::kBookHeaderSize;
+            require(orders <= (this->size_ - at) / ShardSnapshot::kOrderSize);
+            const std::size_t positions_at = at + static_cast<std::size_t>(orders) * ShardSnapshot::kOrderSize;
+            require(positions <= (this->size_ - positions_at) / ShardSnapshot::kPositionSize);
+            const SymbolId symbol = binary::readU32(book);
+            require(symbol < this->symbols_.size());
+            const std::optional<Price> last_trade = (binary::readU32(book + 4) & ShardSnapshot::kHasTraded)
+                                                        ? std::optional<Price>(binary::readI64(book + 24))
+                                                        : std::nullopt;
+            restoreBook(symbol, binary::readU64(book + 8), last_trade, this->base_ + at, orders,
+                        this->base_ + positions_at, positions);
+            at = positions_at + static_cast<std::size_t>(positions) * ShardSnapshot::kPositionSize;
+        }
+    }
+
+    /** @brief Decodes the i-th order of a book handed to the restoreShard() callback. */
+    static Order readOrder(const unsigned char* orders, std::uint64_t i, SymbolId symbol) {
+        const unsigned char* p = orders + i * ShardSnapshot::kOrderSize;
+        return Order(binary::readU64(p), static_cast<OrderType>(p[37]), static_cast<Side>(p[36]),
+                     binary::readI64(p + 16), symbol, binary::readI64(p + 8), binary::readI64(p + 24),
+                     binary::readU32(p + 32), static_cast<SelfTradePrevention>(p[38]));
+    }
+
+    /** @brief Decodes the i-th position of a book handed to the restoreShard() callback into `account` and `position`. */
+    static void readPosition(const unsigned char* positions, std::uint64_t i, AccountId& account, Quantity& position) {
+        const unsigned char* p = positions + i * ShardSnapshot::kPositionSize;
+        account = binary::readU32(p);
+        position = binary::readI64(p + 8);
+    }
+
+private:
+    static constexpr char kMagic[8] = {'C', 'R', 'Y', 'P', 'T', 'O', 'S', '1'};
+    // 2: stop orders, accounts and the last trade price. 3: account positions. 4: the node index and count.
+    static constexpr std::uint32_t kVersion = 4;
+    static constexpr std::size_t kHeaderSize = 64;
+
+    std::string path_;
+    const unsigned char* base_ = nullptr;
+    std::size_t size_ = 0;
+    std::size_t shard_count_ = 0;
+    std::vector<std::string> symbols_;
+
+    static std::size_t align(std::size_t n) { return (n + 7) / 8 * 8; }
+
+    void require(bool condition) const {
+        if (!condition) {
+            throw std::runtime_error("The snapshot '" + this->path_ + "' is damaged.");
+        }
+    }
+
+    const unsigned char* section(std::size_t shard) const {
+        require(shard < this->shard_count_);
+        const std::uint64_t offset = binary::readU64(this->base_ + kHeaderSize + 8 * shard);
+        require(offset <= this->size_ && this->size_ - offset >= ShardSnapshot::kHeaderSize);
+        return this->base_ + offset;
+    }
+
+#if !defined(_WIN32)
+    static bool writeAll(int fd, const unsigned char* data, std::size_t size) {
+        while (size > 0) {
+            const ssize_t written = ::write(fd, data, size);
+            if (written <= 0) {
+                return false;
+            }
+            data += written;
+            size -= static_cast<std::size_t>(written);
+        }
+        return true;
+    }
+#endif
+
+    void unmap() {
+#if !defined(_WIN32)
+        if (this->base_ != nullptr) {
+            ::munmap(const_cast<unsigned char*>(this->base_), this->size_);
+            this->base_ = nullptr;
+        }
+#endif
+    }
+};
@@ -0,0 +1,174 @@
+/**
+ * @file SnapshotTests.cpp
+ * @brief Tests of restoring the engine from a snapshot and the journal records written after it.
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include "Command.h"
+#include "Instrument.h"
+#include "MatchingEngine.h"
+#include "Order.h"
+#include "Risk.h"
+#include "Snapshot.h"
+#include "TestHarness.h"
+#include "TestSupport.h"
+#include "Trade.h"
+
+using testing::SameLevels;
+using testing::Submit;
+using testing::TempFile;
+
+namespace {
+
+constexpr AccountId kLong = 5;  // Has a position on BTC-USDT, close to its limit.
+constexpr AccountId kOther = 9;
+
+/** @brief Two symbols, on different shards of a two-shard engine, and a position limit for kLong. */
+std::vector<SymbolId> Configure(MatchingEngine& engine) {
+    RiskLimits limits;
+    limits.maxPosition = 0.02; // 20 lots.
+    RiskEngine risk;
+    risk.setAccountLimits(kLong, limits);
+    engine.setRiskLimits(risk);
+    return {engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001)),
+            engine.configureSymbol("ETH-USDT", Instrument(0.01, 0.001))};
+}
+
+OrderOptions Account(AccountId account, Price stopPrice = 0) {
+    OrderOptions options;
+    options.account = account;
+    options.stopPrice = stopPrice;
+    return options;
+}
+
+/** @brief What the engine holds when the snapshot is taken: a position, a queue with a re-queued order, a stop order. */
+std::vector<OrderId> RunBeforeSnapshot(MatchingEngine& engine, SymbolId btc) {
+    engine.process(OrderType::Limit, Side::Sell, 15, btc, 110, Account(kOther));
+    engine.process(OrderType::Market, Side::Buy, 15, btc, 0, Account(kLong)); // kLong is 15 lots long.
+    const OrderId first = engine.process(OrderType::Limit, Side::Buy, 10, btc, 100);
+    const OrderId second = engine.process(OrderType::Limit, Side::Buy, 10, btc, 100);
+    const OrderId third = engine.process(OrderType::Limit, Side::Buy, 10, btc, 100);
+    engine.modify(first, std::nullopt, 0.012); // Grows, so it goes to the back of the queue.
+    engine.process(OrderType::StopMarket, Side::Buy, 5, btc, 0, Account(kOther, 120));
+    return {second, third, first};
+}
+
+/** @brief Journaled after the snapshot, so replayed on top of it. */
+void RunAfterSnapshot(MatchingEngine& engine, SymbolId eth) {
+    engine.process(OrderType::Limit, Side::Sell, 10, eth, 130);
+    engine.process(OrderType::Limit, Side::Buy, 4, eth, 130);
+}
+
+/** @brief Trades through the BTC-USDT bids, then fires the stop order; returns every trade. */
+std::vector<Trade> Probe(MatchingEngine& engine, SymbolId btc) {
+    std::vector<Trade> all;
+    std::vector<Trade> trades;
+    CommandReply reply;
+    reply.trades = &trades;
+    Submit(engine, reply, OrderType::Market, Side::Sell, 25, btc);
+    all.insert(all.end(), trades.begin(), trades.end());
+    reply.reset();
+    Submit(engine, reply, OrderType::Limit, Side::Sell, 5, btc, 125); // What the stop order buys when it fires.
+    reply.reset();
+    Submit(engine, reply, OrderType::Limit, Side::Sell, 5, btc, 120);
+    all.insert(all.end(), trades.begin(), trades.end());
+    reply.reset();
+    Submit(engine, reply, OrderType::Limit, Side::Buy, 5, btc, 120); // Trades at 120, which fires the stop.
+    all.insert(all.end(), trades.begin(), trades.end());
+    return all;
+}
+
+bool SameTrades(const std::vector<Trade>& a, const std::vector<Trade>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (std::size_t i = 0; i < a.size(); ++i) {
+        if (a[i].tradeID != b[i].tradeID || a[i].makerOrderID != b[i].makerOrderID ||
+            a[i].takerOrderID != b[i].takerOrderID || a[i].price != b[i].price || a[i].quantity != b[i].quantity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+TEST(ASnapshotRestoresTheBooksQueuesStopsPositionsAndSequences) {
+    TempFile journal("snapshot.journal");
+    TempFile snapshot("snapshot.snap");
+    std::vector<OrderId> queue;
+    std::vector<BookView> before;
+    {
+        MatchingEngine engine(2);
+        const std::vector<SymbolId> symbols = Configure(engine);
+        engine.openJournal(journal.path(), snapshot.path());
+        queue = RunBeforeSnapshot(engine, symbols[0]);
+        engine.writeSnapshot();
+        RunAfterSnapshot(engine, symbols[1]);
+        for (SymbolId symbol : symbols) {
+            before.push_back(engine.getBookView(symbol));
+        }
+    }
+
+    MatchingEngine reference(2);
+    const std::vector<SymbolId> symbols = Configure(reference);
+    RunBeforeSnapshot(reference, symbols[0]);
+    RunAfterSnapshot(reference, symbols[1]);
+
+    MatchingEngine restored(2);
+    Configure(restored);
+    restored.openJournal(journal.path(), snapshot.path());
+    for (SymbolId symbol : symbols) {
+        const BookView view = restored.getBookView(symbol);
+        CHECK(SameLevels(view, before[symbol]));
+        CHECK(view.seq == before[symbol].seq);
+    }
+
+    // The position survived: kLong may not buy past its limit.
+    CHECK_THROWS(std::invalid_argument,
+                 restored.process(OrderType::Limit, Side::Buy, 10, symbols[0], 90, Account(kLong)));
+    CHECK_THROWS(std::invalid_argument,
+                 reference.process(OrderType::Limit, Side::Buy, 10, symbols[0], 90, Account(kLong)));
+
+    const std::vector<Trade> trades = Probe(restored, symbols[0]);
+    CHECK(SameTrades(trades, Probe(reference, symbols[0])));
+    // The bids traded in their queue order...
+    CHECK(trades.size() >= 3);
+    for (std::size_t i = 0; i < queue.size() && i < trades.size(); ++i) {
+        CHECK(trades[i].makerOrderID == queue[i]);
+    }
+    // ...and the stop order was restored and fired.
+    CHECK(trades.size() == 5);
+    CHECK(!trades.empty() && trades.back().price == 125);
+}
+
+TEST(ASnapshotOnlyOpensWithItsShardCountAndNode) {
+    TempFile journal("layout.journal");
+    TempFile snapshot("layout.snap");
+    {
+        MatchingEngine engine(2);
+        engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+        engine.openJournal(journal.path(), snapshot.path());
+        engine.process(OrderType::Limit, Side::Buy, 10, 0, 100);
+        engine.writeSnapshot();
+    }
+    CHECK_THROWS(std::runtime_error, SnapshotFile(snapshot.path(), 1));
+    CHECK_THROWS(std::runtime_error, SnapshotFile(snapshot.path(), 2, 1, 2));
+    SnapshotFile file(snapshot.path(), 2);
+    CHECK(file.symbols() == std::vector<std::string>{"BTC-USDT"});
+
+    // The engine refuses both, whether the journal or the snapshot is the first to disagree.
+    TempFile fresh("layout_fresh.journal");
+    MatchingEngine fewer_shards(1);
+    fewer_shards.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+    CHECK_THROWS(std::runtime_error, fewer_shards.openJournal(journal.path(), snapshot.path()));
+    CHECK_THROWS(std::runtime_error, fewer_shards.openJournal(fresh.path(), snapshot.path()));
+
+    TempFile other_fresh("layout_other.journal");
+    MatchingEngine other_node(2, -1, 1, 2);
+    other_node.configureSymbol("BTC-USDT", Instrument(0.01, 0.001));
+    CHECK_THROWS(std::runtime_error, other_node.openJournal(journal.path()));
+    CHECK_THROWS(std::runtime_error, other_node.openJournal(other_fresh.path(), snapshot.path()));
+}
@@ -0,0 +1,127 @@
+/**
+ * @file SymbolTable.h
+ * @brief Defines the SymbolTable class, the registry of the symbols the engine trades.
+ *
+ * Every tradable symbol is registered at startup with its tick and lot size and gets a dense
+ * integer ID. Orders and trades carry that SymbolId instead of a std::string, so the matching
+ * path never copies, hashes or frees symbol strings, and books can be kept in flat vectors
+ * indexed by it. The string form is only needed at the edges: a request's symbol is looked up
+ * once when it is parsed (and rejected there if it is unknown), and the name is written back
+ * out when an outgoing message is serialized.
+ */
+
+#pragma once
+
+#include <atomic>        // For the published symbol count and the frozen flag
+#include <cstddef>       // For std::size_t
+#include <functional>    // For std::function
+#include <mutex>         // For std::mutex, std::lock_guard
+#include <optional>      // For the result of find()
+#include <stdexcept>     // For std::length_error, std::logic_error
+#include <string>
+#include <unordered_map>
+#include <utility>       // For std::move
+#include <vector>
+
+#include "Order.h"       // For the SymbolId type alias.
+#include "Instrument.h"  // For the tick and lot size of each symbol.
+
+/**
+ * @class SymbolTable
+ * @brief A thread-safe, append-only mapping between symbol names, dense integer IDs and instruments.
+ *
+ * Symbols are added while the engine is being set up. Once the table is frozen it can no longer
+ * change, and lookups by name take no lock.
+ */
+class SymbolTable {
+public:
+    static constexpr std::size_t kMaxSymbols = 4096;
+
+    SymbolTable() {
+        // Reserve up front so the entries never move: readers can then look up a name or an
+        // instrument without taking the lock once they have seen its ID.
+        this->names_.reserve(kMaxSymbols);
+        this->instruments_.reserve(kMaxSymbols);
+    }
+
+    /**
+     * @brief Registers a symbol, assigning the next free ID, or reconfigures one already registered.
+     * A symbol must not be reconfigured once orders for it may have been processed.
+     * @return The symbol's ID.
+     * @throws std::logic_error if the table is frozen.
+     * @throws std::length_error if the table is full.
+     */
+    SymbolId add(const std::string& symbol, const Instrument& instrument) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        if (this->frozen_.load(std::memory_order_relaxed)) {
+            throw std::logic_error("Cannot register symbol '" + symbol + "' after startup.");
+        }
+        auto it = this->ids_.find(symbol);
+        if (it != this->ids_.end()) {
+            this->instruments_[it->second] = instrument;
+            return it->second;
+        }
+        if (this->names_.size() >= kMaxSymbols) {
+            throw std::length_error("Too many symbols; cannot add '" + symbol + "'.");
+        }
+        SymbolId id = static_cast<SymbolId>(this->names_.size());
+        if (this->listener_) {
+            this->listener_(id, symbol); // May throw, in which case the symbol is not added.
+        }
+        this->names_.push_back(symbol);
+        this->instruments_.push_back(instrument);
+        this->ids_.emplace(symbol, id);
+        this->count_.store(this->names_.size(), std::memory_order_release);
+        return id;
+    }
+
+    /** @brief Makes the table read-only, after which find() no longer takes the lock. */
+    void freeze() {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        this->frozen_.store(true, std::memory_order_release);
+    }
+
+    /** @brief Returns the ID of a registered symbol, or nothing if it is not registered. */
+    std::optional<SymbolId> find(const std::string& symbol) const {
+        if (this->frozen_.load(std::memory_order_acquire)) {
+            return lookup(symbol);
+        }
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        return lookup(symbol);
+    }
+
+    /**
+     * @brief Sets a function that is called with every new symbol before it is added.
+     * Calls happen in ID order under the table's lock. If the function throws, add() fails.
+     */
+    void setListener(std::function<void(SymbolId, const std::string&)> listener) {
+        std::lock_guard<std::mutex> lock(this->mtx_);
+        this->listener_ = std::move(listener);
+    }
+
+    /** @brief Returns the name of a registered symbol. */
+    const std::string& name(SymbolId id) const { return this->names_[id]; }
+
+    /** @brief Returns the tick and lot configuration of a registered symbol. */
+    const Instrument& instrument(SymbolId id) const { return this->instruments_[id]; }
+
+    /** @brief The number of symbols registered so far. */
+    std::size_t size() const { return this->count_.load(std::memory_order_acquire); }
+
+private:
+    mutable std::mutex mtx_;
+    std::unordered_map<std::string, SymbolId> ids_;
+    std::vector<std::string> names_;
+    std::vector<Instrument> instruments_;
+    std::atomic<std::size_t> count_{0};
+    std::atomic<bool> frozen_{false};
+    std::function<void(SymbolId, const std::string&)> listener_;
+
+    std::optional<SymbolId> lookup(const std::string& symbol) const {
+        auto it = this->ids_.find(symbol);
+        if (it == this->ids_.end()) {
+            return std::nullopt;
+        }
+        return it->second;
+    }
+};
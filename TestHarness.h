@@ -0,0 +1,73 @@
+/**
+ * @file TestHarness.h
+ * @brief The minimal test runner behind engine_tests: TEST() registers a test, CHECK() records a failed condition.
+ *
+ * Tests are plain functions in the *Tests.cpp files, registered at static initialization and
+ * run by TestMain.cpp in registration order. A failed check prints where it failed and lets the
+ * test go on, so one run reports every broken expectation; the run fails if any check did.
+ */
+
+#pragma once
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace testing {
+
+struct TestCase {
+    const char* name;
+    void (*run)();
+};
+
+inline std::vector<TestCase>& Registry() {
+    static std::vector<TestCase> tests;
+    return tests;
+}
+
+/** @brief The number of checks that failed so far. */
+inline int& Failures() {
+    static int failures = 0;
+    return failures;
+}
+
+struct Registrar {
+    Registrar(const char* name, void (*run)()) { Registry().push_back({name, run}); }
+};
+
+/** @brief Records a failed check. */
+inline void Fail(const char* file, int line, const std::string& what) {
+    std::cerr << file << ":" << line << ": check failed: " << what << "\n";
+    ++Failures();
+}
+
+/** @brief Whether calling fn throws an exception of type E. */
+template <typename E, typename Fn>
+bool Throws(Fn&& fn) {
+    try {
+        fn();
+    } catch (const E&) {
+        return true;
+    } catch (...) {
+        return false;
+    }
+    return false;
+}
+
+} // namespace testing
+
+#define TEST(name)                                                        \
+    static void name();                                                   \
+    static const testing::Registrar name##_registrar(#name, &name);       \
+    static void name()
+
+#define CHECK(condition)                                                  \
+    do {                                                                  \
+        if (!(condition)) {                                               \
+            testing::Fail(__FILE__, __LINE__, #condition);                \
+        }                                                                 \
+    } while (false)
+
+// Checks that `statement` throws an exception of type `type`.
+#define CHECK_THROWS(type, statement) \
+    CHECK(testing::Throws<type>([&] { statement; }))
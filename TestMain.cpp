@@ -0,0 +1,33 @@
+/**
+ * @file TestMain.cpp
+ * @brief Runs the tests registered with TEST() (see TestHarness.h), or only those named on the command line.
+ */
+
+#include <cstdlib>  // For EXIT_SUCCESS, EXIT_FAILURE
+#include <cstring>  // For std::strcmp
+#include <iostream>
+
+#include "TestHarness.h"
+
+int main(int argc, char* argv[]) {
+    std::size_t run = 0;
+    for (const testing::TestCase& test : testing::Registry()) {
+        bool selected = argc < 2;
+        for (int i = 1; i < argc && !selected; ++i) {
+            selected = std::strcmp(argv[i], test.name) == 0;
+        }
+        if (!selected) {
+            continue;
+        }
+        const int before = testing::Failures();
+        test.run();
+        ++run;
+        std::cout << (testing::Failures() == before ? "[ OK ] " : "[FAIL] ") << test.name << std::endl;
+    }
+    if (testing::Failures() != 0) {
+        std::cerr << testing::Failures() << " check(s) failed." << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << run << " test(s) passed." << std::endl;
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,82 @@
+/**
+ * @file TestSupport.h
+ * @brief Helpers shared by the engine tests: scratch files, raw commands and book comparisons.
+ */
+
+#pragma once
+
+#include <cstdio>     // For std::remove
+#include <filesystem>
+#include <string>
+#include <utility>    // For std::move
+#include <vector>
+
+#include "BookView.h"
+#include "Command.h"
+#include "MatchingEngine.h"
+#include "Trade.h"
+
+namespace testing {
+
+/** @brief A file in the temporary directory that is removed when the test starts and when it ends. */
+class TempFile {
+public:
+    explicit TempFile(const std::string& name)
+        : path_((std::filesystem::temp_directory_path() / ("engine_tests_" + name)).string()) {
+        std::remove(this->path_.c_str());
+    }
+
+    ~TempFile() { std::remove(this->path_.c_str()); }
+
+    TempFile(const TempFile&) = delete;
+    TempFile& operator=(const TempFile&) = delete;
+
+    const std::string& path() const { return this->path_; }
+
+private:
+    std::string path_;
+};
+
+/** @brief Submits a command the way the binary gateway does and waits for the shard's reply. */
+inline void Execute(MatchingEngine& engine, Command&& command, CommandReply& reply) {
+    command.reply = &reply;
+    engine.submit(std::move(command));
+    reply.wait();
+}
+
+/**
+ * @brief Submits a new order and waits for its reply, without waiting for a journal to make it durable.
+ * Set `reply.trades` to also receive the trades the order caused.
+ */
+inline void Submit(MatchingEngine& engine, CommandReply& reply, OrderType type, Side side, Quantity quantity,
+                   SymbolId symbol, Price price = 0, const OrderOptions& options = OrderOptions()) {
+    Command command;
+    command.type = CommandType::NewOrder;
+    command.orderType = type;
+    command.side = side;
+    command.quantity = quantity;
+    command.symbol = symbol;
+    command.price = price;
+    command.options = options;
+    Execute(engine, std::move(command), reply);
+}
+
+/** @brief Whether two views show the same levels (their sequence numbers are not compared). */
+inline bool SameLevels(const BookView& a, const BookView& b) {
+    if (a.bidCount != b.bidCount || a.askCount != b.askCount) {
+        return false;
+    }
+    for (std::uint32_t i = 0; i < a.bidCount; ++i) {
+        if (a.bids[i].price != b.bids[i].price || a.bids[i].quantity != b.bids[i].quantity) {
+            return false;
+        }
+    }
+    for (std::uint32_t i = 0; i < a.askCount; ++i) {
+        if (a.asks[i].price != b.asks[i].price || a.asks[i].quantity != b.asks[i].quantity) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace testing
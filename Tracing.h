@@ -0,0 +1,74 @@
+/**
+ * @file Tracing.h
+ * @brief Defines the sampled order traces: the complete timeline of one in every N orders,
+ * served on GET /admin/traces.
+ *
+ * The stage histograms (Metrics.h) say how long each stage takes in general, but not where
+ * one slow order spent its time. When trace sampling is on, the shard copies every N-th
+ * order's timestamps into a ring of recent traces: when the gateway read it, when it was
+ * queued to the shard, when the shard accepted it, when its matching ended and when its
+ * feed messages had been handed to the Publisher. Each shard writes a ring of its own,
+ * through a SeqLock per slot, so tracing takes no lock and shares no cache line with
+ * another shard, and readers never delay the matching thread.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>    // For std::size_t
+#include <cstdint>
+
+#include "BookView.h" // For SeqLock
+#include "Order.h"
+
+/**
+ * @struct OrderTrace
+ * @brief The timeline of one sampled order. The timestamps are Tsc ticks (see Metrics.h).
+ */
+struct OrderTrace {
+    OrderId orderId = 0;
+    SymbolId symbol = 0;
+    std::uint32_t trades = 0;    // The trades the order took part in as the taker.
+    std::uint64_t received = 0;  // The gateway read the request.
+    std::uint64_t queued = 0;    // The request was handed to the shard's queue.
+    std::uint64_t accepted = 0;  // The shard picked the order up.
+    std::uint64_t matched = 0;   // Matching ended: the order traded and/or rested.
+    std::uint64_t published = 0; // The trades and market data updates were handed to the feeds.
+};
+
+/**
+ * @class TraceRing
+ * @brief The most recent traces of one shard. Single writer (the shard), any number of readers.
+ */
+class TraceRing {
+public:
+    static constexpr std::size_t kCapacity = 1024;
+
+    /** @brief Adds a trace, overwriting the oldest one once the ring is full. Shard thread only. */
+    void push(const OrderTrace& trace) {
+        const std::uint64_t count = this->count_.load(std::memory_order_relaxed);
+        this->slots_[count % kCapacity].store(trace);
+        this->count_.store(count + 1, std::memory_order_release);
+    }
+
+    /**
+     * @brief Calls fn(const OrderTrace&) for each trace in the ring, oldest first. Safe from any thread.
+     * A trace being overwritten meanwhile is either skipped or read as its replacement.
+     */
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        const std::uint64_t count = this->count_.load(std::memory_order_acquire);
+        const std::uint64_t first = (count > kCapacity) ? count - kCapacity : 0;
+        OrderTrace trace;
+        for (std::uint64_t i = first; i < count; ++i) {
+            if (this->slots_[i % kCapacity].tryLoad(trace)) {
+                fn(trace);
+            }
+        }
+    }
+
+private:
+    std::array<SeqLock<OrderTrace>, kCapacity> slots_;
+    alignas(64) std::atomic<std::uint64_t> count_{0};
+};
@@ -1,5 +0,0 @@
-// --- START OF FILE Trade.cpp ---
-#include "Trade.h"
-
-// Set the starting value for our shared trade ID counter.
-int Trade::next_trade_id = 1;
\ No newline at end of file
@@ -7,9 +7,12 @@
 
 #pragma once
 
-#include <string>
+#include <cstdint>
+
 #include "Order.h" // We need access to the Side enum and to reference OrderIDs.
 
+using TradeId = std::uint64_t;
+
 /**
  * @struct Trade
  * @brief Represents a single, atomic trade execution.
@@ -21,40 +24,50 @@
 struct Trade {
     // --- Member Variables ---
 
-    int tradeID;        // A unique identifier for this specific trade execution.
-    int makerOrderID;   // The unique ID of the order that was resting on the book (the liquidity provider).
-    int takerOrderID;   // The unique ID of the incoming order that initiated the trade (the liquidity taker).
+    TradeId tradeID;      // A unique identifier for this specific trade execution.
+    OrderId makerOrderID; // The unique ID of the order that was resting on the book (the liquidity provider).
+    OrderId takerOrderID; // The unique ID of the incoming order that initiated the trade (the liquidity taker).
     
-    double price;       // The price at which the trade was executed (always the price of the maker order).
-    double quantity;    // The quantity of the asset that was exchanged in this trade.
+    Price price;        // The price (in ticks) at which the trade was executed (always the price of the maker order).
+    Quantity quantity;  // The quantity (in lots) of the asset that was exchanged in this trade.
 
     Side aggressorSide; // The side (Buy or Sell) of the taker order, indicating the direction of the aggression.
 
-    // The trading symbol for which this trade occurred (e.g., "BTC-USDT").
+    // The interned ID of the trading symbol for which this trade occurred (e.g., the ID of "BTC-USDT").
     // This is crucial for multi-symbol engines.
-    std::string symbol; 
-    
-    // A static member variable to ensure every trade across the entire engine
-    // gets a unique, incrementing ID. It is shared by all Trade objects.
-    static int next_trade_id;
+    SymbolId symbolId;
+
+    // --- Timestamps ---
+    // Tsc timestamps (see Metrics.h), converted to nanoseconds only when they are sent out.
+    // The order timestamps are carried over from the two Orders (see Order::setTimestamps), so
+    // the trade shows how long its taker took to get here and which maker had time priority.
+    std::uint64_t takerReceived; // When the gateway read the request that carried the taker order.
+    std::uint64_t takerAccepted; // When the taker's shard picked the order up.
+    std::uint64_t makerAccepted; // When the maker's shard picked the resting order up.
+    std::uint64_t matched;       // When the matching of the change that caused the trade ended; set by the shard.
 
     // --- Constructor ---
 
     /**
      * @brief Constructs a new Trade object.
-     * This is called by the OrderBook whenever a match occurs.
+     * This is called by the OrderBook whenever a match occurs. The trade ID is left at 0:
+     * it is a sequencing concern, assigned by the matching shard that executed the trade.
+     * So is the match time, which is left at 0 as well.
      */
-    Trade(int maker_id, int taker_id, double p, double q, Side aggressor, const std::string& sym) {
+    Trade(OrderId maker_id, OrderId taker_id, Price p, Quantity q, Side aggressor, SymbolId sym,
+          std::uint64_t taker_received = 0, std::uint64_t taker_accepted = 0, std::uint64_t maker_accepted = 0) {
         // Use `this->` to be explicit that we are assigning to member variables.
-        this->tradeID = next_trade_id++;
+        this->tradeID = 0;
         this->makerOrderID = maker_id;
         this->takerOrderID = taker_id;
         this->price = p;
         this->quantity = q;
         this->aggressorSide = aggressor;
-        this->symbol = sym;
+        this->symbolId = sym;
+        this->takerReceived = taker_received;
+        this->takerAccepted = taker_accepted;
+        this->makerAccepted = maker_accepted;
+        this->matched = 0;
     }
 };
 
-// NOTE: The definition for the static variable (e.g., `int Trade::next_trade_id = 1;`)
-// must be placed in a corresponding .cpp file (Trade.cpp) to avoid linker errors.
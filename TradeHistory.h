@@ -0,0 +1,451 @@
+/**
+ * @file TradeHistory.h
+ * @brief Defines the TradeHistory, which keeps every trade and OHLCV candles in memory-mapped columnar files.
+ *
+ * The feeds only reach the clients subscribed when a trade happens. To let clients that
+ * reconnect, or want a chart, query what they missed, the shard that executed a trade also
+ * appends it to its symbol's history: one file per symbol with a column per field (time, trade
+ * ID, price, quantity, maker and taker order IDs, aggressor side). Next to it, 1 second, 1 minute
+ * and 1 hour candles are kept up to date trade by trade, in the same kind of file.
+ *
+ * Each file has a single writer, the shard owning the symbol, which fills in a row and then
+ * publishes the new row count; readers load the count and scan the rows below it straight out of
+ * the mapping, with no lock, no copy into an intermediate structure and no work for the shard.
+ * The rows are in time order, so a time range is found by binary search. A candle is only
+ * published as a row once its interval is over; the candle still being built is published
+ * through a SeqLock instead, so queries include it.
+ *
+ * File layout: a 64-byte header (an 8-byte magic, the format version, the column count, the row
+ * capacity and the published row count), then each column as an array of `capacity` values.
+ * Times are nanoseconds since the Unix epoch, prices ticks and quantities lots.
+ */
+
+#pragma once
+
+#include <algorithm>  // For std::lower_bound, std::max, std::min
+#include <atomic>
+#include <cerrno>     // For errno
+#include <chrono>     // For the wall-clock time of the trades
+#include <cstddef>    // For std::size_t
+#include <cstdint>
+#include <cstring>    // For std::memcpy, std::memcmp
+#include <initializer_list>
+#include <memory>     // For std::unique_ptr
+#include <stdexcept>  // For std::runtime_error, std::invalid_argument
+#include <string>
+#include <vector>
+
+#if !defined(_WIN32)
+#include <fcntl.h>    // For open
+#include <sys/mman.h> // For mmap, munmap
+#include <sys/stat.h> // For fstat, mkdir
+#include <unistd.h>   // For ftruncate, close
+#endif
+
+#include "BookView.h"     // For SeqLock
+#include "LittleEndian.h"
+#include "Logger.h"
+#include "SymbolTable.h"
+#include "Trade.h"
+
+/**
+ * @class ColumnFile
+ * @brief A memory-mapped file of fixed-width columns with one writer and any number of readers.
+ */
+class ColumnFile {
+public:
+    /**
+     * @brief Opens a column file, creating it with room for `capacity` rows if it does not exist yet.
+     * @param magic What the file starts with; an existing file with another magic is refused.
+     * @param widths The width of each column's values in bytes.
+     * @param capacity The row capacity of a new file. The file is sparse, so unused rows cost no disk.
+     * @throws std::runtime_error if the file cannot be opened or has another layout.
+     */
+    ColumnFile(const std::string& path, const char (&magic)[8], std::initializer_list<std::size_t> widths,
+               std::uint64_t capacity) : widths_(widths) {
+#if defined(_WIN32)
+        (void)path;
+        (void)magic;
+        (void)capacity;
+        throw std::runtime_error("The trade history is only supported on POSIX systems.");
+#else
+        this->fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (this->fd_ < 0) {
+            throw std::runtime_error("Could not open the history file '" + path + "'.");
+        }
+        struct stat info {};
+        ::fstat(this->fd_, &info);
+        const bool fresh = info.st_size == 0;
+        std::uint64_t rows = capacity;
+        if (!fresh) {
+            unsigned char header[kHeaderSize] = {};
+            if (::pread(this->fd_, header, sizeof(header), 0) != static_cast<ssize_t>(sizeof(header)) ||
+                std::memcmp(header, magic, sizeof(magic)) != 0 || binary::readU32(header + 8) != kVersion ||
+                binary::readU32(header + 12) != this->widths_.size()) {
+                ::close(this->fd_);
+                throw std::runtime_error("'" + path + "' is not a history file of this engine version.");
+            }
+            rows = binary::readU64(header + 16);
+        }
+        this->capacity_ = rows;
+        std::uint64_t offset = kHeaderSize;
+        for (std::size_t width : this->widths_) {
+            this->offsets_.push_back(offset);
+            offset += (rows * width + 63) / 64 * 64; // Every column starts on a cache line.
+        }
+        this->size_ = offset;
+        if ((fresh && ::ftruncate(this->fd_, static_cast<off_t>(this->size_)) != 0) ||
+            (!fresh && static_cast<std::uint64_t>(info.st_size) < this->size_)) {
+            ::close(this->fd_);
+            throw std::runtime_error("Could not size the history file '" + path + "'.");
+        }
+        void* base = ::mmap(nullptr, this->size_, PROT_READ | PROT_WRITE, MAP_SHARED, this->fd_, 0);
+        if (base == MAP_FAILED) {
+            ::close(this->fd_);
+            throw std::runtime_error("Could not map the history file '" + path + "'.");
+        }
+        this->base_ = static_cast<unsigned char*>(base);
+        if (fresh) {
+            std::memcpy(this->base_, magic, sizeof(magic));
+            binary::writeU32(this->base_ + 8, kVersion);
+            binary::writeU32(this->base_ + 12, static_cast<std::uint32_t>(this->widths_.size()));
+            binary::writeU64(this->base_ + 16, rows);
+        }
+#endif
+    }
+
+    ColumnFile(const ColumnFile&) = delete;
+    ColumnFile& operator=(const ColumnFile&) = delete;
+
+    /** @brief Unmaps and closes the file. The kernel writes the pages back. */
+    ~ColumnFile() {
+#if !defined(_WIN32)
+        if (this->base_ != nullptr) {
+            ::munmap(this->base_, this->size_);
+        }
+        if (this->fd_ >= 0) {
+            ::close(this->fd_);
+        }
+#endif
+    }
+
+    /** @brief The number of published rows. Safe from any thread. */
+    std::uint64_t size() const { return count().load(std::memory_order_acquire); }
+
+    /** @brief The number of rows the file has room for. */
+    std::uint64_t capacity() const { return this->capacity_; }
+
+    /** @brief Makes the rows below `rows` visible to the readers. Writer only. */
+    void publish(std::uint64_t rows) { count().store(rows, std::memory_order_release); }
+
+    /** @brief The values of column `index`. Rows below size() are immutable and may be read from any thread. */
+    template <typename T>
+    T* column(std::size_t index) const {
+        return reinterpret_cast<T*>(this->base_ + this->offsets_[index]);
+    }
+
+private:
+    static constexpr std::size_t kHeaderSize = 64;
+    static constexpr std::uint32_t kVersion = 1;
+
+    std::vector<std::size_t> widths_;
+    std::vector<std::uint64_t> offsets_; // Where each column starts in the file.
+    int fd_ = -1;
+    unsigned char* base_ = nullptr;
+    std::uint64_t size_ = 0;     // The size of the mapping in bytes.
+    std::uint64_t capacity_ = 0; // The number of rows.
+
+    // The published row count lives in the header, so that it survives a restart with the rows.
+    std::atomic<std::uint64_t>& count() const {
+        static_assert(sizeof(std::atomic<std::uint64_t>) == 8, "The row count must be a plain word.");
+        return *reinterpret_cast<std::atomic<std::uint64_t>*>(this->base_ + 24);
+    }
+};
+
+/** @brief The current wall-clock time in nanoseconds since the Unix epoch, the time of the history's rows. */
+inline std::int64_t WallClockNanos() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch())
+        .count();
+}
+
+/** @brief The candle intervals the history maintains. */
+enum class CandleInterval : std::uint8_t { Second, Minute, Hour };
+
+constexpr std::size_t kCandleIntervals = 3;
+
+/** @brief The length of a candle interval in nanoseconds. */
+constexpr std::int64_t CandleIntervalNanos(CandleInterval interval) {
+    return interval == CandleInterval::Second ? 1'000'000'000LL
+         : interval == CandleInterval::Minute ? 60'000'000'000LL
+                                              : 3'600'000'000'000LL;
+}
+
+/**
+ * @brief Parses "1s", "1m" or "1h".
+ * @throws std::invalid_argument for anything else.
+ */
+inline CandleInterval StringToCandleInterval(const std::string& interval) {
+    if (interval == "1s") return CandleInterval::Second;
+    if (interval == "1m") return CandleInterval::Minute;
+    if (interval == "1h") return CandleInterval::Hour;
+    throw std::invalid_argument("Invalid candle interval '" + interval + "'; expected 1s, 1m or 1h.");
+}
+
+/**
+ * @struct Candle
+ * @brief The open, high, low and close price and the volume of the trades of one interval.
+ */
+struct Candle {
+    std::int64_t start = 0; // The start of the interval, in nanoseconds since the Unix epoch.
+    Price open = 0;
+    Price high = 0;
+    Price low = 0;
+    Price close = 0;
+    Quantity volume = 0;
+    std::uint64_t trades = 0; // 0 for an interval without trades, which is never stored.
+};
+
+/**
+ * @struct TradeRecord
+ * @brief One row of a symbol's trade history.
+ */
+struct TradeRecord {
+    std::int64_t time;  // When the trade was executed, in nanoseconds since the Unix epoch.
+    TradeId tradeId;
+    Price price;
+    Quantity quantity;
+    OrderId makerOrderId;
+    OrderId takerOrderId;
+    Side aggressorSide;
+};
+
+/**
+ * @class TradeHistory
+ * @brief The trade and candle history of every symbol. record() is called by the owning shards; the queries by anyone.
+ */
+class TradeHistory {
+public:
+    // The trades kept per symbol (16.7 million, about 800 MiB of sparse file). Once a symbol's file
+    // is full, its newer trades are not recorded.
+    static constexpr std::uint64_t kDefaultCapacity = std::uint64_t{1} << 24;
+
+    /**
+     * @brief Opens (or creates) the history files of every registered symbol in `directory`.
+     * Symbols registered afterwards get no history.
+     * @throws std::runtime_error if the directory or a file cannot be used.
+     */
+    TradeHistory(const std::string& directory, const SymbolTable& symbols, std::uint64_t capacity = kDefaultCapacity) {
+#if !defined(_WIN32)
+        if (::mkdir(directory.c_str(), 0755) != 0 && errno != EEXIST) {
+            throw std::runtime_error("Could not create the history directory '" + directory + "'.");
+        }
+#endif
+        for (SymbolId id = 0; id < symbols.size(); ++id) {
+            this->symbols_.push_back(std::make_unique<SymbolHistory>(directory + "/" + FileName(symbols.name(id)), capacity));
+        }
+    }
+
+    TradeHistory(const TradeHistory&) = delete;
+    TradeHistory& operator=(const TradeHistory&) = delete;
+
+    /**
+     * @brief Appends the trades of one change to a book (all of one symbol) and updates its candles.
+     * Must only be called by the shard that owns the symbol.
+     * @param time When the trades were executed, in nanoseconds since the Unix epoch.
+     * @param replayed Whether they come from replaying the journal. Replayed trades that are
+     *        already in the history (from before a restart) are not recorded again.
+     */
+    void record(const std::vector<Trade>& trades, std::int64_t time, bool replayed) {
+        const SymbolId symbol = trades.front().symbolId;
+        if (symbol >= this->symbols_.size()) {
+            return;
+        }
+        SymbolHistory& history = *this->symbols_[symbol];
+        for (const Trade& trade : trades) {
+            history.append(trade, time, replayed);
+        }
+    }
+
+    /** @brief Whether a symbol has a history (it was registered before the history was opened). */
+    bool has(SymbolId symbol) const { return symbol < this->symbols_.size(); }
+
+    /**
+     * @brief Calls fn(const TradeRecord&) for the latest `limit` trades executed in [from, to), oldest first.
+     * @return The number of trades visited.
+     */
+    template <typename Fn>
+    std::size_t forEachTrade(SymbolId symbol, std::int64_t from, std::int64_t to, std::size_t limit, Fn&& fn) const {
+        if (!has(symbol)) {
+            return 0;
+        }
+        const ColumnFile& file = this->symbols_[symbol]->trades;
+        const std::uint64_t rows = file.size();
+        const std::int64_t* times = file.column<std::int64_t>(kTime);
+        const std::uint64_t first = std::lower_bound(times, times + rows, from) - times;
+        const std::uint64_t end = std::lower_bound(times + first, times + rows, to) - times;
+        const std::uint64_t begin = std::max(first, end - std::min<std::uint64_t>(end, limit));
+        const TradeId* ids = file.column<TradeId>(kTradeId);
+        const Price* prices = file.column<Price>(kPrice);
+        const Quantity* quantities = file.column<Quantity>(kQuantity);
+        const OrderId* makers = file.column<OrderId>(kMaker);
+        const OrderId* takers = file.column<OrderId>(kTaker);
+        const std::uint8_t* sides = file.column<std::uint8_t>(kSide);
+        for (std::uint64_t i = begin; i < end; ++i) {
+            fn(TradeRecord{times[i], ids[i], prices[i], quantities[i], makers[i], takers[i], static_cast<Side>(sides[i])});
+        }
+        return static_cast<std::size_t>(end - begin);
+    }
+
+    /**
+     * @brief Calls fn(const Candle&) for the latest `limit` candles starting in [from, to), oldest first,
+     * including the one still being built.
+     * @return The number of candles visited.
+     */
+    template <typename Fn>
+    std::size_t forEachCandle(SymbolId symbol, CandleInterval interval, std::int64_t from, std::int64_t to,
+                              std::size_t limit, Fn&& fn) const {
+        if (!has(symbol) || limit == 0) {
+            return 0;
+        }
+        const SymbolHistory& history = *this->symbols_[symbol];
+        const std::size_t k = static_cast<std::size_t>(interval);
+        const ColumnFile& file = *history.candles[k];
+        // Read the current candle first: once it is complete it may also show up in the rows.
+        const Candle current = history.current[k].load();
+        const std::uint64_t rows = file.size();
+        const std::int64_t* starts = file.column<std::int64_t>(kStart);
+        const bool with_current = current.trades != 0 && current.start >= from && current.start < to &&
+                                  (rows == 0 || current.start > starts[rows - 1]);
+
+        const std::uint64_t first = std::lower_bound(starts, starts + rows, from) - starts;
+        const std::uint64_t end = std::lower_bound(starts + first, starts + rows, to) - starts;
+        const std::uint64_t wanted = limit - (with_current ? 1 : 0);
+        const std::uint64_t begin = std::max(first, end - std::min<std::uint64_t>(end, wanted));
+        for (std::uint64_t i = begin; i < end; ++i) {
+            fn(SymbolHistory::row(file, i));
+        }
+        if (with_current) {
+            fn(current);
+        }
+        return static_cast<std::size_t>(end - begin) + (with_current ? 1 : 0);
+    }
+
+private:
+    static constexpr char kTradesMagic[8] = {'C', 'R', 'Y', 'P', 'T', 'O', 'T', '1'};
+    static constexpr char kCandlesMagic[8] = {'C', 'R', 'Y', 'P', 'T', 'O', 'C', '1'};
+    static constexpr const char* kIntervalNames[kCandleIntervals] = {"1s", "1m", "1h"};
+
+    // The columns of a trade file.
+    enum TradeColumn : std::size_t { kTime, kTradeId, kPrice, kQuantity, kMaker, kTaker, kSide };
+    // The columns of a candle file.
+    enum CandleColumn : std::size_t { kStart, kOpen, kHigh, kLow, kClose, kVolume, kTrades };
+
+    /** @brief The history files of one symbol, and the state of its writer. */
+    struct SymbolHistory {
+        ColumnFile trades;
+        // Completed candles are rows; the one being built is also kept in the row after them, so
+        // that it survives a restart, and in `current` for the readers.
+        std::unique_ptr<ColumnFile> candles[kCandleIntervals];
+        SeqLock<Candle> current[kCandleIntervals];
+        Candle building[kCandleIntervals];
+        TradeId last_id = 0;        // The newest trade recorded.
+        std::int64_t last_time = 0; // Its time; later trades never get an earlier one.
+        bool full = false;
+
+        SymbolHistory(const std::string& prefix, std::uint64_t capacity)
+            : trades(prefix + ".trades", kTradesMagic, {8, 8, 8, 8, 8, 8, 1}, capacity) {
+            for (std::size_t k = 0; k < kCandleIntervals; ++k) {
+                // Every candle has at least one trade, so there are never more candles than trades.
+                candles[k] = std::make_unique<ColumnFile>(prefix + ".candles-" + kIntervalNames[k], kCandlesMagic,
+                                                          std::initializer_list<std::size_t>{8, 8, 8, 8, 8, 8, 8},
+                                                          capacity);
+                const std::uint64_t rows = candles[k]->size();
+                if (rows < candles[k]->capacity()) {
+                    building[k] = row(*candles[k], rows);
+                }
+                current[k].store(building[k]);
+            }
+            const std::uint64_t rows = trades.size();
+            if (rows > 0) {
+                last_id = trades.column<TradeId>(kTradeId)[rows - 1];
+                last_time = trades.column<std::int64_t>(kTime)[rows - 1];
+            }
+        }
+
+        void append(const Trade& trade, std::int64_t time, bool replayed) {
+            const std::uint64_t rows = trades.size();
+            if (replayed && rows > 0 && trade.tradeID <= last_id) {
+                return; // Recorded before the restart.
+            }
+            if (rows == trades.capacity()) {
+                if (!full) {
+                    LOG_WARN("The trade history of symbol {} is full; newer trades are not recorded.", trade.symbolId);
+                    full = true;
+                }
+                return;
+            }
+            time = std::max(time, last_time); // Keep the rows in time order, even if the clock steps back.
+            trades.column<std::int64_t>(kTime)[rows] = time;
+            trades.column<TradeId>(kTradeId)[rows] = trade.tradeID;
+            trades.column<Price>(kPrice)[rows] = trade.price;
+            trades.column<Quantity>(kQuantity)[rows] = trade.quantity;
+            trades.column<OrderId>(kMaker)[rows] = trade.makerOrderID;
+            trades.column<OrderId>(kTaker)[rows] = trade.takerOrderID;
+            trades.column<std::uint8_t>(kSide)[rows] = static_cast<std::uint8_t>(trade.aggressorSide);
+            trades.publish(rows + 1);
+            last_id = trade.tradeID;
+            last_time = time;
+
+            for (std::size_t k = 0; k < kCandleIntervals; ++k) {
+                const std::int64_t start = time - time % CandleIntervalNanos(static_cast<CandleInterval>(k));
+                ColumnFile& file = *candles[k];
+                Candle& candle = building[k];
+                std::uint64_t completed = file.size();
+                if (candle.trades != 0 && candle.start != start) {
+                    file.publish(++completed); // Its row is already written.
+                    candle = Candle{};
+                }
+                if (candle.trades == 0) {
+                    candle.start = start;
+                    candle.open = candle.high = candle.low = trade.price;
+                }
+                candle.high = std::max(candle.high, trade.price);
+                candle.low = std::min(candle.low, trade.price);
+                candle.close = trade.price;
+                candle.volume += trade.quantity;
+                ++candle.trades;
+                writeRow(file, completed, candle);
+                current[k].store(candle);
+            }
+        }
+
+        static Candle row(const ColumnFile& file, std::uint64_t i) {
+            return Candle{file.column<std::int64_t>(kStart)[i], file.column<Price>(kOpen)[i], file.column<Price>(kHigh)[i],
+                          file.column<Price>(kLow)[i], file.column<Price>(kClose)[i], file.column<Quantity>(kVolume)[i],
+                          file.column<std::uint64_t>(kTrades)[i]};
+        }
+
+        static void writeRow(ColumnFile& file, std::uint64_t i, const Candle& candle) {
+            file.column<std::int64_t>(kStart)[i] = candle.start;
+            file.column<Price>(kOpen)[i] = candle.open;
+            file.column<Price>(kHigh)[i] = candle.high;
+            file.column<Price>(kLow)[i] = candle.low;
+            file.column<Price>(kClose)[i] = candle.close;
+            file.column<Quantity>(kVolume)[i] = candle.volume;
+            file.column<std::uint64_t>(kTrades)[i] = candle.trades;
+        }
+    };
+
+    std::vector<std::unique_ptr<SymbolHistory>> symbols_;
+
+    /** @brief The file name prefix of a symbol: its name, with anything but letters, digits, '-', '_' and '.' replaced. */
+    static std::string FileName(const std::string& symbol) {
+        std::string name = symbol;
+        for (char& c : name) {
+            const bool safe = (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') || c == '-' ||
+                              c == '_' || c == '.';
+            c = safe ? c : '_';
+        }
+        return name;
+    }
+};
@@ -12,51 +12,450 @@
 #include <vector>             // For std::vector
 #include <stdexcept>          // For std::invalid_argument
 #include <chrono>             // For std::chrono::seconds
-#include <thread>             // For std::this_thread::sleep_for
+#include <memory>             // For std::shared_ptr
 #include <fstream>            // For reading the HTML file
 #include <streambuf>          // For reading the HTML file
+#include <sstream>            // For parsing the symbol file
+#include <optional>           // For the optional fields of a modify request
+#include <atomic>             // For counting the feed clients
+#include <limits>             // For the largest account ID
 
 #include "httplib.h"          // The single-header HTTP server library
 #include "json.hpp"           // The single-header JSON library for C++
 #include "MatchingEngine.h"   // Our main engine class that orchestrates everything
+#include "BinaryGateway.h"    // The binary TCP order-entry sessions
+#include "Logger.h"           // Asynchronous logging off the request threads
+#include "FeedServer.h"       // The event-driven feed port
+#include "HttpCommon.h"       // The order parsing and feed streaming shared with the routing gateway
 
 // Create a convenient alias for the nlohmann::json type.
 using json = nlohmann::json;
 
-// --- Helper Functions: Data Validation and Conversion ---
+// --- Command-Line Options ---
 
 /**
- * @brief Converts a string to a Side enum.
- * @param s The input string ("buy" or "sell").
- * @return The corresponding Side enum value.
- * @throws std::invalid_argument if the string is not a valid side.
+ * @struct ServerOptions
+ * @brief The configuration of the server, taken from the command line.
  */
-Side StringToSide(const std::string& s) {
-    if (s == "buy") return Side::Buy;
-    if (s == "sell") return Side::Sell;
-    throw std::invalid_argument("Invalid side specified: '" + s + "'. Must be 'buy' or 'sell'.");
+struct ServerOptions {
+    std::size_t shards = 1; // --shards N: the number of matching threads.
+    int first_core = -1;    // --pin-cores C: pin shard i to core C + i (Linux only).
+    std::size_t node_index = 0; // --node I/N: run as node I of the N engine nodes behind a routing gateway.
+    std::size_t node_count = 1;
+    int http_port = 8080;   // --http-port P: the port of the HTTP server.
+    int binary_port = 9000; // --binary-port P: the port of the binary order-entry gateway (0 disables it).
+    bool cancel_on_disconnect = false; // --cancel-on-disconnect on|off: cancel a binary session's orders when it drops.
+    std::string symbols;    // --symbols PATH: register the symbols listed in PATH instead of the built-in ones.
+    std::string risk;       // --risk PATH: check new orders against the risk limits listed in PATH.
+    std::string journal;    // --journal PATH: journal every accepted command to PATH and replay it on startup.
+    std::string snapshot;   // --snapshot PATH: periodically snapshot the books to PATH (needs --journal).
+    int snapshot_interval = 60; // --snapshot-interval S: seconds between snapshots.
+    std::string history;    // --history DIR: record every trade and 1s/1m/1h candles in DIR for GET /trades and GET /candles.
+    int replication_port = 0;   // --replication-port P: stream the journal to hot standbys on P (needs --journal; 0 disables it).
+    std::string primary_host;   // --standby HOST:PORT: run as the hot standby of the primary whose replication port this is.
+    std::uint16_t primary_port = 0;
+    int takeover_timeout_ms = 1000; // --takeover-timeout MS: how long the primary may be silent before the standby takes over.
+    LogLevel log_level = LogLevel::Info; // --log-level L: debug, info, warn, error or off.
+    std::uint32_t trace_sample = 0; // --trace-sample N: trace one in every N orders for GET /admin/traces (0 disables it).
+    int feed_port = 8081;   // --feed-port P: the port of the event-driven feed server (0 disables it).
+    std::size_t feed_threads = 2; // --feed-threads N: the feed server's event-loop threads.
+    MulticastConfig multicast;    // --multicast GROUP:PORT: also send the binary feed to this multicast group.
+                                  // --multicast-interface ADDR, --multicast-ttl N: how to send it.
+                                  // --retransmit-port P: the port of its retransmit/snapshot service (0 disables it).
+};
+
+/**
+ * @brief Parses the command-line arguments into ServerOptions.
+ * @throws std::invalid_argument on an unknown flag or a missing/invalid value.
+ */
+ServerOptions ParseOptions(int argc, char* argv[]) {
+    ServerOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string flag = argv[i];
+        if (i + 1 >= argc) {
+            throw std::invalid_argument("Missing value for option '" + flag + "'.");
+        }
+        std::string value = argv[++i];
+        if (flag == "--shards") {
+            options.shards = std::stoul(value);
+        } else if (flag == "--pin-cores") {
+            options.first_core = std::stoi(value);
+        } else if (flag == "--node") {
+            const std::size_t slash = value.find('/');
+            std::size_t index_end = 0, count_end = 0;
+            try {
+                options.node_index = std::stoul(value.substr(0, slash), &index_end);
+                options.node_count = std::stoul(value.substr(slash + 1), &count_end);
+            } catch (const std::exception&) {
+                options.node_count = 0;
+            }
+            if (slash == std::string::npos || index_end != slash || count_end != value.size() - slash - 1 ||
+                options.node_index >= options.node_count) {
+                throw std::invalid_argument("Invalid node '" + value + "'; expected INDEX/COUNT with INDEX below COUNT.");
+            }
+        } else if (flag == "--http-port") {
+            options.http_port = std::stoi(value);
+            if (options.http_port <= 0 || options.http_port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+        } else if (flag == "--symbols") {
+            options.symbols = value;
+        } else if (flag == "--risk") {
+            options.risk = value;
+        } else if (flag == "--journal") {
+            options.journal = value;
+        } else if (flag == "--snapshot") {
+            options.snapshot = value;
+        } else if (flag == "--snapshot-interval") {
+            options.snapshot_interval = std::stoi(value);
+            if (options.snapshot_interval <= 0) {
+                throw std::invalid_argument("Invalid snapshot interval '" + value + "'.");
+            }
+        } else if (flag == "--history") {
+            options.history = value;
+        } else if (flag == "--replication-port") {
+            options.replication_port = std::stoi(value);
+            if (options.replication_port < 0 || options.replication_port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+        } else if (flag == "--standby") {
+            const std::size_t colon = value.rfind(':');
+            const int port = (colon == std::string::npos) ? 0 : std::stoi(value.substr(colon + 1));
+            if (colon == 0 || port <= 0 || port > 65535) {
+                throw std::invalid_argument("Invalid primary '" + value + "'; expected HOST:PORT.");
+            }
+            options.primary_host = value.substr(0, colon);
+            options.primary_port = static_cast<std::uint16_t>(port);
+        } else if (flag == "--takeover-timeout") {
+            options.takeover_timeout_ms = std::stoi(value);
+            if (options.takeover_timeout_ms <= 0) {
+                throw std::invalid_argument("Invalid takeover timeout '" + value + "'.");
+            }
+        } else if (flag == "--log-level") {
+            options.log_level = ParseLogLevel(value);
+        } else if (flag == "--trace-sample") {
+            const long long every = std::stoll(value);
+            if (every < 0 || every > std::numeric_limits<std::uint32_t>::max()) {
+                throw std::invalid_argument("Invalid trace sampling '" + value + "'.");
+            }
+            options.trace_sample = static_cast<std::uint32_t>(every);
+        } else if (flag == "--binary-port") {
+            options.binary_port = std::stoi(value);
+            if (options.binary_port < 0 || options.binary_port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+        } else if (flag == "--cancel-on-disconnect") {
+            if (value != "on" && value != "off") {
+                throw std::invalid_argument("Invalid value '" + value + "' for --cancel-on-disconnect; expected on or off.");
+            }
+            options.cancel_on_disconnect = (value == "on");
+        } else if (flag == "--feed-port") {
+            options.feed_port = std::stoi(value);
+            if (options.feed_port < 0 || options.feed_port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+        } else if (flag == "--multicast") {
+            const std::size_t colon = value.rfind(':');
+            const int port = (colon == std::string::npos) ? 0 : std::stoi(value.substr(colon + 1));
+            if (colon == 0 || port <= 0 || port > 65535) {
+                throw std::invalid_argument("Invalid multicast group '" + value + "'; expected GROUP:PORT.");
+            }
+            options.multicast.group = value.substr(0, colon);
+            options.multicast.port = static_cast<std::uint16_t>(port);
+        } else if (flag == "--multicast-interface") {
+            options.multicast.interfaceAddress = value;
+        } else if (flag == "--multicast-ttl") {
+            options.multicast.ttl = std::stoi(value);
+            if (options.multicast.ttl < 0 || options.multicast.ttl > 255) {
+                throw std::invalid_argument("Invalid multicast TTL '" + value + "'.");
+            }
+        } else if (flag == "--retransmit-port") {
+            const int port = std::stoi(value);
+            if (port < 0 || port > 65535) {
+                throw std::invalid_argument("Invalid port '" + value + "'.");
+            }
+            options.multicast.retransmitPort = static_cast<std::uint16_t>(port);
+        } else if (flag == "--feed-threads") {
+            options.feed_threads = std::stoul(value);
+            if (options.feed_threads == 0) {
+                throw std::invalid_argument("Invalid number of feed threads '" + value + "'.");
+            }
+        } else {
+            throw std::invalid_argument("Unknown option '" + flag + "'.");
+        }
+    }
+    if (!options.snapshot.empty() && options.journal.empty()) {
+        throw std::invalid_argument("--snapshot needs --journal.");
+    }
+    if (options.replication_port != 0 && options.journal.empty()) {
+        throw std::invalid_argument("--replication-port needs --journal.");
+    }
+    return options;
 }
 
 /**
- * @brief Converts a string to an OrderType enum.
- * @param s The input string ("market", "limit", "ioc", "fok").
- * @return The corresponding OrderType enum value.
- * @throws std::invalid_argument if the string is not a valid order type.
+ * @brief Registers the symbols listed in a file with the engine, in file order.
+ *
+ * Each non-empty line that does not start with '#' holds a symbol, its tick size and its lot
+ * size, separated by whitespace, e.g. `BTC-USDT 0.01 0.000001`.
+ * @throws std::runtime_error if the file cannot be read, a line is malformed or a symbol is listed twice.
  */
-OrderType StringToOrderType(const std::string& s) {
-    if (s == "market") return OrderType::Market;
-    if (s == "limit") return OrderType::Limit;
-    if (s == "ioc") return OrderType::IOC;
-    if (s == "fok") return OrderType::FOK;
-    throw std::invalid_argument("Invalid order_type specified: '" + s + "'.");
+void LoadSymbols(const std::string& path, MatchingEngine& engine) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open the symbol file '" + path + "'.");
+    }
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        std::istringstream fields(line);
+        std::string symbol, extra;
+        double tick_size = 0, lot_size = 0;
+        if (!(fields >> symbol) || symbol[0] == '#') {
+            continue;
+        }
+        const std::string where = "'" + path + "' line " + std::to_string(line_number);
+        if (!(fields >> tick_size >> lot_size) || (fields >> extra)) {
+            throw std::runtime_error(where + ": expected 'SYMBOL TICK_SIZE LOT_SIZE'.");
+        }
+        const std::size_t registered = engine.symbolCount();
+        SymbolId id = 0;
+        try {
+            id = engine.configureSymbol(symbol, Instrument(tick_size, lot_size));
+        } catch (const std::exception& e) {
+            throw std::runtime_error(where + ": " + e.what());
+        }
+        if (id < registered) {
+            throw std::runtime_error(where + ": symbol '" + symbol + "' is listed twice.");
+        }
+    }
+    if (engine.symbolCount() == 0) {
+        throw std::runtime_error("The symbol file '" + path + "' lists no symbols.");
+    }
+}
+
+/**
+ * @brief Reads the pre-trade risk limits listed in a file.
+ *
+ * Each non-empty line that does not start with '#' holds an account ID, or '*' for the default
+ * limits of every account not listed, followed by `key=value` limits, e.g.
+ * `7 max_order_quantity=5 max_open_orders=100 max_notional=1000000 max_position=20 price_band=0.05`.
+ * Limits left out are unlimited. An account's line replaces the defaults for it entirely.
+ * @throws std::runtime_error if the file cannot be read or a line is malformed.
+ */
+RiskEngine LoadRiskLimits(const std::string& path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("Could not open the risk limit file '" + path + "'.");
+    }
+    RiskEngine risk;
+    std::string line;
+    std::size_t line_number = 0;
+    while (std::getline(file, line)) {
+        ++line_number;
+        std::istringstream fields(line);
+        std::string account;
+        if (!(fields >> account) || account[0] == '#') {
+            continue;
+        }
+        const std::string where = "'" + path + "' line " + std::to_string(line_number);
+        RiskLimits limits;
+        std::string limit;
+        while (fields >> limit) {
+            const std::size_t equals = limit.find('=');
+            const std::string key = limit.substr(0, equals);
+            double value = -1;
+            try {
+                value = (equals == std::string::npos) ? -1 : std::stod(limit.substr(equals + 1));
+            } catch (const std::exception&) {
+            }
+            if (!(value >= 0)) {
+                throw std::runtime_error(where + ": expected KEY=VALUE with a non-negative value, got '" + limit + "'.");
+            }
+            if (key == "max_order_quantity") {
+                limits.maxOrderQuantity = value;
+            } else if (key == "max_open_orders") {
+                limits.maxOpenOrders = static_cast<std::uint32_t>(value);
+            } else if (key == "max_notional") {
+                limits.maxNotional = value;
+            } else if (key == "max_position") {
+                limits.maxPosition = value;
+            } else if (key == "price_band") {
+                limits.priceBand = value;
+            } else {
+                throw std::runtime_error(where + ": unknown limit '" + key + "'.");
+            }
+        }
+        if (account == "*") {
+            risk.setDefaultLimits(limits);
+            continue;
+        }
+        unsigned long id = 0;
+        try {
+            std::size_t parsed = 0;
+            id = std::stoul(account, &parsed);
+            if (parsed != account.size()) {
+                id = 0;
+            }
+        } catch (const std::exception&) {
+        }
+        if (id == kNoAccount || id > std::numeric_limits<AccountId>::max()) {
+            throw std::runtime_error(where + ": expected an account ID or '*', got '" + account + "'.");
+        }
+        risk.setAccountLimits(static_cast<AccountId>(id), limits);
+    }
+    return risk;
 }
 
 // --- Main Server Application ---
 
-int main() {
+int main(int argc, char* argv[]) {
+    ServerOptions options;
+    try {
+        options = ParseOptions(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        std::cerr << "Usage: engine [--shards N] [--pin-cores FIRST_CORE] [--node INDEX/COUNT] [--http-port PORT]"
+                     " [--binary-port PORT] [--feed-port PORT]"
+                     " [--feed-threads N] [--symbols PATH] [--risk PATH] [--history DIR] [--journal PATH] [--snapshot PATH] [--snapshot-interval SECONDS]"
+                     " [--log-level LEVEL] [--multicast GROUP:PORT] [--multicast-interface ADDR] [--multicast-ttl N]"
+                     " [--retransmit-port PORT] [--cancel-on-disconnect on|off]"
+                     " [--replication-port PORT] [--standby HOST:PORT] [--takeover-timeout MS] [--trace-sample N]" << std::endl;
+        return 1;
+    }
+    Logger::instance().setLevel(options.log_level);
+
     // 1. Instantiate the Server and the Engine
     httplib::Server svr;
-    MatchingEngine engine;
+    MatchingEngine engine(options.shards, options.first_core, options.node_index, options.node_count);
+    std::cout << "Matching engine running with " << engine.shardCount() << " shard(s)." << std::endl;
+    if (options.node_count > 1) {
+        std::cout << "Running as node " << options.node_index << " of " << options.node_count << "." << std::endl;
+    }
+
+    // --- Register the symbols we list, with their tick and lot sizes. Orders for any other symbol are rejected. ---
+    if (!options.symbols.empty()) {
+        try {
+            LoadSymbols(options.symbols, engine);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    } else {
+        engine.configureSymbol("BTC-USDT", Instrument(0.01, 0.000001));
+        engine.configureSymbol("ETH-USDT", Instrument(0.01, 0.00001));
+    }
+    std::cout << "Trading " << engine.symbolCount() << " symbol(s)." << std::endl;
+
+    // --- Load the pre-trade risk limits new orders are checked against ---
+    if (!options.risk.empty()) {
+        try {
+            engine.setRiskLimits(LoadRiskLimits(options.risk));
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Checking new orders against the risk limits in '" << options.risk << "'." << std::endl;
+    }
+
+    // --- Trace one in every N orders ---
+    if (options.trace_sample != 0) {
+        engine.setTraceSampling(options.trace_sample);
+        std::cout << "Tracing one in every " << options.trace_sample << " order(s)." << std::endl;
+    }
+
+    // --- Open the trade history before the journal, so that it also gets the trades of replayed commands ---
+    if (!options.history.empty()) {
+        try {
+            engine.openHistory(options.history);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Recording the trade history in '" << options.history << "'." << std::endl;
+    }
+
+    // --- Recover the books from the snapshot and journal, if one is configured ---
+    const bool standby = !options.primary_host.empty();
+    if (standby) {
+        engine.standBy();
+    }
+    if (!options.journal.empty()) {
+        try {
+            engine.openJournal(options.journal, options.snapshot);
+            // A standby's journal is written by the primary's stream; it snapshots once it has taken over.
+            if (!options.snapshot.empty() && !standby) {
+                engine.startSnapshots(std::chrono::seconds(options.snapshot_interval));
+            }
+            if (options.replication_port != 0) {
+                engine.startReplication(static_cast<std::uint16_t>(options.replication_port));
+                std::cout << "Streaming the journal to standbys on port " << options.replication_port << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // The registry is complete; from here on symbols are only looked up.
+    engine.freezeSymbols();
+
+    // --- Follow the primary as its hot standby, taking over if it goes silent ---
+    if (standby) {
+        try {
+            engine.followPrimary(options.primary_host, options.primary_port,
+                                 std::chrono::milliseconds(options.takeover_timeout_ms), [&engine, &options] {
+                if (!options.snapshot.empty()) {
+                    engine.startSnapshots(std::chrono::seconds(options.snapshot_interval));
+                }
+            });
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        std::cout << "Standing by for the primary at " << options.primary_host << ":" << options.primary_port
+                  << "; order entry is rejected until it takes over." << std::endl;
+    }
+
+    // --- Start the multicast feed for the consumers on the local network ---
+    if (!options.multicast.group.empty()) {
+        try {
+            engine.startMulticast(options.multicast);
+            std::cout << "Multicasting the feed to " << options.multicast.group << ":" << options.multicast.port;
+            if (options.multicast.retransmitPort != 0) {
+                std::cout << ", retransmit service on port " << options.multicast.retransmitPort;
+            }
+            std::cout << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // --- Start the binary order-entry gateway for algorithmic clients ---
+    BinaryGateway gateway(engine, static_cast<std::uint16_t>(options.binary_port), options.cancel_on_disconnect);
+    if (options.binary_port != 0) {
+        try {
+            gateway.start();
+            std::cout << "Binary gateway listening on port " << options.binary_port << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+
+    // --- Start the feed server, which streams the feeds to any number of clients from a few threads ---
+    FeedServer feed_server(engine, static_cast<std::uint16_t>(options.feed_port), options.feed_threads);
+    if (options.feed_port != 0 && FeedServer::kSupported) {
+        try {
+            feed_server.start();
+            std::cout << "Feed server listening on port " << options.feed_port << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
 
     // --- Read the HTML file into a string for serving ---
     std::string html_content;
@@ -75,7 +474,7 @@ int main() {
     // This allows web pages from any origin (including your local file system) to make requests.
     svr.set_pre_routing_handler([](const httplib::Request&, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
-        res.set_header("Access-Control-Allow-Methods", "POST, GET, OPTIONS");
+        res.set_header("Access-Control-Allow-Methods", "POST, GET, PATCH, DELETE, OPTIONS");
         res.set_header("Access-Control-Allow-Headers", "Content-Type");
         return httplib::Server::HandlerResponse::Unhandled;
     });
@@ -97,22 +496,37 @@ int main() {
 
     // --- Handler for the REST API endpoint: /order ---
     auto order_handler = [&](const httplib::Request& req, httplib::Response& res) {
+        const std::uint64_t received = Tsc::now();
         try {
             auto j = json::parse(req.body);
-            std::cout << "Received order request: " << j.dump(2) << std::endl;
             std::string symbol = j.at("symbol");
-            OrderType type = StringToOrderType(j.at("order_type"));
-            Side side = StringToSide(j.at("side"));
-            double quantity = j.at("quantity");
-            double price = j.value("price", 0.0);
+            std::string type_name = j.at("order_type");
+            std::string side_name = j.at("side");
+            double decimal_quantity = j.at("quantity").get<double>();
+            double decimal_price = j.value("price", 0.0);
+            LOG_INFO("Received order request: symbol={} order_type={} side={} quantity={} price={}",
+                     symbol, type_name, side_name, decimal_quantity, decimal_price);
+            OrderType type = StringToOrderType(type_name);
+            Side side = StringToSide(side_name);
+            // Look the symbol up once; the engine only ever sees its ID. Unknown symbols stop here.
+            SymbolId symbol_id = engine.findSymbol(symbol);
+            // Convert the decimal values into the fixed-point ticks and lots used internally.
+            const Instrument& instrument = engine.getInstrument(symbol_id);
+            Quantity quantity = instrument.toLots(decimal_quantity);
+            Price price = instrument.toTicks(decimal_price);
+            OrderOptions options = ParseOrderOptions(j, type, instrument);
+            engine.metrics().sharedStage(Stage::Parse).record(Tsc::toNanos(Tsc::now() - received));
 
-            Order order(type, side, quantity, symbol, price);
-            int order_id = order.getOrderID();
-            engine.process(order); // The engine handles matching and broadcasting
+            // The engine handles matching and broadcasting on the symbol's shard thread.
+            std::vector<OrderId> self_trade_cancels;
+            OrderId order_id = engine.process(type, side, quantity, symbol_id, price, options, &self_trade_cancels, received);
 
             json response_json;
             response_json["status"] = "Order Received";
             response_json["order_id"] = order_id;
+            if (!self_trade_cancels.empty()) {
+                response_json["self_trade_cancelled"] = self_trade_cancels;
+            }
             res.set_content(response_json.dump(2), "application/json");
 
         } catch (const std::exception& e) {
@@ -121,48 +535,469 @@ int main() {
             error_response["status"] = "Error";
             error_response["message"] = e.what();
             res.set_content(error_response.dump(2), "application/json");
-            std::cerr << "Error processing request: " << e.what() << std::endl;
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
         }
     };
 
     svr.Post("/order", order_handler);
     svr.Post("/order/", order_handler);
 
-    // --- Handlers for the real-time data feeds using Server-Sent Events (SSE) ---
-    
-    // Trade Feed Endpoint
-    svr.Get("/ws/trades", [&](const httplib::Request&, httplib::Response& res) {
-        res.set_chunked_content_provider("text/event-stream", 
-            [&](size_t, httplib::DataSink& sink) {
-                std::cout << "New client connected to trade feed." << std::endl;
-                engine.add_trade_client(sink);
-                while (sink.is_writable()) {
-                    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // --- Handler for submitting many orders at once: POST /orders/batch ---
+    // The body is a JSON array of orders in the same format as POST /order. The orders of each
+    // symbol are matched back to back, and each symbol publishes its trades and market data
+    // once for the whole batch. If any order is invalid, none of them is submitted.
+    svr.Post("/orders/batch", [&](const httplib::Request& req, httplib::Response& res) {
+        const std::uint64_t received = Tsc::now();
+        try {
+            auto j = json::parse(req.body);
+            if (!j.is_array()) {
+                throw std::invalid_argument("The body must be a JSON array of orders.");
+            }
+            LOG_INFO("Received batch of {} order(s).", j.size());
+
+            std::vector<BatchOrder> orders(j.size());
+            for (std::size_t i = 0; i < j.size(); ++i) {
+                try {
+                    const json& order_json = j[i];
+                    orders[i].symbol = engine.findSymbol(order_json.at("symbol"));
+                    const Instrument& instrument = engine.getInstrument(orders[i].symbol);
+                    orders[i].type = StringToOrderType(order_json.at("order_type"));
+                    orders[i].side = StringToSide(order_json.at("side"));
+                    orders[i].quantity = instrument.toLots(order_json.at("quantity").get<double>());
+                    orders[i].price = instrument.toTicks(order_json.value("price", 0.0));
+                    orders[i].options = ParseOrderOptions(order_json, orders[i].type, instrument);
+                } catch (const std::exception& e) {
+                    throw std::invalid_argument("Order " + std::to_string(i) + ": " + e.what());
                 }
-                std::cout << "Trade feed client disconnected." << std::endl;
-                return true;
             }
-        );
+
+            engine.metrics().sharedStage(Stage::Parse).record(Tsc::toNanos(Tsc::now() - received));
+            std::vector<OrderId> self_trade_cancels;
+            engine.processBatch(orders, &self_trade_cancels, received);
+
+            json response_json;
+            response_json["status"] = "Batch Received";
+            response_json["order_ids"] = json::array();
+            for (const BatchOrder& order : orders) {
+                response_json["order_ids"].push_back(order.orderId);
+            }
+            if (!self_trade_cancels.empty()) {
+                response_json["self_trade_cancelled"] = self_trade_cancels;
+            }
+            res.set_content(response_json.dump(2), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing batch: {}", e.what());
+        }
     });
 
-    // Market Data Feed Endpoint
-    svr.Get("/ws/marketdata", [&](const httplib::Request&, httplib::Response& res) {
-        res.set_chunked_content_provider("text/event-stream", 
-            [&](size_t, httplib::DataSink& sink) {
-                std::cout << "New client connected to market data feed." << std::endl;
-                engine.add_market_data_client(sink);
-                while (sink.is_writable()) {
-                    std::this_thread::sleep_for(std::chrono::seconds(1));
+    // --- Handler for monitoring: GET /metrics ---
+    // Stage latency histograms and per-symbol counters in the Prometheus text format.
+    svr.Get("/metrics", [&](const httplib::Request&, httplib::Response& res) {
+        res.set_content(engine.renderMetrics(), "text/plain; version=0.0.4");
+    });
+
+    // --- Handler listing the symbols: GET /symbols ---
+    // Binary gateway clients use this to learn the IDs, tick sizes and lot sizes of the symbols.
+    svr.Get("/symbols", [&](const httplib::Request&, httplib::Response& res) {
+        json symbols_json = json::array();
+        for (std::size_t id = 0; id < engine.symbolCount(); ++id) {
+            const Instrument& instrument = engine.getInstrument(static_cast<SymbolId>(id));
+            symbols_json.push_back({{"symbol", engine.symbolName(static_cast<SymbolId>(id))},
+                                    {"symbol_id", id},
+                                    {"tick_size", instrument.getTickSize()},
+                                    {"lot_size", instrument.getLotSize()}});
+        }
+        res.set_content(symbols_json.dump(2), "application/json");
+    });
+
+    // --- Handler describing this engine's place behind a routing gateway: GET /node ---
+    // The gateway checks that its list of nodes matches what each node was started with.
+    svr.Get("/node", [&](const httplib::Request&, httplib::Response& res) {
+        json node_json;
+        node_json["node"] = engine.nodeIndex();
+        node_json["nodes"] = engine.nodeCount();
+        node_json["standby"] = engine.isStandby();
+        res.set_content(node_json.dump(2), "application/json");
+    });
+
+    // --- Handler for the sampled order traces: GET /admin/traces?limit=N ---
+    // The complete timeline of the most recent traced orders (see --trace-sample), oldest first.
+    // The timestamps are monotonic nanoseconds, comparable with the ones in the trade feed.
+    svr.Get("/admin/traces", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            const std::size_t kMaxTraces = TraceRing::kCapacity * engine.shardCount();
+            std::size_t limit = 100;
+            if (req.has_param("limit")) {
+                const long long value = std::stoll(req.get_param_value("limit"));
+                if (value < 1 || value > static_cast<long long>(kMaxTraces)) {
+                    throw std::invalid_argument("limit must be between 1 and " + std::to_string(kMaxTraces) + ".");
                 }
-                std::cout << "Market data client disconnected." << std::endl;
-                return true;
+                limit = static_cast<std::size_t>(value);
             }
-        );
+            json traces_json = json::array();
+            for (const OrderTrace& trace : engine.recentTraces(limit)) {
+                traces_json.push_back({{"order_id", trace.orderId},
+                                       {"symbol", engine.symbolName(trace.symbol)},
+                                       {"trades", trace.trades},
+                                       {"received_ns", Tsc::toNanos(trace.received)},
+                                       {"queued_ns", Tsc::toNanos(trace.queued)},
+                                       {"accepted_ns", Tsc::toNanos(trace.accepted)},
+                                       {"matched_ns", Tsc::toNanos(trace.matched)},
+                                       {"published_ns", Tsc::toNanos(trace.published)}});
+            }
+            json response_json;
+            response_json["sample_every"] = engine.traceSampling();
+            response_json["traces"] = std::move(traces_json);
+            res.set_content(response_json.dump(), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+        }
+    });
+
+    // --- Handlers for reading a book: GET /book/{symbol}?depth=N and GET /bbo/{symbol} ---
+    // Both read the copy of the top of the book that its shard refreshes after every visible
+    // change, so they never wait for (or delay) the matching thread. The fields match the
+    // "l2update" and "bbo" feed messages, including the market data sequence number.
+    svr.Get(R"(/book/([^/]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            SymbolId symbol_id = engine.findSymbol(req.matches[1].str());
+            int depth = BookView::kDepth;
+            if (req.has_param("depth")) {
+                depth = std::stoi(req.get_param_value("depth"));
+                if (depth < 1 || depth > BookView::kDepth) {
+                    throw std::invalid_argument("depth must be between 1 and " + std::to_string(BookView::kDepth) + ".");
+                }
+            }
+            const BookView view = engine.getBookView(symbol_id);
+            const Instrument& instrument = engine.getInstrument(symbol_id);
+            auto levels_json = [&](const LevelQuote* levels, std::uint32_t count) {
+                json levels_array = json::array();
+                for (std::uint32_t i = 0; i < count && i < static_cast<std::uint32_t>(depth); ++i) {
+                    levels_array.push_back(json::array({std::to_string(instrument.fromTicks(levels[i].price)),
+                                                        std::to_string(instrument.fromLots(levels[i].quantity))}));
+                }
+                return levels_array;
+            };
+
+            json response_json;
+            response_json["symbol"] = req.matches[1].str();
+            response_json["seq"] = view.seq;
+            response_json["bids"] = levels_json(view.bids, view.bidCount);
+            response_json["asks"] = levels_json(view.asks, view.askCount);
+            if (view.bidCount > 0 && view.askCount > 0) {
+                response_json["best_bid"] = instrument.fromTicks(view.bids[0].price);
+                response_json["best_ask"] = instrument.fromTicks(view.asks[0].price);
+            } else {
+                response_json["best_bid"] = nullptr;
+                response_json["best_ask"] = nullptr;
+            }
+            res.set_content(response_json.dump(), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+        }
+    });
+
+    svr.Get(R"(/bbo/([^/]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            SymbolId symbol_id = engine.findSymbol(req.matches[1].str());
+            const BookView view = engine.getBookView(symbol_id);
+            const Instrument& instrument = engine.getInstrument(symbol_id);
+
+            json response_json;
+            response_json["symbol"] = req.matches[1].str();
+            response_json["seq"] = view.seq;
+            response_json["best_bid"] = nullptr;
+            response_json["bid_quantity"] = nullptr;
+            response_json["best_ask"] = nullptr;
+            response_json["ask_quantity"] = nullptr;
+            if (view.bidCount > 0) {
+                response_json["best_bid"] = instrument.fromTicks(view.bids[0].price);
+                response_json["bid_quantity"] = instrument.fromLots(view.bids[0].quantity);
+            }
+            if (view.askCount > 0) {
+                response_json["best_ask"] = instrument.fromTicks(view.asks[0].price);
+                response_json["ask_quantity"] = instrument.fromLots(view.asks[0].quantity);
+            }
+            res.set_content(response_json.dump(), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+        }
+    });
+
+    // --- Handlers for the history: GET /trades/{symbol} and GET /candles/{symbol}?interval=1s|1m|1h ---
+    // Both take `from` and `to` (nanoseconds since the Unix epoch, `to` exclusive) and `limit`,
+    // and return the latest `limit` rows of the range, oldest first. The rows are read straight
+    // out of the history's mapped files, so a query never involves the matching threads.
+    const std::size_t kDefaultHistoryLimit = 100;
+    const std::size_t kMaxHistoryLimit = 10000;
+    auto history_query = [&](const httplib::Request& req, SymbolId& symbol_id, std::int64_t& from, std::int64_t& to,
+                             std::size_t& limit) {
+        symbol_id = engine.findSymbol(req.matches[1].str());
+        if (engine.history() == nullptr || !engine.history()->has(symbol_id)) {
+            return false;
+        }
+        from = req.has_param("from") ? std::stoll(req.get_param_value("from")) : 0;
+        to = req.has_param("to") ? std::stoll(req.get_param_value("to")) : std::numeric_limits<std::int64_t>::max();
+        limit = kDefaultHistoryLimit;
+        if (req.has_param("limit")) {
+            const long long value = std::stoll(req.get_param_value("limit"));
+            if (value < 1 || value > static_cast<long long>(kMaxHistoryLimit)) {
+                throw std::invalid_argument("limit must be between 1 and " + std::to_string(kMaxHistoryLimit) + ".");
+            }
+            limit = static_cast<std::size_t>(value);
+        }
+        return true;
+    };
+    auto no_history = [](httplib::Response& res) {
+        res.status = 404; // Not Found
+        json error_response;
+        error_response["status"] = "Error";
+        error_response["message"] = "There is no trade history for this symbol; start the engine with --history DIR.";
+        res.set_content(error_response.dump(2), "application/json");
+    };
+
+    svr.Get(R"(/trades/([^/]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            SymbolId symbol_id = 0;
+            std::int64_t from = 0, to = 0;
+            std::size_t limit = 0;
+            if (!history_query(req, symbol_id, from, to, limit)) {
+                no_history(res);
+                return;
+            }
+            const Instrument& instrument = engine.getInstrument(symbol_id);
+            json trades_json = json::array();
+            engine.history()->forEachTrade(symbol_id, from, to, limit, [&](const TradeRecord& trade) {
+                trades_json.push_back({{"trade_id", trade.tradeId},
+                                       {"timestamp", trade.time},
+                                       {"price", instrument.fromTicks(trade.price)},
+                                       {"quantity", instrument.fromLots(trade.quantity)},
+                                       {"aggressor_side", trade.aggressorSide == Side::Buy ? "buy" : "sell"},
+                                       {"maker_order_id", trade.makerOrderId},
+                                       {"taker_order_id", trade.takerOrderId}});
+            });
+            json response_json;
+            response_json["symbol"] = req.matches[1].str();
+            response_json["trades"] = std::move(trades_json);
+            res.set_content(response_json.dump(), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+        }
+    });
+
+    svr.Get(R"(/candles/([^/]+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            SymbolId symbol_id = 0;
+            std::int64_t from = 0, to = 0;
+            std::size_t limit = 0;
+            const std::string interval_name = req.has_param("interval") ? req.get_param_value("interval") : "1m";
+            const CandleInterval interval = StringToCandleInterval(interval_name);
+            if (!history_query(req, symbol_id, from, to, limit)) {
+                no_history(res);
+                return;
+            }
+            const Instrument& instrument = engine.getInstrument(symbol_id);
+            json candles_json = json::array();
+            engine.history()->forEachCandle(symbol_id, interval, from, to, limit, [&](const Candle& candle) {
+                candles_json.push_back({{"start", candle.start},
+                                        {"open", instrument.fromTicks(candle.open)},
+                                        {"high", instrument.fromTicks(candle.high)},
+                                        {"low", instrument.fromTicks(candle.low)},
+                                        {"close", instrument.fromTicks(candle.close)},
+                                        {"volume", instrument.fromLots(candle.volume)},
+                                        {"trades", candle.trades}});
+            });
+            json response_json;
+            response_json["symbol"] = req.matches[1].str();
+            response_json["interval"] = interval_name;
+            response_json["candles"] = std::move(candles_json);
+            res.set_content(response_json.dump(), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+        }
+    });
+
+    // --- Handler for cancelling a resting order: DELETE /order/{id} ---
+    svr.Delete(R"(/order/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            OrderId order_id = std::stoull(req.matches[1].str());
+            json response_json;
+            if (engine.cancel(order_id)) {
+                response_json["status"] = "Order Cancelled";
+                response_json["order_id"] = order_id;
+            } else {
+                res.status = 404; // Not Found
+                response_json["status"] = "Error";
+                response_json["message"] = "Order " + std::to_string(order_id) + " is not resting on any book.";
+            }
+            res.set_content(response_json.dump(2), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
+        }
+    });
+
+    // --- Handler for cancelling every order of an account: DELETE /orders?account=N[&symbol=S] ---
+    svr.Delete("/orders", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            if (!req.has_param("account")) {
+                throw std::invalid_argument("A mass cancel needs an 'account'.");
+            }
+            const unsigned long account = std::stoul(req.get_param_value("account"));
+            if (account == kNoAccount || account > std::numeric_limits<AccountId>::max()) {
+                throw std::invalid_argument("'account' must be between 1 and 4294967295.");
+            }
+            std::optional<SymbolId> symbol;
+            if (req.has_param("symbol")) {
+                symbol = engine.findSymbol(req.get_param_value("symbol"));
+            }
+            json response_json;
+            response_json["status"] = "Orders Cancelled";
+            response_json["cancelled"] = engine.massCancel(static_cast<AccountId>(account), symbol);
+            res.set_content(response_json.dump(2), "application/json");
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
+        }
+    });
+
+    // --- Handler for modifying a resting order: PATCH /order/{id} ---
+    // The body may contain a new "price" and/or a new remaining "quantity". Reducing the
+    // quantity keeps the order's time priority; changing the price (or adding quantity) loses it.
+    svr.Patch(R"(/order/(\d+))", [&](const httplib::Request& req, httplib::Response& res) {
+        try {
+            OrderId order_id = std::stoull(req.matches[1].str());
+            auto j = json::parse(req.body);
+            std::optional<double> price;
+            std::optional<double> quantity;
+            if (j.contains("price")) price = j.at("price").get<double>();
+            if (j.contains("quantity")) quantity = j.at("quantity").get<double>();
+
+            json response_json;
+            switch (engine.modify(order_id, price, quantity)) {
+                case ModifyResult::NotFound:
+                    res.status = 404; // Not Found
+                    response_json["status"] = "Error";
+                    response_json["message"] = "Order " + std::to_string(order_id) + " is not resting on any book.";
+                    break;
+                case ModifyResult::Amended:
+                    response_json["status"] = "Order Modified";
+                    response_json["order_id"] = order_id;
+                    response_json["priority"] = "kept";
+                    break;
+                case ModifyResult::Replaced:
+                    response_json["status"] = "Order Modified";
+                    response_json["order_id"] = order_id;
+                    response_json["priority"] = "lost";
+                    break;
+            }
+            res.set_content(response_json.dump(2), "application/json");
+
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+            LOG_RATE_LIMITED(LogLevel::Warn, 10, "Error processing request: {}", e.what());
+        }
     });
 
+    // --- Handlers for the real-time data feeds using Server-Sent Events (SSE) ---
+    
+    // Each of these clients holds one of the HTTP server's threads for as long as it stays connected,
+    // so at most half of the threads are given to them and the rest are kept for order entry; the
+    // feed server (--feed-port) serves the same feeds to any number of clients.
+    // Every feed accepts `?coalesce_ms=N` to have the messages of up to N milliseconds written together,
+    // and `?symbols=A,B` to only receive the messages about those symbols.
+    // /ws/trades: `?format=batch` sends one "trade_batch" per taker order instead of one "trade" per fill.
+    // /ws/marketdata: `?channel=l2delta` subscribes to incremental updates instead of full snapshots,
+    // `?channel=bbo` to the best bid and offer only, `?channel=l3` to every change of every resting order.
+    // `?depth=N` limits l2update snapshots to the top N levels.
+    const int kMaxHttpFeedClients = static_cast<int>(CPPHTTPLIB_THREAD_POOL_COUNT / 2);
+    auto http_feed_clients = std::make_shared<std::atomic<int>>(0);
+    auto feed_handler = [&engine, &options, kMaxHttpFeedClients, http_feed_clients](const httplib::Request& req, httplib::Response& res) {
+        FeedRequest feed;
+        try {
+            feed = ParseFeedRequest(req.path, req.params, engine);
+        } catch (const std::exception& e) {
+            res.status = 400; // Bad Request
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = e.what();
+            res.set_content(error_response.dump(2), "application/json");
+            return;
+        }
+        if (http_feed_clients->fetch_add(1) >= kMaxHttpFeedClients) {
+            http_feed_clients->fetch_sub(1);
+            res.status = 503; // Service Unavailable
+            json error_response;
+            error_response["status"] = "Error";
+            error_response["message"] = options.feed_port != 0
+                ? "Too many feed clients; connect to port " + std::to_string(options.feed_port) + " instead."
+                : std::string("Too many feed clients.");
+            res.set_content(error_response.dump(2), "application/json");
+            return;
+        }
+        const std::string path = req.path;
+        res.set_chunked_content_provider("text/event-stream", 
+            [&engine, feed, path](size_t, httplib::DataSink& sink) {
+                LOG_INFO("New client connected to {}.", path);
+                std::shared_ptr<Subscriber> subscriber = engine.subscribe(feed.channel, feed.filter);
+                StreamFeed(*subscriber, sink, &engine.metrics().sharedStage(Stage::Write), feed.coalesce);
+                engine.unsubscribe(subscriber);
+                LOG_INFO("Feed client of {} disconnected.", path);
+                return true;
+            },
+            [http_feed_clients](bool) { http_feed_clients->fetch_sub(1); }
+        );
+    };
+    svr.Get("/ws/trades", feed_handler);
+    svr.Get("/ws/marketdata", feed_handler);
+
     // --- Start the Server ---
-    std::cout << "Server listening on http://localhost:8080" << std::endl;
-    svr.listen("0.0.0.0", 8080);
+    std::cout << "Server listening on http://localhost:" << options.http_port << std::endl;
+    svr.listen("0.0.0.0", options.http_port);
 
     return 0;
 }